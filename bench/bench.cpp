@@ -0,0 +1,239 @@
+#include "dataset.h"
+
+#include "simfil/simfil.h"
+#include "simfil/model/model.h"
+#include "simfil/model/json.h"
+#include "simfil/model/string-pool.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simfil;
+using namespace simfil::bench;
+
+namespace
+{
+
+auto config() -> const Config&
+{
+    static const auto config = Config::fromEnv();
+    return config;
+}
+
+auto threads() -> size_t
+{
+    if (config().threads > 0)
+        return config().threads;
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+auto features() -> const std::string&
+{
+    static const auto text = generateFeatures(config());
+    return text;
+}
+
+auto parse(const std::string& text) -> ModelPoolPtr
+{
+    auto model = std::make_shared<ModelPool>();
+    std::istringstream input(text);
+    json::parseRoots(input, model, json::RootLayout::Lines);
+    return model;
+}
+
+/* Dataset parsed once, shared by the query benchmarks. */
+auto model() -> const ModelPoolPtr&
+{
+    static const auto model = parse(features());
+    return model;
+}
+
+auto serialized() -> const std::string&
+{
+    static const auto bytes = [] {
+        std::ostringstream output;
+        model()->write(output);
+        return output.str();
+    }();
+    return bytes;
+}
+
+/* Evaluate `query` on all roots and return the number of results. */
+auto run(Environment& env, const Expr& expr, size_t threadCount) -> size_t
+{
+    size_t n = 0;
+    for (const auto& rootResult : eval(env, expr, *model(), threadCount))
+        n += rootResult.size();
+    return n;
+}
+
+void queryBenchmarks(std::string_view family, const std::vector<std::string_view>& queries)
+{
+    Environment env(model()->strings());
+    for (auto query : queries) {
+        auto expr = compile(env, query, false);
+        const auto name = std::string(family) + ": " + std::string(query);
+
+        BENCHMARK(name + " [1 thread]") {
+            return run(env, *expr, 1);
+        };
+        BENCHMARK(name + " [" + std::to_string(threads()) + " threads]") {
+            return run(env, *expr, threads());
+        };
+    }
+}
+
+}
+
+TEST_CASE("JSON", "[bench.json]")
+{
+    INFO("features: " << config().features);
+
+    BENCHMARK("json::parse") {
+        auto model = std::make_shared<ModelPool>();
+        std::istringstream input(features());
+        for (std::string line; std::getline(input, line);)
+            json::parse(line, model);
+        return model->numRoots();
+    };
+
+    BENCHMARK("json::parseRoots [" + std::to_string(threads()) + " threads]") {
+        auto model = std::make_shared<ModelPool>();
+        std::istringstream input(features());
+        return json::parseRoots(input, model, json::RootLayout::Lines, threads());
+    };
+}
+
+TEST_CASE("Serialization", "[bench.serialization]")
+{
+    REQUIRE(model()->numRoots() == config().features);
+
+    BENCHMARK("ModelPool::write") {
+        std::ostringstream output;
+        model()->write(output);
+        return output.tellp();
+    };
+
+    BENCHMARK_ADVANCED("ModelPool::read")(Catch::Benchmark::Chronometer meter) {
+        std::vector<ModelPoolPtr> pools;
+        for (auto i = 0; i < meter.runs(); ++i)
+            pools.push_back(std::make_shared<ModelPool>());
+        meter.measure([&](int i) {
+            std::istringstream input(serialized());
+            pools[i]->read(input);
+            return pools[i]->numRoots();
+        });
+    };
+}
+
+TEST_CASE("String Pool", "[bench.string-pool]")
+{
+    const auto words = vocabulary(4096, config().seed);
+
+    /* Every thread inserts the same words: after the first pass, mostly hits. */
+    auto contended = [&](size_t threadCount, auto&& op) {
+        auto pool = std::make_shared<StringPool>();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&, t]() {
+                for (auto i = 0u; i < words.size(); ++i)
+                    op(*pool, words[(i + t * 97) % words.size()]);
+            });
+        }
+        for (auto& worker : workers)
+            worker.join();
+        return pool->size();
+    };
+
+    for (auto threadCount : {size_t(1), threads()}) {
+        const auto suffix = " [" + std::to_string(threadCount) + " threads]";
+
+        BENCHMARK("StringPool::emplace" + suffix) {
+            return contended(threadCount, [](StringPool& pool, const std::string& word) {
+                pool.emplace(word);
+            });
+        };
+
+        BENCHMARK("StringPool::emplace+get" + suffix) {
+            return contended(threadCount, [](StringPool& pool, const std::string& word) {
+                pool.emplace(word);
+                for (auto i = 0; i < 4; ++i)
+                    pool.get(word);
+            });
+        };
+    }
+}
+
+TEST_CASE("Compile", "[bench.compile]")
+{
+    /* A small rule pack */
+    static const std::vector<std::string_view> rules = {
+        "typeId == 'Road' and properties.speedLimit > 100",
+        "typeId == 'Lane' and properties.lanes > 3",
+        "count(geometry.*) < 2",
+        "properties.name == re'.*(Haupt|Main).*'",
+        "any(relations.*.type == 'crosses' and relations.*.weight > 8)",
+        "properties.attributes.attr_017 + properties.attributes.attr_018 > 150",
+        "**.attr_200 == 42",
+        "sum(relations.*.weight) > 20",
+        "typeId == 'Sign' and not properties.oneway",
+        "count(properties.attributes.*) > 80",
+    };
+
+    BENCHMARK("compile [" + std::to_string(rules.size()) + " rules]") {
+        Environment env(Environment::WithNewStringCache);
+        size_t n = 0;
+        for (auto rule : rules)
+            n += compile(env, rule, false) != nullptr;
+        return n;
+    };
+
+    BENCHMARK("compile bytecode [" + std::to_string(rules.size()) + " rules]") {
+        Environment env(Environment::WithNewStringCache);
+        size_t n = 0;
+        for (auto rule : rules)
+            n += compile(env, rule, false, Backend::Bytecode) != nullptr;
+        return n;
+    };
+}
+
+TEST_CASE("Wildcard Queries", "[bench.query.wildcard]")
+{
+    queryBenchmarks("wildcard", {
+        "count(** == 42)",
+        "**.speedLimit > 100",
+        "count(**.weight)",
+    });
+}
+
+TEST_CASE("Wide Object Queries", "[bench.query.wide]")
+{
+    queryBenchmarks("wide", {
+        "properties.attributes.attr_000",
+        "properties.attributes.attr_255 > 50",
+        "properties.attributes.*.{_ == 100}",
+    });
+}
+
+TEST_CASE("Regex Queries", "[bench.query.regex]")
+{
+    queryBenchmarks("regex", {
+        "properties.name == re'.*(Haupt|Main).*'",
+        "typeId == re'^(Road|Lane)$' and properties.name == re'.*strasse'",
+    });
+}
+
+TEST_CASE("Aggregation Queries", "[bench.query.aggregate]")
+{
+    queryBenchmarks("aggregate", {
+        "sum(relations.*.weight)",
+        "count(geometry.*.*)",
+        "sum(properties.attributes.*, $sum + $val * 2, 0)",
+    });
+}
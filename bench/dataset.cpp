@@ -0,0 +1,160 @@
+#include "dataset.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+
+namespace simfil::bench
+{
+
+namespace
+{
+
+auto envNumber(const char* name, size_t fallback) -> size_t
+{
+    if (auto value = std::getenv(name); value && *value)
+        return static_cast<size_t>(std::strtoull(value, nullptr, 10));
+    return fallback;
+}
+
+constexpr std::array<std::string_view, 4> Types = {"Road", "Lane", "Sign", "POI"};
+constexpr std::array<std::string_view, 12> Names = {
+    "Hauptstrasse", "Main Street", "Bahnhofstrasse", "High Street",
+    "Kirchweg", "Park Avenue", "Schulstrasse", "Station Road",
+    "Gartenweg", "Mill Lane", "Dorfstrasse", "Church Road"};
+constexpr std::array<std::string_view, 3> Relations = {"connects", "crosses", "overlaps"};
+
+struct Writer
+{
+    std::string& out;
+
+    void raw(std::string_view s) { out += s; }
+
+    void key(std::string_view k)
+    {
+        out.push_back('"');
+        out += k;
+        out += "\":";
+    }
+
+    void string(std::string_view s)
+    {
+        out.push_back('"');
+        out += s;
+        out.push_back('"');
+    }
+
+    void number(int64_t v) { out += std::to_string(v); }
+
+    void number(double v)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6f", v);
+        out += buf;
+    }
+};
+
+}
+
+auto Config::fromEnv() -> Config
+{
+    Config config;
+    config.features = envNumber("SIMFIL_BENCH_FEATURES", config.features);
+    config.threads = envNumber("SIMFIL_BENCH_THREADS", config.threads);
+    config.seed = static_cast<uint32_t>(envNumber("SIMFIL_BENCH_SEED", config.seed));
+    return config;
+}
+
+auto generateFeatures(const Config& config) -> std::string
+{
+    std::mt19937 rng(config.seed);
+    auto uniform = [&](int64_t lo, int64_t hi) {
+        return std::uniform_int_distribution<int64_t>(lo, hi)(rng);
+    };
+
+    std::string out;
+    out.reserve(config.features * 2048);
+    Writer w{out};
+
+    for (size_t i = 0; i < config.features; ++i) {
+        const auto type = Types[uniform(0, Types.size() - 1)];
+
+        w.raw("{");
+        w.key("id"); w.number(static_cast<int64_t>(i));
+        w.raw(","); w.key("typeId"); w.string(type);
+
+        w.raw(","); w.key("properties"); w.raw("{");
+        w.key("name"); w.string(Names[uniform(0, Names.size() - 1)]);
+        w.raw(","); w.key("speedLimit"); w.number(uniform(1, 13) * 10);
+        w.raw(","); w.key("lanes"); w.number(uniform(1, 4));
+        w.raw(","); w.key("oneway"); w.raw(uniform(0, 3) == 0 ? "true" : "false");
+
+        /* Sparse wide object: about a quarter of the fields are set */
+        w.raw(","); w.key("attributes"); w.raw("{");
+        bool first = true;
+        for (size_t f = 0; f < WideFields; ++f) {
+            if (uniform(0, 3) != 0)
+                continue;
+            char name[16];
+            std::snprintf(name, sizeof(name), "attr_%03zu", f);
+            if (!first)
+                w.raw(",");
+            first = false;
+            w.key(name);
+            w.number(uniform(0, 100));
+        }
+        w.raw("}}");
+
+        /* Polyline of lon/lat pairs */
+        w.raw(","); w.key("geometry"); w.raw("[");
+        auto lon = 11.0 + static_cast<double>(uniform(0, 1000000)) * 1e-6;
+        auto lat = 48.0 + static_cast<double>(uniform(0, 1000000)) * 1e-6;
+        const auto points = uniform(2, 16);
+        for (int64_t p = 0; p < points; ++p) {
+            if (p > 0)
+                w.raw(",");
+            lon += static_cast<double>(uniform(-100, 100)) * 1e-6;
+            lat += static_cast<double>(uniform(-100, 100)) * 1e-6;
+            w.raw("["); w.number(lon); w.raw(","); w.number(lat); w.raw("]");
+        }
+        w.raw("]");
+
+        w.raw(","); w.key("relations"); w.raw("[");
+        const auto relations = uniform(0, 4);
+        for (int64_t r = 0; r < relations; ++r) {
+            if (r > 0)
+                w.raw(",");
+            w.raw("{");
+            w.key("type"); w.string(Relations[uniform(0, Relations.size() - 1)]);
+            w.raw(","); w.key("target"); w.number(uniform(0, static_cast<int64_t>(config.features)));
+            w.raw(","); w.key("weight"); w.number(uniform(1, 10));
+            w.raw("}");
+        }
+        w.raw("]}\n");
+    }
+
+    return out;
+}
+
+auto vocabulary(size_t n, uint32_t seed) -> std::vector<std::string>
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> length(4, 24);
+    std::uniform_int_distribution<int> letter('a', 'z');
+
+    std::vector<std::string> words;
+    words.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::string word(static_cast<size_t>(length(rng)), ' ');
+        for (auto& c : word)
+            c = static_cast<char>(letter(rng));
+        /* Keep the words distinct */
+        word += std::to_string(i);
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+}
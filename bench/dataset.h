@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simfil::bench
+{
+
+/**
+ * Benchmark settings, read from the environment:
+ *   SIMFIL_BENCH_FEATURES  Number of features (roots) of the dataset (default 10000)
+ *   SIMFIL_BENCH_THREADS   Threads for parallel evaluation and string pool
+ *                          contention, 0 = hardware concurrency (default 0)
+ *   SIMFIL_BENCH_SEED      Seed of the dataset generator (default 1)
+ */
+struct Config
+{
+    size_t features = 10000;
+    size_t threads = 0;
+    uint32_t seed = 1;
+
+    static auto fromEnv() -> Config;
+};
+
+/** Field names of the wide attribute object of every feature. */
+static constexpr size_t WideFields = 256;
+
+/**
+ * Generate a map-like dataset as NDJSON, one feature per line. Features
+ * are roads, lanes, signs and POIs with a name, typed properties, a wide
+ * sparse attribute object (fields `attr_000` ... `attr_255`), a polyline
+ * geometry and relations to other features. For a given standard library,
+ * the output only depends on the config.
+ */
+auto generateFeatures(const Config& config) -> std::string;
+
+/** Vocabulary of distinct strings, e.g. for string pool benchmarks. */
+auto vocabulary(size_t n, uint32_t seed) -> std::vector<std::string>;
+
+}
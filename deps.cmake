@@ -47,7 +47,7 @@ else()
   endif()
 endif()
 
-if (SIMFIL_WITH_TESTS)
+if (SIMFIL_WITH_TESTS OR SIMFIL_WITH_BENCHMARKS)
   if (NOT TARGET Catch2::Catch2WithMain)
     FetchContent_Declare(catch2
       GIT_REPOSITORY "https://github.com/catchorg/Catch2.git"
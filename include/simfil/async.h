@@ -0,0 +1,69 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#pragma once
+
+#include "simfil/environment.h"
+#include "simfil/value.h"
+#include "simfil/model/model.h"
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace simfil
+{
+
+class Expr;
+
+/**
+ * Asynchronous evaluation of many queries on a small pool of worker
+ * threads, e.g. for models which load their data on demand. submit()
+ * queues an evaluation and returns a future of its results. Workers take
+ * the queued evaluations in batches and call Model::prefetch() once per
+ * model with the roots of a batch, so a lazily-loaded model fetches the
+ * data of all these evaluations with one request before any of them runs.
+ * While one worker waits for a prefetch, the others evaluate the batches
+ * whose data is loaded.
+ *
+ * Evaluation itself is synchronous: a node access which still has to load
+ * data blocks its worker. The environment and submitted expressions must
+ * outlive the evaluator or, respectively, their evaluation.
+ */
+class AsyncEvaluator
+{
+public:
+    /**
+     * Param:
+     *   env      Environment which the submitted expressions were compiled with.
+     * Param:
+     *   threads  Number of worker threads. Zero selects
+     *            `std::thread::hardware_concurrency()`.
+     * Param:
+     *   batch    Maximum number of evaluations per prefetch.
+     */
+    explicit AsyncEvaluator(Environment& env, size_t threads = 0, size_t batch = 64);
+
+    /** Finishes all queued evaluations, then stops the workers. */
+    ~AsyncEvaluator();
+
+    AsyncEvaluator(const AsyncEvaluator&) = delete;
+    AsyncEvaluator& operator=(const AsyncEvaluator&) = delete;
+
+    /**
+     * Queue the evaluation of `ast` on `root`. The future holds the
+     * results, or the exception thrown by the prefetch or evaluation.
+     */
+    auto submit(const Expr& ast, ModelNode::Ptr root) -> std::future<std::vector<Value>>;
+
+    /** Wait until all evaluations which were submitted so far are done. */
+    auto wait() -> void;
+
+private:
+    static auto modelOf(const ModelNode& node) -> const Model*;
+
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}
@@ -6,11 +6,18 @@
 #include "simfil/model/model.h"
 
 #include <map>
+#include <list>
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <chrono>
 #include <functional>
 #include <mutex>
+#include <stdexcept>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace simfil
 {
@@ -19,6 +26,7 @@ class Expr;
 class Function;
 struct ResultFn;
 struct Debug;
+class Profiler;
 
 /** Trace call stats. */
 struct Trace
@@ -28,6 +36,155 @@ struct Trace
     std::vector<Value> values;
 };
 
+/**
+ * Thread-safe, bounded LRU cache of compiled expressions.
+ *
+ * Entries are keyed by an opaque string built from the query source
+ * and its compile flags. Each entry remembers the string pool it was
+ * compiled against; lazily resolved field name IDs are only valid for
+ * that pool, so entries of a different pool are treated as misses.
+ */
+class CompileCache
+{
+public:
+    static constexpr size_t DefaultCapacity = 512;
+
+    explicit CompileCache(size_t capacity = DefaultCapacity);
+
+    /** Get cached expression for `key`, or null. Counts a hit or miss. */
+    auto find(std::string_view key, const std::shared_ptr<StringPool>& strings) -> std::shared_ptr<const Expr>;
+
+    /** Insert an expression, evicting the least recently used entry if full. */
+    auto insert(std::string_view key, const std::shared_ptr<StringPool>& strings, std::shared_ptr<const Expr> expr) -> void;
+
+    /** Change the maximum number of entries. A capacity of 0 disables the cache. */
+    auto setCapacity(size_t capacity) -> void;
+    auto capacity() const -> size_t;
+
+    /** Remove all entries. Does not reset the stats. */
+    auto clear() -> void;
+
+    /** Stats */
+    auto size() const -> size_t;
+    auto hits() const -> size_t;
+    auto misses() const -> size_t;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        /* Compared by owner, as a new pool may reuse a freed pool's address */
+        std::weak_ptr<StringPool> strings;
+        std::shared_ptr<const Expr> expr;
+    };
+
+    auto trim() -> void;
+
+    mutable std::mutex mtx_;
+    size_t capacity_;
+    std::list<Entry> entries_; /* Most recently used first */
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<size_t> misses_ = 0;
+};
+
+/**
+ * Token to cancel running evaluations, e.g. from a request handler
+ * whose client went away. Evaluations with the token in their
+ * EvalLimits check it while they run. Thread-safe.
+ */
+class CancellationToken
+{
+public:
+    auto cancel() -> void { cancelled_.store(true, std::memory_order_relaxed); }
+    auto reset() -> void { cancelled_.store(false, std::memory_order_relaxed); }
+    [[nodiscard]] auto cancelled() const -> bool { return cancelled_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic_bool cancelled_ = false;
+};
+
+/**
+ * Resource limits of every single evaluation of an expression on a
+ * root node (see Environment::limits). Zero means unlimited.
+ */
+struct EvalLimits
+{
+    /* Maximum number of model nodes which wildcards, paths, unpacked
+     * ranges and function loops may visit */
+    size_t maxNodes = 0;
+
+    /* Maximum number of results */
+    size_t maxResults = 0;
+
+    /* Maximum wall-clock time */
+    std::chrono::milliseconds timeout{0};
+
+    /* Cancels the evaluation once cancelled, if set */
+    std::shared_ptr<CancellationToken> cancel;
+
+    [[nodiscard]] auto active() const -> bool
+    {
+        return maxNodes || maxResults || timeout.count() > 0 || cancel;
+    }
+};
+
+/**
+ * Thrown if an evaluation exceeds one of its EvalLimits, or is cancelled.
+ */
+struct EvalLimitError : std::runtime_error
+{
+    enum Reason
+    {
+        Nodes,
+        Results,
+        Timeout,
+        Cancelled,
+    };
+    Reason reason;
+
+    EvalLimitError(Reason reason, const std::string& msg)
+        : std::runtime_error(msg)
+        , reason(reason)
+    {}
+};
+
+/**
+ * Budget of a running evaluation with EvalLimits, shared by all copies of
+ * its Context. Visiting a node costs an increment and a comparison; the
+ * clock and the cancellation token are only checked every CheckInterval
+ * visited nodes.
+ */
+class EvalBudget
+{
+public:
+    static constexpr size_t CheckInterval = 1024;
+
+    /** The limits must outlive the budget. Throws if already cancelled. */
+    explicit EvalBudget(const EvalLimits& limits);
+
+    /** Count `n` visited nodes. Throws EvalLimitError if a limit is exceeded. */
+    auto visit(size_t n = 1) -> void
+    {
+        nodes_ += n;
+        if (nodes_ >= nextCheck_)
+            check();
+    }
+
+    /** Count a result. Throws EvalLimitError if there are too many. */
+    auto result() -> void;
+
+    /** Check all limits now. */
+    auto check() -> void;
+
+private:
+    const EvalLimits& limits_;
+    size_t nodes_ = 0;
+    size_t results_ = 0;
+    size_t nextCheck_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+};
+
 struct Environment
 {
 public:
@@ -92,7 +249,21 @@ public:
     std::map<std::string, const Function*> functions;
 
     Debug* debug = nullptr;
+
+    /* Limits of every evaluation with this environment. Must not be
+     * modified while expressions are evaluated. */
+    EvalLimits limits;
+
+#if defined(SIMFIL_PROFILER)
+    /* Collects per-expression stats if set, see Profiler. */
+    Profiler* profiler = nullptr;
+#endif
     std::shared_ptr<StringPool> stringPool;
+
+    /* Expressions compiled by `compileCached(...)`. Must be cleared
+     * if `functions` is modified, as constant calls are folded
+     * at compile time. */
+    std::unique_ptr<CompileCache> compileCache;
 };
 
 /**
@@ -111,12 +282,31 @@ struct Context
     };
     Phase phase = Evaluation;
 
+    /* Memory for temporary buffers which do not outlive the
+     * evaluation, see Scratch. eval() sets the pool of the
+     * evaluating thread. */
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource();
+
+    /* Budget of the evaluation if the environment sets limits. */
+    EvalBudget* budget = nullptr;
+
     Context(Environment*, Phase = Phase::Evaluation);
+
+    /* Count `n` visited nodes against the budget, see EvalBudget. */
+    auto visit(size_t n = 1) const -> void
+    {
+        if (budget)
+            budget->visit(n);
+    }
 };
 
 /**
  * Debug interface
  */
+/**
+ * Evaluation hooks. Model values passed to the hooks may only borrow
+ * their model; use Value::own() to keep one beyond the hook call.
+ */
 struct Debug
 {
     std::function<void(const Expr&, Context&, Value&, const ResultFn&)> evalBegin;
@@ -36,6 +36,10 @@ public:
     /* Evaluation wrapper */
     auto eval(Context ctx, Value val, const ResultFn& res) const -> Result
     {
+#if defined(SIMFIL_PROFILER)
+        if (ctx.env->profiler) [[unlikely]]
+            return profile(std::move(ctx), std::move(val), res);
+#endif
         auto dbg = ctx.env->debug;
         if (dbg) dbg->evalBegin(*this, ctx, val, res);
         auto r = ieval(std::move(ctx), std::move(val), res);
@@ -46,6 +50,11 @@ public:
 private:
     /* Abstract evaluation implementation */
     virtual auto ieval(Context, Value, const ResultFn&) const -> Result = 0;
+
+#if defined(SIMFIL_PROFILER)
+    /* Evaluation wrapper under Environment::profiler, see profiler.cpp */
+    auto profile(Context, Value, const ResultFn&) const -> Result;
+#endif
 };
 
 using ExprPtr = std::unique_ptr<Expr>;
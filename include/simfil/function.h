@@ -110,6 +110,13 @@ public:
 
     auto ident() const -> const FnInfo& override;
     auto eval(Context, Value, const std::vector<ExprPtr>&, const ResultFn&) const -> Result override;
+
+    /**
+     * Count positive results of `args`, but stop evaluating them once
+     * `limit` is reached. Sets `undef` if an argument is undefined
+     * during compilation.
+     */
+    auto count(Context, Value, const std::vector<ExprPtr>&, int64_t limit, bool& undef) const -> int64_t;
 };
 
 class TraceFn : public Function
@@ -200,6 +207,51 @@ public:
     auto eval(Context, Value, const std::vector<ExprPtr>&, const ResultFn&) const -> Result override;
 };
 
+class TopFn : public Function
+{
+public:
+    static TopFn Fn;
+
+    TopFn();
+
+    auto ident() const -> const FnInfo& override;
+    auto eval(Context, Value, const std::vector<ExprPtr>&, const ResultFn&) const -> Result override;
+};
+
+/**
+ * Bounded selection of the `k` values with the largest keys, which needs
+ * O(k) memory however many values are pushed. Keys are ordered by `<`;
+ * values whose key is not a number or string are ignored. Among equal
+ * keys, the value with the lower `order` ranks first.
+ */
+class TopK
+{
+public:
+    explicit TopK(size_t k);
+
+    /** Offer `value`. Returns true if it is kept (for now). */
+    auto push(Value key, Value value, uint64_t order) -> bool;
+
+    /** Offer all values kept by `other`. */
+    auto merge(TopK&& other) -> void;
+
+    /** Take the kept values, ordered by descending key. */
+    auto take() -> std::vector<Value>;
+
+private:
+    struct Entry
+    {
+        Value key;
+        Value value;
+        uint64_t order;
+    };
+
+    static auto ranksBefore(const Entry& l, const Entry& r) -> bool;
+
+    size_t k_;
+    std::vector<Entry> heap_;  // Heap with the lowest ranked entry in front
+};
+
 /** Utility functions for working with arguments*/
 namespace util
 {
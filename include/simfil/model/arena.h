@@ -3,14 +3,17 @@
 #pragma once
 
 #include <vector>
-#include <shared_mutex>
-#include <mutex>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
 #include <sfl/segmented_vector.hpp>
 
 #include "../exception-handler.h"
 
-// Define this to enable array arena read-write locking.
+// Define this (or set the SIMFIL_ARRAY_ARENA_THREAD_SAFE CMake option)
+// to enable lock-free concurrent appending to different arrays.
 // #define ARRAY_ARENA_THREAD_SAFE
 
 namespace bitsery::ext {
@@ -18,9 +21,130 @@ namespace bitsery::ext {
     struct ArrayArenaExt;
 }
 
+namespace simfil::detail {
+    // Pre-declare memory-mapped ModelPool format, see ModelPool::writeMapped()
+    struct MappedFormat;
+}
+
 namespace simfil
 {
 
+namespace detail
+{
+
+/**
+ * Append-only paged vector which can grow concurrently without locks.
+ * Elements never move: Pages are allocated on first use and published
+ * through a two-level table of atomic pointers, and grow_by() reserves
+ * a range of elements with a single atomic increment.
+ */
+template <class T, size_t PageSize>
+class ConcurrentPagedVector
+{
+public:
+    static constexpr size_t NumDirectories = 256;
+    static constexpr size_t PagesPerDirectory = 1024;
+
+    ConcurrentPagedVector() = default;
+    ConcurrentPagedVector(ConcurrentPagedVector const&) = delete;
+    ConcurrentPagedVector(ConcurrentPagedVector&& other) noexcept { swap(other); }
+    ConcurrentPagedVector& operator=(ConcurrentPagedVector&& other) noexcept {
+        if (this != &other) {
+            clear();
+            swap(other);
+        }
+        return *this;
+    }
+    ~ConcurrentPagedVector() { clear(); }
+
+    /// Reserve `n` default-initialized elements and return the index of the first.
+    size_t grow_by(size_t n) {
+        auto offset = size_.fetch_add(n, std::memory_order_relaxed);
+        if (offset + n > NumDirectories * PagesPerDirectory * PageSize)
+            raise<std::length_error>("ConcurrentPagedVector capacity exceeded.");
+        if (n > 0)
+            for (auto p = offset / PageSize; p <= (offset + n - 1) / PageSize; ++p)
+                page(p);
+        return offset;
+    }
+
+    void push_back(T const& value) { (*this)[grow_by(1)] = value; }
+    void resize(size_t n) { if (n > size()) grow_by(n - size()); }  // Not thread-safe
+    void reserve(size_t) {}  // Pages are allocated on first use
+
+    T& operator[](size_t i) { return page(i / PageSize)[i % PageSize]; }
+    T const& operator[](size_t i) const { return page(i / PageSize)[i % PageSize]; }
+
+    /// Number of reserved elements.
+    [[nodiscard]] size_t size() const { return size_.load(std::memory_order_acquire); }
+
+    /// Release all pages. Not thread-safe.
+    void clear() {
+        for (auto& dirSlot : directories_) {
+            auto* dir = dirSlot.exchange(nullptr);
+            if (!dir)
+                continue;
+            for (auto& pageSlot : dir->pages)
+                delete[] pageSlot.exchange(nullptr);
+            delete dir;
+        }
+        size_ = 0;
+    }
+
+    void shrink_to_fit() {}
+
+private:
+    struct Directory {
+        std::array<std::atomic<T*>, PagesPerDirectory> pages{};
+    };
+
+    T* page(size_t p) const {
+        auto& dirSlot = directories_[p / PagesPerDirectory];
+        auto* dir = dirSlot.load(std::memory_order_acquire);
+        if (!dir) {
+            auto* fresh = new Directory;
+            if (dirSlot.compare_exchange_strong(dir, fresh, std::memory_order_acq_rel))
+                dir = fresh;
+            else
+                delete fresh;
+        }
+
+        auto& pageSlot = dir->pages[p % PagesPerDirectory];
+        auto* result = pageSlot.load(std::memory_order_acquire);
+        if (!result) {
+            auto* fresh = new T[PageSize]();
+            if (pageSlot.compare_exchange_strong(result, fresh, std::memory_order_acq_rel))
+                result = fresh;
+            else
+                delete[] fresh;
+        }
+        return result;
+    }
+
+    void swap(ConcurrentPagedVector& other) noexcept {
+        for (size_t i = 0; i < NumDirectories; ++i)
+            directories_[i] = other.directories_[i].exchange(directories_[i].load());
+        size_ = other.size_.exchange(size_.load());
+    }
+
+    mutable std::array<std::atomic<Directory*>, NumDirectories> directories_{};
+    std::atomic<size_t> size_{0};
+};
+
+template <class T, size_t N>
+size_t grow_by(sfl::segmented_vector<T, N>& vec, size_t n) {
+    auto offset = vec.size();
+    vec.resize(offset + n);
+    return offset;
+}
+
+template <class T, size_t N>
+size_t grow_by(ConcurrentPagedVector<T, N>& vec, size_t n) {
+    return vec.grow_by(n);
+}
+
+}  // namespace detail
+
 /// Address of an array within an ArrayArena
 using ArrayIndex = int32_t;
 
@@ -34,7 +158,14 @@ constexpr static ArrayIndex InvalidArrayIndex = -1;
  * forward-linked array chunks. When an array grows beyond the current capacity c
  * of its current last chunk, a new chunk of size c*2 is allocated and becomes
  * the new last chunk. This is then set as linked to the previous last chunk.
- * Usually, appending will be lock-free, and only growth needs the lock.
+ *
+ * With ARRAY_ARENA_THREAD_SAFE, different threads may append to different
+ * arrays concurrently, and read any array, without taking a lock: Storage
+ * is a ConcurrentPagedVector, where elements never move. Small chunks are
+ * carved from per-thread slabs, so writers rarely touch a shared counter.
+ * Sizes and chunk links are published with release/acquire semantics, so
+ * readers see a consistent prefix of an array, even while it is appended to.
+ * Each array must only have a single writer at a time.
  *
  * @tparam ElementType_ The type of elements stored in the arrays.
  * @tparam PageSize The number of elements that each segment in the
@@ -44,6 +175,7 @@ template <class ElementType_, size_t PageSize = 4096, size_t ChunkPageSize = 409
 class ArrayArena
 {
     friend struct bitsery::ext::ArrayArenaExt;
+    friend struct detail::MappedFormat;
 
 public:
     using ElementType = ElementType_;
@@ -57,27 +189,58 @@ public:
      */
     ArrayIndex new_array(size_t initialCapacity)
     {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::unique_lock guard(lock_);
-        #endif
-        size_t offset = data_.size();
-        data_.resize(offset + initialCapacity);
-        auto index = static_cast<ArrayIndex>(heads_.size());
-        heads_.push_back({(SizeType_)offset, (SizeType_)initialCapacity, 0,
-             InvalidArrayIndex,
-             InvalidArrayIndex});
+        ensure_writable();
+        size_t offset = allocate(initialCapacity);
+        auto index = static_cast<ArrayIndex>(detail::grow_by(heads_, 1));
+        // Readers may see the reserved head already: Its size and link
+        // are published like in push_back(), the other fields are only
+        // read once the size is published.
+        Chunk& head = heads_[index];
+        head.offset = (SizeType_)offset;
+        head.capacity = (SizeType_)initialCapacity;
+        head.last = InvalidArrayIndex;
+        store(head.next, InvalidArrayIndex);
+        store(head.size, (SizeType_)0);
+        return index;
+    }
+
+    /**
+     * Creates a new array of `n` elements in a single chunk without slack
+     * capacity, and calls `init(element, i)` to fill in each element.
+     *
+     * @param n The number of elements of the new array.
+     * @param init Callback which assigns the element at index i.
+     * @return The index of the new array.
+     */
+    template <typename Fn>
+    ArrayIndex new_array(size_t n, Fn&& init)
+    {
+        auto index = new_array(n);
+        Chunk& head = heads_[index];
+        for (size_t i = 0; i < n; ++i)
+            init(data_[head.offset + i], i);
+        store(head.size, (SizeType_)n);
         return index;
     }
 
+    /**
+     * Reserves storage for `arrays` more arrays with `elements` more
+     * elements in total, so that filling them does not reallocate
+     * the arena's bookkeeping.
+     */
+    void reserve(size_t arrays, size_t elements)
+    {
+        ensure_writable();
+        heads_.reserve(heads_.size() + arrays);
+        data_.reserve(data_.size() + elements);
+    }
+
     /**
      * Returns the number of arrays in the arena.
      * @return The number of arrays.
      */
     [[nodiscard]] size_t size() const {
-    #ifdef ARRAY_ARENA_THREAD_SAFE
-            std::shared_lock guard(lock_);
-    #endif
-            return heads_.size();
+            return view_.heads ? view_.numHeads : heads_.size();
     }
 
     /**
@@ -87,10 +250,7 @@ public:
      * @return The size of the array.
      */
     [[nodiscard]] SizeType_ size(ArrayIndex const& a) const {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::shared_lock guard(lock_);
-        #endif
-        return heads_[a].size;
+        return load(head(a).size);
     }
 
     /**
@@ -118,14 +278,14 @@ public:
     ElementType_& push_back(ArrayIndex const& a, ElementType_ const& data)
     {
         Chunk& updatedLast = ensure_capacity_and_get_last_chunk(a);
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::shared_lock guard(lock_);
-        #endif
-        auto& elem = data_[updatedLast.offset + updatedLast.size];
+        Chunk& head = heads_[a];
+        auto chunkSize = (&head != &updatedLast) ? updatedLast.size : head.size;
+        auto& elem = data_[updatedLast.offset + chunkSize];
         elem = data;
-        ++heads_[a].size;
-        if (&heads_[a] != &updatedLast)
-            ++updatedLast.size;
+        // Publish the element: The continuation first, then the total size.
+        if (&head != &updatedLast)
+            store(updatedLast.size, (SizeType_)(updatedLast.size + 1));
+        store(head.size, (SizeType_)(head.size + 1));
         return elem;
     }
 
@@ -141,14 +301,14 @@ public:
     ElementType_& emplace_back(ArrayIndex const& a, Args&&... args)
     {
         Chunk& updatedLast = ensure_capacity_and_get_last_chunk(a);
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::shared_lock guard(lock_);
-        #endif
-        auto& elem = data_[updatedLast.offset + updatedLast.size];
+        Chunk& head = heads_[a];
+        auto chunkSize = (&head != &updatedLast) ? updatedLast.size : head.size;
+        auto& elem = data_[updatedLast.offset + chunkSize];
         new (&elem) ElementType_(std::forward<Args>(args)...);
-        ++heads_[a].size;
-        if (&heads_[a] != &updatedLast)
-            ++updatedLast.size;
+        // Publish the element: The continuation first, then the total size.
+        if (&head != &updatedLast)
+            store(updatedLast.size, (SizeType_)(updatedLast.size + 1));
+        store(head.size, (SizeType_)(head.size + 1));
         return elem;
     }
 
@@ -159,12 +319,12 @@ public:
      * Make sure no other threads are accessing the ArrayArena while calling this method.
      */
     void clear() {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::unique_lock guard(lock_);
-        #endif
         heads_.clear();
         continuations_.clear();
         data_.clear();
+        view_ = {};
+        frozen_ = false;
+        id_ = next_id();
     }
 
     /**
@@ -175,14 +335,49 @@ public:
      * Make sure no other threads are accessing the ArrayArena while calling this method.
      */
     void shrink_to_fit() {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::unique_lock guard(lock_);
-        #endif
         heads_.shrink_to_fit();
         continuations_.shrink_to_fit();
         data_.shrink_to_fit();
     }
 
+    /**
+     * Rewrites every array into a single contiguous chunk without slack
+     * capacity, drops all continuation chunks and marks the arena read-only.
+     * Afterwards, element access and iteration never follow chunk links.
+     * Array indices stay the same. Calling clear() makes the arena writable again.
+     *
+     * This operation is not thread-safe and should be used with caution.
+     * Make sure no other threads are accessing the ArrayArena while calling this method.
+     */
+    void compact() {
+        if (view_.heads)
+            return;
+
+        Column<ElementType_, PageSize> data;
+        for (size_t a = 0; a < heads_.size(); ++a) {
+            auto offset = static_cast<SizeType_>(data.size());
+            auto size = heads_[a].size;
+            iterate(static_cast<ArrayIndex>(a), [&data](auto&& elem) { data.push_back(elem); });
+            heads_[a] = {offset, size, size, InvalidArrayIndex, InvalidArrayIndex};
+        }
+
+        continuations_.clear();
+        continuations_.shrink_to_fit();
+        heads_.shrink_to_fit();
+        data_ = std::move(data);
+        data_.shrink_to_fit();
+        frozen_ = true;
+        id_ = next_id();
+    }
+
+    /**
+     * Check whether the arena is read-only, i.e. compacted
+     * or a view onto external memory.
+     */
+    [[nodiscard]] bool is_read_only() const {
+        return frozen_ || view_.heads;
+    }
+
     // Iterator-related types and functions
     template<typename T, bool is_const>
     class ArrayIterator;
@@ -291,9 +486,9 @@ public:
     const_iterator end(ArrayIndex const& a) const { return const_iterator(*this, a, size(a)); }
 
     ArrayArenaIterator begin() { return ArrayArenaIterator(*this, 0); }
-    ArrayArenaIterator end() { return ArrayArenaIterator(*this, static_cast<ArrayIndex>(heads_.size())); }
+    ArrayArenaIterator end() { return ArrayArenaIterator(*this, static_cast<ArrayIndex>(size())); }
     ArrayArenaIterator begin() const { return ArrayArenaIterator(*this, 0); }
-    ArrayArenaIterator end() const { return ArrayArenaIterator(*this, static_cast<ArrayIndex>(heads_.size())); }
+    ArrayArenaIterator end() const { return ArrayArenaIterator(*this, static_cast<ArrayIndex>(size())); }
 
     ArrayRange range(ArrayIndex const& array) {return ArrayRange(begin(array), end(array));}
 
@@ -302,26 +497,28 @@ public:
     template <typename Func>
     void iterate(ArrayIndex const& a, Func&& lambda)
     {
-        Chunk const* current = &heads_[a];
+        Chunk const* current = &head(a);
         size_t globalIndex = 0;
         while (current != nullptr)
         {
-            for (size_t i = 0; i < current->size && i < current->capacity; ++i)
+            const size_t chunkSize = load(current->size);
+            for (size_t i = 0; i < chunkSize && i < current->capacity; ++i)
             {
                 if constexpr (std::is_invocable_r_v<bool, Func, ElementType_&>) {
                     // If lambda returns bool, break if it returns false
-                    if (!lambda(data_[current->offset + i]))
+                    if (!lambda(element(current->offset + i)))
                         return;
                 }
                 else if constexpr (std::is_invocable_v<Func, ElementType_&, size_t>) {
                     // If lambda takes two arguments, pass the current index
-                    lambda(data_[current->offset + i], globalIndex);
+                    lambda(element(current->offset + i), globalIndex);
                 }
                 else
-                    lambda(data_[current->offset + i]);
+                    lambda(element(current->offset + i));
                 ++globalIndex;
             }
-            current = (current->next != InvalidArrayIndex) ? &continuations_[current->next] : nullptr;
+            const auto next = load(current->next);
+            current = (next != InvalidArrayIndex) ? &continuation(next) : nullptr;
         }
     }
 
@@ -338,14 +535,109 @@ private:
         ArrayIndex last = InvalidArrayIndex;  // The index of the last chunk in the sequence, or InvalidArrayIndex if none.
     };
 
-    sfl::segmented_vector<ArrayArena::Chunk, ChunkPageSize> heads_;         // Head chunks of all arrays.
-    sfl::segmented_vector<ArrayArena::Chunk, ChunkPageSize> continuations_; // Continuation chunks of all arrays.
-    sfl::segmented_vector<ElementType_, PageSize> data_;  // The underlying segmented_vector storing the array elements.
-
     #ifdef ARRAY_ARENA_THREAD_SAFE
-    mutable std::shared_mutex lock_; // Mutex for synchronizing access to the data structure during growth.
+    template <class T, size_t N>
+    using Column = detail::ConcurrentPagedVector<T, N>;
+    #else
+    template <class T, size_t N>
+    using Column = sfl::segmented_vector<T, N>;
     #endif
 
+    Column<ArrayArena::Chunk, ChunkPageSize> heads_;         // Head chunks of all arrays.
+    Column<ArrayArena::Chunk, ChunkPageSize> continuations_; // Continuation chunks of all arrays.
+    Column<ElementType_, PageSize> data_;  // The underlying segmented_vector storing the array elements.
+
+    // Read-only storage owned by someone else, e.g. a memory-mapped file.
+    // If set, the containers above are unused and the arena cannot be modified.
+    struct View
+    {
+        Chunk const* heads = nullptr;
+        size_t numHeads = 0;
+        Chunk const* continuations = nullptr;
+        size_t numContinuations = 0;
+        ElementType_ const* data = nullptr;
+        size_t numData = 0;
+    } view_;
+
+    // Set by compact().
+    bool frozen_ = false;
+
+    // Identifies the current storage generation of this arena, to match
+    // per-thread slabs to the arena they were taken from.
+    uint64_t id_ = next_id();
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // Chunk sizes and links are read concurrently with a writer,
+    // when the arena is thread-safe.
+    template <class T>
+    static T load(T const& field) {
+        #ifdef ARRAY_ARENA_THREAD_SAFE
+        return std::atomic_ref<T>(const_cast<T&>(field)).load(std::memory_order_acquire);
+        #else
+        return field;
+        #endif
+    }
+
+    template <class T>
+    static void store(T& field, T value) {
+        #ifdef ARRAY_ARENA_THREAD_SAFE
+        std::atomic_ref<T>(field).store(value, std::memory_order_release);
+        #else
+        field = value;
+        #endif
+    }
+
+    /**
+     * Reserve `n` elements in data_ and return the offset of the first one.
+     * With ARRAY_ARENA_THREAD_SAFE, small requests are served from a slab
+     * of the calling thread.
+     */
+    size_t allocate(size_t n) {
+        #ifdef ARRAY_ARENA_THREAD_SAFE
+        constexpr size_t SlabSize = 256;
+        if (n > 0 && n <= SlabSize / 4) {
+            struct Slab {
+                uint64_t arena = 0;
+                size_t next = 0;
+                size_t end = 0;
+            };
+            thread_local Slab slab;
+            if (slab.arena != id_ || slab.end - slab.next < n) {
+                auto offset = data_.grow_by(SlabSize);
+                slab = {id_, offset, offset + SlabSize};
+            }
+            auto offset = slab.next;
+            slab.next += n;
+            return offset;
+        }
+        #endif
+        return detail::grow_by(data_, n);
+    }
+
+    Chunk const& head(ArrayIndex const& a) const {
+        return view_.heads ? view_.heads[a] : heads_[a];
+    }
+
+    Chunk const& continuation(ArrayIndex const& c) const {
+        return view_.heads ? view_.continuations[c] : continuations_[c];
+    }
+
+    // Elements of a view are handed out as mutable references, as the
+    // non-const accessors are shared with writable arenas. All modifying
+    // functions refuse to work on a view.
+    ElementType_& element(size_t const& i) const {
+        return view_.heads ? const_cast<ElementType_&>(view_.data[i]) : const_cast<ElementType_&>(data_[i]);
+    }
+
+    void ensure_writable() const {
+        if (is_read_only())
+            raise<std::runtime_error>("Cannot modify a read-only ArrayArena.");
+    }
+
     /**
      * Ensures that the specified array has enough capacity to add one more element
      * and returns a reference to the last chunk in the array.
@@ -358,28 +650,21 @@ private:
      */
     Chunk& ensure_capacity_and_get_last_chunk(ArrayIndex const& a)
     {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::shared_lock read_guard(lock_);
-        #endif
+        ensure_writable();
         Chunk& head = heads_[a];
         Chunk& last = (head.last == InvalidArrayIndex) ? head : continuations_[head.last];
         if (last.size < last.capacity)
             return last;
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        read_guard.unlock();
-        std::unique_lock guard(lock_);
-        #endif
-        size_t offset = data_.size();
         size_t newCapacity = std::max((SizeType_)2, (SizeType_)last.capacity * 2);
-        data_.resize(offset + newCapacity);
+        size_t offset = allocate(newCapacity);
         if (head.capacity == 0) {
             head.offset = (SizeType_)offset;
             head.capacity = static_cast<SizeType_>(newCapacity);
             return head;
         }
-        auto newIndex = static_cast<ArrayIndex>(continuations_.size());
-        continuations_.push_back({(SizeType_)offset, (SizeType_)newCapacity, 0, InvalidArrayIndex, InvalidArrayIndex});
-        last.next = newIndex;
+        auto newIndex = static_cast<ArrayIndex>(detail::grow_by(continuations_, 1));
+        continuations_[newIndex] = {(SizeType_)offset, (SizeType_)newCapacity, 0, InvalidArrayIndex, InvalidArrayIndex};
+        store(last.next, newIndex);
         head.last = newIndex;
         return continuations_[newIndex];
     }
@@ -387,18 +672,17 @@ private:
     template <typename ElementTypeRef, typename Self>
     static ElementTypeRef at_impl(Self& self, ArrayIndex const& a, size_t const& i)
     {
-        #ifdef ARRAY_ARENA_THREAD_SAFE
-        std::shared_lock guard(self.lock_);
-        #endif
-        typename Self::Chunk const* current = &self.heads_[a];
+        typename Self::Chunk const* current = &self.head(a);
         size_t remaining = i;
         while (true) {
-            if (remaining < current->capacity && remaining < current->size)
-                return self.data_[current->offset + remaining];
-            if (current->next == InvalidArrayIndex)
+            // Check the published size first, which orders the other reads.
+            if (remaining < load(current->size) && remaining < current->capacity)
+                return self.element(current->offset + remaining);
+            const auto next = load(current->next);
+            if (next == InvalidArrayIndex)
                 raise<std::out_of_range>("Index out of range");
             remaining -= current->capacity;
-            current = &self.continuations_[current->next];
+            current = &self.continuation(next);
         }
     }
 };
@@ -48,7 +48,7 @@ struct ArrayArenaExt
     template <typename S, typename ElementType, size_t PageSize, size_t ChunkPageSize, typename Fnc>
     void serialize(S& s, simfil::ArrayArena<ElementType, PageSize, ChunkPageSize> const& arena, Fnc&& fnc) const
     {
-        auto numArrays = static_cast<simfil::ArrayIndex>(arena.heads_.size());
+        auto numArrays = static_cast<simfil::ArrayIndex>(arena.size());
         s.value4b(numArrays);
         for (simfil::ArrayIndex i = 0; i < numArrays; ++i) {
             auto size = arena.size(i);
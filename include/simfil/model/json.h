@@ -11,8 +11,37 @@
 namespace simfil::json
 {
 
+/**
+ * Parse a JSON document and add it as a new root to the model.
+ * Nodes are created directly from the parser events, without
+ * building an intermediate JSON DOM. Object fields are sorted by key,
+ * and a repeated key keeps its last value, like in a `nlohmann::json`.
+ */
 void parse(std::istream& input, ModelPoolPtr const& model);
 void parse(const std::string& input, ModelPoolPtr const& model);
 ModelPoolPtr parse(const std::string& input);
 
+/** Layout of an input which holds many root documents. */
+enum class RootLayout
+{
+    Lines, // NDJSON: One JSON document per line.
+    Array, // A single top-level array: Each element becomes a root.
+};
+
+/**
+ * Parse many root documents from the input and add them to the model,
+ * in input order. The input is read in batches and split into documents,
+ * which are parsed by a set of worker threads into compact token tapes.
+ * The tapes are then turned into model nodes on the calling thread, as
+ * a ModelPool does not support concurrent modification. As the tapes
+ * know the size of every object and array, no storage chunks are chained.
+ * If a document fails to parse, the error is rethrown. The roots of
+ * documents before it may already have been added, and stay in the model.
+ * Param:
+ *   threads  Maximum number of worker threads. Zero selects
+ *            `std::thread::hardware_concurrency()`.
+ * Returns the number of added roots.
+ */
+size_t parseRoots(std::istream& input, ModelPoolPtr const& model, RootLayout layout, size_t threads = 0);
+
 }
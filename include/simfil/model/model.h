@@ -6,13 +6,18 @@
 #  include "nlohmann/json.hpp"
 #endif
 
+#include <array>
+#include <cstddef>
 #include <memory>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 #include <istream>
 #include <ostream>
 
 #include "nodes.h"
+#include "value-index.h"
 
 namespace simfil
 {
@@ -70,6 +75,47 @@ public:
      * implementation returns an unset optional.
      */
     virtual std::optional<std::string_view> lookupStringId(StringId id) const;
+
+    /**
+     * Called by AsyncEvaluator with the root nodes of a batch of queued
+     * evaluations, before they are evaluated. Models which load their
+     * data lazily (e.g. from remote storage) can override this to fetch
+     * the data of all nodes with one request, instead of blocking on
+     * each node access during evaluation. The base implementation does
+     * nothing.
+     */
+    virtual void prefetch(std::span<const ModelNode::Ptr> nodes) const;
+
+    /**
+     * Value type which all nodes in `column` have, or Undef if it depends
+     * on the node. Lets Value::field() classify a node by its address,
+     * without resolving it. The base model knows no column types.
+     */
+    [[nodiscard]] ValueType columnType(uint8_t column) const {
+        return columnTypes_ ? (*columnTypes_)[column] : ValueType::Undef;
+    }
+
+protected:
+    /**
+     * Model reference for nodes which are resolved from n. Reuses the
+     * reference held by n if it points to this model, so resolving a
+     * node which only borrows its model (see Value::borrowed) does not
+     * touch the model's reference count.
+     */
+    [[nodiscard]] ModelConstPtr modelFor(ModelNode const& n) const;
+
+    /**
+     * Register the value type of all nodes in `column`, e.g. for a custom
+     * column whose nodes are always objects. Nodes in a column with a type
+     * other than Undef are classified without calling their type(), and
+     * containers and null nodes without calling their value(). Not
+     * thread-safe: Register types before the model is queried.
+     */
+    void setColumnType(uint8_t column, ValueType type);
+
+private:
+    /// Shared by copies of a model until one of them registers a type.
+    std::shared_ptr<std::array<ValueType, 256>> columnTypes_;
 };
 
 /**
@@ -80,6 +126,7 @@ class ModelPool : public Model
 {
     template<typename, typename> friend struct BaseObject;
     template<typename, typename> friend struct BaseArray;
+    friend class ModelBuilder;
 
 public:
     /**
@@ -131,6 +178,27 @@ public:
     /** Designate a model node index as a root */
     void addRoot(ModelNode::Ptr const& rootNode);
 
+    /** Minimum field count of objects covered by buildFieldIndex(). */
+    static constexpr uint32_t FieldIndexMinFields = 16;
+
+    /** Maximum field count of indexed objects which are looked up by a SIMD scan. */
+    static constexpr uint32_t FieldIndexScanMaxFields = 64;
+
+    /**
+     * Build a field index for all objects which have at least `minFields`
+     * fields. The index stores the field names and node addresses of these
+     * objects in two separate packed arrays (structure-of-arrays), so field
+     * lookups compare many names per SIMD instruction, and `at`/`keyAt`
+     * do not need to walk the object's storage chunks. Objects with more
+     * than FieldIndexScanMaxFields fields also get a stable-sorted copy of
+     * their names, which lookups binary-search instead of scanning.
+     * Objects which are extended after the index was built fall back to
+     * the regular storage until the index is rebuilt.
+     * The index is not serialized; read() rebuilds it after loading.
+     * Note: Must not be called while the pool is queried by other threads.
+     */
+    void buildFieldIndex(uint32_t minFields = FieldIndexMinFields);
+
     /**
      * Adopt members from the given vector and obtain a new object
      * model index which has these members.
@@ -148,12 +216,98 @@ public:
     ModelNode::Ptr newValue(double const& value);
     ModelNode::Ptr newValue(std::string_view const& value);
 
+    /**
+     * Enable or disable deduplication of string values. When enabled,
+     * newValue(std::string_view) returns the existing node for a value which
+     * is already in the pool, so repeated strings (e.g. enum-like attributes)
+     * are stored once - also in the serialized model. Enabling indexes the
+     * strings which are already in the pool. The setting is kept by clear().
+     * Off by default.
+     */
+    void setStringDeduplication(bool enabled);
+    [[nodiscard]] bool stringDeduplication() const;
+
     /** Node-type-specific resolve-functions */
     [[nodiscard]]
     model_ptr<Object> resolveObject(ModelNode::Ptr const& n) const;
     [[nodiscard]]
     model_ptr<Array> resolveArray(ModelNode::Ptr const& n) const;
 
+    /**
+     * Non-virtual node access for hot evaluation paths. native() returns
+     * the pool of `n` if it is a plain ModelPool (derived pools may
+     * override resolve()) and `n` is stored in one of its built-in columns,
+     * otherwise null. The accessors below read the columns directly,
+     * without resolving a temporary node per call. They expect addresses
+     * of this pool, e.g. the members of its objects and arrays.
+     */
+    [[nodiscard]] static ModelPool const* native(ModelNode const& n);
+
+    /** Same results as type()/value()/size() of the resolved node. */
+    [[nodiscard]] ValueType typeOf(ModelNodeAddress a) const;
+    [[nodiscard]] ScalarValueType valueOf(ModelNodeAddress a) const;
+    [[nodiscard]] uint32_t sizeOf(ModelNodeAddress a) const;
+
+    /**
+     * Batch form of valueOf() for numbers: If all `addrs` are ints (intsOf)
+     * or floats (floatsOf), writes their values to `out`, which must have
+     * room for `addrs.size()` values, and returns true. Otherwise returns
+     * false, and the contents of `out` are unspecified.
+     */
+    bool intsOf(std::span<const ModelNodeAddress> addrs, int64_t* out) const;
+    bool floatsOf(std::span<const ModelNodeAddress> addrs, double* out) const;
+
+    /** Address of an object's field, or a null address if there is none. */
+    [[nodiscard]] ModelNodeAddress fieldOf(ModelNodeAddress object, StringId name) const;
+
+    /**
+     * Call `fn(ModelNodeAddress)` for the members of an object or array,
+     * until it returns false. Returns false if the iteration was stopped.
+     */
+    template<typename Fn>
+    bool forEachMember(ModelNodeAddress a, Fn&& fn) const;
+
+    /** Like forEachMember(), but calls `fn(StringId, ModelNodeAddress)` for the fields of an object. */
+    template<typename Fn>
+    bool forEachField(ModelNodeAddress a, Fn&& fn) const;
+
+    /** Get the pool which `n` belongs to, or null if its model is no ModelPool. */
+    [[nodiscard]] static ModelPool const* of(ModelNode const& n);
+
+    /**
+     * Declare a secondary index over the values which `path` yields for
+     * each root, e.g. `features.*.id` (see ValueIndex). Queries which
+     * compare such a path against a literal look up the index instead of
+     * walking the root. Indexes are built by compact() and readMapped(),
+     * or right away if the pool is read-only already. clear() keeps the
+     * declarations, but drops the built indexes. Indexes are not serialized.
+     * Note: Must not be called while the pool is queried by other threads.
+     */
+    void addIndex(std::string_view path);
+
+    /** Get the built index for a normalized path (see ValueIndex::normalizePath()), or null. */
+    [[nodiscard]] ValueIndex const* index(std::string_view path) const;
+
+    /**
+     * Enable or disable per-root field filters: A small bloom filter of the
+     * field names which occur in the objects below each root. Queries which
+     * cannot be true without some field (e.g. `**.tollInfo`) skip the roots
+     * which do not contain it, without walking them. Filters are built like
+     * secondary indexes, by compact() and readMapped(), or right away if the
+     * pool is read-only already. The setting is kept by clear(). Off by
+     * default. Queries only use the filters of plain ModelPools, as derived
+     * pools may resolve nodes to objects with additional fields.
+     */
+    void setFieldFilters(bool enabled);
+    [[nodiscard]] bool fieldFilters() const;
+
+    /**
+     * Check if a field named `name` may occur in the objects below the root
+     * node at `root`, including the root itself. Always true for nodes
+     * without a field filter.
+     */
+    [[nodiscard]] bool mayContainField(ModelNodeAddress root, StringId name) const;
+
     /** Access the field name storage */
     [[nodiscard]]
     std::shared_ptr<StringPool> strings() const;
@@ -165,12 +319,124 @@ public:
      */
     virtual void setStrings(std::shared_ptr<simfil::StringPool> const& strings);
 
+    /**
+     * Append all nodes and roots of `other` to this pool, e.g. to combine
+     * tiles into a region. The columns and member arrays are copied in
+     * bulk, node addresses are relocated by the sizes of this pool's
+     * columns, and field names are translated with a single id table if
+     * the pools have different string pools. Returns the index of the
+     * first root of `other` in this pool. `other` must be a plain pool
+     * which is not memory-mapped, and this pool must be writable.
+     * New objects are not covered by the field index until
+     * buildFieldIndex() is called again.
+     */
+    size_t merge(ModelPool const& other);
+
     std::optional<std::string_view> lookupStringId(StringId id) const override;
 
     /** Serialization */
     virtual void write(std::ostream& outputStream);
     virtual void read(std::istream& inputStream);
 
+    /**
+     * Compressed serialization, e.g. for sending models over the network.
+     * Integers are delta- and varint-coded, doubles are XOR-coded against
+     * their predecessor, and string ranges and node addresses are
+     * delta-coded. The string data itself is stored as is. Like for
+     * write()/read(), the string pool is not part of the format and can be
+     * sent with StringPool::write(), including partial writes.
+     */
+    virtual void writeCompressed(std::ostream& outputStream) const;
+    virtual void readCompressed(std::istream& inputStream);
+
+    /**
+     * Chunked serialization for large pools: Every column (roots, values,
+     * strings, object and array members) is encoded into its own block,
+     * and the blocks are encoded, checksummed and decoded on up to
+     * `threads` threads (zero selects the hardware concurrency). A
+     * directory of the blocks' columns, sizes and checksums precedes
+     * them. The encoding of a block is the same as in write(). readChunked()
+     * raises if a checksum does not match, and leaves the pool unchanged
+     * if it raises. Like for write()/read(), the
+     * string pool is not part of the format.
+     */
+    virtual void writeChunked(std::ostream& outputStream, size_t threads = 0);
+    virtual void readChunked(std::istream& inputStream, size_t threads = 0);
+
+    /**
+     * Sizes of all columns and arrays of a pool at some point in time.
+     * Obtained via checkpoint(), and used by writeDelta().
+     */
+    struct Checkpoint
+    {
+        size_t roots_ = 0;
+        size_t i64_ = 0;
+        size_t double_ = 0;
+        size_t strings_ = 0;
+        size_t stringData_ = 0;
+        std::vector<uint32_t> objectSizes_;
+        std::vector<uint32_t> arraySizes_;
+
+        /// Highest id in the string pool, so that new field names
+        /// can be sent with `strings()->write(out, highestString_ + 1)`.
+        StringId highestString_ = 0;
+    };
+
+    [[nodiscard]] Checkpoint checkpoint() const;
+
+    /**
+     * Delta serialization for pools which grow over time: writeDelta() writes
+     * only the roots, values, objects and arrays which were added since the
+     * checkpoint, and the members which were added to existing objects and
+     * arrays, in the compressed format. readDelta() applies such a delta to
+     * a pool which is in the state of the checkpoint, e.g. because it read
+     * the previous deltas, and raises if it is not. A delta which raises
+     * leaves the pool unchanged. New objects are not
+     * covered by the field index until buildFieldIndex() is called again.
+     */
+    void writeDelta(std::ostream& outputStream, Checkpoint const& since) const;
+    void readDelta(std::istream& inputStream);
+
+    /**
+     * Zero-copy serialization. writeMapped() stores all columns as plain
+     * arrays in a versioned layout, with each section aligned to a cache line.
+     * readMapped() turns this pool into a read-only view onto such a buffer,
+     * without copying or decoding anything, so loading takes constant time
+     * and the pages of a memory-mapped file are shared between processes.
+     *
+     * The string pool is not part of the format and must be restored
+     * separately, like for write()/read(). The format is specific to the
+     * byte order and StringId width of the build. The field index is not
+     * rebuilt by readMapped(); call buildFieldIndex() if needed.
+     *
+     * A mapped pool cannot be modified, and `owner` is kept alive until
+     * the pool is cleared or destroyed. readMapped() checks the header,
+     * the section bounds and the chunk tables of the arrays, so walking
+     * them stays within the buffer. Node references are not checked;
+     * call validate() when reading untrusted data.
+     */
+    void writeMapped(std::ostream& outputStream) const;
+    void readMapped(std::shared_ptr<const void> owner, std::span<const std::byte> data);
+
+    /** Memory-map the file at `path` (read-only) and call readMapped() with it. */
+    void readMapped(std::string const& path);
+
+    /** Check whether this pool is a read-only view created by readMapped(). */
+    [[nodiscard]] bool isMapped() const;
+
+    /**
+     * Freeze the pool after construction: Stores the members of every object
+     * and array contiguously, releases all slack capacity and makes the pool
+     * read-only, so that lookups never follow chunk links. Call this before
+     * handing the pool to query threads and before serialization. clear()
+     * makes the pool writable again.
+     * Note: Must not be called while the pool is queried by other threads.
+     */
+    virtual void compact();
+
+    /** Check whether the pool was compacted or is mapped. */
+    [[nodiscard]] bool isReadOnly() const;
+
 #if defined(SIMFIL_WITH_MODEL_JSON)
     /** JSON Serialization */
     virtual nlohmann::json toJson() const;
@@ -186,6 +452,95 @@ protected:
      */
     Object::Storage& objectMemberStorage();
     Array::Storage& arrayMemberStorage();
+
+    /** Packed view onto the fields of an indexed object. */
+    struct IndexedFields
+    {
+        std::span<const StringId> names_;
+        std::span<const ModelNodeAddress> nodes_;
+
+        /* Names sorted by value and their positions in `names_`,
+         * only set for objects with more than FieldIndexScanMaxFields fields. */
+        std::span<const StringId> sortedNames_;
+        std::span<const uint32_t> sortedSlots_;
+
+        /**
+         * Position of the first field named `name`, or `names_.size()`
+         * if there is none.
+         */
+        [[nodiscard]] size_t find(StringId name) const;
+    };
+
+    /**
+     * Get the packed fields of an object, if the object is covered by
+     * the field index and still has `size` fields. Returns empty spans
+     * otherwise.
+     */
+    [[nodiscard]] IndexedFields indexedFields(ArrayIndex members, uint32_t size) const;
+};
+
+/**
+ * Bulk construction of a pool's nodes, e.g. for converters which create
+ * many millions of nodes: The builder works on bare node addresses instead
+ * of model_ptr handles, which hold a reference to the model. Objects and
+ * arrays are created from spans of their members in one call, and are
+ * stored in a single chunk of exactly their size. reserve() allocates the
+ * column capacities up front.
+ *
+ * Addresses are not checked - members must be addresses of this pool.
+ * The builder must not outlive the pool.
+ */
+class ModelBuilder
+{
+public:
+    /** Object field for object(). */
+    struct Field
+    {
+        StringId name_ = StringPool::Empty;
+        ModelNodeAddress node_;
+    };
+
+    /** Number of nodes and members to reserve room for. */
+    struct Capacity
+    {
+        size_t roots_ = 0;
+        size_t objects_ = 0;
+        size_t fields_ = 0;       /* Fields of all objects */
+        size_t arrays_ = 0;
+        size_t elements_ = 0;     /* Elements of all arrays */
+        size_t ints_ = 0;         /* Integers outside of the int16/uint16 range */
+        size_t doubles_ = 0;
+        size_t strings_ = 0;
+        size_t stringBytes_ = 0;
+    };
+
+    explicit ModelBuilder(ModelPool& pool);
+
+    /** Reserve room for `capacity` more nodes. */
+    void reserve(Capacity const& capacity);
+
+    /** Get or insert a field name of the pool's string pool. */
+    StringId name(std::string_view const& name);
+
+    /** Add scalar values. Small integers and bools take no storage. */
+    [[nodiscard]] ModelNodeAddress null() const;
+    ModelNodeAddress value(bool value);
+    ModelNodeAddress value(int64_t value);
+    ModelNodeAddress value(double value);
+    ModelNodeAddress value(std::string_view const& value);
+
+    /** Add an object or array with the given members. */
+    ModelNodeAddress object(std::span<const Field> fields);
+    ModelNodeAddress array(std::span<const ModelNodeAddress> elements);
+
+    /** Designate a node as root. */
+    void addRoot(ModelNodeAddress node);
+
+    /** Get a model node handle, e.g. to extend a node later on. */
+    [[nodiscard]] ModelNode::Ptr node(ModelNodeAddress address) const;
+
+private:
+    ModelPool& pool_;
 };
 
 }
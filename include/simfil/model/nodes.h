@@ -27,8 +27,13 @@ class Model;
 struct ModelNode;
 struct Environment;
 class Expr;
+struct ResultFn;
+struct EvalOptions;
+class AsyncEvaluator;
+class ModelBuilder;
 
 std::vector<Value> eval(Environment& env, const Expr& ast, const ModelNode& node);
+size_t eval(Environment& env, const Expr& ast, const ModelNode& node, const ResultFn& res, const EvalOptions& options);
 
 using ModelConstPtr = std::shared_ptr<const Model>;
 using ModelPoolConstPtr = std::shared_ptr<const ModelPool>;
@@ -144,6 +149,7 @@ private:
  *
  * Some special cases apply for small scalar types:
  * - String: The index is interpreted directly as a string ID.
+ *   For this reason, StringPool::MaxId never exceeds 24 bits.
  * - UInt16|Int16|Bool: The index is interpreted as the integer value.
  * - Null: The index value is ignored.
  */
@@ -196,7 +202,11 @@ struct ModelNode
     friend class ModelPool;
     friend class Model;
     friend class OverlayNode;
+    friend class Value;
+    friend class AsyncEvaluator;
+    friend class ModelBuilder;
     friend std::vector<Value> eval(Environment& env, const Expr& ast, const ModelNode& node);
+    friend size_t eval(Environment& env, const Expr& ast, const ModelNode& node, const ResultFn& res, const EvalOptions& options);
 
     /// Get the node's scalar value if it has one
     [[nodiscard]] virtual ScalarValueType value() const;
@@ -517,6 +527,16 @@ struct BaseObject : public MandatoryDerivedModelNodeBase<ModelType>
         return addFieldInternal(name, static_cast<ModelNode::Ptr>(value));
     }
 
+    /**
+     * Add a field by the id of a name which is already interned in the
+     * model's string pool, e.g. through a KeyCache. This skips the name lookup.
+     */
+    template<class OtherModelNodeType>
+    requires std::derived_from<OtherModelNodeType, ModelNodeType>
+    BaseObject& addField(StringId name, model_ptr<OtherModelNodeType> const& value) {
+        return addFieldInternal(name, static_cast<ModelNode::Ptr>(value));
+    }
+
     [[nodiscard]] ValueType type() const override;
     [[nodiscard]] ModelNode::Ptr at(int64_t) const override;
     [[nodiscard]] uint32_t size() const override;
@@ -538,11 +558,14 @@ protected:
 
         template<typename S>
         void serialize(S& s) {
-            s.value2b(name_);
+            s.template value<sizeof(StringId)>(name_);
             s.object(node_);
         }
     };
 
+    /* Same size for 16- and 32-bit StringIds, as the address is 4-byte aligned. */
+    static_assert(sizeof(Field) == 8);
+
     using Storage = ArrayArena<Field, detail::ColumnPageSize*2>;
     using ModelNode::model_;
     using MandatoryDerivedModelNodeBase<ModelType>::model;
@@ -552,6 +575,7 @@ protected:
     BaseObject(ArrayIndex members, ModelConstPtr pool, ModelNodeAddress);
 
     BaseObject& addFieldInternal(std::string_view const& name, ModelNode::Ptr const& value={});
+    BaseObject& addFieldInternal(StringId name, ModelNode::Ptr const& value={});
 
     Storage* storage_ = nullptr;
     ArrayIndex members_ = 0;
@@ -575,6 +599,14 @@ struct Object : public BaseObject<ModelPool, ModelNode>
     Object& addField(std::string_view const& name, double const& value);
     Object& addField(std::string_view const& name, std::string_view const& value);
 
+    /** Overloads for names which are already interned, see BaseObject. */
+    Object& addBool(StringId name, bool value);
+    Object& addField(StringId name, uint16_t value);
+    Object& addField(StringId name, int16_t value);
+    Object& addField(StringId name, int64_t const& value);
+    Object& addField(StringId name, double const& value);
+    Object& addField(StringId name, std::string_view const& value);
+
     [[nodiscard]] ModelNode::Ptr get(std::string_view const& fieldName) const;
 
     /**
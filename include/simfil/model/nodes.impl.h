@@ -94,16 +94,22 @@ ValueType BaseObject<ModelType, ModelNodeType>::type() const
 template <class ModelType, class ModelNodeType>
 ModelNode::Ptr BaseObject<ModelType, ModelNodeType>::at(int64_t i) const
 {
-    if (i < 0 || i >= (int64_t)storage_->size(members_))
+    auto size = storage_->size(members_);
+    if (i < 0 || i >= (int64_t)size)
         return {};
+    if (auto indexed = model().indexedFields(members_, size); !indexed.nodes_.empty())
+        return ModelNode::Ptr::make(model_, indexed.nodes_[i]);
     return ModelNode::Ptr::make(model_, storage_->at(members_, i).node_);
 }
 
 template <class ModelType, class ModelNodeType>
 StringId BaseObject<ModelType, ModelNodeType>::keyAt(int64_t i) const
 {
-    if (i < 0 || i >= (int64_t)storage_->size(members_))
+    auto size = storage_->size(members_);
+    if (i < 0 || i >= (int64_t)size)
         return {};
+    if (auto indexed = model().indexedFields(members_, size); !indexed.names_.empty())
+        return indexed.names_[i];
     return storage_->at(members_, i).name_;
 }
 
@@ -116,6 +122,14 @@ uint32_t BaseObject<ModelType, ModelNodeType>::size() const
 template <class ModelType, class ModelNodeType>
 ModelNode::Ptr BaseObject<ModelType, ModelNodeType>::get(const StringId& field) const
 {
+    // Wide objects may be covered by the pool's packed field index.
+    if (auto indexed = model().indexedFields(members_, storage_->size(members_)); !indexed.names_.empty()) {
+        auto i = indexed.find(field);
+        if (i == indexed.names_.size())
+            return {};
+        return ModelNode::Ptr::make(model_, indexed.nodes_[i]);
+    }
+
     ModelNode::Ptr result;
     storage_->iterate(
         members_,
@@ -150,9 +164,46 @@ BaseObject<ModelType, ModelNodeType>& BaseObject<ModelType, ModelNodeType>::addF
     std::string_view const& name,
     ModelNode::Ptr const& value)
 {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, value->addr());
+    return addFieldInternal(model().strings()->emplace(name), value);
+}
+
+template <class ModelType, class ModelNodeType>
+BaseObject<ModelType, ModelNodeType>& BaseObject<ModelType, ModelNodeType>::addFieldInternal(
+    StringId name,
+    ModelNode::Ptr const& value)
+{
+    storage_->emplace_back(members_, name, value->addr());
     return *this;
 }
 
+template<typename Fn>
+bool ModelPool::forEachMember(ModelNodeAddress a, Fn&& fn) const
+{
+    auto self = const_cast<ModelPool*>(this);
+    auto cont = true;
+    if (a.column() == Objects) {
+        self->objectMemberStorage().iterate(
+            (ArrayIndex)a.index(),
+            [&](auto&& member) { return (cont = fn(member.node_)); });
+    }
+    else if (a.column() == Arrays) {
+        self->arrayMemberStorage().iterate(
+            (ArrayIndex)a.index(),
+            [&](auto&& member) { return (cont = fn(member)); });
+    }
+    return cont;
+}
+
+template<typename Fn>
+bool ModelPool::forEachField(ModelNodeAddress a, Fn&& fn) const
+{
+    auto cont = true;
+    if (a.column() == Objects) {
+        const_cast<ModelPool*>(this)->objectMemberStorage().iterate(
+            (ArrayIndex)a.index(),
+            [&](auto&& member) { return (cont = fn(member.name_, member.node_)); });
+    }
+    return cont;
+}
+
 }  // namespace simfil
\ No newline at end of file
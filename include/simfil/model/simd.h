@@ -0,0 +1,26 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "string-pool.h"
+
+namespace simfil::simd
+{
+
+/**
+ * Find the first position of `id` in a packed array of string IDs.
+ * Returns `ids.size()` if the ID is not contained.
+ *
+ * The scan compares a full vector register of IDs per instruction.
+ * The kernel is selected once at runtime: AVX2 or SSE2 on x86-64,
+ * NEON on AArch64, and a scalar loop on all other targets.
+ */
+size_t findStringId(std::span<const StringId> ids, StringId id);
+
+/** Name of the kernel selected by findStringId(), for diagnostics. */
+const char* findStringIdKernel();
+
+}
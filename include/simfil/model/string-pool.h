@@ -3,7 +3,10 @@
 #include <cstddef>
 #include <type_traits>
 #include <unordered_map>
-#include <shared_mutex>
+#include <mutex>
+#include <memory>
+#include <array>
+#include <vector>
 #include <atomic>
 #include <optional>
 #include <string_view>
@@ -15,7 +18,13 @@
 namespace simfil
 {
 
+#if defined(SIMFIL_WIDE_STRING_ID)
+/// 32-bit ids, enabled by the SIMFIL_WIDE_STRING_ID build option.
+/// Note: Changes the binary format of string pools and models.
+using StringId = uint32_t;
+#else
 using StringId = uint16_t;
+#endif
 static_assert(std::is_unsigned_v<StringId>, "StringId must be unsigned!");
 
 namespace detail
@@ -31,6 +40,24 @@ struct CaseInsensitiveEqual
 {
     bool operator()(const std::string_view& lhs, const std::string_view& rhs) const;
 };
+
+// Counter split into cache line sized stripes. Threads increment
+// their own stripe, so that concurrent updates do not contend.
+struct StripedCounter
+{
+    static constexpr size_t Stripes = 16;
+
+    void increment();
+    int64_t load() const;
+    void store(int64_t value);
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::atomic_int64_t value{0};
+    };
+    std::array<Stripe, Stripes> stripes_;
+};
 }  // namespace detail
 
 /**
@@ -49,6 +76,10 @@ struct StringPool
         FirstDynamicId = 128
     };
 
+    /// Highest id a pool may hand out. Wide ids are limited to 24 bits,
+    /// so that they still fit the index of a ModelNodeAddress.
+    static constexpr StringId MaxId = sizeof(StringId) == 2 ? 0xffff : 0xffffff;
+
     /// Default constructor initializes strings for static Ids
     StringPool();
 
@@ -81,6 +112,10 @@ struct StringPool
     size_t hits() const;
     size_t misses() const;
 
+    /// Counter which is incremented whenever strings are added.
+    /// Allows caching the result of failed lookups until the pool changes.
+    uint64_t generation() const;
+
     /// Add a static key-string mapping - Warning: Not thread-safe.
     void addStaticKey(StringId k, std::string const& v);
 
@@ -93,19 +128,85 @@ struct StringPool
     bool operator== (StringPool const& other) const;
 
 private:
-    mutable std::shared_mutex stringStoreMutex_;
-    std::unordered_map<
-        std::string_view,
-        StringId,
-        detail::CaseInsensitiveHash,
-        detail::CaseInsensitiveEqual>
-        idForString_;
-    std::unordered_map<StringId, std::string_view> stringForId_;
-    std::deque<std::string> storedStrings_;
-    StringId nextId_ = FirstDynamicId;
+    struct Entry
+    {
+        std::string_view str;  // Points into `blocks_`
+        StringId id;
+        size_t hash;
+    };
+
+    /// Insert-only open addressing table over `entries_`.
+    struct HashTable
+    {
+        explicit HashTable(size_t capacity);
+        size_t mask;
+        std::atomic_size_t count{0};
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    /// Flat table, indexed by StringId.
+    struct IdTable
+    {
+        explicit IdTable(size_t capacity);
+        size_t capacity;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    const Entry* find(std::string_view const& str, size_t hash) const;
+    StringId insert(std::string_view const& str, StringId id, size_t hash);  // Requires writeMutex_
+    std::string_view store(std::string_view const& str);  // Requires writeMutex_
+
+    /*
+     * Readers never lock: They load the current table, which is only ever
+     * appended to in place, or replaced by a larger copy when full. Replaced
+     * tables are kept alive until the pool is destroyed, so a reader holding
+     * an old table can safely finish its lookup.
+     */
+    mutable std::mutex writeMutex_;
+    std::deque<Entry> entries_;
+    std::vector<std::unique_ptr<char[]>> blocks_;  // String bytes, never moved
+    char* blockEnd_ = nullptr;
+    size_t blockFree_ = 0;
+    std::vector<std::unique_ptr<HashTable>> hashTables_;
+    std::vector<std::unique_ptr<IdTable>> idTables_;
+    std::atomic<HashTable*> hashTable_{nullptr};
+    std::atomic<IdTable*> idTable_{nullptr};
+    std::atomic<uint32_t> nextId_ = FirstDynamicId;
     std::atomic_int64_t byteSize_{0};
-    std::atomic_int64_t cacheHits_{0};
-    std::atomic_int64_t cacheMisses_{0};
+    detail::StripedCounter cacheHits_;
+    detail::StripedCounter cacheMisses_;
+    std::atomic_uint64_t generation_{0};
+};
+
+/**
+ * Key to StringId cache for a single ingest thread. Model builders
+ * which add the same few field names over and over resolve them through
+ * a KeyCache, and add fields by StringId: Repeated keys are then found by
+ * an exact match in a small local map, without case-folding hashes or
+ * touching the shared StringPool. Not thread-safe - use one per thread.
+ */
+struct KeyCache
+{
+    explicit KeyCache(std::shared_ptr<StringPool> strings);
+
+    /// Get the id of a field name, interning it in the pool on first use.
+    StringId emplace(std::string_view const& str);
+
+    /// The pool which ids are interned in.
+    [[nodiscard]] std::shared_ptr<StringPool> const& strings() const;
+
+    /// Number of cached keys.
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view const& str) const { return std::hash<std::string_view>{}(str); }
+    };
+
+    std::shared_ptr<StringPool> strings_;
+    std::unordered_map<std::string, StringId, Hash, std::equal_to<>> ids_;
 };
 
 }  // namespace simfil
@@ -0,0 +1,101 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "nodes.h"
+
+namespace simfil
+{
+
+/**
+ * Secondary index over the values which a path yields for each root of
+ * a ModelPool, see ModelPool::addIndex(). A path is a dot-separated list
+ * of field names, `*` (any child) and `**` (any descendant), e.g.
+ * `features.*.id`, and yields the same values as the equivalent query.
+ *
+ * Equality lookups use hash tables from value to roots, range lookups a
+ * sorted list of all numeric values. For query evaluation, the index
+ * additionally keeps the value types and the smallest and largest value
+ * of every root.
+ */
+class ValueIndex
+{
+public:
+    /** Comparison of a path value against a literal, `value <op> literal`. */
+    enum class Comparison
+    {
+        Eq,
+        Lt,
+        LtEq,
+        Gt,
+        GtEq,
+    };
+
+    /** Get the normalized form of a path. Raises for empty segments. */
+    static std::string normalizePath(std::string_view path);
+
+    /** Build the index for `path` over all roots of `pool`. */
+    ValueIndex(ModelPool const& pool, std::string_view path);
+
+    /** The normalized path of the index. */
+    [[nodiscard]] std::string const& path() const;
+
+    /**
+     * Roots for which the path yields a value equal to `value`, ordered
+     * by address. Integers and floats are compared like in queries.
+     */
+    [[nodiscard]] std::vector<ModelNodeAddress> equal(ScalarValueType const& value) const;
+
+    /** Roots for which the path yields a number in [lower, upper], ordered by address. */
+    [[nodiscard]] std::vector<ModelNodeAddress> range(double lower, double upper) const;
+
+    /**
+     * Check if any value of the path on `root` satisfies `value <op> literal`,
+     * with the semantics of the query operators. Returns no result if `root`
+     * is not an indexed root, or if comparing one of its values would raise
+     * (e.g. a string compared to a number), so the caller has to evaluate
+     * the comparison itself.
+     */
+    [[nodiscard]] std::optional<bool> test(ModelNodeAddress root, Comparison op, ScalarValueType const& literal) const;
+
+private:
+    /** Value types of a root, a bit per comparable kind. Nulls have none. */
+    enum Kind : uint8_t
+    {
+        Number = 1,
+        String = 2,
+        Bool = 4,
+        Other = 8,
+    };
+
+    struct RootInfo
+    {
+        uint8_t kinds_ = 0;
+        bool hasInt_ = false;
+        bool hasFloat_ = false;
+        bool hasString_ = false;
+        int64_t minInt_ = 0, maxInt_ = 0;
+        double minFloat_ = 0, maxFloat_ = 0;
+        std::string minString_, maxString_;
+    };
+
+    void add(ModelNodeAddress root, RootInfo& info, ModelNode const& node);
+
+    std::string path_;
+    std::unordered_map<uint32_t, RootInfo> roots_;
+    std::unordered_map<int64_t, std::vector<ModelNodeAddress>> ints_;
+    std::unordered_map<double, std::vector<ModelNodeAddress>> floats_;
+    std::unordered_map<std::string, std::vector<ModelNodeAddress>> strings_;
+    std::vector<ModelNodeAddress> bools_[2];
+    std::vector<std::pair<double, ModelNodeAddress>> sorted_;
+};
+
+}
@@ -4,15 +4,31 @@
 #include "value.h"
 #include "model/model.h"
 
+#include <utility>
+
+#include <sfl/small_vector.hpp>
+
 namespace simfil
 {
 
 struct OverlayNodeStorage final : public Model
 {
-    Value value_;
-    std::map<StringId, Value> overlayChildren_;
+    Value value_ = Value::null();
+    /* Injected fields in insertion order. Overlays carry only a few
+     * (e.g. `$sum`, `$val`, `$idx`), which are stored inline. */
+    sfl::small_vector<std::pair<StringId, Value>, 4> overlayChildren_;
+
+    /** Storage for a shared OverlayNode, which owns its values. */
+    explicit OverlayNodeStorage(Value const& val) : value_(val) { value_.own(); } // NOLINT
 
-    explicit OverlayNodeStorage(Value const& val) : value_(val) {} // NOLINT
+    /**
+     * Storage which is reused for all iterations of a loop, see
+     * OverlayNode::reset(). It is not owned by a shared pointer,
+     * and only borrows its values.
+     */
+    OverlayNodeStorage() = default;
+
+    [[nodiscard]] Value* find(StringId key);
 
     void resolve(ModelNode const& n, ResolveFn const& cb) const override;
 };
@@ -24,7 +40,26 @@ class OverlayNode final : public MandatoryDerivedModelNodeBase<OverlayNodeStorag
 public:
     explicit OverlayNode(Value const& val);
     explicit OverlayNode(ModelNode const& n);
+
+    /** Node which references reusable `storage` without owning it. */
+    explicit OverlayNode(OverlayNodeStorage& storage);
+
+    /** Set the field `key`, unless it is set already. */
     auto set(StringId const& key, Value const& child) -> void;
+
+    /** Drop all fields and overlay `val` instead, keeping the storage. */
+    auto reset(Value const& val) -> void;
+
+    /**
+     * Get a value which may outlive reusable storage: If `val` is this
+     * node of reusable storage, returns an owning copy of the overlay,
+     * otherwise `val` itself.
+     */
+    [[nodiscard]] auto escape(Value val) const -> Value;
+
+    /** Copy of the overlay in storage which is owned by shared pointers. */
+    [[nodiscard]] auto copy() const -> model_ptr<OverlayNode>;
+
     [[nodiscard]] ScalarValueType value() const override;
     [[nodiscard]] ValueType type() const override;
     [[nodiscard]] ModelNode::Ptr get(const StringId& key) const override;
@@ -32,6 +67,10 @@ public:
     [[nodiscard]] StringId keyAt(int64_t i) const override;
     [[nodiscard]] uint32_t size() const override;
     [[nodiscard]] bool iterate(IterCallback const& cb) const override;
+
+private:
+    /** Whether the storage is owned by shared pointers (and owns its values). */
+    [[nodiscard]] auto shared() const -> bool;
 };
 
 }
@@ -0,0 +1,81 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace simfil
+{
+
+class Expr;
+struct Environment;
+
+/**
+ * Per-expression profiler. Attach it via Environment::profiler to count
+ * the invocations and results of every Expr node evaluated under that
+ * environment. Time is not measured per call: every `interval` the
+ * evaluating thread records its current expression stack, weighted with
+ * the time elapsed since its last sample (a statistical sampling profile
+ * on the CPU cycle counter, where available).
+ *
+ * Only available if simfil is built with SIMFIL_WITH_PROFILER, which
+ * defines SIMFIL_PROFILER. Without it, evaluation has no profiling hooks.
+ * Attach it after compilation, as constant folding evaluates temporary
+ * expressions. Do not call reset() while an evaluation is running, and
+ * call report() only while the profiled expressions are alive.
+ */
+class Profiler
+{
+public:
+    /** Stats of one expression node. */
+    struct ExprStats
+    {
+        const Expr* expr = nullptr;
+        std::string text;        /* Expr::toString() */
+        uint64_t calls = 0;      /* Number of Expr::eval calls */
+        uint64_t results = 0;    /* Number of values passed to the result callback */
+        uint64_t nodeResults = 0; /* Results which are model nodes, not visited nodes */
+        uint64_t selfNs = 0;     /* Sampled time with this node on top of the stack */
+        uint64_t totalNs = 0;    /* Sampled time with this node anywhere on the stack */
+    };
+
+    struct Report
+    {
+        std::vector<ExprStats> exprs;   /* Ordered by totalNs, then calls */
+        std::vector<std::pair<std::string, uint64_t>> stacks; /* Folded stack -> ns */
+        uint64_t stringHits = 0;        /* StringPool lookups since start/reset */
+        uint64_t stringMisses = 0;
+
+        /** Report as JSON object. */
+        auto toJson() const -> std::string;
+
+        /** Collapsed stacks ("root;child;leaf <ns>" per line), as read by flamegraph.pl. */
+        auto toFolded() const -> std::string;
+
+        /** Human readable table of the `limit` most expensive nodes. */
+        auto toString(size_t limit = 20) const -> std::string;
+    };
+
+    /**
+     * @param env       Environment whose string pool stats are reported.
+     * @param interval  Sampling interval in nanoseconds.
+     */
+    explicit Profiler(const Environment& env, uint64_t interval = 100'000);
+    ~Profiler();
+
+    auto report() const -> Report;
+    auto reset() -> void;
+
+private:
+    friend class Expr;
+
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}
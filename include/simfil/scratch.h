@@ -0,0 +1,66 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace simfil
+{
+
+/**
+ * Scratch memory for the temporary buffers of an evaluation, e.g. batch
+ * buffers or the value stack of the bytecode interpreter (see
+ * Context::scratch). Every thread has its own unsynchronized pool, which
+ * keeps freed blocks for reuse, so consecutive evaluations on a thread
+ * (like the roots of a parallel worker) recycle memory instead of
+ * contending on the global allocator. Scratch memory must not outlive the
+ * evaluation which allocated it.
+ */
+class Scratch
+{
+public:
+    /** Memory the pool may keep after the outermost evaluation of a thread ended. */
+    static constexpr std::size_t MaxRetained = 64u << 20;
+
+    /** Guard for one evaluation on the calling thread. Scopes may nest. */
+    class Scope
+    {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        [[nodiscard]] std::pmr::memory_resource* resource() const;
+
+    private:
+        Scratch& scratch_;
+    };
+
+    /** Scratch memory of the calling thread. */
+    static Scratch& local();
+
+    /** Bytes which the pool currently holds from the system allocator. */
+    [[nodiscard]] std::size_t retained() const;
+
+private:
+    /** Counts the bytes the pool holds. */
+    struct Upstream : std::pmr::memory_resource
+    {
+        std::size_t bytes_ = 0;
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+    };
+
+    Scratch() = default;
+
+    Upstream upstream_;
+    std::pmr::unsynchronized_pool_resource pool_{&upstream_};
+    std::size_t depth_ = 0;
+};
+
+}
@@ -2,7 +2,11 @@
 
 #pragma once
 
+#include <cstddef>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 #include <string_view>
 
@@ -15,6 +19,32 @@
 namespace simfil
 {
 
+/**
+ * Options for callback based evaluation.
+ */
+struct EvalOptions
+{
+    /* Number of leading results to skip */
+    size_t offset = 0;
+
+    /* Maximum number of results to pass to the callback */
+    size_t limit = std::numeric_limits<size_t>::max();
+};
+
+/**
+ * Execution backend of compiled expressions.
+ */
+enum class Backend
+{
+    /* Evaluate the expression tree directly */
+    Tree,
+
+    /* Lower the expression tree to a linear bytecode program, which is run
+     * by an interpreter loop. Falls back to the tree while a debugger
+     * (`Environment::debug`) is attached. */
+    Bytecode,
+};
+
 /**
  * Compile expression `src`.
  * Param:
@@ -23,8 +53,17 @@ namespace simfil
  *   src  Source code to compile into an expression-tree.
  * Param:
  *   any  If true, wrap expression with call to `any(...)`.
+ * Param:
+ *   backend  Execution backend of the returned expression.
+ */
+auto compile(Environment& env, std::string_view src, bool any = true, Backend backend = Backend::Tree) -> ExprPtr;
+
+/**
+ * Compile expression `src` or return a previously compiled expression
+ * from the environment's `compileCache`. The returned expression is
+ * shared and must not be modified. Parameters are the same as for `compile`.
  */
-auto compile(Environment& env, std::string_view src, bool any = true) -> ExprPtr;
+auto compileCached(Environment& env, std::string_view src, bool any = true, Backend backend = Backend::Tree) -> std::shared_ptr<const Expr>;
 
 /**
  * Evaluate compiled expression.
@@ -37,4 +76,165 @@ auto compile(Environment& env, std::string_view src, bool any = true) -> ExprPtr
  */
 auto eval(Environment& env, const Expr& ast, ModelNode const& node) -> std::vector<Value>;
 
+/**
+ * Evaluate compiled expression and pass each result to a callback
+ * instead of collecting them. Evaluation stops as soon as the callback
+ * returns `Result::Stop` or `options.limit` results have been passed.
+ * Param:
+ *   env      Environment (must be same as the one passed to compile!)
+ * Param:
+ *   ast      Expression-Tree generated by prior call to `compile(...)`
+ * Param:
+ *   node     Root node of the data model to query in
+ * Param:
+ *   res      Result callback, e.g. `LambdaResultFn([](Context, Value v) {...})`
+ * Param:
+ *   options  Offset and limit applied to the result sequence
+ * Returns:
+ *   Number of results passed to `res`.
+ */
+auto eval(Environment& env, const Expr& ast, ModelNode const& node, const ResultFn& res, const EvalOptions& options = {}) -> size_t;
+
+/**
+ * Evaluate compiled expression and only count its results.
+ * The count honors `options.offset` and `options.limit`, so a limit
+ * of one turns this into a cheap "has any result" test.
+ */
+auto evalCount(Environment& env, const Expr& ast, ModelNode const& node, const EvalOptions& options = {}) -> size_t;
+
+/**
+ * Evaluate compiled expression on multiple root nodes in parallel.
+ * The roots are distributed dynamically over a set of worker threads.
+ * The result vector holds one entry per root, in the order of `roots`.
+ * If an evaluation throws, the remaining roots are skipped and the
+ * first exception is rethrown on the calling thread.
+ * Param:
+ *   env      Environment (must be same as the one passed to compile!)
+ * Param:
+ *   ast      Expression-Tree generated by prior call to `compile(...)`
+ * Param:
+ *   roots    Root nodes of the data model to query in
+ * Param:
+ *   threads  Maximum number of worker threads. Zero selects
+ *            `std::thread::hardware_concurrency()`. If `env.debug`
+ *            is set, evaluation always happens on the calling thread.
+ */
+auto eval(Environment& env, const Expr& ast, const std::vector<ModelNode::Ptr>& roots, size_t threads = 0) -> std::vector<std::vector<Value>>;
+
+/**
+ * Evaluate compiled expression on all roots of a model pool in parallel.
+ * See the overload above - the result holds one entry per root.
+ */
+auto eval(Environment& env, const Expr& ast, const ModelPool& model, size_t threads = 0) -> std::vector<std::vector<Value>>;
+
+/**
+ * Evaluate compiled expression on all roots of a model pool in parallel,
+ * but only keep the `k` results with the largest keys, ordered by
+ * descending key (see the `top` function of the language). The first
+ * result of `key`, evaluated on a result, is its key. Results whose key
+ * is not a number or string are dropped. Among equal keys, results of
+ * lower roots rank first. Memory stays in O(k) per thread, instead of
+ * holding all results until they are sorted.
+ */
+auto top(Environment& env, const Expr& ast, const Expr& key, const ModelPool& model, size_t k, size_t threads = 0) -> std::vector<Value>;
+
+/**
+ * A set of compiled expressions which are evaluated together, e.g. the
+ * rules of a validation rule pack. The expressions are planned as one:
+ * All `**.name` lookups of the pack are served by a single walk over
+ * the root, which collects the fields of every name at once, and path
+ * prefixes with wildcards which occur more than once (like `a.**` or
+ * `a.*.b.*`) are evaluated only once per root. Results and their order
+ * are the same as for evaluating each expression on its own.
+ */
+class QueryPack
+{
+public:
+    /**
+     * Param:
+     *   exprs  Expressions compiled by `compile(...)`, in result order.
+     */
+    explicit QueryPack(std::vector<ExprPtr> exprs);
+    ~QueryPack();
+
+    QueryPack(QueryPack&&) noexcept;
+    QueryPack& operator=(QueryPack&&) noexcept;
+
+    auto size() const -> size_t;
+    auto expr(size_t i) const -> const Expr&;
+
+    /** Number of path prefixes which are shared by the expressions. */
+    auto sharedPaths() const -> size_t;
+
+    /** Field names which are collected by the shared `**` walk. */
+    auto sharedFields() const -> const std::vector<std::string>&;
+
+private:
+    friend auto eval(Environment& env, const QueryPack& pack, ModelNode const& node) -> std::vector<std::vector<Value>>;
+
+    std::vector<ExprPtr> exprs_;
+    uint64_t id_;
+    size_t paths_ = 0;
+    std::vector<std::string> fields_;
+};
+
+/**
+ * Evaluate all expressions of a pack on one root node.
+ * The result holds one entry per expression of the pack.
+ */
+auto eval(Environment& env, const QueryPack& pack, ModelNode const& node) -> std::vector<std::vector<Value>>;
+
+/**
+ * Evaluate all expressions of a pack on all roots of a model pool in
+ * parallel, see the single expression overload. The result holds one
+ * entry per root, which holds one entry per expression.
+ */
+auto eval(Environment& env, const QueryPack& pack, const ModelPool& model, size_t threads = 0) -> std::vector<std::vector<std::vector<Value>>>;
+
+/**
+ * Results of a compiled expression on all roots of a model pool, which
+ * are kept up to date while the pool grows: update() only evaluates the
+ * roots which were added since the last update, and the roots whose
+ * results may have changed because members were appended to their
+ * objects or arrays (e.g. by `Object::addField` or `Object::extend`).
+ *
+ * An appended member only affects a root if the expression can reach the
+ * grown object from the root. If the expression reads fields by name only
+ * (no wildcards, subscripts or custom functions), objects below fields of
+ * other names are not reachable, so appending to them re-evaluates nothing.
+ * Roots of derived pools are evaluated by every update.
+ *
+ * The environment, expression and model must outlive this object. The
+ * pool must not be modified during update(), and must not be cleared.
+ */
+class IncrementalEval
+{
+public:
+    IncrementalEval(Environment& env, const Expr& ast, const ModelPool& model);
+    ~IncrementalEval();
+
+    /**
+     * Evaluate the new and affected roots in parallel (see the model pool
+     * overload of `eval(...)`). The first update evaluates all roots.
+     * Returns the results, which hold one entry per root.
+     */
+    auto update(size_t threads = 0) -> const std::vector<std::vector<Value>>&;
+
+    /** Results as of the last update(). */
+    auto results() const -> const std::vector<std::vector<Value>>&;
+
+    /** Number of roots which were evaluated by the last update(). */
+    auto evaluated() const -> size_t;
+
+    /**
+     * Sorted field names which the expression reads, or no value if it
+     * may read any field.
+     */
+    auto fields() const -> const std::optional<std::vector<std::string>>&;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
 }
@@ -4,6 +4,9 @@
 
 #include "value.h"
 #include "typed-meta-type.h"
+#include <memory>
+#include <regex>
+#include <string>
 #include <string_view>
 
 namespace simfil
@@ -41,10 +44,32 @@ public:
     auto unpack(const IRange& , std::function<bool(Value)> res) const -> void override;
 };
 
+/**
+ * Compiled regular expression (ECMAScript syntax, full match).
+ * Patterns which are plain literals, optionally surrounded by `.*`,
+ * are matched by string comparison instead of std::regex.
+ */
+class Regex
+{
+public:
+    explicit Regex(std::string_view pattern);
+
+    /** Get the compiled pattern from a bounded cache shared by all threads. */
+    static auto cached(std::string_view pattern) -> std::shared_ptr<const Regex>;
+
+    [[nodiscard]] auto match(std::string_view str) const -> bool;
+
+private:
+    enum class Kind { Regex, Literal, Prefix, Suffix, Contains };
+    Kind kind_ = Kind::Regex;
+    std::string literal_;
+    std::regex re_;
+};
+
 struct Re
 {
     std::string str;
-    std::regex re;
+    std::shared_ptr<const Regex> re;  // Shared by all copies of the value.
 };
 
 class ReType : public TypedMetaType<Re>
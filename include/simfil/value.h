@@ -245,18 +245,60 @@ public:
 
     static auto field(const ModelNode& node) -> Value
     {
-        return {node.type(), node.value(), model_ptr<ModelNode>(node)};
+        const auto type = typeOf(node);
+        return {type, valueOf(node, type), model_ptr<ModelNode>(node)};
     }
 
     static auto field(ModelNode&& node) -> Value
     {
-        return {node.type(), node.value(), model_ptr<ModelNode>(std::move(node))};
+        const auto type = typeOf(node);
+        auto value = valueOf(node, type);
+        return {type, std::move(value), model_ptr<ModelNode>(std::move(node))};
     }
 
     template <class ModelNodeT>
     static auto field(const model_ptr<ModelNodeT>& node) -> Value
     {
-        return {node->type(), node->value(), node};
+        const auto type = typeOf(*node);
+        return {type, valueOf(*node, type), node};
+    }
+
+    /**
+     * Type of `node`, taken from the column types of its model (see
+     * Model::columnType()) if registered, otherwise from `node.type()`.
+     */
+    static auto typeOf(const ModelNode& node) -> ValueType;
+
+    /** Value of `node` of `type`. Containers and null have no value to resolve. */
+    static auto valueOf(const ModelNode& node, ValueType type) -> ScalarValueType
+    {
+        if (type == ValueType::Object || type == ValueType::Array || type == ValueType::Null)
+            return {};
+        return node.value();
+    }
+
+    /**
+     * Value for the node at `address` of `pool`, which is the model of
+     * `parent` (see ModelPool::native()). Reads the type and value from
+     * the pool's columns instead of resolving the node.
+     */
+    static auto field(const ModelPool& pool, const ModelNode& parent, ModelNodeAddress address) -> Value;
+
+    /**
+     * Like field(), but the value's node only references its model
+     * without owning it. Copies of the value, and of all nodes which
+     * are resolved from it, do not touch the model's reference count.
+     * The caller must keep the model alive while the value is in use,
+     * and call own() before handing the value out.
+     */
+    static auto borrowed(const ModelNode& node) -> Value
+    {
+        auto result = field(node);
+        if (result.node) {
+            auto& model = result.node->model_;
+            model = ModelConstPtr(ModelConstPtr(), model.get());
+        }
+        return result;
     }
 
     Value(ValueType type)  // NOLINT
@@ -356,6 +398,9 @@ public:
         return scalarVisitor.result;
     }
 
+    /// Make sure that the node of this Value keeps its model alive.
+    auto own() -> Value&;
+
     /// Get the string_view of this Value if it has one.
     std::string_view const* stringViewValue() {
         return std::get_if<std::string_view>(&value);
@@ -7,10 +7,12 @@
 #  include "simfil/model/json.h"
 #endif
 
+#if defined(SIMFIL_PROFILER)
+#  include "simfil/profiler.h"
+#endif
+
 #include <string>
 #include <string_view>
-#include <thread>
-#include <atomic>
 #include <fstream>
 #include <chrono>
 #include <optional>
@@ -28,6 +30,7 @@ struct
     bool auto_any = false;
     bool verbose = true;
     bool multi_threaded = true;
+    bool profile = false;
 } options;
 
 static void set_option(const std::string& option, bool& flag, std::string_view cmd)
@@ -103,42 +106,11 @@ static std::string input(const char* prompt = "> ")
 
 static auto eval_mt(simfil::Environment& env, const simfil::Expr& expr, const std::shared_ptr<simfil::ModelPool>& model)
 {
-    std::vector<std::vector<simfil::Value>> result;
-    result.resize(std::max<size_t>(1, model->numRoots()));
-
-    if (!model->numRoots()) {
+    if (!model->numRoots())
         model->addRoot(simfil::ModelNode::Ptr());
-        result[0] = simfil::eval(env, expr, *model->root(0));
-        return result;
-    }
-
-    auto n_threads = std::max<size_t>(std::min<size_t>(std::thread::hardware_concurrency(), model->numRoots()), 1);
-    if (env.debug)
-        n_threads = 1;
-    if (!options.multi_threaded)
-        n_threads = 1;
-
-    auto idx = std::atomic_size_t(0);
-    auto threads = std::vector<std::thread>();
-    threads.reserve(n_threads);
-    for (auto i = 0; i < n_threads; ++i) {
-        threads.emplace_back(std::thread([&, i]() {
-            size_t next;
-            while ((next = idx++) < model->numRoots()) {
-                try {
-                    result[next] = simfil::eval(env, expr, *model->root(next));
-                } catch (...) {
-                    return;
-                }
-            }
-        }));
-    }
 
-    for (auto& thread : threads)
-        if (thread.joinable())
-            thread.join();
-
-    return result;
+    /* Zero threads means hardware concurrency */
+    return simfil::eval(env, expr, *model, options.multi_threaded ? 0 : 1);
 }
 
 
@@ -165,6 +137,9 @@ int main(int argc, char *argv[])
             set_option("any", options.auto_any, cmd);
             set_option("verbose", options.verbose, cmd);
             set_option("mt", options.multi_threaded, cmd);
+#if defined(SIMFIL_PROFILER)
+            set_option("profile", options.profile, cmd);
+#endif
             continue;
         }
 
@@ -180,6 +155,12 @@ int main(int argc, char *argv[])
         if (options.verbose)
             std::cout << "Expression:\n  " << expr->toString() << "\n";
 
+#if defined(SIMFIL_PROFILER)
+        std::optional<simfil::Profiler> profiler;
+        if (options.profile)
+            env.profiler = &profiler.emplace(env);
+#endif
+
         std::vector<std::vector<simfil::Value>> res;
         std::chrono::milliseconds msec;
 
@@ -205,6 +186,11 @@ int main(int argc, char *argv[])
         for (const auto& v : flatres) {
             std::cout << "  " << v.toString() << "\n";
         }
+
+#if defined(SIMFIL_PROFILER)
+        if (profiler)
+            std::cout << "Profile:\n" << profiler->report().toString();
+#endif
     }
 
     return 0;
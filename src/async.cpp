@@ -0,0 +1,161 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#include "simfil/async.h"
+#include "simfil/simfil.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace simfil
+{
+
+struct AsyncEvaluator::Impl
+{
+    struct Task
+    {
+        const Expr* ast;
+        ModelNode::Ptr root;
+        std::promise<std::vector<Value>> promise;
+    };
+
+    Environment& env;
+    const size_t batch;
+
+    std::mutex mtx;
+    std::condition_variable queued;
+    std::condition_variable idle;
+    std::deque<Task> tasks;
+    size_t running = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    Impl(Environment& env, size_t batch)
+        : env(env)
+        , batch(std::max<size_t>(batch, 1))
+    {}
+
+    auto work() -> void
+    {
+        std::vector<Task> current;
+        for (;;) {
+            {
+                std::unique_lock lock(mtx);
+                queued.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+
+                const auto n = std::min(batch, tasks.size());
+                for (auto i = 0u; i < n; ++i) {
+                    current.push_back(std::move(tasks.front()));
+                    tasks.pop_front();
+                }
+                running += n;
+            }
+
+            run(current);
+
+            std::unique_lock lock(mtx);
+            running -= current.size();
+            current.clear();
+            if (running == 0 && tasks.empty())
+                idle.notify_all();
+        }
+    }
+
+    auto run(std::vector<Task>& current) -> void
+    {
+        /* One prefetch per model, in submission order */
+        std::vector<std::exception_ptr> errors(current.size());
+        std::vector<bool> done(current.size(), false);
+        std::vector<ModelNode::Ptr> roots;
+        for (auto i = 0u; i < current.size(); ++i) {
+            if (done[i])
+                continue;
+
+            const auto model = AsyncEvaluator::modelOf(*current[i].root);
+            std::vector<size_t> members;
+            roots.clear();
+            for (auto j = i; j < current.size(); ++j) {
+                if (!done[j] && AsyncEvaluator::modelOf(*current[j].root) == model) {
+                    done[j] = true;
+                    members.push_back(j);
+                    roots.push_back(current[j].root);
+                }
+            }
+
+            if (!model)
+                continue;
+            try {
+                model->prefetch(roots);
+            } catch (...) {
+                for (auto j : members)
+                    errors[j] = std::current_exception();
+            }
+        }
+
+        for (auto i = 0u; i < current.size(); ++i) {
+            auto& task = current[i];
+            if (errors[i]) {
+                task.promise.set_exception(errors[i]);
+                continue;
+            }
+            try {
+                task.promise.set_value(eval(env, *task.ast, *task.root));
+            } catch (...) {
+                task.promise.set_exception(std::current_exception());
+            }
+        }
+    }
+};
+
+AsyncEvaluator::AsyncEvaluator(Environment& env, size_t threads, size_t batch)
+    : impl_(std::make_unique<Impl>(env, batch))
+{
+    if (threads == 0)
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    impl_->workers.reserve(threads);
+    for (auto i = 0u; i < threads; ++i)
+        impl_->workers.emplace_back([this]() { impl_->work(); });
+}
+
+AsyncEvaluator::~AsyncEvaluator()
+{
+    {
+        std::unique_lock lock(impl_->mtx);
+        impl_->stopping = true;
+    }
+    impl_->queued.notify_all();
+    for (auto& worker : impl_->workers)
+        worker.join();
+}
+
+auto AsyncEvaluator::submit(const Expr& ast, ModelNode::Ptr root) -> std::future<std::vector<Value>>
+{
+    std::promise<std::vector<Value>> promise;
+    auto future = promise.get_future();
+    {
+        std::unique_lock lock(impl_->mtx);
+        impl_->tasks.push_back({&ast, std::move(root), std::move(promise)});
+    }
+    impl_->queued.notify_one();
+    return future;
+}
+
+auto AsyncEvaluator::wait() -> void
+{
+    std::unique_lock lock(impl_->mtx);
+    impl_->idle.wait(lock, [this]() { return impl_->running == 0 && impl_->tasks.empty(); });
+}
+
+auto AsyncEvaluator::modelOf(const ModelNode& node) -> const Model*
+{
+    return node.model_.get();
+}
+
+}
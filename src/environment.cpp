@@ -1,5 +1,10 @@
 #include "simfil/environment.h"
 #include "simfil/function.h"
+#include "simfil/exception-handler.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
 
 namespace simfil
 {
@@ -8,6 +13,7 @@ Environment::Environment(std::shared_ptr<StringPool> strings)
     : warnMtx(std::make_unique<std::mutex>())
     , traceMtx(std::make_unique<std::mutex>())
     , stringPool(std::move(strings))
+    , compileCache(std::make_unique<CompileCache>())
 {
     if (!stringPool)
         raise<std::runtime_error>("The string cache must not be null.");
@@ -22,6 +28,7 @@ Environment::Environment(std::shared_ptr<StringPool> strings)
     functions["select"] = &SelectFn::Fn;
     functions["sum"]    = &SumFn::Fn;
     functions["keys"]   = &KeysFn::Fn;
+    functions["top"]    = &TopFn::Fn;
     functions["trace"]  = &TraceFn::Fn;
     functions["re"]     = &ReFn::Fn;
 }
@@ -55,6 +62,127 @@ auto Environment::strings() const -> std::shared_ptr<StringPool> {
     return stringPool;
 }
 
+CompileCache::CompileCache(size_t capacity)
+    : capacity_(capacity)
+{}
+
+auto CompileCache::find(std::string_view key, const std::shared_ptr<StringPool>& strings) -> std::shared_ptr<const Expr>
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    auto iter = index_.find(key);
+    if (iter == index_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+
+    /* Compiled against a different string pool */
+    const auto& owner = iter->second->strings;
+    if (owner.expired() || owner.owner_before(strings) || strings.owner_before(owner)) {
+        entries_.erase(iter->second);
+        index_.erase(iter);
+        ++misses_;
+        return nullptr;
+    }
+
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    ++hits_;
+    return iter->second->expr;
+}
+
+auto CompileCache::insert(std::string_view key, const std::shared_ptr<StringPool>& strings, std::shared_ptr<const Expr> expr) -> void
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    if (capacity_ == 0)
+        return;
+
+    if (auto iter = index_.find(key); iter != index_.end()) {
+        iter->second->strings = strings;
+        iter->second->expr = std::move(expr);
+        entries_.splice(entries_.begin(), entries_, iter->second);
+        return;
+    }
+
+    entries_.push_front({std::string(key), strings, std::move(expr)});
+    index_.emplace(entries_.front().key, entries_.begin());
+    trim();
+}
+
+auto CompileCache::setCapacity(size_t capacity) -> void
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    capacity_ = capacity;
+    trim();
+}
+
+auto CompileCache::capacity() const -> size_t
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    return capacity_;
+}
+
+auto CompileCache::clear() -> void
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    index_.clear();
+    entries_.clear();
+}
+
+auto CompileCache::size() const -> size_t
+{
+    std::unique_lock<std::mutex> _(mtx_);
+    return entries_.size();
+}
+
+auto CompileCache::hits() const -> size_t
+{
+    return hits_;
+}
+
+auto CompileCache::misses() const -> size_t
+{
+    return misses_;
+}
+
+auto CompileCache::trim() -> void
+{
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+EvalBudget::EvalBudget(const EvalLimits& limits)
+    : limits_(limits)
+{
+    if (limits_.timeout.count() > 0)
+        deadline_ = std::chrono::steady_clock::now() + limits_.timeout;
+    check();
+}
+
+auto EvalBudget::result() -> void
+{
+    if (limits_.maxResults && ++results_ > limits_.maxResults)
+        raise<EvalLimitError>(EvalLimitError::Results,
+                              fmt::format("Evaluation exceeded its limit of {} results.", limits_.maxResults));
+}
+
+auto EvalBudget::check() -> void
+{
+    if (limits_.maxNodes && nodes_ > limits_.maxNodes)
+        raise<EvalLimitError>(EvalLimitError::Nodes,
+                              fmt::format("Evaluation exceeded its limit of {} visited nodes.", limits_.maxNodes));
+    if (limits_.cancel && limits_.cancel->cancelled())
+        raise<EvalLimitError>(EvalLimitError::Cancelled, "Evaluation was cancelled.");
+    if (limits_.timeout.count() > 0 && std::chrono::steady_clock::now() > deadline_)
+        raise<EvalLimitError>(EvalLimitError::Timeout,
+                              fmt::format("Evaluation exceeded its timeout of {} ms.", limits_.timeout.count()));
+
+    /* Check again after the next interval, or right when passing maxNodes */
+    nextCheck_ = nodes_ + CheckInterval;
+    if (limits_.maxNodes)
+        nextCheck_ = std::min(nextCheck_, limits_.maxNodes + 1);
+}
+
 Context::Context(Environment* env, Context::Phase phase)
     : env(env)
     , phase(phase)
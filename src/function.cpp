@@ -9,7 +9,9 @@
 #include "simfil/overlay.h"
 #include "fmt/core.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <ranges>
 #include <stdexcept>
@@ -249,7 +251,18 @@ auto CountFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, con
 
     auto subctx = ctx;
     auto undef = false; /* At least one value is undef */
-    int64_t count = 0;
+    auto n = count(ctx, std::move(val), args, std::numeric_limits<int64_t>::max(), undef);
+
+    if (undef)
+        return res(subctx, Value::undef());
+    return res(subctx, Value::make(n));
+}
+
+auto CountFn::count(Context ctx, Value val, const std::vector<ExprPtr>& args, int64_t limit, bool& undef) const -> int64_t
+{
+    int64_t n = 0;
+    if (limit <= 0)
+        return n;
 
     for (const auto& arg : args) {
         arg->eval(ctx, val, LambdaResultFn([&](Context, Value vv) {
@@ -259,17 +272,16 @@ auto CountFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, con
                     return Result::Stop;
                 }
             }
-            count += boolify(std::move(vv)) ? 1 : 0;
-            return Result::Continue;
+            ctx.visit();
+            n += boolify(std::move(vv)) ? 1 : 0;
+            return n < limit ? Result::Continue : Result::Stop;
         }));
 
-        if (undef)
+        if (undef || n >= limit)
             break;
     }
 
-    if (undef)
-        return res(subctx, Value::undef());
-    return res(subctx, Value::make(count));
+    return n;
 }
 
 TraceFn TraceFn::Fn;
@@ -311,7 +323,7 @@ auto TraceFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, con
             auto copy = vv;
             if (auto sv = vv.stringViewValue())
                 copy = Value::make(std::string(*sv));
-            values.emplace_back(std::move(copy));
+            values.emplace_back(std::move(copy.own()));
         }
         return res(std::move(ctx), std::move(vv));
     }));
@@ -448,11 +460,11 @@ namespace {
 template <class _Container = std::vector<std::string>>
 _Container split(std::string_view what,
                  std::string_view at,
-                 bool removeEmpty = true)
+                 bool removeEmpty = true,
+                 _Container container = {})
 {
     using ResultType = typename _Container::value_type;
 
-    _Container container;
     auto out = std::back_inserter(container);
 
     /* Special case: empty `what` */
@@ -505,9 +517,14 @@ auto SplitFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, con
     if (!ok)
         return res(subctx, Value::undef());
 
-    auto items = split(str.as<ValueType::String>(), sep.as<ValueType::String>(), !keepEmpty.as<ValueType::Bool>());
+    /* The views into `str` are copied once, into the values passed on.
+     * Results may outlive the model, so they cannot stay views. */
+    auto view = str.stringViewValue();
+    auto whole = view ? *view : std::string_view(std::get<std::string>(str.value));
+    auto items = split(whole, sep.as<ValueType::String>(), !keepEmpty.as<ValueType::Bool>(),
+                       std::pmr::vector<std::string_view>(ctx.scratch));
     for (auto&& item : items) {
-        if (res(subctx, Value::make(std::move(item))) == Result::Stop)
+        if (res(subctx, Value::make(std::string(item))) == Result::Stop)
             break;
     }
 
@@ -589,16 +606,21 @@ auto SumFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, const
             return Result::Continue;
         }));
 
+    /* All iterations share one overlay, which does not allocate per value */
+    OverlayNodeStorage storage;
+    auto ov = model_ptr<OverlayNode>::make(storage);
+
     (void)args[0]->eval(ctx, val, LambdaResultFn([&, n = 0](Context ctx, Value vv) mutable {
+        ctx.visit();
         if (subexpr) {
-            auto ov = model_ptr<OverlayNode>::make(vv);
+            ov->reset(vv);
             ov->set(StringPool::OverlaySum, sum);
             ov->set(StringPool::OverlayValue, vv);
             ov->set(StringPool::OverlayIndex, Value::make((int64_t)n++));
 
             subexpr->eval(ctx, Value::field(ov), LambdaResultFn([&ov, &sum](auto ctx, auto vv) {
                 ov->set(StringPool::OverlaySum, vv);
-                sum = vv;
+                sum = ov->escape(std::move(vv));
                 return Result::Continue;
             }));
         } else {
@@ -651,4 +673,120 @@ auto KeysFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, cons
     return result;
 }
 
+TopFn TopFn::Fn;
+TopFn::TopFn() = default;
+
+auto TopFn::ident() const -> const FnInfo&
+{
+    static const FnInfo info{
+        "top",
+        "Returns the $count values with the largest keys, ordered by descending key.",
+        "top(values..., count, [key = _]) -> <any>"
+    };
+    return info;
+}
+
+auto TopFn::eval(Context ctx, Value val, const std::vector<ExprPtr>& args, const ResultFn& res) const -> Result
+{
+    if (args.size() < 2 || args.size() > 3)
+        raise<std::runtime_error>("top: Expected 2 or 3 arguments; got "s + std::to_string(args.size()));
+
+    Value count = Value::undef();
+    if (!ArgParser("top", ctx, val, args, 1).arg("count", ValueType::Int, count).ok())
+        return res(ctx, Value::undef());
+
+    const Expr* key = args.size() == 3 ? args[2].get() : nullptr;
+    TopK best(static_cast<size_t>(std::max<int64_t>(count.as<ValueType::Int>(), 0)));
+    auto undef = false;
+    uint64_t n = 0;
+
+    (void)args[0]->eval(ctx, val, LambdaResultFn([&](Context ctx, Value vv) {
+        ctx.visit();
+        if (ctx.phase == Context::Phase::Compilation && vv.isa(ValueType::Undef)) {
+            undef = true;
+            return Result::Stop;
+        }
+
+        const auto order = n++;
+        if (!key) {
+            best.push(vv, vv, order);
+            return Result::Continue;
+        }
+
+        /* The first key of a value counts */
+        (void)key->eval(ctx, vv, LambdaResultFn([&](Context ctx, Value kv) {
+            if (ctx.phase == Context::Phase::Compilation && kv.isa(ValueType::Undef))
+                undef = true;
+            else
+                best.push(std::move(kv), vv, order);
+            return Result::Stop;
+        }));
+        return undef ? Result::Stop : Result::Continue;
+    }));
+
+    if (undef)
+        return res(ctx, Value::undef());
+
+    for (auto& value : best.take()) {
+        if (res(ctx, std::move(value)) == Result::Stop)
+            return Result::Stop;
+    }
+    return Result::Continue;
+}
+
+TopK::TopK(size_t k)
+    : k_(k)
+{
+    heap_.reserve(std::min<size_t>(k, 1024));
+}
+
+auto TopK::ranksBefore(const Entry& l, const Entry& r) -> bool
+{
+    if (boolify(BinaryOperatorDispatcher<OperatorLt>::dispatch(r.key, l.key)))
+        return true;
+    if (boolify(BinaryOperatorDispatcher<OperatorLt>::dispatch(l.key, r.key)))
+        return false;
+    return l.order < r.order;
+}
+
+auto TopK::push(Value key, Value value, uint64_t order) -> bool
+{
+    if (k_ == 0 || !(key.isa(ValueType::Int) || key.isa(ValueType::Float) || key.isa(ValueType::String)))
+        return false;
+
+    Entry entry{std::move(key), std::move(value), order};
+    if (heap_.size() == k_) {
+        if (!ranksBefore(entry, heap_.front()))
+            return false;
+        std::pop_heap(heap_.begin(), heap_.end(), ranksBefore);
+        heap_.pop_back();
+    }
+
+    /* Kept values may outlive the evaluation which produced them */
+    entry.key.own();
+    entry.value.own();
+    heap_.push_back(std::move(entry));
+    std::push_heap(heap_.begin(), heap_.end(), ranksBefore);
+    return true;
+}
+
+auto TopK::merge(TopK&& other) -> void
+{
+    for (auto& entry : other.heap_)
+        push(std::move(entry.key), std::move(entry.value), entry.order);
+    other.heap_.clear();
+}
+
+auto TopK::take() -> std::vector<Value>
+{
+    std::sort_heap(heap_.begin(), heap_.end(), ranksBefore);
+
+    std::vector<Value> values;
+    values.reserve(heap_.size());
+    for (auto& entry : heap_)
+        values.push_back(std::move(entry.value));
+    heap_.clear();
+    return values;
+}
+
 }
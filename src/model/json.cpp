@@ -2,67 +2,501 @@
 
 #include "simfil/model/json.h"
 #include "simfil/model/model.h"
+#include "simfil/exception-handler.h"
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+
 namespace simfil::json
 {
 using json = nlohmann::json;
 
-static ModelNode::Ptr build(const json& j, ModelPool & model)
+namespace
+{
+
+/**
+ * SAX handler which creates model nodes from JSON parser events, as
+ * replayed by a Tape. The sizes of begin events are the exact numbers
+ * of members. Every completed top-level value is added to the model as
+ * a new root.
+ *
+ * Object fields are collected until the object ends, then added sorted
+ * by key, and a repeated key keeps its last value. This is how a
+ * `nlohmann::json` object, which is a `std::map`, stores them.
+ */
+class Builder
+{
+public:
+    explicit Builder(ModelPool& model) : model_(model), strings_(model.strings()), keys_(strings_) {}
+
+    bool null() { return attach({}); }
+    bool boolean(bool value) { return attach(model_.newSmallValue(value)); }
+    bool number_integer(int64_t value) { return attach(model_.newValue(value)); }
+    bool number_unsigned(uint64_t value) { return attach(model_.newValue((int64_t)value)); }
+    bool number_float(double value, std::string_view) { return attach(model_.newValue(value)); }
+    bool string(std::string_view value) { return attach(model_.newValue(value)); }
+
+    template <class Binary>
+    bool binary(Binary&) { return false; }
+
+    bool key(std::string_view name) { return key(keys_.emplace(name)); }
+
+    /** Set the name of the next field to an id from the model's string pool. */
+    bool key(StringId name) {
+        key_ = name;
+        return true;
+    }
+
+    bool start_object(size_t size) {
+        auto object = model_.newObject(size);
+        attach(object);
+        stack_.push_back({std::move(object), {}, fields_.size()});
+        return true;
+    }
+
+    bool start_array(size_t size) {
+        auto array = model_.newArray(size);
+        attach(array);
+        stack_.push_back({{}, std::move(array), fields_.size()});
+        return true;
+    }
+
+    bool end_object() {
+        auto& top = stack_.back();
+        auto begin = fields_.begin() + static_cast<std::ptrdiff_t>(top.fields);
+        auto byName = [](Field const& l, Field const& r) { return l.name < r.name; };
+        if (!std::is_sorted(begin, fields_.end(), byName))
+            std::stable_sort(begin, fields_.end(), byName);
+        for (auto it = begin; it != fields_.end(); ++it) {
+            if (std::next(it) != fields_.end() && std::next(it)->name == it->name)
+                continue;  // The last value of a repeated key wins.
+            top.object->addField(it->id, it->node);
+        }
+        fields_.erase(begin, fields_.end());
+        stack_.pop_back();
+        return true;
+    }
+
+    bool end_array() { stack_.pop_back(); return true; }
+
+    template <class Exception>
+    bool parse_error(size_t, const std::string&, const Exception& ex) {
+        throw ex;
+    }
+
+    /** Number of roots which were added to the model. */
+    [[nodiscard]] size_t roots() const { return roots_; }
+
+private:
+    struct Frame {
+        model_ptr<Object> object;
+        model_ptr<Array> array;
+        size_t fields = 0;  // Start of the object's fields in fields_.
+    };
+
+    struct Field {
+        std::string_view name;
+        StringId id;
+        ModelNode::Ptr node;
+    };
+
+    bool attach(ModelNode::Ptr const& node) {
+        if (stack_.empty()) {
+            model_.addRoot(node);
+            ++roots_;
+        }
+        else if (auto& top = stack_.back(); top.object)
+            fields_.push_back({strings_->resolve(key_).value_or(""), key_, node});
+        else
+            top.array->append(node);
+        return true;
+    }
+
+    ModelPool& model_;
+    std::shared_ptr<StringPool> strings_;
+    KeyCache keys_;
+    std::vector<Frame> stack_;
+    std::vector<Field> fields_;  // Fields of the open objects, innermost last.
+    StringId key_ = StringPool::Empty;
+    size_t roots_ = 0;
+};
+
+/**
+ * Compact recording of JSON parser events, which can be replayed into
+ * a Builder later. Tapes are filled concurrently by the parser threads of
+ * parseRoots(). Begin tokens store the final number of members, so the
+ * Builder can allocate objects and arrays with their exact capacity.
+ * Keys are interned by the parser threads, each through its own KeyCache.
+ */
+class Tape
+{
+public:
+    explicit Tape(std::shared_ptr<StringPool> strings) : keys_(std::move(strings)) {}
+
+    bool null() { return emit(Token::Null, 0); }
+    bool boolean(bool value) { return emit(Token::Bool, value); }
+    bool number_integer(int64_t value) { return emit(Token::Int, value); }
+    bool number_unsigned(uint64_t value) { return emit(Token::Int, (int64_t)value); }
+
+    bool number_float(double value, std::string_view) {
+        emit(Token::Double, 0);
+        tokens_.back().d = value;
+        return true;
+    }
+
+    bool string(std::string_view value) { return emitString(Token::String, value); }
+
+    template <class Binary>
+    bool binary(Binary&) { return false; }
+
+    bool key(std::string_view name) {
+        ++tokens_[open_.back()].i;
+        return emit(Token::Key, keys_.emplace(name));
+    }
+
+    bool start_object(size_t) {
+        emit(Token::BeginObject, 0);
+        open_.push_back(tokens_.size() - 1);
+        return true;
+    }
+
+    bool start_array(size_t) {
+        emit(Token::BeginArray, 0);
+        open_.push_back(tokens_.size() - 1);
+        return true;
+    }
+
+    bool end_object() { open_.pop_back(); return emit(Token::End, 0); }
+    bool end_array() { open_.pop_back(); return emit(Token::End, 0); }
+
+    template <class Exception>
+    bool parse_error(size_t, const std::string&, const Exception& ex) {
+        throw ex;
+    }
+
+    /** Parse a single JSON document and append its events. */
+    void parse(std::string_view document) {
+        open_.clear();
+        json::sax_parse(document.begin(), document.end(), this);
+    }
+
+    void parse(std::istream& input) {
+        open_.clear();
+        json::sax_parse(input, this);
+    }
+
+    void clear() {
+        tokens_.clear();
+        chars_.clear();
+    }
+
+    void replay(Builder& builder) const {
+        for (auto const& token : tokens_) {
+            switch (token.kind) {
+            case Token::Null: builder.null(); break;
+            case Token::Bool: builder.boolean(token.i != 0); break;
+            case Token::Int: builder.number_integer(token.i); break;
+            case Token::Double: builder.number_float(token.d, {}); break;
+            case Token::String: builder.string(text(token)); break;
+            case Token::Key: builder.key((StringId)token.i); break;
+            case Token::BeginObject: builder.start_object((size_t)token.i); break;
+            case Token::BeginArray: builder.start_array((size_t)token.i); break;
+            case Token::End: builder.end_object(); break;
+            }
+        }
+    }
+
+private:
+    struct Token {
+        enum Kind : uint8_t { Null, Bool, Int, Double, String, Key, BeginObject, BeginArray, End };
+        Kind kind = Null;
+        uint32_t length = 0;  // Length of a String, whose `i` is the offset into chars_.
+        union {
+            int64_t i = 0;
+            double d;
+        };
+    };
+
+    bool emit(Token::Kind kind, int64_t value) {
+        if (!open_.empty() && tokens_[open_.back()].kind == Token::BeginArray && kind != Token::End)
+            ++tokens_[open_.back()].i;
+        auto& token = tokens_.emplace_back();
+        token.kind = kind;
+        token.i = value;
+        return true;
+    }
+
+    bool emitString(Token::Kind kind, std::string_view value) {
+        if (value.size() > UINT32_MAX)
+            raise<std::length_error>("JSON string exceeds 4GB.");
+        emit(kind, (int64_t)chars_.size());
+        tokens_.back().length = (uint32_t)value.size();
+        chars_.append(value);
+        return true;
+    }
+
+    [[nodiscard]] std::string_view text(Token const& token) const {
+        return {chars_.data() + token.i, token.length};
+    }
+
+    KeyCache keys_;
+    std::vector<Token> tokens_;
+    std::string chars_;
+    std::vector<size_t> open_;  // Token indices of the open objects/arrays.
+};
+
+/**
+ * Reads batches of root documents from a stream. The splitter only tracks
+ * line breaks, or nesting depth and string literals for RootLayout::Array,
+ * so it is much faster than parsing, and leaves that to the Tapes.
+ */
+class Splitter
 {
-    switch (j.type()) {
-    case json::value_t::null:
-        return {};
-    case json::value_t::boolean:
-        return model.newSmallValue(j.get<bool>());
-    case json::value_t::number_float:
-        return model.newValue(j.get<double>());
-    case json::value_t::number_unsigned:
-        return model.newValue((int64_t)j.get<uint64_t>());
-    case json::value_t::number_integer:
-        return model.newValue(j.get<int64_t>());
-    case json::value_t::string:
-        return model.newValue(j.get<std::string>());
-    default:
-        break;
-    }
-
-    if (j.is_object()) {
-        auto object = model.newObject(j.size());
-        for (auto&& [key, value] : j.items())
-            object->addField(key, build(value, model));
-        return object;
-    }
-
-    if (j.is_array()) {
-        auto array = model.newArray(j.size());
-        for (const auto& value : j)
-            array->append(build(value, model));
-        return array;
-    }
-
-    return {};
+public:
+    static constexpr size_t BlockSize = 1 << 20;
+    static constexpr size_t BatchSize = 16 << 20;
+
+    Splitter(std::istream& input, RootLayout layout) : input_(input), layout_(layout) {}
+
+    /**
+     * Read the next batch of documents. The returned views stay
+     * valid until the next call. Returns false at the end of the input.
+     */
+    bool next(std::vector<std::string_view>& documents) {
+        buffer_.erase(0, begin_);
+        pos_ -= begin_;
+        begin_ = 0;
+        ranges_.clear();
+
+        size_t batchSize = 0;
+        while (batchSize < BatchSize) {
+            if (pos_ == buffer_.size() && !read()) {
+                finish();
+                break;
+            }
+            auto count = ranges_.size();
+            if (layout_ == RootLayout::Lines)
+                scanLines();
+            else
+                scanArray();
+            for (auto i = count; i < ranges_.size(); ++i)
+                batchSize += ranges_[i].second - ranges_[i].first;
+        }
+
+        documents.clear();
+        for (auto const& [begin, end] : ranges_)
+            documents.emplace_back(buffer_.data() + begin, end - begin);
+        return !documents.empty();
+    }
+
+private:
+    bool read() {
+        if (!input_)
+            return false;
+        auto size = buffer_.size();
+        buffer_.resize(size + BlockSize);
+        input_.read(buffer_.data() + size, BlockSize);
+        buffer_.resize(size + input_.gcount());
+        return buffer_.size() > size;
+    }
+
+    void scanLines() {
+        while (pos_ < buffer_.size()) {
+            auto* newline = static_cast<const char*>(
+                std::memchr(buffer_.data() + pos_, '\n', buffer_.size() - pos_));
+            if (!newline) {
+                pos_ = buffer_.size();
+                return;
+            }
+            pos_ = newline - buffer_.data();
+            addDocument(begin_, pos_);
+            begin_ = ++pos_;
+        }
+    }
+
+    void scanArray() {
+        for (; pos_ < buffer_.size(); ++pos_) {
+            auto c = buffer_[pos_];
+            if (done_) {
+                if (!std::isspace((unsigned char)c))
+                    raise<std::runtime_error>("Unexpected content after the top-level JSON array.");
+                begin_ = pos_ + 1;
+            }
+            else if (!started_) {
+                if (c == '[')
+                    started_ = true;
+                else if (!std::isspace((unsigned char)c))
+                    raise<std::runtime_error>("Expected a top-level JSON array.");
+                begin_ = pos_ + 1;
+            }
+            else if (inString_) {
+                if (escape_)
+                    escape_ = false;
+                else if (c == '\\')
+                    escape_ = true;
+                else if (c == '"')
+                    inString_ = false;
+            }
+            else if (c == '"')
+                inString_ = true;
+            else if (c == '[' || c == '{')
+                ++depth_;
+            else if ((c == ']' || c == '}') && depth_ > 0)
+                --depth_;
+            else if (depth_ == 0 && (c == ',' || c == ']')) {
+                if (!addDocument(begin_, pos_) && (c == ',' || elements_ > 0))
+                    raise<std::runtime_error>("Missing element in the top-level JSON array.");
+                done_ = (c == ']');
+                begin_ = pos_ + 1;
+            }
+        }
+    }
+
+    void finish() {
+        if (layout_ == RootLayout::Lines)
+            addDocument(begin_, buffer_.size());
+        else if (started_ && !done_)
+            raise<std::runtime_error>("Unterminated top-level JSON array.");
+        begin_ = buffer_.size();
+    }
+
+    /** Add the trimmed range as a document, unless it is empty. */
+    bool addDocument(size_t begin, size_t end) {
+        while (begin < end && std::isspace((unsigned char)buffer_[begin]))
+            ++begin;
+        while (end > begin && std::isspace((unsigned char)buffer_[end - 1]))
+            --end;
+        if (begin == end)
+            return false;
+        ranges_.emplace_back(begin, end);
+        ++elements_;
+        return true;
+    }
+
+    std::istream& input_;
+    RootLayout layout_;
+    std::string buffer_;
+    std::vector<std::pair<size_t, size_t>> ranges_;
+    size_t begin_ = 0;  // Start of the current document.
+    size_t pos_ = 0;    // Scan position.
+    size_t elements_ = 0;
+    size_t depth_ = 0;
+    bool started_ = false;
+    bool done_ = false;
+    bool inString_ = false;
+    bool escape_ = false;
+};
+
+}
+
+namespace
+{
+
+/* The parser does not know the sizes of objects and arrays when they
+ * begin, so the events are recorded first, see Tape. */
+template <class Input>
+void build(Input& input, ModelPool& model)
+{
+    Tape tape(model.strings());
+    tape.parse(input);
+    Builder builder(model);
+    tape.replay(builder);
+}
+
 }
 
 void parse(std::istream& input, ModelPoolPtr const& model)
 {
-    model->addRoot(build(json::parse(input), *model));
+    build(input, *model);
     model->validate();
+    model->buildFieldIndex();
 }
 
 void parse(const std::string& input, ModelPoolPtr const& model)
 {
-    model->addRoot(build(json::parse(input), *model));
+    std::string_view document(input);
+    build(document, *model);
     model->validate();
+    model->buildFieldIndex();
 }
 
 ModelPoolPtr parse(const std::string& input)
 {
     auto model = std::make_shared<simfil::ModelPool>();
-    model->addRoot(build(json::parse(input), *model));
-    model->validate();
+    parse(input, model);
     return model;
 }
 
+size_t parseRoots(std::istream& input, ModelPoolPtr const& model, RootLayout layout, size_t threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max<size_t>(threads, 1);
+
+    Splitter splitter(input, layout);
+    Builder builder(*model);
+    std::vector<Tape> tapes;
+    tapes.reserve(threads);
+    for (auto i = 0u; i < threads; ++i)
+        tapes.emplace_back(model->strings());
+    std::vector<std::string_view> documents;
+
+    while (splitter.next(documents)) {
+        /* Each worker parses a contiguous range of documents of roughly equal
+         * byte size, so replaying the tapes in worker order keeps the input
+         * order. The calling thread replays each tape as soon as its worker
+         * is done, while the later workers are still parsing. */
+        size_t totalSize = 0;
+        for (auto const& document : documents)
+            totalSize += document.size();
+
+        const auto numWorkers = std::min(threads, documents.size());
+        std::vector<size_t> bounds{0};
+        size_t size = 0;
+        for (auto i = 0u; i < documents.size() && bounds.size() < numWorkers; ++i) {
+            size += documents[i].size();
+            if (size * numWorkers >= totalSize * bounds.size())
+                bounds.push_back(i + 1);
+        }
+        bounds.push_back(documents.size());
+
+        std::vector<std::exception_ptr> errors(bounds.size() - 1);
+        auto work = [&](size_t w) {
+            tapes[w].clear();
+            try {
+                for (auto i = bounds[w]; i < bounds[w + 1]; ++i)
+                    tapes[w].parse(documents[i]);
+            } catch (...) {
+                errors[w] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(errors.size());
+        for (auto w = 0u; w < errors.size(); ++w)
+            workers.emplace_back(work, w);
+
+        std::exception_ptr error;
+        for (auto w = 0u; w < errors.size(); ++w) {
+            workers[w].join();
+            if (!error && errors[w])
+                error = errors[w];
+            if (!error)
+                tapes[w].replay(builder);
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    model->validate();
+    model->buildFieldIndex();
+    return builder.roots();
+}
+
 }
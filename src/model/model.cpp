@@ -2,15 +2,40 @@
 #include "simfil/model/arena.h"
 #include "simfil/model/bitsery-traits.h"
 #include "simfil/model/nodes.h"
+#include "simfil/model/simd.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
 #include <memory>
+#include <optional>
+#include <thread>
 #include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
+#if defined(_WIN32)
+#  include <filesystem>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <bitsery/bitsery.h>
+#include <bitsery/adapter/buffer.h>
 #include <bitsery/adapter/stream.h>
 #include <bitsery/traits/string.h>
 #include <sfl/segmented_vector.hpp>
@@ -18,20 +43,612 @@
 namespace simfil
 {
 
+namespace detail
+{
+
+/**
+ * Memory-mapped ModelPool format, see ModelPool::writeMapped().
+ *
+ * The file starts with a Header, which holds the byte offset and size of
+ * every section. A section is a plain array of the in-memory element type,
+ * so it can be used in place. Sections start at multiples of `Alignment`.
+ */
+struct MappedFormat
+{
+    static constexpr std::array<char, 8> Magic = {'S', 'I', 'M', 'F', 'I', 'L', 'M', 'P'};
+    static constexpr uint32_t Version = 1;
+    static constexpr size_t Alignment = 64;
+
+    enum Section : uint32_t {
+        Roots,
+        Int64,
+        Double,
+        StringData,
+        StringRanges,
+        ObjectHeads,
+        ObjectContinuations,
+        ObjectData,
+        ArrayHeads,
+        ArrayContinuations,
+        ArrayData,
+        NumSections
+    };
+
+    struct SectionEntry
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    struct Header
+    {
+        std::array<char, 8> magic = Magic;
+        uint32_t version = Version;
+        uint8_t stringIdSize = sizeof(StringId);
+        uint8_t littleEndian = std::endian::native == std::endian::little;
+        uint16_t numSections = NumSections;
+        std::array<SectionEntry, NumSections> sections;
+    };
+
+    /** Write `n` elements, which are obtained via `get(i)`, in blocks. */
+    template <class T, class Get>
+    static void writeElements(std::ostream& out, size_t n, Get&& get)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        constexpr size_t BlockSize = 4096;
+        std::vector<T> block;
+        block.reserve(std::min(n, BlockSize));
+        for (size_t i = 0; i < n;) {
+            block.clear();
+            for (; i < n && block.size() < BlockSize; ++i)
+                block.push_back(get(i));
+            out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(T)));
+        }
+    }
+
+    /** A section to be written: element count, element size and writer. */
+    struct SectionSource
+    {
+        size_t count = 0;
+        size_t elementSize = 1;
+        std::function<void(std::ostream&)> write;
+    };
+
+    template <class Container>
+    static SectionSource column(Container const& c)
+    {
+        using T = std::decay_t<decltype(c[0])>;
+        return {c.size(), sizeof(T), [&c](std::ostream& out) {
+            writeElements<T>(out, c.size(), [&c](size_t i) { return c[i]; });
+        }};
+    }
+
+    /** Sections of an arena, in the order heads, continuations, data. */
+    template <class Arena>
+    static std::array<SectionSource, 3> arena(Arena const& a)
+    {
+        using Chunk = typename Arena::Chunk;
+        using Element = typename Arena::ElementType;
+        const auto numConts = a.view_.heads ? a.view_.numContinuations : a.continuations_.size();
+        const auto numData = a.view_.heads ? a.view_.numData : a.data_.size();
+        return {{
+            {a.size(), sizeof(Chunk), [&a](std::ostream& out) {
+                writeElements<Chunk>(out, a.size(), [&a](size_t i) { return a.head((ArrayIndex)i); });
+            }},
+            {numConts, sizeof(Chunk), [&a, numConts](std::ostream& out) {
+                writeElements<Chunk>(out, numConts, [&a](size_t i) { return a.continuation((ArrayIndex)i); });
+            }},
+            {numData, sizeof(Element), [&a, numData](std::ostream& out) {
+                writeElements<Element>(out, numData, [&a](size_t i) { return a.element(i); });
+            }},
+        }};
+    }
+
+    static void write(std::ostream& out, std::array<SectionSource, NumSections> const& sources)
+    {
+        Header header;
+        uint64_t offset = sizeof(Header);
+        for (auto i = 0u; i < NumSections; ++i) {
+            offset = (offset + Alignment - 1) / Alignment * Alignment;
+            header.sections[i] = {offset, sources[i].count * sources[i].elementSize};
+            offset += header.sections[i].size;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t pos = sizeof(Header);
+        static const std::array<char, Alignment> padding{};
+        for (auto i = 0u; i < NumSections; ++i) {
+            out.write(padding.data(), static_cast<std::streamsize>(header.sections[i].offset - pos));
+            sources[i].write(out);
+            pos = header.sections[i].offset + header.sections[i].size;
+        }
+    }
+
+    /** Validate the header of `data` and get the bounds-checked sections. */
+    static Header read(std::span<const std::byte> data)
+    {
+        Header header;
+        if (data.size() < sizeof(Header))
+            raise<std::runtime_error>("Mapped ModelPool: Buffer is too small.");
+        std::memcpy(&header, data.data(), sizeof(Header));
+
+        if (header.magic != Magic)
+            raise<std::runtime_error>("Mapped ModelPool: Bad magic.");
+        if (header.version != Version)
+            raise<std::runtime_error>(fmt::format("Mapped ModelPool: Unsupported version {}.", header.version));
+        if (header.stringIdSize != sizeof(StringId))
+            raise<std::runtime_error>(fmt::format("Mapped ModelPool: StringId size mismatch ({} != {}).", header.stringIdSize, sizeof(StringId)));
+        if (header.littleEndian != (std::endian::native == std::endian::little))
+            raise<std::runtime_error>("Mapped ModelPool: Byte order mismatch.");
+        if (header.numSections != NumSections)
+            raise<std::runtime_error>("Mapped ModelPool: Bad section count.");
+        if (reinterpret_cast<uintptr_t>(data.data()) % alignof(std::max_align_t) != 0)
+            raise<std::runtime_error>("Mapped ModelPool: Buffer is not aligned.");
+
+        for (auto const& section : header.sections) {
+            if (section.offset % Alignment != 0 || section.offset > data.size() || section.size > data.size() - section.offset)
+                raise<std::runtime_error>("Mapped ModelPool: Bad section bounds.");
+        }
+        return header;
+    }
+
+    template <class T>
+    static std::span<const T> section(std::span<const std::byte> data, Header const& header, Section s)
+    {
+        auto const& entry = header.sections[s];
+        if (entry.size % sizeof(T) != 0)
+            raise<std::runtime_error>("Mapped ModelPool: Bad section size.");
+        return {reinterpret_cast<const T*>(data.data() + entry.offset), entry.size / sizeof(T)};
+    }
+
+    /** Check that all chunks lie within the data section, and that each
+     *  continuation exists and belongs to at most one chain, so walking
+     *  the arrays neither reads out of bounds nor loops forever. */
+    template <class Chunk>
+    static void checkChunks(std::span<const Chunk> heads, std::span<const Chunk> continuations, size_t numData)
+    {
+        auto inBounds = [numData](Chunk const& chunk) {
+            auto used = std::min<uint64_t>(chunk.size, chunk.capacity);
+            return chunk.offset <= numData && used <= numData - chunk.offset;
+        };
+
+        std::vector<bool> linked(continuations.size());
+        for (auto const& head : heads) {
+            auto const* chunk = &head;
+            while (true) {
+                if (!inBounds(*chunk))
+                    raise<std::runtime_error>("Mapped ModelPool: Bad chunk bounds.");
+                auto next = chunk->next;
+                if (next == InvalidArrayIndex)
+                    break;
+                if (next < 0 || static_cast<size_t>(next) >= continuations.size() || linked[next])
+                    raise<std::runtime_error>("Mapped ModelPool: Bad chunk link.");
+                linked[next] = true;
+                chunk = &continuations[next];
+            }
+        }
+    }
+
+    template <class Arena>
+    static void setView(Arena& a, std::span<const std::byte> data, Header const& header, Section heads)
+    {
+        using Chunk = typename Arena::Chunk;
+        using Element = typename Arena::ElementType;
+        auto h = section<Chunk>(data, header, heads);
+        auto c = section<Chunk>(data, header, static_cast<Section>(heads + 1));
+        auto d = section<Element>(data, header, static_cast<Section>(heads + 2));
+        checkChunks(h, c, d.size());
+        a.clear();
+        a.view_ = {h.data(), h.size(), c.data(), c.size(), d.data(), d.size()};
+    }
+};
+
+/**
+ * Read `size` bytes from `in` into `out`. The buffer grows in bounded
+ * steps as data arrives, so a corrupt size from an untrusted header
+ * cannot request a huge allocation up front. Returns false if the
+ * stream ends first.
+ */
+inline bool readBytes(std::istream& in, uint64_t size, std::string& out)
+{
+    constexpr uint64_t Step = uint64_t(1) << 20;
+    out.clear();
+    while (out.size() < size) {
+        auto offset = out.size();
+        auto n = std::min<uint64_t>(size - offset, Step);
+        out.resize(offset + n);
+        in.read(out.data() + offset, static_cast<std::streamsize>(n));
+        if (static_cast<uint64_t>(in.gcount()) != n)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Compressed serialization format, see ModelPool::writeCompressed().
+ * A small header is followed by the size of the payload and the payload,
+ * so the reader decodes from memory. All integers are LEB128 varints,
+ * signed ones zigzag-coded.
+ */
+struct CompressedFormat
+{
+    static constexpr std::array<char, 8> Magic = {'S', 'I', 'M', 'F', 'I', 'L', 'C', 'Z'};
+    static constexpr std::array<char, 8> DeltaMagic = {'S', 'I', 'M', 'F', 'I', 'L', 'D', 'T'};
+    static constexpr uint32_t Version = 1;
+
+    struct Writer
+    {
+        std::string bytes;
+
+        void varint(uint64_t v) {
+            while (v >= 0x80) {
+                bytes.push_back(static_cast<char>(v | 0x80));
+                v >>= 7;
+            }
+            bytes.push_back(static_cast<char>(v));
+        }
+
+        void zigzag(int64_t v) {
+            varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+        }
+
+        /** Write the bytes of `v` which differ from `prev`, framed by a
+         *  byte with the number of equal leading and trailing bytes,
+         *  or a zero byte if `v` equals `prev`. */
+        void xorDouble(uint64_t v, uint64_t prev) {
+            auto x = v ^ prev;
+            if (x == 0) {
+                bytes.push_back(0);
+                return;
+            }
+            auto lead = std::countl_zero(x) / 8;
+            auto trail = std::countr_zero(x) / 8;
+            bytes.push_back(static_cast<char>(0x80 | (lead << 3) | trail));
+            for (auto i = trail; i < 8 - lead; ++i)
+                bytes.push_back(static_cast<char>(x >> (8 * i)));
+        }
+
+        /** Addresses are coded as their column, and the zigzag delta
+         *  to the previous index in the same column. */
+        void address(ModelNodeAddress a, std::array<uint32_t, 256>& prev) {
+            auto col = a.column();
+            bytes.push_back(static_cast<char>(col));
+            zigzag(static_cast<int64_t>(a.index()) - prev[col]);
+            prev[col] = a.index();
+        }
+    };
+
+    struct Reader
+    {
+        std::string_view bytes;
+        size_t pos = 0;
+
+        uint8_t byte() {
+            if (pos >= bytes.size())
+                raise<std::runtime_error>("Compressed ModelPool: Unexpected end of data.");
+            return static_cast<uint8_t>(bytes[pos++]);
+        }
+
+        uint64_t varint() {
+            uint64_t v = 0;
+            for (auto shift = 0; shift < 64; shift += 7) {
+                auto b = byte();
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return v;
+            }
+            raise<std::runtime_error>("Compressed ModelPool: Bad varint.");
+        }
+
+        int64_t zigzag() {
+            auto v = varint();
+            return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+        }
+
+        /** Read a count, which cannot exceed the remaining bytes. */
+        size_t count() {
+            auto n = varint();
+            if (n > bytes.size() - pos)
+                raise<std::runtime_error>("Compressed ModelPool: Bad element count.");
+            return static_cast<size_t>(n);
+        }
+
+        uint64_t xorDouble(uint64_t prev) {
+            auto frame = byte();
+            if (frame == 0)
+                return prev;
+            auto lead = (frame >> 3) & 0x7;
+            auto trail = frame & 0x7;
+            if (!(frame & 0x80) || lead + trail >= 8)
+                raise<std::runtime_error>("Compressed ModelPool: Bad double frame.");
+            uint64_t x = 0;
+            for (auto i = trail; i < 8 - lead; ++i)
+                x |= static_cast<uint64_t>(byte()) << (8 * i);
+            return prev ^ x;
+        }
+
+        ModelNodeAddress address(std::array<uint32_t, 256>& prev) {
+            auto col = byte();
+            auto index = static_cast<int64_t>(prev[col]) + zigzag();
+            if (index < 0 || index > 0xffffff)
+                raise<std::runtime_error>("Compressed ModelPool: Bad node address.");
+            prev[col] = static_cast<uint32_t>(index);
+            return {col, prev[col]};
+        }
+
+        StringId fieldName() {
+            auto name = varint();
+            if (name > StringPool::MaxId)
+                raise<std::runtime_error>("Compressed ModelPool: Bad field name.");
+            return static_cast<StringId>(name);
+        }
+
+        std::string_view raw(size_t n) {
+            if (n > bytes.size() - pos)
+                raise<std::runtime_error>("Compressed ModelPool: Unexpected end of data.");
+            auto result = bytes.substr(pos, n);
+            pos += n;
+            return result;
+        }
+    };
+
+    /** Write the arrays of an arena, starting at `from`, with `element` coding one member. */
+    template <class Arena, class Fn>
+    static void writeArena(Writer& w, Arena const& arena, size_t from, Fn&& element)
+    {
+        std::array<uint32_t, 256> prev{};
+        w.varint(arena.size() - from);
+        for (auto a = static_cast<ArrayIndex>(from); a < static_cast<ArrayIndex>(arena.size()); ++a) {
+            w.varint(arena.size(a));
+            // iterate() does not modify the arena, it just lacks a const overload.
+            const_cast<Arena&>(arena).iterate(a, [&](auto const& member) { element(member, prev); });
+        }
+    }
+
+    /** Read arrays and add them to the arena, with `element` appending one member. */
+    template <class Arena, class Fn>
+    static void readArena(Reader& r, Arena& arena, Fn&& element)
+    {
+        std::array<uint32_t, 256> prev{};
+        auto numArrays = r.count();
+        for (size_t i = 0; i < numArrays; ++i) {
+            auto size = r.count();
+            auto a = arena.new_array(size);
+            for (size_t j = 0; j < size; ++j)
+                element(a, prev);
+        }
+    }
+
+    /** Write the header, the size of the payload and the payload. */
+    static void writeHeader(std::ostream& out, std::array<char, 8> const& magic, Writer const& payload)
+    {
+        Writer header;
+        header.bytes.append(magic.data(), magic.size());
+        header.varint(Version);
+        header.varint(sizeof(StringId));
+        header.varint(payload.bytes.size());
+        out.write(header.bytes.data(), static_cast<std::streamsize>(header.bytes.size()));
+        out.write(payload.bytes.data(), static_cast<std::streamsize>(payload.bytes.size()));
+    }
+
+    /** Validate the header and read the payload. */
+    static std::string readPayload(std::istream& in, std::array<char, 8> const& expectedMagic)
+    {
+        std::array<char, 8> magic{};
+        in.read(magic.data(), magic.size());
+        if (!in || magic != expectedMagic)
+            raise<std::runtime_error>("Compressed ModelPool: Bad magic.");
+
+        /* The header varints are read byte by byte from the stream. */
+        auto headerVarint = [&in]() {
+            std::string bytes;
+            do {
+                auto c = in.get();
+                if (c == std::char_traits<char>::eof() || bytes.size() >= 10)
+                    raise<std::runtime_error>("Compressed ModelPool: Bad header.");
+                bytes.push_back(static_cast<char>(c));
+            } while (bytes.back() & 0x80);
+            return Reader{bytes}.varint();
+        };
+        auto version = headerVarint();
+        if (version != Version)
+            raise<std::runtime_error>(fmt::format("Compressed ModelPool: Unsupported version {}.", version));
+        auto stringIdSize = headerVarint();
+        if (stringIdSize != sizeof(StringId))
+            raise<std::runtime_error>(fmt::format("Compressed ModelPool: StringId size mismatch ({} != {}).", stringIdSize, sizeof(StringId)));
+
+        std::string payload;
+        if (!readBytes(in, headerVarint(), payload))
+            raise<std::runtime_error>("Compressed ModelPool: Unexpected end of data.");
+        return payload;
+    }
+};
+
+/**
+ * Chunked serialization format, see ModelPool::writeChunked(). The header
+ * holds a directory with the id, byte size and checksum of every column
+ * block, followed by the blocks in directory order. Each block is the
+ * bitsery encoding of one column, like in write(), so blocks are encoded
+ * and decoded independently. Header integers are LEB128 varints.
+ */
+struct ChunkedFormat
+{
+    static constexpr std::array<char, 8> Magic = {'S', 'I', 'M', 'F', 'I', 'L', 'C', 'K'};
+    static constexpr uint32_t Version = 1;
+
+    enum Column : uint32_t {
+        Roots,
+        Int64,
+        Double,
+        StringData,
+        StringRanges,
+        ObjectMembers,
+        ArrayMembers,
+        NumColumns
+    };
+
+    struct Block
+    {
+        uint32_t column = 0;
+        uint64_t checksum = 0;
+        std::string bytes;
+    };
+
+    /** 64-bit checksum, mixing eight bytes per step. */
+    static uint64_t checksum(std::string_view data)
+    {
+        constexpr uint64_t Prime = 0x9e3779b97f4a7c15ull;
+        uint64_t h = data.size() * Prime;
+        size_t i = 0;
+        for (; i + 8 <= data.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data.data() + i, 8);
+            h = std::rotl((h ^ word) * Prime, 31);
+        }
+        for (; i < data.size(); ++i)
+            h = (h ^ static_cast<uint8_t>(data[i])) * Prime;
+        return h ^ (h >> 29);
+    }
+
+    static void write(std::ostream& out, std::vector<Block> const& blocks)
+    {
+        CompressedFormat::Writer header;
+        header.bytes.append(Magic.data(), Magic.size());
+        header.varint(Version);
+        header.varint(sizeof(StringId));
+        header.varint(blocks.size());
+        for (auto const& block : blocks) {
+            header.varint(block.column);
+            header.varint(block.bytes.size());
+            header.varint(block.checksum);
+        }
+        out.write(header.bytes.data(), static_cast<std::streamsize>(header.bytes.size()));
+        for (auto const& block : blocks)
+            out.write(block.bytes.data(), static_cast<std::streamsize>(block.bytes.size()));
+    }
+
+    /** Read the directory and the blocks. Checksums are verified by the caller. */
+    static std::vector<Block> read(std::istream& in)
+    {
+        std::array<char, 8> magic{};
+        in.read(magic.data(), magic.size());
+        if (!in || magic != Magic)
+            raise<std::runtime_error>("Chunked ModelPool: Bad magic.");
+
+        auto varint = [&in]() {
+            std::string bytes;
+            do {
+                auto c = in.get();
+                if (c == std::char_traits<char>::eof() || bytes.size() >= 10)
+                    raise<std::runtime_error>("Chunked ModelPool: Bad header.");
+                bytes.push_back(static_cast<char>(c));
+            } while (bytes.back() & 0x80);
+            return CompressedFormat::Reader{bytes}.varint();
+        };
+        auto version = varint();
+        if (version != Version)
+            raise<std::runtime_error>(fmt::format("Chunked ModelPool: Unsupported version {}.", version));
+        auto stringIdSize = varint();
+        if (stringIdSize != sizeof(StringId))
+            raise<std::runtime_error>(fmt::format("Chunked ModelPool: StringId size mismatch ({} != {}).", stringIdSize, sizeof(StringId)));
+
+        auto numBlocks = varint();
+        if (numBlocks > NumColumns)
+            raise<std::runtime_error>("Chunked ModelPool: Bad column count.");
+        std::vector<Block> blocks(numBlocks);
+        std::vector<uint64_t> sizes(numBlocks);
+        std::array<bool, NumColumns> seen{};
+        for (auto i = 0u; i < numBlocks; ++i) {
+            auto column = varint();
+            if (column >= NumColumns)
+                raise<std::runtime_error>(fmt::format("Chunked ModelPool: Unknown column {}.", column));
+            /* Blocks are decoded concurrently, each into its own column */
+            if (seen[column])
+                raise<std::runtime_error>(fmt::format("Chunked ModelPool: Duplicate column {}.", column));
+            seen[column] = true;
+            blocks[i].column = static_cast<uint32_t>(column);
+            sizes[i] = varint();
+            blocks[i].checksum = varint();
+        }
+        for (auto i = 0u; i < numBlocks; ++i) {
+            if (!readBytes(in, sizes[i], blocks[i].bytes))
+                raise<std::runtime_error>("Chunked ModelPool: Unexpected end of data.");
+        }
+        return blocks;
+    }
+
+    /**
+     * Call `fn(i)` for `i < n` on up to `threads` threads, and rethrow
+     * the first exception.
+     */
+    template <class Fn>
+    static void parallel(size_t n, size_t threads, Fn&& fn)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        threads = std::clamp<size_t>(threads, 1, std::max<size_t>(n, 1));
+
+        std::atomic_size_t next = 0;
+        std::vector<std::exception_ptr> errors(threads);
+        auto work = [&](size_t w) {
+            try {
+                for (auto i = next++; i < n; i = next++)
+                    fn(i);
+            } catch (...) {
+                errors[w] = std::current_exception();
+                next = n;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (auto w = 1u; w < threads; ++w)
+            workers.emplace_back(work, w);
+        work(0);
+        for (auto& worker : workers)
+            worker.join();
+        for (auto const& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    }
+};
+
+}
+
+ModelConstPtr Model::modelFor(ModelNode const& n) const
+{
+    if (n.model_.get() == this)
+        return n.model_;
+    return shared_from_this();
+}
+
+void Model::setColumnType(uint8_t column, ValueType type)
+{
+    if (!columnTypes_ || columnTypes_.use_count() > 1) {
+        auto types = std::make_shared<std::array<ValueType, 256>>();
+        if (columnTypes_)
+            *types = *columnTypes_;
+        else
+            types->fill(ValueType::Undef);
+        columnTypes_ = std::move(types);
+    }
+    (*columnTypes_)[column] = type;
+}
+
 void Model::resolve(const ModelNode& n, const ResolveFn& cb) const
 {
     switch (n.addr_.column()) {
         case Null:
-            cb(ModelNodeBase(shared_from_this()));
+            cb(ModelNodeBase(modelFor(n)));
             break;
         case UInt16:
-            cb(SmallValueNode<uint16_t>(shared_from_this(), n.addr_));
+            cb(SmallValueNode<uint16_t>(modelFor(n), n.addr_));
             break;
         case Int16:
-            cb(SmallValueNode<int16_t>(shared_from_this(), n.addr_));
+            cb(SmallValueNode<int16_t>(modelFor(n), n.addr_));
             break;
         case Bool:
-            cb(SmallValueNode<bool>(shared_from_this(), n.addr_));
+            cb(SmallValueNode<bool>(modelFor(n), n.addr_));
             break;
         case Scalar:
             cb(ValueNode(n));
@@ -63,7 +680,29 @@ struct ModelPool::Impl
     /// This model pool's field name store
     std::shared_ptr<StringPool> strings_;
 
-    struct {
+    /// Set if the columns are a read-only view onto external memory,
+    /// see readMapped(). The arenas hold their own views.
+    struct Mapping {
+        std::shared_ptr<const void> owner_;
+        std::span<const ModelNodeAddress> roots_;
+        std::span<const int64_t> i64_;
+        std::span<const double> double_;
+        std::string_view stringData_;
+        std::span<const StringRange> strings_;
+    };
+    std::optional<Mapping> mapping_;
+
+    /// Set by compact().
+    bool frozen_ = false;
+
+    void ensureWritable() const {
+        if (mapping_)
+            raise<std::runtime_error>("Cannot modify a memory-mapped ModelPool.");
+        if (frozen_)
+            raise<std::runtime_error>("Cannot modify a compacted ModelPool.");
+    }
+
+    struct Columns {
         sfl::segmented_vector<ModelNodeAddress, detail::ColumnPageSize> roots_;
         sfl::segmented_vector<int64_t, detail::ColumnPageSize> i64_;
         sfl::segmented_vector<double, detail::ColumnPageSize> double_;
@@ -75,29 +714,322 @@ struct ModelPool::Impl
         Array::Storage arrayMemberArrays_;
     } columns_;
 
+    /// Table from the ids of `from` to the ids of the same strings in `to`,
+    /// which are inserted if needed. Ids which `from` cannot resolve are kept.
+    static std::vector<StringId> translateNames(StringPool const& from, StringPool& to) {
+        std::vector<StringId> names(static_cast<size_t>(from.highest()) + 1);
+        for (size_t id = 0; id < names.size(); ++id) {
+            auto str = from.resolve(static_cast<StringId>(id));
+            names[id] = str ? to.emplace(*str) : static_cast<StringId>(id);
+        }
+        return names;
+    }
+
+    /// Append scalar values, shared by newValue() and ModelBuilder.
+    ModelNodeAddress addInt(int64_t value) {
+        if (value < 0 && value >= std::numeric_limits<int16_t>::min())
+            return {Int16, (uint32_t)(int16_t)value};
+        if (value >= 0 && value <= std::numeric_limits<uint16_t>::max())
+            return {UInt16, (uint32_t)value};
+        ensureWritable();
+        columns_.i64_.emplace_back(value);
+        return {Int64, (uint32_t)columns_.i64_.size()-1};
+    }
+
+    ModelNodeAddress addDouble(double value) {
+        ensureWritable();
+        columns_.double_.emplace_back(value);
+        return {Double, (uint32_t)columns_.double_.size()-1};
+    }
+
+    ModelNodeAddress addString(std::string_view value) {
+        ensureWritable();
+        if (stringValues_) {
+            if (auto it = stringValues_->find(value); it != stringValues_->end())
+                return {String, *it};
+        }
+
+        columns_.strings_.emplace_back(StringRange{
+            (uint32_t)columns_.stringData_.size(),
+            (uint32_t)value.size()
+        });
+        columns_.stringData_ += value;
+        auto index = (uint32_t)columns_.strings_.size()-1;
+        if (stringValues_)
+            stringValues_->insert(index);
+        return {String, index};
+    }
+
+    /// Packed field index for wide objects, see buildFieldIndex().
+    /// Not serialized - it is derived from objectMemberArrays_.
+    struct FieldIndexRange {
+        uint32_t offset_ = 0;
+        uint32_t size_ = 0;
+        uint32_t sortedOffset_ = 0;
+    };
+
+    struct {
+        uint32_t minFields_ = 0;
+        std::vector<FieldIndexRange> ranges_;
+        std::vector<StringId> names_;
+        std::vector<ModelNodeAddress> nodes_;
+        /// Sorted names of objects above FieldIndexScanMaxFields,
+        /// with their positions in the object.
+        std::vector<StringId> sortedNames_;
+        std::vector<uint32_t> sortedSlots_;
+    } fieldIndex_;
+
+    /// Set of String column indices, hashed by their content,
+    /// see setStringDeduplication(). Not serialized.
+    struct StringValueHash {
+        using is_transparent = void;
+        Impl const* impl_;
+        size_t operator()(std::string_view const& str) const { return std::hash<std::string_view>{}(str); }
+        size_t operator()(uint32_t index) const { return (*this)(impl_->stringValue(index)); }
+    };
+
+    struct StringValueEqual {
+        using is_transparent = void;
+        Impl const* impl_;
+        template<typename L, typename R>
+        bool operator()(L const& lhs, R const& rhs) const { return value(lhs) == value(rhs); }
+        std::string_view value(std::string_view const& str) const { return str; }
+        std::string_view value(uint32_t index) const { return impl_->stringValue(index); }
+    };
+
+    using StringValueSet = std::unordered_set<uint32_t, StringValueHash, StringValueEqual>;
+    std::unique_ptr<StringValueSet> stringValues_;
+
+    /// Secondary indexes by normalized path, see addIndex(). Declared
+    /// indexes which were not built yet are null. Not serialized.
+    std::map<std::string, std::unique_ptr<ValueIndex>, std::less<>> valueIndexes_;
+
+    /// Build all declared secondary indexes.
+    void buildValueIndexes(ModelPool const& pool) {
+        for (auto& [path, index] : valueIndexes_)
+            index = std::make_unique<ValueIndex>(pool, path);
+    }
+
+    /// Bloom filter of the field names below a root, see setFieldFilters().
+    struct FieldFilter {
+        std::array<uint64_t, 4> bits_{};
+
+        /// Two bit positions per name, taken from a multiplicative hash.
+        static std::pair<uint32_t, uint32_t> positions(StringId name) {
+            auto h = static_cast<uint32_t>(name) * 2654435761u;
+            return {h >> 24, (h >> 16) & 0xff};
+        }
+
+        void add(StringId name) {
+            auto [a, b] = positions(name);
+            bits_[a / 64] |= uint64_t(1) << (a % 64);
+            bits_[b / 64] |= uint64_t(1) << (b % 64);
+        }
+
+        [[nodiscard]] bool mayContain(StringId name) const {
+            auto [a, b] = positions(name);
+            return (bits_[a / 64] >> (a % 64) & 1) && (bits_[b / 64] >> (b % 64) & 1);
+        }
+    };
+
+    /// Field filters by root address, if enabled. Not serialized.
+    bool fieldFiltersEnabled_ = false;
+    std::unordered_map<uint32_t, FieldFilter> fieldFilters_;
+
+    /// Build the field filters of all roots, if enabled.
+    void buildFieldFilters() {
+        fieldFilters_.clear();
+        if (!fieldFiltersEnabled_)
+            return;
+
+        auto const numRoots = mapping_ ? mapping_->roots_.size() : columns_.roots_.size();
+        std::vector<ModelNodeAddress> stack;
+        for (size_t i = 0; i < numRoots; ++i) {
+            auto root = mapping_ ? mapping_->roots_[i] : columns_.roots_[i];
+            auto& filter = fieldFilters_[root.value_];
+            stack.assign(1, root);
+            while (!stack.empty()) {
+                auto addr = stack.back();
+                stack.pop_back();
+                // Mapped buffers are not validated yet, so skip bad indices.
+                if (addr.column() == Objects && addr.index() < columns_.objectMemberArrays_.size()) {
+                    columns_.objectMemberArrays_.iterate((ArrayIndex)addr.index(), [&](auto&& member) {
+                        filter.add(member.name_);
+                        stack.push_back(member.node_);
+                        return true;
+                    });
+                }
+                else if (addr.column() == Arrays && addr.index() < columns_.arrayMemberArrays_.size()) {
+                    columns_.arrayMemberArrays_.iterate((ArrayIndex)addr.index(), [&](auto&& member) {
+                        stack.push_back(member);
+                        return true;
+                    });
+                }
+                else if (addr.column() >= FirstCustomColumnId) {
+                    // Custom nodes may have any field.
+                    filter.bits_.fill(~uint64_t(0));
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] std::string_view stringValue(uint32_t index) const {
+        auto const& range = columns_.strings_[index];
+        return std::string_view(columns_.stringData_).substr(range.offset_, range.length_);
+    }
+
+    /// (Re-)index all strings, if deduplication is enabled.
+    void indexStringValues() {
+        if (!stringValues_)
+            return;
+        stringValues_->clear();
+        for (uint32_t i = 0; i < columns_.strings_.size(); ++i)
+            stringValues_->insert(i);
+    }
+
+    /**
+     * Write the column entries, roots and arrays which were added after
+     * the checkpoint, in the compressed format. Members which were added
+     * to arrays of the checkpoint are not covered, see writeDelta().
+     */
+    void writeColumns(detail::CompressedFormat::Writer& w, Checkpoint const& from) const {
+        std::array<uint32_t, 256> prevAddress{};
+        w.varint(columns_.roots_.size() - from.roots_);
+        for (auto i = from.roots_; i < columns_.roots_.size(); ++i)
+            w.address(columns_.roots_[i], prevAddress);
+
+        int64_t prevInt = 0;
+        w.varint(columns_.i64_.size() - from.i64_);
+        for (auto i = from.i64_; i < columns_.i64_.size(); ++i) {
+            auto value = columns_.i64_[i];
+            w.zigzag(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(prevInt)));
+            prevInt = value;
+        }
+
+        uint64_t prevDouble = 0;
+        w.varint(columns_.double_.size() - from.double_);
+        for (auto i = from.double_; i < columns_.double_.size(); ++i) {
+            auto bits = std::bit_cast<uint64_t>(columns_.double_[i]);
+            w.xorDouble(bits, prevDouble);
+            prevDouble = bits;
+        }
+
+        /* Ranges usually follow each other, so their offset delta is zero. */
+        auto end = static_cast<int64_t>(from.stringData_);
+        w.varint(columns_.strings_.size() - from.strings_);
+        for (auto i = from.strings_; i < columns_.strings_.size(); ++i) {
+            auto const& range = columns_.strings_[i];
+            w.varint(range.length_);
+            w.zigzag(static_cast<int64_t>(range.offset_) - end);
+            end = static_cast<int64_t>(range.offset_) + range.length_;
+        }
+        w.varint(columns_.stringData_.size() - from.stringData_);
+        w.bytes.append(columns_.stringData_, from.stringData_);
+
+        detail::CompressedFormat::writeArena(w, columns_.objectMemberArrays_, from.objectSizes_.size(), [&w](auto const& field, auto& prev) {
+            w.varint(field.name_);
+            w.address(field.node_, prev);
+        });
+        detail::CompressedFormat::writeArena(w, columns_.arrayMemberArrays_, from.arraySizes_.size(), [&w](auto const& node, auto& prev) {
+            w.address(node, prev);
+        });
+    }
+
+    /** Append the entries written by writeColumns() to `columns`, e.g. to
+     *  staging columns. String offsets start at `stringBase` plus the size
+     *  of the string data of `columns`. */
+    static void readColumns(detail::CompressedFormat::Reader& r, Columns& columns, size_t stringBase = 0) {
+        std::array<uint32_t, 256> prevAddress{};
+        for (auto n = r.count(); n > 0; --n)
+            columns.roots_.emplace_back(r.address(prevAddress));
+
+        uint64_t prevInt = 0;
+        for (auto n = r.count(); n > 0; --n) {
+            prevInt += static_cast<uint64_t>(r.zigzag());
+            columns.i64_.emplace_back(static_cast<int64_t>(prevInt));
+        }
+
+        uint64_t prevDouble = 0;
+        for (auto n = r.count(); n > 0; --n) {
+            prevDouble = r.xorDouble(prevDouble);
+            columns.double_.emplace_back(std::bit_cast<double>(prevDouble));
+        }
+
+        auto firstString = columns.strings_.size();
+        auto end = static_cast<int64_t>(stringBase + columns.stringData_.size());
+        for (auto n = r.count(); n > 0; --n) {
+            auto length = r.varint();
+            auto offset = end + r.zigzag();
+            if (offset < 0 || length > UINT32_MAX || offset + length > UINT32_MAX)
+                raise<std::runtime_error>("Compressed ModelPool: Bad string range.");
+            columns.strings_.emplace_back(StringRange{static_cast<uint32_t>(offset), static_cast<uint32_t>(length)});
+            end = offset + static_cast<int64_t>(length);
+        }
+        columns.stringData_ += r.raw(r.count());
+        for (auto i = firstString; i < columns.strings_.size(); ++i) {
+            auto const& range = columns.strings_[i];
+            if (static_cast<size_t>(range.offset_) + range.length_ > stringBase + columns.stringData_.size())
+                raise<std::runtime_error>("Compressed ModelPool: Bad string range.");
+        }
+
+        detail::CompressedFormat::readArena(r, columns.objectMemberArrays_, [&](ArrayIndex a, auto& prev) {
+            auto name = r.fieldName();  // Arguments are evaluated in any order.
+            columns.objectMemberArrays_.emplace_back(a, name, r.address(prev));
+        });
+        detail::CompressedFormat::readArena(r, columns.arrayMemberArrays_, [&](ArrayIndex a, auto& prev) {
+            columns.arrayMemberArrays_.emplace_back(a, r.address(prev));
+        });
+    }
+
     template<typename S>
     void readWrite(S& s) {
-        constexpr size_t maxColumnSize = std::numeric_limits<uint32_t>::max();
+        for (uint32_t c = 0; c < detail::ChunkedFormat::NumColumns; ++c)
+            readWriteColumn(s, static_cast<detail::ChunkedFormat::Column>(c));
+    }
 
-        s.container(columns_.roots_, maxColumnSize);
+    /// Serialize a single column, in the order of readWrite().
+    template<typename S>
+    void readWriteColumn(S& s, detail::ChunkedFormat::Column column) {
+        readWriteColumn(s, columns_, column);
+    }
 
-        s.container(columns_.i64_, maxColumnSize);
-        s.container(columns_.double_, maxColumnSize);
-        s.text1b(columns_.stringData_, maxColumnSize);
-        s.container(columns_.strings_, maxColumnSize);
+    /// Serialize a single column of `columns`, e.g. of staging columns.
+    template<typename S>
+    static void readWriteColumn(S& s, Columns& columns, detail::ChunkedFormat::Column column) {
+        using Column = detail::ChunkedFormat::Column;
+        constexpr size_t maxColumnSize = std::numeric_limits<uint32_t>::max();
 
-        s.ext(columns_.objectMemberArrays_, bitsery::ext::ArrayArenaExt{});
-        s.ext(columns_.arrayMemberArrays_, bitsery::ext::ArrayArenaExt{});
+        switch (column) {
+        case Column::Roots: s.container(columns.roots_, maxColumnSize); break;
+        case Column::Int64: s.container(columns.i64_, maxColumnSize); break;
+        case Column::Double: s.container(columns.double_, maxColumnSize); break;
+        case Column::StringData: s.text1b(columns.stringData_, maxColumnSize); break;
+        case Column::StringRanges: s.container(columns.strings_, maxColumnSize); break;
+        case Column::ObjectMembers: s.ext(columns.objectMemberArrays_, bitsery::ext::ArrayArenaExt{}); break;
+        case Column::ArrayMembers: s.ext(columns.arrayMemberArrays_, bitsery::ext::ArrayArenaExt{}); break;
+        case Column::NumColumns: break;
+        }
     }
 };
 
 ModelPool::ModelPool()
-    : impl_(std::make_unique<ModelPool::Impl>(std::make_shared<StringPool>()))
+    : ModelPool(std::make_shared<StringPool>())
 {}
 
 ModelPool::ModelPool(std::shared_ptr<StringPool> stringStore)
     : impl_(std::make_unique<ModelPool::Impl>(std::move(stringStore)))
-{}
+{
+    // Scalar nodes carry their own type, custom columns are up to derived pools.
+    setColumnType(Null, ValueType::Null);
+    setColumnType(UInt16, ValueType::Int);
+    setColumnType(Int16, ValueType::Int);
+    setColumnType(Bool, ValueType::Bool);
+    setColumnType(Objects, ValueType::Object);
+    setColumnType(Arrays, ValueType::Array);
+    setColumnType(Int64, ValueType::Int);
+    setColumnType(Double, ValueType::Float);
+    setColumnType(String, ValueType::String);
+}
 
 ModelPool::~ModelPool()  // NOLINT
 {}
@@ -187,68 +1119,271 @@ void ModelPool::clear()
     clear_and_shrink(columns.stringData_);
     clear_and_shrink(columns.objectMemberArrays_);
     clear_and_shrink(columns.arrayMemberArrays_);
+
+    clear_and_shrink(impl_->fieldIndex_.ranges_);
+    clear_and_shrink(impl_->fieldIndex_.names_);
+    clear_and_shrink(impl_->fieldIndex_.nodes_);
+    clear_and_shrink(impl_->fieldIndex_.sortedNames_);
+    clear_and_shrink(impl_->fieldIndex_.sortedSlots_);
+
+    impl_->mapping_.reset();
+    impl_->frozen_ = false;
+    impl_->indexStringValues();
+    for (auto& [_, index] : impl_->valueIndexes_)
+        index.reset();
+    impl_->fieldFilters_.clear();
 }
 
 void ModelPool::resolve(ModelNode const& n, ResolveFn const& cb) const
 {
-    auto get = [&n](auto const& vec) -> auto& {
-        auto idx = n.addr_.index();
-        if (idx >= vec.size())
-            raise<std::runtime_error>(
-                fmt::format(
-                    "Bad node reference: col={}, i={}",
-                    (uint16_t)n.addr_.column(), idx
-                ));
-        return vec[idx];
-    };
-
     switch (n.addr_.column()) {
     case Objects: {
-        cb(Object(shared_from_this(), n.addr_));
+        cb(Object(modelFor(n), n.addr_));
         break;
     }
     case Arrays: {
-        cb(Array(shared_from_this(), n.addr_));
+        cb(Array(modelFor(n), n.addr_));
         break;
     }
-    case Int64: {
-        auto& val = get(impl_->columns_.i64_);
-        cb(ValueNode(val, shared_from_this()));
+    case Int64:
+    case Double:
+    case String: {
+        cb(ValueNode(valueOf(n.addr_), modelFor(n)));
         break;
     }
-    case Double: {
-        auto& val = get(impl_->columns_.double_);
-        cb(ValueNode(val, shared_from_this()));
-        break;
+    default: Model::resolve(n, cb);
     }
+}
+
+ModelPool const* ModelPool::native(ModelNode const& n)
+{
+    auto const* model = n.model_.get();
+    if (!model || typeid(*model) != typeid(ModelPool))
+        return nullptr;
+    if (n.addr_.column() == Scalar || n.addr_.column() >= FirstCustomColumnId)
+        return nullptr;
+    return static_cast<ModelPool const*>(model);
+}
+
+ValueType ModelPool::typeOf(ModelNodeAddress a) const
+{
+    switch (a.column()) {
+    case Null: return ValueType::Null;
+    case UInt16:
+    case Int16: return ValueType::Int;
+    case Bool: return ValueType::Bool;
+    /* Scalar nodes carry their value, which an address alone does not. */
+    case Scalar: return ValueType::Null;
+    case Objects: return ValueType::Object;
+    case Arrays: return ValueType::Array;
+    case Int64: return ValueType::Int;
+    case Double: return ValueType::Float;
+    case String: return ValueType::String;
+    default:
+        raise<std::runtime_error>(fmt::format("Bad column reference: col={}", (uint16_t)a.column()));
+    }
+}
+
+ScalarValueType ModelPool::valueOf(ModelNodeAddress a) const
+{
+    auto get = [&a](auto const& vec) -> auto& {
+        auto idx = a.index();
+        if (idx >= vec.size())
+            raise<std::runtime_error>(
+                fmt::format(
+                    "Bad node reference: col={}, i={}",
+                    (uint16_t)a.column(), idx
+                ));
+        return vec[idx];
+    };
+
+    auto& mapping = impl_->mapping_;
+    switch (a.column()) {
+    case UInt16: return static_cast<int64_t>(a.uint16());
+    case Int16: return static_cast<int64_t>(a.int16());
+    case Bool: return a.uint16() != 0;
+    case Int64: return mapping ? get(mapping->i64_) : get(impl_->columns_.i64_);
+    case Double: return mapping ? get(mapping->double_) : get(impl_->columns_.double_);
     case String: {
-        auto& val = get(impl_->columns_.strings_);
-        cb(ValueNode(
-            // TODO: Make sure that the string view is not turned into a string here.
-            std::string_view(impl_->columns_.stringData_).substr(val.offset_, val.length_),
-            shared_from_this()));
-        break;
+        auto& val = mapping ? get(mapping->strings_) : get(impl_->columns_.strings_);
+        auto data = mapping ? mapping->stringData_ : std::string_view(impl_->columns_.stringData_);
+        return data.substr(val.offset_, val.length_);
     }
-    default: Model::resolve(n, cb);
+    default: return {};
+    }
+}
+
+bool ModelPool::intsOf(std::span<const ModelNodeAddress> addrs, int64_t* out) const
+{
+    auto read = [&](auto const& i64) {
+        for (auto i = 0u; i < addrs.size(); ++i) {
+            auto a = addrs[i];
+            switch (a.column()) {
+            case UInt16: out[i] = a.uint16(); break;
+            case Int16: out[i] = a.int16(); break;
+            case Int64:
+                if (a.index() >= i64.size())
+                    return false;
+                out[i] = i64[a.index()];
+                break;
+            default: return false;
+            }
+        }
+        return true;
+    };
+
+    if (auto& mapping = impl_->mapping_)
+        return read(mapping->i64_);
+    return read(impl_->columns_.i64_);
+}
+
+bool ModelPool::floatsOf(std::span<const ModelNodeAddress> addrs, double* out) const
+{
+    auto read = [&](auto const& doubles) {
+        for (auto i = 0u; i < addrs.size(); ++i) {
+            auto a = addrs[i];
+            if (a.column() != Double || a.index() >= doubles.size())
+                return false;
+            out[i] = doubles[a.index()];
+        }
+        return true;
+    };
+
+    if (auto& mapping = impl_->mapping_)
+        return read(mapping->double_);
+    return read(impl_->columns_.double_);
+}
+
+uint32_t ModelPool::sizeOf(ModelNodeAddress a) const
+{
+    switch (a.column()) {
+    case Objects: return (uint32_t)impl_->columns_.objectMemberArrays_.size((ArrayIndex)a.index());
+    case Arrays: return (uint32_t)impl_->columns_.arrayMemberArrays_.size((ArrayIndex)a.index());
+    default: return 0;
     }
 }
 
+ModelNodeAddress ModelPool::fieldOf(ModelNodeAddress object, StringId name) const
+{
+    if (object.column() != Objects)
+        return {};
+
+    auto members = (ArrayIndex)object.index();
+    auto& storage = impl_->columns_.objectMemberArrays_;
+    if (auto indexed = indexedFields(members, storage.size(members)); !indexed.names_.empty()) {
+        auto i = indexed.find(name);
+        if (i == indexed.names_.size())
+            return {};
+        return indexed.nodes_[i];
+    }
+
+    ModelNodeAddress result;
+    storage.iterate(members, [&](auto&& member) {
+        if (member.name_ == name) {
+            result = member.node_;
+            return false;
+        }
+        return true;
+    });
+    return result;
+}
+
 size_t ModelPool::numRoots() const {
+    if (impl_->mapping_)
+        return impl_->mapping_->roots_.size();
     return impl_->columns_.roots_.size();
 }
 
 ModelNode::Ptr ModelPool::root(size_t const& i) const {
-    if ((i < 0) || (i >= impl_->columns_.roots_.size()))
+    if ((i < 0) || (i >= numRoots()))
         raise<std::runtime_error>("Root index does not exist.");
+    if (impl_->mapping_)
+        return ModelNode(shared_from_this(), impl_->mapping_->roots_[i]);
     return ModelNode(shared_from_this(), impl_->columns_.roots_.at(i));
 }
 
 void ModelPool::addRoot(ModelNode::Ptr const& rootNode) {
+    impl_->ensureWritable();
     impl_->columns_.roots_.emplace_back(rootNode->addr_);
 }
 
+void ModelPool::buildFieldIndex(uint32_t minFields)
+{
+    auto& index = impl_->fieldIndex_;
+    auto& members = impl_->columns_.objectMemberArrays_;
+
+    index.minFields_ = std::max<uint32_t>(minFields, 1);
+    index.ranges_.clear();
+    index.names_.clear();
+    index.nodes_.clear();
+    index.sortedNames_.clear();
+    index.sortedSlots_.clear();
+
+    std::vector<uint32_t> slots;
+    for (ArrayIndex i = 0; i < static_cast<ArrayIndex>(members.size()); ++i) {
+        auto size = members.size(i);
+        if (size < index.minFields_)
+            continue;
+
+        if (index.ranges_.size() <= static_cast<size_t>(i))
+            index.ranges_.resize(members.size());
+
+        auto offset = (uint32_t)index.names_.size();
+        index.ranges_[i] = {offset, size, (uint32_t)index.sortedNames_.size()};
+        members.iterate(i, [&](auto&& member) {
+            index.names_.push_back(member.name_);
+            index.nodes_.push_back(member.node_);
+        });
+        if (size <= FieldIndexScanMaxFields)
+            continue;
+
+        // Stable, so duplicate names still yield the first inserted field.
+        slots.resize(size);
+        for (uint32_t slot = 0; slot < size; ++slot)
+            slots[slot] = slot;
+        std::stable_sort(slots.begin(), slots.end(), [&](auto l, auto r) {
+            return index.names_[offset + l] < index.names_[offset + r];
+        });
+        for (auto slot : slots) {
+            index.sortedNames_.push_back(index.names_[offset + slot]);
+            index.sortedSlots_.push_back(slot);
+        }
+    }
+}
+
+size_t ModelPool::IndexedFields::find(StringId name) const
+{
+    if (sortedNames_.empty())
+        return simd::findStringId(names_, name);
+
+    auto it = std::lower_bound(sortedNames_.begin(), sortedNames_.end(), name);
+    if (it == sortedNames_.end() || *it != name)
+        return names_.size();
+    return sortedSlots_[it - sortedNames_.begin()];
+}
+
+ModelPool::IndexedFields ModelPool::indexedFields(ArrayIndex members, uint32_t size) const
+{
+    auto const& index = impl_->fieldIndex_;
+    if (size < index.minFields_ || members < 0 || static_cast<size_t>(members) >= index.ranges_.size())
+        return {};
+
+    auto const& range = index.ranges_[members];
+    if (range.size_ != size)
+        return {};
+    IndexedFields result{
+        {index.names_.data() + range.offset_, range.size_},
+        {index.nodes_.data() + range.offset_, range.size_}};
+    if (range.size_ > FieldIndexScanMaxFields) {
+        result.sortedNames_ = {index.sortedNames_.data() + range.sortedOffset_, range.size_};
+        result.sortedSlots_ = {index.sortedSlots_.data() + range.sortedOffset_, range.size_};
+    }
+    return result;
+}
+
 model_ptr<Object> ModelPool::newObject(size_t initialFieldCapacity)
 {
+    impl_->ensureWritable();
     auto memberArrId = impl_->columns_.objectMemberArrays_.new_array(initialFieldCapacity);
     return Object(
         shared_from_this(),
@@ -257,6 +1392,7 @@ model_ptr<Object> ModelPool::newObject(size_t initialFieldCapacity)
 
 model_ptr<Array> ModelPool::newArray(size_t initialFieldCapacity)
 {
+    impl_->ensureWritable();
     auto memberArrId = impl_->columns_.arrayMemberArrays_.new_array(initialFieldCapacity);
     return Array(
         shared_from_this(),
@@ -283,43 +1419,168 @@ std::optional<std::string_view> Model::lookupStringId(const StringId) const
     return {};
 }
 
+void Model::prefetch(std::span<const ModelNode::Ptr>) const
+{}
+
 ModelNode::Ptr ModelPool::newValue(int64_t const& value)
 {
-    if (value < 0 && value >= std::numeric_limits<int16_t>::min())
-        return newSmallValue((int16_t)value);
-    else if (value >= 0 && value <= std::numeric_limits<uint16_t>::max())
-        return newSmallValue((uint16_t)value);
-    impl_->columns_.i64_.emplace_back(value);
-    return ModelNode(shared_from_this(), {Int64, (uint32_t)impl_->columns_.i64_.size()-1});
+    return ModelNode(shared_from_this(), impl_->addInt(value));
 }
 
 ModelNode::Ptr ModelPool::newValue(double const& value)
 {
-    impl_->columns_.double_.emplace_back(value);
-    return ModelNode(shared_from_this(), {Double, (uint32_t)impl_->columns_.double_.size()-1});
+    return ModelNode(shared_from_this(), impl_->addDouble(value));
 }
 
 ModelNode::Ptr ModelPool::newValue(std::string_view const& value)
 {
-    impl_->columns_.strings_.emplace_back(Impl::StringRange{
-        (uint32_t)impl_->columns_.stringData_.size(),
-        (uint32_t)value.size()
+    return ModelNode(shared_from_this(), impl_->addString(value));
+}
+
+ModelBuilder::ModelBuilder(ModelPool& pool) : pool_(pool)
+{}
+
+void ModelBuilder::reserve(Capacity const& capacity)
+{
+    auto& impl = *pool_.impl_;
+    impl.ensureWritable();
+    auto& columns = impl.columns_;
+    columns.roots_.reserve(columns.roots_.size() + capacity.roots_);
+    columns.i64_.reserve(columns.i64_.size() + capacity.ints_);
+    columns.double_.reserve(columns.double_.size() + capacity.doubles_);
+    columns.strings_.reserve(columns.strings_.size() + capacity.strings_);
+    columns.stringData_.reserve(columns.stringData_.size() + capacity.stringBytes_);
+    columns.objectMemberArrays_.reserve(capacity.objects_, capacity.fields_);
+    columns.arrayMemberArrays_.reserve(capacity.arrays_, capacity.elements_);
+}
+
+StringId ModelBuilder::name(std::string_view const& name)
+{
+    return pool_.impl_->strings_->emplace(name);
+}
+
+ModelNodeAddress ModelBuilder::null() const
+{
+    return {Model::Null, 0};
+}
+
+ModelNodeAddress ModelBuilder::value(bool value)
+{
+    return {Model::Bool, (uint32_t)value};
+}
+
+ModelNodeAddress ModelBuilder::value(int64_t value)
+{
+    return pool_.impl_->addInt(value);
+}
+
+ModelNodeAddress ModelBuilder::value(double value)
+{
+    return pool_.impl_->addDouble(value);
+}
+
+ModelNodeAddress ModelBuilder::value(std::string_view const& value)
+{
+    return pool_.impl_->addString(value);
+}
+
+ModelNodeAddress ModelBuilder::object(std::span<const Field> fields)
+{
+    auto& impl = *pool_.impl_;
+    impl.ensureWritable();
+    auto members = impl.columns_.objectMemberArrays_.new_array(fields.size(), [&](auto& member, size_t i) {
+        member.name_ = fields[i].name_;
+        member.node_ = fields[i].node_;
     });
-    impl_->columns_.stringData_ += value;
-    return ModelNode(shared_from_this(), {String, (uint32_t)impl_->columns_.strings_.size()-1});
+    return {ModelPool::Objects, (uint32_t)members};
+}
+
+ModelNodeAddress ModelBuilder::array(std::span<const ModelNodeAddress> elements)
+{
+    auto& impl = *pool_.impl_;
+    impl.ensureWritable();
+    auto members = impl.columns_.arrayMemberArrays_.new_array(elements.size(), [&](auto& member, size_t i) {
+        member = elements[i];
+    });
+    return {ModelPool::Arrays, (uint32_t)members};
+}
+
+void ModelBuilder::addRoot(ModelNodeAddress node)
+{
+    pool_.impl_->ensureWritable();
+    pool_.impl_->columns_.roots_.emplace_back(node);
+}
+
+ModelNode::Ptr ModelBuilder::node(ModelNodeAddress address) const
+{
+    return ModelNode(pool_.shared_from_this(), address);
+}
+
+void ModelPool::setStringDeduplication(bool enabled)
+{
+    if (!enabled) {
+        impl_->stringValues_.reset();
+        return;
+    }
+    if (impl_->stringValues_)
+        return;
+    impl_->stringValues_ = std::make_unique<Impl::StringValueSet>(
+        0, Impl::StringValueHash{impl_.get()}, Impl::StringValueEqual{impl_.get()});
+    impl_->indexStringValues();
+}
+
+bool ModelPool::stringDeduplication() const
+{
+    return impl_->stringValues_ != nullptr;
+}
+
+ModelPool const* ModelPool::of(ModelNode const& n)
+{
+    return dynamic_cast<ModelPool const*>(n.model_.get());
+}
+
+void ModelPool::addIndex(std::string_view path)
+{
+    auto [it, _] = impl_->valueIndexes_.try_emplace(ValueIndex::normalizePath(path));
+    if (isReadOnly())
+        it->second = std::make_unique<ValueIndex>(*this, it->first);
+}
+
+ValueIndex const* ModelPool::index(std::string_view path) const
+{
+    auto it = impl_->valueIndexes_.find(path);
+    return it != impl_->valueIndexes_.end() ? it->second.get() : nullptr;
+}
+
+void ModelPool::setFieldFilters(bool enabled)
+{
+    impl_->fieldFiltersEnabled_ = enabled;
+    if (!enabled || isReadOnly())
+        impl_->buildFieldFilters();
+}
+
+bool ModelPool::fieldFilters() const
+{
+    return impl_->fieldFiltersEnabled_;
+}
+
+bool ModelPool::mayContainField(ModelNodeAddress root, StringId name) const
+{
+    auto it = impl_->fieldFilters_.find(root.value_);
+    return it == impl_->fieldFilters_.end() || it->second.mayContain(name);
 }
 
 model_ptr<Object> ModelPool::resolveObject(const ModelNode::Ptr& n) const {
     if (n->addr_.column() != Objects)
         raise<std::runtime_error>("Cannot cast this node to an object.");
-    return Object(shared_from_this(), n->addr_);
+    return Object(modelFor(*n), n->addr_);
 }
 
 model_ptr<Array> ModelPool::resolveArray(ModelNode::Ptr const& n) const
 {
     if (n->addr_.column() != Arrays)
         raise<std::runtime_error>("Cannot cast this node to an array.");
-    return Array(shared_from_this(), n->addr_);
+    return Array(modelFor(*n), n->addr_);
 }
 
 std::shared_ptr<StringPool> ModelPool::strings() const
@@ -333,17 +1594,124 @@ void ModelPool::setStrings(std::shared_ptr<StringPool> const& strings)
         raise<std::runtime_error>("Attempt to call ModelPool::setStrings(nullptr)!");
 
     auto oldStrings = impl_->strings_;
+    if (oldStrings && *strings != *oldStrings)
+        impl_->ensureWritable();
+
     impl_->strings_ = strings;
     if (!oldStrings || *strings == *oldStrings)
         return;
 
     // Translate object field IDs to the new dictionary.
+    auto names = Impl::translateNames(*oldStrings, *strings);
     for (auto memberArray : impl_->columns_.objectMemberArrays_) {
         for (auto& member : memberArray) {
-            if (auto resolvedName = oldStrings->resolve(member.name_))
-                member.name_ = strings->emplace(*resolvedName);
+            if (member.name_ < names.size())
+                member.name_ = names[member.name_];
         }
     }
+
+    // The field index still holds the old IDs.
+    if (impl_->fieldIndex_.minFields_)
+        buildFieldIndex(impl_->fieldIndex_.minFields_);
+}
+
+size_t ModelPool::merge(ModelPool const& other)
+{
+    impl_->ensureWritable();
+    if (&other == this)
+        raise<std::runtime_error>("Cannot merge a ModelPool into itself.");
+    if (other.impl_->mapping_)
+        raise<std::runtime_error>("Cannot merge a memory-mapped ModelPool.");
+
+    auto& columns = impl_->columns_;
+    auto const& from = other.impl_->columns_;
+
+    // Node indices are 24 bits wide.
+    constexpr size_t MaxIndex = 0xffffff;
+    const std::pair<size_t, size_t> sizes[] = {
+        {columns.i64_.size(), from.i64_.size()},
+        {columns.double_.size(), from.double_.size()},
+        {columns.strings_.size(), from.strings_.size()},
+        {columns.objectMemberArrays_.size(), from.objectMemberArrays_.size()},
+        {columns.arrayMemberArrays_.size(), from.arrayMemberArrays_.size()}};
+    for (auto [size, added] : sizes) {
+        if (size + added > MaxIndex)
+            raise<std::runtime_error>("ModelPool merge: Too many nodes.");
+    }
+
+    const auto i64Offset = (uint32_t)columns.i64_.size();
+    const auto doubleOffset = (uint32_t)columns.double_.size();
+    const auto stringOffset = (uint32_t)columns.strings_.size();
+    const auto objectOffset = (uint32_t)columns.objectMemberArrays_.size();
+    const auto arrayOffset = (uint32_t)columns.arrayMemberArrays_.size();
+    const auto dataOffset = (uint32_t)columns.stringData_.size();
+    const auto firstRoot = columns.roots_.size();
+
+    auto relocate = [&](ModelNodeAddress a) -> ModelNodeAddress {
+        switch (a.column()) {
+        case Null:
+        case UInt16:
+        case Int16:
+        case Bool:
+        case Scalar: return a;
+        case Int64: return {Int64, a.index() + i64Offset};
+        case Double: return {Double, a.index() + doubleOffset};
+        case String: return {String, a.index() + stringOffset};
+        case Objects: return {Objects, a.index() + objectOffset};
+        case Arrays: return {Arrays, a.index() + arrayOffset};
+        default:
+            raise<std::runtime_error>(fmt::format("ModelPool merge: Cannot relocate column {}.", (uint16_t)a.column()));
+        }
+    };
+
+    // Field names are translated by table, unless the pools share their strings.
+    std::vector<StringId> names;
+    if (impl_->strings_ != other.impl_->strings_)
+        names = Impl::translateNames(*other.impl_->strings_, *impl_->strings_);
+    auto translate = [&names](StringId name) {
+        return names.empty() || name >= names.size() ? name : names[name];
+    };
+
+    columns.i64_.insert(columns.i64_.end(), from.i64_.begin(), from.i64_.end());
+    columns.double_.insert(columns.double_.end(), from.double_.begin(), from.double_.end());
+    columns.stringData_ += from.stringData_;
+    for (auto const& range : from.strings_)
+        columns.strings_.emplace_back(Impl::StringRange{range.offset_ + dataOffset, range.length_});
+    if (impl_->stringValues_) {
+        for (auto i = (size_t)stringOffset; i < columns.strings_.size(); ++i)
+            impl_->stringValues_->insert(static_cast<uint32_t>(i));
+    }
+
+    // Members are gathered first, so each array is created as one chunk.
+    // iterate() does not modify the arenas, it just lacks a const overload.
+    auto& fromObjects = const_cast<Object::Storage&>(from.objectMemberArrays_);
+    std::vector<std::pair<StringId, ModelNodeAddress>> fields;
+    for (ArrayIndex a = 0; a < (ArrayIndex)fromObjects.size(); ++a) {
+        fields.clear();
+        fromObjects.iterate(a, [&](auto const& field) {
+            fields.emplace_back(translate(field.name_), relocate(field.node_));
+        });
+        columns.objectMemberArrays_.new_array(fields.size(), [&](auto& field, size_t i) {
+            field.name_ = fields[i].first;
+            field.node_ = fields[i].second;
+        });
+    }
+
+    auto& fromArrays = const_cast<Array::Storage&>(from.arrayMemberArrays_);
+    std::vector<ModelNodeAddress> elements;
+    for (ArrayIndex a = 0; a < (ArrayIndex)fromArrays.size(); ++a) {
+        elements.clear();
+        fromArrays.iterate(a, [&](auto const& element) {
+            elements.push_back(relocate(element));
+        });
+        columns.arrayMemberArrays_.new_array(elements.size(), [&](auto& element, size_t i) {
+            element = elements[i];
+        });
+    }
+
+    for (auto const& root : from.roots_)
+        columns.roots_.emplace_back(relocate(root));
+    return firstRoot;
 }
 
 std::optional<std::string_view> ModelPool::lookupStringId(const StringId id) const
@@ -360,11 +1728,15 @@ Array::Storage& ModelPool::arrayMemberStorage() {
 }
 
 void ModelPool::write(std::ostream& outputStream) {
+    if (impl_->mapping_)
+        raise<std::runtime_error>("Cannot write a memory-mapped ModelPool, use writeMapped().");
     bitsery::Serializer<bitsery::OutputStreamAdapter> s(outputStream);
     impl_->readWrite(s);
 }
 
 void ModelPool::read(std::istream& inputStream) {
+    if (isReadOnly())
+        clear();
     bitsery::Deserializer<bitsery::InputStreamAdapter> s(inputStream);
     impl_->readWrite(s);
     if (s.adapter().error() != bitsery::ReaderError::NoError) {
@@ -372,6 +1744,357 @@ void ModelPool::read(std::istream& inputStream) {
             "Failed to read ModelPool: Error {}",
             static_cast<std::underlying_type_t<bitsery::ReaderError>>(s.adapter().error())));
     }
+    impl_->indexStringValues();
+    buildFieldIndex(impl_->fieldIndex_.minFields_ ? impl_->fieldIndex_.minFields_ : FieldIndexMinFields);
+}
+
+void ModelPool::writeCompressed(std::ostream& outputStream) const
+{
+    using Format = detail::CompressedFormat;
+    if (impl_->mapping_)
+        raise<std::runtime_error>("Cannot write a memory-mapped ModelPool, use writeMapped().");
+
+    Format::Writer w;
+    impl_->writeColumns(w, Checkpoint{});
+    Format::writeHeader(outputStream, Format::Magic, w);
+}
+
+void ModelPool::readCompressed(std::istream& inputStream)
+{
+    using Format = detail::CompressedFormat;
+    auto payload = Format::readPayload(inputStream, Format::Magic);
+
+    /* Decode into staging columns, so a corrupt stream leaves the pool as it was */
+    Impl::Columns staging;
+    Format::Reader r{payload};
+    Impl::readColumns(r, staging);
+
+    clear();
+    impl_->columns_ = std::move(staging);
+    impl_->indexStringValues();
+    buildFieldIndex(impl_->fieldIndex_.minFields_ ? impl_->fieldIndex_.minFields_ : FieldIndexMinFields);
+}
+
+void ModelPool::writeChunked(std::ostream& outputStream, size_t threads)
+{
+    using Format = detail::ChunkedFormat;
+    if (impl_->mapping_)
+        raise<std::runtime_error>("Cannot write a memory-mapped ModelPool, use writeMapped().");
+
+    std::vector<Format::Block> blocks(Format::NumColumns);
+    Format::parallel(blocks.size(), threads, [&](size_t i) {
+        auto& block = blocks[i];
+        block.column = static_cast<uint32_t>(i);
+
+        bitsery::Serializer<bitsery::OutputBufferAdapter<std::string>> s(block.bytes);
+        impl_->readWriteColumn(s, static_cast<Format::Column>(i));
+        s.adapter().flush();
+        block.bytes.resize(s.adapter().writtenBytesCount());
+        block.checksum = Format::checksum(block.bytes);
+    });
+    Format::write(outputStream, blocks);
+}
+
+void ModelPool::readChunked(std::istream& inputStream, size_t threads)
+{
+    using Format = detail::ChunkedFormat;
+    auto blocks = Format::read(inputStream);
+
+    /* Decode into staging columns, so a corrupt stream leaves the pool as it was */
+    Impl::Columns staging;
+    Format::parallel(blocks.size(), threads, [&](size_t i) {
+        auto const& block = blocks[i];
+        if (Format::checksum(block.bytes) != block.checksum)
+            raise<std::runtime_error>(fmt::format("Chunked ModelPool: Checksum mismatch in column {}.", block.column));
+
+        bitsery::Deserializer<bitsery::InputBufferAdapter<std::string>> s(block.bytes.begin(), block.bytes.size());
+        Impl::readWriteColumn(s, staging, static_cast<Format::Column>(block.column));
+        if (s.adapter().error() != bitsery::ReaderError::NoError || !s.adapter().isCompletedSuccessfully()) {
+            raise<std::runtime_error>(fmt::format(
+                "Chunked ModelPool: Failed to read column {}: Error {}", block.column,
+                static_cast<std::underlying_type_t<bitsery::ReaderError>>(s.adapter().error())));
+        }
+    });
+
+    clear();
+    impl_->columns_ = std::move(staging);
+    impl_->indexStringValues();
+    buildFieldIndex(impl_->fieldIndex_.minFields_ ? impl_->fieldIndex_.minFields_ : FieldIndexMinFields);
+}
+
+ModelPool::Checkpoint ModelPool::checkpoint() const
+{
+    auto const& columns = impl_->columns_;
+    Checkpoint result;
+    result.roots_ = numRoots();
+    result.i64_ = columns.i64_.size();
+    result.double_ = columns.double_.size();
+    result.strings_ = columns.strings_.size();
+    result.stringData_ = columns.stringData_.size();
+    result.highestString_ = impl_->strings_->highest();
+
+    auto sizes = [](auto const& arena, auto& out) {
+        out.resize(arena.size());
+        for (ArrayIndex a = 0; a < static_cast<ArrayIndex>(arena.size()); ++a)
+            out[a] = arena.size(a);
+    };
+    sizes(columns.objectMemberArrays_, result.objectSizes_);
+    sizes(columns.arrayMemberArrays_, result.arraySizes_);
+    return result;
+}
+
+void ModelPool::writeDelta(std::ostream& outputStream, Checkpoint const& since) const
+{
+    using Format = detail::CompressedFormat;
+    if (impl_->mapping_)
+        raise<std::runtime_error>("Cannot write a delta of a memory-mapped ModelPool.");
+
+    auto const& columns = impl_->columns_;
+    if (columns.roots_.size() < since.roots_ ||
+        columns.i64_.size() < since.i64_ ||
+        columns.double_.size() < since.double_ ||
+        columns.strings_.size() < since.strings_ ||
+        columns.stringData_.size() < since.stringData_ ||
+        columns.objectMemberArrays_.size() < since.objectSizes_.size() ||
+        columns.arrayMemberArrays_.size() < since.arraySizes_.size())
+        raise<std::runtime_error>("ModelPool delta: The checkpoint is ahead of the pool.");
+
+    Format::Writer w;
+    for (auto n : {since.roots_, since.i64_, since.double_, since.strings_, since.stringData_,
+                   since.objectSizes_.size(), since.arraySizes_.size()})
+        w.varint(n);
+
+    /* Members which were appended to arrays of the checkpoint. */
+    auto writeGrown = [&w](auto const& arena, std::vector<uint32_t> const& sizes, auto&& element) {
+        std::vector<ArrayIndex> grown;
+        for (ArrayIndex a = 0; a < static_cast<ArrayIndex>(sizes.size()); ++a) {
+            if (arena.size(a) < sizes[a])
+                raise<std::runtime_error>("ModelPool delta: The checkpoint is ahead of the pool.");
+            if (arena.size(a) > sizes[a])
+                grown.push_back(a);
+        }
+
+        std::array<uint32_t, 256> prev{};
+        w.varint(grown.size());
+        for (auto a : grown) {
+            w.varint(a);
+            w.varint(sizes[a]);
+            w.varint(arena.size(a) - sizes[a]);
+            // iterate() does not modify the arena, it just lacks a const overload.
+            const_cast<std::decay_t<decltype(arena)>&>(arena).iterate(a, [&](auto const& member, size_t i) {
+                if (i >= sizes[a])
+                    element(member, prev);
+            });
+        }
+    };
+    writeGrown(columns.objectMemberArrays_, since.objectSizes_, [&w](auto const& field, auto& prev) {
+        w.varint(field.name_);
+        w.address(field.node_, prev);
+    });
+    writeGrown(columns.arrayMemberArrays_, since.arraySizes_, [&w](auto const& node, auto& prev) {
+        w.address(node, prev);
+    });
+
+    impl_->writeColumns(w, since);
+    Format::writeHeader(outputStream, Format::DeltaMagic, w);
+}
+
+void ModelPool::readDelta(std::istream& inputStream)
+{
+    using Format = detail::CompressedFormat;
+    impl_->ensureWritable();
+    auto payload = Format::readPayload(inputStream, Format::DeltaMagic);
+
+    auto& columns = impl_->columns_;
+    Format::Reader r{payload};
+    for (auto n : {columns.roots_.size(), columns.i64_.size(), columns.double_.size(),
+                   columns.strings_.size(), columns.stringData_.size(),
+                   columns.objectMemberArrays_.size(), columns.arrayMemberArrays_.size()}) {
+        if (r.varint() != n)
+            raise<std::runtime_error>("ModelPool delta: The pool does not match the checkpoint of the delta.");
+    }
+
+    /* Read the whole delta into staging storage before modifying the pool,
+     * so a delta which does not match or is truncated leaves it as it was.
+     * Grown arrays are written in ascending order. */
+    auto readGrown = [&r](auto const& arena, auto&& element) {
+        std::array<uint32_t, 256> prev{};
+        std::optional<uint64_t> last;
+        for (auto n = r.count(); n > 0; --n) {
+            auto a = r.varint();
+            auto size = r.varint();
+            if (a >= arena.size() || arena.size(static_cast<ArrayIndex>(a)) != size || (last && a <= *last))
+                raise<std::runtime_error>("ModelPool delta: The pool does not match the checkpoint of the delta.");
+            last = a;
+            for (auto count = r.count(); count > 0; --count)
+                element(static_cast<ArrayIndex>(a), prev);
+        }
+    };
+    std::vector<std::pair<ArrayIndex, Object::Storage::ElementType>> grownObjects;
+    readGrown(columns.objectMemberArrays_, [&](ArrayIndex a, auto& prev) {
+        auto name = r.fieldName();  // Arguments are evaluated in any order.
+        grownObjects.emplace_back(a, Object::Storage::ElementType(name, r.address(prev)));
+    });
+    std::vector<std::pair<ArrayIndex, ModelNodeAddress>> grownArrays;
+    readGrown(columns.arrayMemberArrays_, [&](ArrayIndex a, auto& prev) {
+        grownArrays.emplace_back(a, r.address(prev));
+    });
+    Impl::Columns added;
+    Impl::readColumns(r, added, columns.stringData_.size());
+
+    for (auto const& [a, field] : grownObjects)
+        columns.objectMemberArrays_.push_back(a, field);
+    for (auto const& [a, member] : grownArrays)
+        columns.arrayMemberArrays_.push_back(a, member);
+
+    auto append = [](auto& to, auto const& from) {
+        for (auto const& value : from)
+            to.push_back(value);
+    };
+    auto stringSize = columns.strings_.size();
+    append(columns.roots_, added.roots_);
+    append(columns.i64_, added.i64_);
+    append(columns.double_, added.double_);
+    append(columns.strings_, added.strings_);
+    columns.stringData_ += added.stringData_;
+
+    /* New arrays keep their indices, as they are appended in order */
+    auto appendArrays = [](auto& to, auto const& from) {
+        for (ArrayIndex a = 0; a < static_cast<ArrayIndex>(from.size()); ++a) {
+            to.new_array(from.size(a), [&](auto& member, size_t i) {
+                member = from.at(a, i);
+            });
+        }
+    };
+    appendArrays(columns.objectMemberArrays_, added.objectMemberArrays_);
+    appendArrays(columns.arrayMemberArrays_, added.arrayMemberArrays_);
+
+    if (impl_->stringValues_) {
+        for (auto i = stringSize; i < columns.strings_.size(); ++i)
+            impl_->stringValues_->insert(static_cast<uint32_t>(i));
+    }
+}
+
+void ModelPool::writeMapped(std::ostream& outputStream) const
+{
+    using Format = detail::MappedFormat;
+    auto const& columns = impl_->columns_;
+    auto const& mapping = impl_->mapping_;
+
+    auto column = [&mapping](auto const& owned, auto member) {
+        return mapping ? Format::column((*mapping).*member) : Format::column(owned);
+    };
+
+    auto objects = Format::arena(columns.objectMemberArrays_);
+    auto arrays = Format::arena(columns.arrayMemberArrays_);
+    Format::write(outputStream, {
+        column(columns.roots_, &Impl::Mapping::roots_),
+        column(columns.i64_, &Impl::Mapping::i64_),
+        column(columns.double_, &Impl::Mapping::double_),
+        column(columns.stringData_, &Impl::Mapping::stringData_),
+        column(columns.strings_, &Impl::Mapping::strings_),
+        objects[0], objects[1], objects[2],
+        arrays[0], arrays[1], arrays[2],
+    });
+}
+
+void ModelPool::readMapped(std::shared_ptr<const void> owner, std::span<const std::byte> data)
+{
+    using Format = detail::MappedFormat;
+    auto header = Format::read(data);
+
+    auto chars = Format::section<char>(data, header, Format::StringData);
+    Impl::Mapping mapping{
+        std::move(owner),
+        Format::section<ModelNodeAddress>(data, header, Format::Roots),
+        Format::section<int64_t>(data, header, Format::Int64),
+        Format::section<double>(data, header, Format::Double),
+        std::string_view(chars.data(), chars.size()),
+        Format::section<Impl::StringRange>(data, header, Format::StringRanges),
+    };
+
+    clear();
+    Format::setView(impl_->columns_.objectMemberArrays_, data, header, Format::ObjectHeads);
+    Format::setView(impl_->columns_.arrayMemberArrays_, data, header, Format::ArrayHeads);
+    impl_->fieldIndex_ = {};
+    impl_->mapping_ = std::move(mapping);
+    impl_->buildValueIndexes(*this);
+    impl_->buildFieldFilters();
+}
+
+void ModelPool::readMapped(std::string const& path)
+{
+#if defined(_WIN32)
+    // No mmap here - read the file into an owned buffer instead, which
+    // still avoids all decoding.
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        raise<std::runtime_error>(fmt::format("Failed to open {}", path));
+    auto size = std::filesystem::file_size(path);
+    auto buffer = std::make_shared<std::vector<std::byte>>(size);
+    file.read(reinterpret_cast<char*>(buffer->data()), static_cast<std::streamsize>(size));
+    if (!file)
+        raise<std::runtime_error>(fmt::format("Failed to read {}", path));
+    readMapped(buffer, *buffer);
+#else
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        raise<std::runtime_error>(fmt::format("Failed to open {}", path));
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        raise<std::runtime_error>(fmt::format("Failed to map {}: Bad file size", path));
+    }
+
+    auto size = static_cast<size_t>(info.st_size);
+    auto* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        raise<std::runtime_error>(fmt::format("Failed to map {}", path));
+
+    std::shared_ptr<const void> owner(addr, [size](const void* p) {
+        ::munmap(const_cast<void*>(p), size);
+    });
+    readMapped(owner, {static_cast<const std::byte*>(addr), size});
+#endif
+}
+
+bool ModelPool::isMapped() const
+{
+    return impl_->mapping_.has_value();
+}
+
+void ModelPool::compact()
+{
+    if (isReadOnly())
+        return;
+
+    auto& columns = impl_->columns_;
+    columns.roots_.shrink_to_fit();
+    columns.i64_.shrink_to_fit();
+    columns.double_.shrink_to_fit();
+    columns.stringData_.shrink_to_fit();
+    columns.strings_.shrink_to_fit();
+    columns.objectMemberArrays_.compact();
+    columns.arrayMemberArrays_.compact();
+
+    // The index holds copies of the fields, which are unaffected by compaction.
+    auto& index = impl_->fieldIndex_;
+    index.ranges_.shrink_to_fit();
+    index.names_.shrink_to_fit();
+    index.nodes_.shrink_to_fit();
+    index.sortedNames_.shrink_to_fit();
+    index.sortedSlots_.shrink_to_fit();
+
+    impl_->frozen_ = true;
+    impl_->buildValueIndexes(*this);
+    impl_->buildFieldFilters();
+}
+
+bool ModelPool::isReadOnly() const
+{
+    return impl_->frozen_ || impl_->mapping_.has_value();
 }
 
 #if defined(SIMFIL_WITH_MODEL_JSON)
@@ -254,38 +254,56 @@ ModelNode::Ptr Object::get(std::string_view const& fieldName) const {
 }
 
 Object& Object::addBool(std::string_view const& name, bool value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newSmallValue(value)->addr());
+    return addBool(model().strings()->emplace(name), value);
+}
+
+Object& Object::addBool(StringId name, bool value) {
+    storage_->emplace_back(members_, name, model().newSmallValue(value)->addr());
     return *this;
 }
 
 Object& Object::addField(std::string_view const& name, uint16_t value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newSmallValue(value)->addr());
+    return addField(model().strings()->emplace(name), value);
+}
+
+Object& Object::addField(StringId name, uint16_t value) {
+    storage_->emplace_back(members_, name, model().newSmallValue(value)->addr());
     return *this;
 }
 
 Object& Object::addField(std::string_view const& name, int16_t value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newSmallValue(value)->addr());
+    return addField(model().strings()->emplace(name), value);
+}
+
+Object& Object::addField(StringId name, int16_t value) {
+    storage_->emplace_back(members_, name, model().newSmallValue(value)->addr());
     return *this;
 }
 
 Object& Object::addField(std::string_view const& name, int64_t const& value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newValue(value)->addr());
+    return addField(model().strings()->emplace(name), value);
+}
+
+Object& Object::addField(StringId name, int64_t const& value) {
+    storage_->emplace_back(members_, name, model().newValue(value)->addr());
     return *this;
 }
 
 Object& Object::addField(std::string_view const& name, double const& value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newValue(value)->addr());
+    return addField(model().strings()->emplace(name), value);
+}
+
+Object& Object::addField(StringId name, double const& value) {
+    storage_->emplace_back(members_, name, model().newValue(value)->addr());
     return *this;
 }
 
 Object& Object::addField(std::string_view const& name, std::string_view const& value) {
-    auto fieldId = model().strings()->emplace(name);
-    storage_->emplace_back(members_, fieldId, model().newValue(value)->addr());
+    return addField(model().strings()->emplace(name), value);
+}
+
+Object& Object::addField(StringId name, std::string_view const& value) {
+    storage_->emplace_back(members_, name, model().newValue(value)->addr());
     return *this;
 }
 
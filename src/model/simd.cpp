@@ -0,0 +1,156 @@
+#include "simfil/model/simd.h"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define SIMFIL_SIMD_X64
+#  include <immintrin.h>
+#  if defined(__GNUC__) || defined(__clang__)
+#    define SIMFIL_SIMD_AVX2
+#  endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  define SIMFIL_SIMD_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace simfil::simd
+{
+
+namespace
+{
+
+static_assert(sizeof(StringId) == 2 || sizeof(StringId) == 4,
+              "The SIMD kernels compare 16- or 32-bit lanes.");
+
+/* Number of StringIds per 128-bit register */
+constexpr size_t Lanes128 = 16 / sizeof(StringId);
+
+size_t findScalar(const StringId* ids, size_t n, StringId id)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (ids[i] == id)
+            return i;
+    return n;
+}
+
+#if defined(SIMFIL_SIMD_X64)
+size_t findSSE2(const StringId* ids, size_t n, StringId id)
+{
+#if defined(SIMFIL_WIDE_STRING_ID)
+    const auto key = _mm_set1_epi32(static_cast<int>(id));
+#else
+    const auto key = _mm_set1_epi16(static_cast<short>(id));
+#endif
+
+    size_t i = 0;
+    for (; i + Lanes128 <= n; i += Lanes128) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i));
+#if defined(SIMFIL_WIDE_STRING_ID)
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi32(block, key)));
+#else
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(block, key)));
+#endif
+        /* One mask bit per byte of a lane */
+        if (mask)
+            return i + std::countr_zero(mask) / sizeof(StringId);
+    }
+    return i + findScalar(ids + i, n - i, id);
+}
+#endif
+
+#if defined(SIMFIL_SIMD_AVX2)
+__attribute__((target("avx2")))
+size_t findAVX2(const StringId* ids, size_t n, StringId id)
+{
+#if defined(SIMFIL_WIDE_STRING_ID)
+    const auto key = _mm256_set1_epi32(static_cast<int>(id));
+#else
+    const auto key = _mm256_set1_epi16(static_cast<short>(id));
+#endif
+
+    size_t i = 0;
+    for (; i + 2 * Lanes128 <= n; i += 2 * Lanes128) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+#if defined(SIMFIL_WIDE_STRING_ID)
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi32(block, key)));
+#else
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, key)));
+#endif
+        if (mask)
+            return i + std::countr_zero(mask) / sizeof(StringId);
+    }
+    return i + findSSE2(ids + i, n - i, id);
+}
+#endif
+
+#if defined(SIMFIL_SIMD_NEON)
+size_t findNEON(const StringId* ids, size_t n, StringId id)
+{
+    size_t i = 0;
+#if defined(SIMFIL_WIDE_STRING_ID)
+    const auto key = vdupq_n_u32(id);
+    for (; i + Lanes128 <= n; i += Lanes128) {
+        auto eq = vceqq_u32(vld1q_u32(ids + i), key);
+        /* Narrow each 32-bit lane to 16 bits, so the mask fits a 64-bit
+         * scalar with two bytes per lane. */
+        auto mask = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(eq)), 0);
+        if (mask)
+            return i + std::countr_zero(mask) / 16;
+    }
+#else
+    const auto key = vdupq_n_u16(id);
+    for (; i + Lanes128 <= n; i += Lanes128) {
+        auto eq = vceqq_u16(vld1q_u16(ids + i), key);
+        /* Narrow each 16-bit lane to 8 bits, so the mask fits a 64-bit
+         * scalar with one byte per lane. */
+        auto mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(eq)), 0);
+        if (mask)
+            return i + std::countr_zero(mask) / 8;
+    }
+#endif
+    return i + findScalar(ids + i, n - i, id);
+}
+#endif
+
+using FindFn = size_t (*)(const StringId*, size_t, StringId);
+
+struct Kernel
+{
+    FindFn fn;
+    const char* name;
+};
+
+Kernel selectKernel()
+{
+#if defined(SIMFIL_SIMD_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        return {findAVX2, "avx2"};
+#endif
+#if defined(SIMFIL_SIMD_X64)
+    return {findSSE2, "sse2"};
+#elif defined(SIMFIL_SIMD_NEON)
+    return {findNEON, "neon"};
+#else
+    return {findScalar, "scalar"};
+#endif
+}
+
+const Kernel& kernel()
+{
+    static const Kernel selected = selectKernel();
+    return selected;
+}
+
+}
+
+size_t findStringId(std::span<const StringId> ids, StringId id)
+{
+    return kernel().fn(ids.data(), ids.size(), id);
+}
+
+const char* findStringIdKernel()
+{
+    return kernel().name;
+}
+
+}
@@ -8,8 +8,10 @@
 #include <algorithm>
 #include <cmath>
 #include <mutex>
+#include <thread>
+#include <cassert>
 #include <stdexcept>
-#include <locale>
+#include <cstring>
 
 /**
  * Note: This code is taken from bitsery traits/string.h and adopted
@@ -42,8 +44,76 @@ struct TextTraits<std::basic_string_view<CharT, Traits>>
 namespace simfil
 {
 
+namespace
+{
+constexpr size_t InitialHashTableCapacity = 256;
+constexpr size_t InitialIdTableCapacity = 256;
+constexpr size_t StringBlockSize = 64 * 1024;
+
+constexpr uint64_t repeatByte(uint8_t b)
+{
+    return 0x0101010101010101ULL * b;
+}
+
+// Lower-case the ASCII letters of eight bytes at once. Other bytes,
+// including those >= 0x80, are left as they are.
+uint64_t foldCase(uint64_t word)
+{
+    const auto heptets = word & repeatByte(0x7f);
+    const auto aboveZ = heptets + repeatByte(0x7f - 'Z');
+    const auto fromA = heptets + repeatByte(0x80 - 'A');
+    const auto upper = ~word & (fromA ^ aboveZ) & repeatByte(0x80);
+    return word | (upper >> 2);
+}
+
+// Load up to eight bytes, zero-padded.
+uint64_t loadWord(const char* data, size_t n)
+{
+    uint64_t word = 0;
+    std::memcpy(&word, data, n);
+    return word;
+}
+}
+
+void detail::StripedCounter::increment()
+{
+    static thread_local const size_t stripe =
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) % Stripes;
+    stripes_[stripe].value.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t detail::StripedCounter::load() const
+{
+    int64_t sum = 0;
+    for (const auto& stripe : stripes_)
+        sum += stripe.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void detail::StripedCounter::store(int64_t value)
+{
+    for (auto& stripe : stripes_)
+        stripe.value.store(0, std::memory_order_relaxed);
+    stripes_[0].value.store(value, std::memory_order_relaxed);
+}
+
+StringPool::HashTable::HashTable(size_t capacity)
+    : mask(capacity - 1)
+    , slots(std::make_unique<std::atomic<const Entry*>[]>(capacity))
+{
+    assert((capacity & mask) == 0 && "Capacity must be a power of two");
+}
+
+StringPool::IdTable::IdTable(size_t capacity)
+    : capacity(capacity)
+    , slots(std::make_unique<std::atomic<const Entry*>[]>(capacity))
+{}
+
 StringPool::StringPool()
 {
+    hashTable_ = hashTables_.emplace_back(std::make_unique<HashTable>(InitialHashTableCapacity)).get();
+    idTable_ = idTables_.emplace_back(std::make_unique<IdTable>(InitialIdTableCapacity)).get();
+
     addStaticKey(Empty, "");
     addStaticKey(OverlaySum, "$sum");
     addStaticKey(OverlayValue, "$val");
@@ -52,108 +122,154 @@ StringPool::StringPool()
 
 StringPool::StringPool(const StringPool& other)
 {
-    std::unique_lock lockThis(stringStoreMutex_, std::defer_lock);
-    std::shared_lock lockOther(other.stringStoreMutex_, std::defer_lock);
-    std::lock(lockThis, lockOther);
+    std::unique_lock lock(other.writeMutex_);
 
-    // Copy storedStrings_.
-    storedStrings_ = other.storedStrings_;
+    hashTable_ = hashTables_.emplace_back(std::make_unique<HashTable>(other.hashTable_.load()->mask + 1)).get();
+    idTable_ = idTables_.emplace_back(std::make_unique<IdTable>(other.idTable_.load()->capacity)).get();
 
-    // Map from old string data pointer to new string_view.
-    std::unordered_map<const char*, std::string_view> strDataToNewStrView;
+    // Re-insert the entries in their original order, with their ids. The id
+    // table of `other` tells which entry owns an id, if there are several.
+    for (const auto& entry : other.entries_)
+        insert(entry.str, entry.id, entry.hash);
 
-    // Build the mapping from old string data pointers to new string_views.
-    for (size_t i = 0; i < other.storedStrings_.size(); ++i) {
-        strDataToNewStrView[other.storedStrings_[i].data()] = storedStrings_[i];
+    nextId_ = other.nextId_.load();
+    byteSize_ = other.byteSize_.load();
+    cacheHits_.store(other.cacheHits_.load());
+    cacheMisses_.store(other.cacheMisses_.load());
+    generation_ = other.generation_.load();
+}
+
+const StringPool::Entry* StringPool::find(std::string_view const& str, size_t hash) const
+{
+    static const detail::CaseInsensitiveEqual equal;
+
+    const auto* table = hashTable_.load(std::memory_order_acquire);
+    for (auto i = hash & table->mask;; i = (i + 1) & table->mask) {
+        const auto* entry = table->slots[i].load(std::memory_order_acquire);
+        if (!entry)
+            return nullptr;
+        if (entry->hash == hash && equal(entry->str, str))
+            return entry;
     }
+}
 
-    // Rebuild idForString_ with new string_views pointing into this->storedStrings_.
-    idForString_.clear();
-    for (const auto& [oldStrView, id] : other.idForString_) {
-        // Get the new string_view corresponding to the old string data pointer.
-        auto it = strDataToNewStrView.find(oldStrView.data());
-        if (it != strDataToNewStrView.end()) {
-            idForString_.emplace(it->second, id);
-        }
-        else {
-            // This should not happen if everything is consistent.
-            raise<std::runtime_error>("Failed to rebuild idForString_ in StringPool copy constructor");
+StringId StringPool::insert(std::string_view const& str, StringId id, size_t hash)
+{
+    auto* table = hashTable_.load(std::memory_order_relaxed);
+
+    // Keep the load factor below 1/2, so probe sequences stay short.
+    if ((table->count.load(std::memory_order_relaxed) + 1) * 2 > table->mask + 1) {
+        auto& grown = hashTables_.emplace_back(std::make_unique<HashTable>((table->mask + 1) * 2));
+        for (const auto& entry : entries_) {
+            auto i = entry.hash & grown->mask;
+            while (grown->slots[i].load(std::memory_order_relaxed))
+                i = (i + 1) & grown->mask;
+            grown->slots[i].store(&entry, std::memory_order_relaxed);
         }
+        grown->count.store(entries_.size(), std::memory_order_relaxed);
+        table = grown.get();
+        hashTable_.store(table, std::memory_order_release);
     }
 
-    // Copy stringForId_.
-    stringForId_ = other.stringForId_;
+    const auto& entry = entries_.emplace_back(Entry{store(str), id, hash});
+    auto i = hash & table->mask;
+    while (table->slots[i].load(std::memory_order_relaxed))
+        i = (i + 1) & table->mask;
+    table->slots[i].store(&entry, std::memory_order_release);
+    table->count.fetch_add(1, std::memory_order_relaxed);
+
+    auto* ids = idTable_.load(std::memory_order_relaxed);
+    if (id >= ids->capacity) {
+        auto capacity = ids->capacity;
+        while (capacity <= id)
+            capacity *= 2;
+        auto& grown = idTables_.emplace_back(std::make_unique<IdTable>(capacity));
+        for (size_t j = 0; j < ids->capacity; ++j)
+            grown->slots[j].store(ids->slots[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ids = grown.get();
+        idTable_.store(ids, std::memory_order_release);
+    }
 
-    // Copy other member variables.
-    nextId_ = other.nextId_;
-    byteSize_ = other.byteSize_.load();
-    cacheHits_ = other.cacheHits_.load();
-    cacheMisses_ = other.cacheMisses_.load();
+    // The first string stored for an id owns it.
+    if (!ids->slots[id].load(std::memory_order_relaxed))
+        ids->slots[id].store(&entry, std::memory_order_release);
+
+    byteSize_ += static_cast<int64_t>(entry.str.size());
+    generation_.fetch_add(1, std::memory_order_release);
+    return id;
+}
+
+std::string_view StringPool::store(std::string_view const& str)
+{
+    if (str.empty())
+        return {};
+
+    // Strings are packed into large blocks instead of being allocated one by
+    // one. Blocks are never resized, so stored strings stay valid for readers.
+    if (str.size() > blockFree_) {
+        const auto size = std::max(StringBlockSize, str.size());
+        blockEnd_ = blocks_.emplace_back(std::make_unique<char[]>(size)).get();
+        blockFree_ = size;
+    }
+    std::memcpy(blockEnd_, str.data(), str.size());
+    const std::string_view stored(blockEnd_, str.size());
+    blockEnd_ += str.size();
+    blockFree_ -= str.size();
+    return stored;
 }
 
 StringId StringPool::emplace(std::string_view const& str)
 {
-    {
-        std::shared_lock lock(stringStoreMutex_);
-        auto it = idForString_.find(str);
-        if (it != idForString_.end()) {
-            ++cacheHits_;
-            return it->second;
-        }
+    const auto hash = detail::CaseInsensitiveHash{}(str);
+    if (const auto* entry = find(str, hash)) {
+        cacheHits_.increment();
+        return entry->id;
     }
-    {
-        std::unique_lock lock(stringStoreMutex_);
-        // Double-check in case another thread added the string.
-        auto it = idForString_.find(str);
-        if (it != idForString_.end()) {
-            ++cacheHits_;
-            return it->second;
-        }
 
-        // Store the string to maintain ownership.
-        auto& storedString = storedStrings_.emplace_back(str);
-        StringId id = nextId_++;
-        if (nextId_ < id) {
-            raise<std::overflow_error>("StringPool id overflow!");
-        }
-        idForString_.emplace(storedString, id);
-        stringForId_.emplace(id, storedString);
-        byteSize_ += static_cast<int64_t>(storedString.size());
-        ++cacheMisses_;
+    std::unique_lock lock(writeMutex_);
+    // Double-check in case another thread added the string.
+    if (const auto* entry = find(str, hash)) {
+        cacheHits_.increment();
+        return entry->id;
+    }
 
-        return id;
+    const auto next = nextId_.load();
+    if (next > MaxId) {
+        raise<std::overflow_error>("StringPool id overflow!");
     }
+    const auto id = static_cast<StringId>(next);
+    nextId_ = next + 1;
+    cacheMisses_.increment();
+    return insert(str, id, hash);
 }
 
 StringId StringPool::get(std::string_view const& str)
 {
-    std::shared_lock stringStoreReadAccess_(stringStoreMutex_);
-    auto it = idForString_.find(str);
-    if (it != idForString_.end()) {
-        ++cacheHits_;
-        return it->second;
+    if (const auto* entry = find(str, detail::CaseInsensitiveHash{}(str))) {
+        cacheHits_.increment();
+        return entry->id;
     }
     return StringPool::Empty;
 }
 
 std::optional<std::string_view> StringPool::resolve(const StringId& id) const
 {
-    std::shared_lock stringStoreReadAccess_(stringStoreMutex_);
-    auto it = stringForId_.find(id);
-    if (it != stringForId_.end())
-        return it->second;
+    const auto* ids = idTable_.load(std::memory_order_acquire);
+    if (id >= ids->capacity)
+        return std::nullopt;
+    if (const auto* entry = ids->slots[id].load(std::memory_order_acquire))
+        return entry->str;
     return std::nullopt;
 }
 
 StringId StringPool::highest() const
 {
-    return nextId_ - 1;
+    return static_cast<StringId>(nextId_ - 1);
 }
 
 size_t StringPool::size() const
 {
-    std::shared_lock stringStoreReadAccess_(stringStoreMutex_);
-    return idForString_.size();
+    return hashTable_.load(std::memory_order_acquire)->count.load(std::memory_order_relaxed);
 }
 
 size_t StringPool::bytes() const
@@ -163,73 +279,82 @@ size_t StringPool::bytes() const
 
 size_t StringPool::hits() const
 {
-    return cacheHits_;
+    return cacheHits_.load();
 }
 
 size_t StringPool::misses() const
 {
-    return cacheMisses_;
+    return cacheMisses_.load();
+}
+
+uint64_t StringPool::generation() const
+{
+    return generation_.load(std::memory_order_acquire);
 }
 
 void StringPool::addStaticKey(StringId id, const std::string& value)
 {
-    std::unique_lock lock(stringStoreMutex_);
-    auto& storedString = storedStrings_.emplace_back(value);
-    idForString_.emplace(storedString, id);
-    stringForId_.emplace(id, storedString);
+    std::unique_lock lock(writeMutex_);
+    insert(value, id, detail::CaseInsensitiveHash{}(value));
 }
 
 void StringPool::write(std::ostream& outputStream, const StringId offset) const  // NOLINT
 {
-    std::shared_lock stringStoreReadAccess(stringStoreMutex_);
+    std::unique_lock lock(writeMutex_);
     bitsery::Serializer<bitsery::OutputStreamAdapter> s(outputStream);
 
     // Calculate how many strings will be sent
     StringId sendStrCount = 0;
     const auto high = highest();
-    for (auto strId = offset; strId <= high; ++strId) {
-        auto it = stringForId_.find(strId);
-        if (it != stringForId_.end())
+    const auto* ids = idTable_.load(std::memory_order_relaxed);
+    auto stored = [&](uint32_t strId) -> const Entry* {
+        if (strId >= ids->capacity)
+            return nullptr;
+        return ids->slots[strId].load(std::memory_order_relaxed);
+    };
+
+    for (uint32_t strId = offset; strId <= high; ++strId) {
+        if (stored(strId))
             ++sendStrCount;
     }
-    s.value2b(sendStrCount);
+    s.value<sizeof(StringId)>(sendStrCount);
 
     // Send the pool's key-string pairs
-    for (auto strId = offset; strId <= high; ++strId) {
-        auto it = stringForId_.find(strId);
-        if (it != stringForId_.end()) {
-            s.value2b(strId);
+    for (uint32_t strId = offset; strId <= high; ++strId) {
+        if (const auto* entry = stored(strId)) {
+            s.value<sizeof(StringId)>(static_cast<StringId>(strId));
             // Don't support strings longer than 64kB.
-            s.text1b(it->second, std::numeric_limits<uint16_t>::max());
+            s.text1b(entry->str, std::numeric_limits<uint16_t>::max());
         }
     }
 }
 
 void StringPool::read(std::istream& inputStream)
 {
-    std::unique_lock stringStoreWriteAccess_(stringStoreMutex_);
+    std::unique_lock lock(writeMutex_);
     bitsery::Deserializer<bitsery::InputStreamAdapter> s(inputStream);
 
     // Determine how many strings are to be received
     StringId rcvStringCount{};
-    s.value2b(rcvStringCount);
+    s.value<sizeof(StringId)>(rcvStringCount);
 
     // Read strings
+    std::string stringValue;
     for (auto i = 0; i < rcvStringCount; ++i) {
         // Read string key
         StringId stringId{};
-        s.value2b(stringId);
+        s.value<sizeof(StringId)>(stringId);
 
         // Don't support strings longer than 64kB.
-        auto& stringValue = storedStrings_.emplace_back();
         s.text1b(stringValue, std::numeric_limits<uint16_t>::max());
+        if (s.adapter().error() != bitsery::ReaderError::NoError)
+            break;
 
         // Insert string into the pool
-        auto [it, insertionTookPlace] = idForString_.try_emplace(stringValue, stringId);
-        if (insertionTookPlace) {
-            stringForId_.try_emplace(stringId, stringValue);
-            byteSize_ += static_cast<int64_t>(stringValue.size());
-            nextId_ = std::max<StringId>(nextId_, stringId + 1);
+        const auto hash = detail::CaseInsensitiveHash{}(stringValue);
+        if (!find(stringValue, hash)) {
+            insert(stringValue, stringId, hash);
+            nextId_ = std::max<uint32_t>(nextId_, static_cast<uint32_t>(stringId) + 1);
         }
     }
 
@@ -241,41 +366,80 @@ void StringPool::read(std::istream& inputStream)
 }
 
 bool StringPool::operator==(const StringPool &other) const {
-    return idForString_ == other.idForString_;
+    if (size() != other.size())
+        return false;
+
+    std::unique_lock lock(writeMutex_);
+    for (const auto& entry : entries_) {
+        const auto* otherEntry = other.find(entry.str, entry.hash);
+        if (!otherEntry || otherEntry->id != entry.id)
+            return false;
+    }
+    return true;
 }
 
 size_t detail::CaseInsensitiveHash::operator()(const std::string_view& str) const
 {
-    // FNV-1a Hash (Fowler–Noll–Vo) for case-insensitive hashing.
-    // Reference: http://www.isthe.com/chongo/tech/comp/fnv/#FNV-reference-source
-    // Selects 64-bit FNV-1a offset basis and prime if size_t is 8 bytes,
-    // and 32-bit FNV values if size_t is 4 bytes.
-    constexpr size_t offsetBasis = sizeof(size_t) == 4 ? 2166136261U : 14695981039346656037ULL;
-    constexpr size_t prime = sizeof(size_t) == 4 ? 16777619U : 1099511628211ULL;
+    // Mixes eight case-folded bytes per step, instead of folding and
+    // hashing every character on its own. Only ASCII letters are folded,
+    // like std::tolower does in the classic locale.
+    constexpr uint64_t prime = 0x9e3779b97f4a7c15ULL;
+
+    uint64_t hash = str.size() * prime;
+    size_t i = 0;
+    for (; i + 8 <= str.size(); i += 8)
+        hash = (hash ^ foldCase(loadWord(str.data() + i, 8))) * prime;
+    if (i < str.size())
+        hash = (hash ^ foldCase(loadWord(str.data() + i, str.size() - i))) * prime;
+
+    // The table index is taken from the low bits, which the multiplications
+    // only fill from the low bits of the input.
+    hash ^= hash >> 32;
+    hash *= prime;
+    hash ^= hash >> 29;
+    return static_cast<size_t>(hash);
+}
 
-    size_t hash = offsetBasis;
-    std::locale locale{};
+bool detail::CaseInsensitiveEqual::operator()(
+    const std::string_view& lhs,
+    const std::string_view& rhs) const
+{
+    if (lhs.size() != rhs.size())
+        return false;
 
-    for (auto c : str) {
-        c = std::tolower(c, locale);
-        hash ^= c;
-        hash *= prime;
+    size_t i = 0;
+    for (; i + 8 <= lhs.size(); i += 8) {
+        if (foldCase(loadWord(lhs.data() + i, 8)) != foldCase(loadWord(rhs.data() + i, 8)))
+            return false;
     }
+    if (i < lhs.size()) {
+        const auto n = lhs.size() - i;
+        return foldCase(loadWord(lhs.data() + i, n)) == foldCase(loadWord(rhs.data() + i, n));
+    }
+    return true;
+}
 
-    return hash;
+KeyCache::KeyCache(std::shared_ptr<StringPool> strings)
+    : strings_(std::move(strings))
+{}
+
+StringId KeyCache::emplace(std::string_view const& str)
+{
+    if (auto it = ids_.find(str); it != ids_.end())
+        return it->second;
+    auto id = strings_->emplace(str);
+    ids_.emplace(str, id);
+    return id;
 }
 
-bool detail::CaseInsensitiveEqual::operator()(
-    const std::string_view& lhs,
-    const std::string_view& rhs) const
+std::shared_ptr<StringPool> const& KeyCache::strings() const
 {
-    std::locale locale{};
-    return std::equal(
-        lhs.begin(),
-        lhs.end(),
-        rhs.begin(),
-        rhs.end(),
-        [&locale](auto l, auto r)
-        { return std::tolower(l, locale) == std::tolower(r, locale); });
+    return strings_;
 }
+
+size_t KeyCache::size() const
+{
+    return ids_.size();
+}
+
 }  // namespace simfil
@@ -0,0 +1,353 @@
+#include "simfil/model/value-index.h"
+#include "simfil/model/model.h"
+#include "simfil/exception-handler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+
+#include <fmt/format.h>
+
+namespace simfil
+{
+
+namespace
+{
+
+/** Doubles of a larger magnitude are not exact for every integer. */
+constexpr double MaxExactInt = 9007199254740992.0; // 2^53
+
+/** One segment of an index path. */
+struct Step
+{
+    enum Kind { Field, Child, Descendants } kind_;
+    StringId name_ = StringPool::Empty;
+};
+
+template <class Fn>
+void walk(ModelNode const& node, std::span<const Step> steps, Fn const& fn);
+
+/** Same traversal as the `**` wildcard expression. */
+template <class Fn>
+void descend(ModelNode const& node, std::span<const Step> steps, Fn const& fn)
+{
+    if (node.type() == ValueType::Null)
+        return;
+
+    walk(node, steps, fn);
+    node.iterate(ModelNode::IterLambda([&](auto&& sub) {
+        descend(sub, steps, fn);
+        return true;
+    }));
+}
+
+template <class Fn>
+void walk(ModelNode const& node, std::span<const Step> steps, Fn const& fn)
+{
+    if (steps.empty()) {
+        fn(node);
+        return;
+    }
+
+    auto rest = steps.subspan(1);
+    switch (steps.front().kind_) {
+    case Step::Field:
+        if (auto name = steps.front().name_)
+            if (auto sub = node.get(name))
+                walk(*sub, rest, fn);
+        break;
+    case Step::Child:
+        node.iterate(ModelNode::IterLambda([&](auto&& sub) {
+            walk(sub, rest, fn);
+            return true;
+        }));
+        break;
+    case Step::Descendants:
+        descend(node, rest, fn);
+        break;
+    }
+}
+
+bool lessAddress(ModelNodeAddress const& l, ModelNodeAddress const& r)
+{
+    return l.value_ < r.value_;
+}
+
+void sortUnique(std::vector<ModelNodeAddress>& roots)
+{
+    std::sort(roots.begin(), roots.end(), lessAddress);
+    roots.erase(std::unique(roots.begin(), roots.end(), [](auto const& l, auto const& r) {
+        return l.value_ == r.value_;
+    }), roots.end());
+}
+
+/** Hash key of a float, so that -0.0 and 0.0 share an entry. */
+double floatKey(double d)
+{
+    return d == 0. ? 0. : d;
+}
+
+std::optional<std::string_view> stringOf(ScalarValueType const& v)
+{
+    if (auto str = std::get_if<std::string_view>(&v))
+        return *str;
+    if (auto str = std::get_if<std::string>(&v))
+        return *str;
+    return {};
+}
+
+}
+
+std::string ValueIndex::normalizePath(std::string_view path)
+{
+    std::string result;
+    for (size_t begin = 0; begin <= path.size();) {
+        auto end = std::min(path.find('.', begin), path.size());
+        auto segment = path.substr(begin, end - begin);
+        while (!segment.empty() && segment.front() == ' ')
+            segment.remove_prefix(1);
+        while (!segment.empty() && segment.back() == ' ')
+            segment.remove_suffix(1);
+
+        if (segment.empty())
+            raise<std::runtime_error>(fmt::format("Bad index path '{}'", path));
+
+        /* `_` refers to the current node */
+        if (segment != "_") {
+            if (!result.empty())
+                result.push_back('.');
+            result.append(segment);
+        }
+        begin = end + 1;
+    }
+
+    if (result.empty())
+        raise<std::runtime_error>(fmt::format("Bad index path '{}'", path));
+    return result;
+}
+
+ValueIndex::ValueIndex(ModelPool const& pool, std::string_view path)
+    : path_(normalizePath(path))
+{
+    std::vector<Step> steps;
+    for (size_t begin = 0; begin <= path_.size();) {
+        auto end = std::min(path_.find('.', begin), path_.size());
+        auto segment = std::string_view(path_).substr(begin, end - begin);
+        if (segment == "*")
+            steps.push_back({Step::Child});
+        else if (segment == "**")
+            steps.push_back({Step::Descendants});
+        else
+            steps.push_back({Step::Field, pool.strings()->get(segment)});
+        begin = end + 1;
+    }
+
+    for (size_t i = 0; i < pool.numRoots(); ++i) {
+        auto root = pool.root(i);
+        auto addr = root->addr();
+        auto& info = roots_[addr.value_];
+        walk(*root, steps, [&](ModelNode const& node) {
+            add(addr, info, node);
+        });
+    }
+
+    for (auto& [_, roots] : ints_)
+        sortUnique(roots);
+    for (auto& [_, roots] : floats_)
+        sortUnique(roots);
+    for (auto& [_, roots] : strings_)
+        sortUnique(roots);
+    for (auto& roots : bools_)
+        sortUnique(roots);
+    std::sort(sorted_.begin(), sorted_.end(), [](auto const& l, auto const& r) {
+        return l.first < r.first;
+    });
+}
+
+void ValueIndex::add(ModelNodeAddress root, RootInfo& info, ModelNode const& node)
+{
+    auto value = node.value();
+    switch (node.type()) {
+    case ValueType::Null:
+        return;
+    case ValueType::Int:
+        if (auto i = std::get_if<int64_t>(&value)) {
+            info.kinds_ |= Number;
+            info.minInt_ = info.hasInt_ ? std::min(info.minInt_, *i) : *i;
+            info.maxInt_ = info.hasInt_ ? std::max(info.maxInt_, *i) : *i;
+            info.hasInt_ = true;
+            ints_[*i].push_back(root);
+            sorted_.emplace_back(static_cast<double>(*i), root);
+            return;
+        }
+        break;
+    case ValueType::Float:
+        if (auto d = std::get_if<double>(&value)) {
+            info.kinds_ |= Number;
+            /* NaN is neither equal to, nor smaller or larger than anything */
+            if (std::isnan(*d))
+                return;
+            info.minFloat_ = info.hasFloat_ ? std::min(info.minFloat_, *d) : *d;
+            info.maxFloat_ = info.hasFloat_ ? std::max(info.maxFloat_, *d) : *d;
+            info.hasFloat_ = true;
+            floats_[floatKey(*d)].push_back(root);
+            sorted_.emplace_back(*d, root);
+            return;
+        }
+        break;
+    case ValueType::String:
+        if (auto str = stringOf(value)) {
+            info.kinds_ |= String;
+            if (!info.hasString_ || *str < info.minString_)
+                info.minString_ = *str;
+            if (!info.hasString_ || *str > info.maxString_)
+                info.maxString_ = *str;
+            info.hasString_ = true;
+            strings_[std::string(*str)].push_back(root);
+            return;
+        }
+        break;
+    case ValueType::Bool:
+        if (auto b = std::get_if<bool>(&value)) {
+            info.kinds_ |= Bool;
+            bools_[*b ? 1 : 0].push_back(root);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    info.kinds_ |= Other;
+}
+
+std::string const& ValueIndex::path() const
+{
+    return path_;
+}
+
+std::vector<ModelNodeAddress> ValueIndex::equal(ScalarValueType const& value) const
+{
+    std::vector<ModelNodeAddress> result;
+    auto append = [&result](auto const& map, auto const& key) {
+        if (auto it = map.find(key); it != map.end())
+            result.insert(result.end(), it->second.begin(), it->second.end());
+    };
+
+    if (auto i = std::get_if<int64_t>(&value)) {
+        append(ints_, *i);
+        append(floats_, floatKey(static_cast<double>(*i)));
+    }
+    else if (auto d = std::get_if<double>(&value); d && !std::isnan(*d)) {
+        append(floats_, floatKey(*d));
+        if (std::trunc(*d) == *d) {
+            if (std::abs(*d) < MaxExactInt)
+                append(ints_, static_cast<int64_t>(*d));
+            else
+                for (auto const& [i, roots] : ints_)
+                    if (static_cast<double>(i) == *d)
+                        result.insert(result.end(), roots.begin(), roots.end());
+        }
+    }
+    else if (auto str = stringOf(value)) {
+        append(strings_, std::string(*str));
+    }
+    else if (auto b = std::get_if<bool>(&value)) {
+        auto const& roots = bools_[*b ? 1 : 0];
+        result.insert(result.end(), roots.begin(), roots.end());
+    }
+
+    sortUnique(result);
+    return result;
+}
+
+std::vector<ModelNodeAddress> ValueIndex::range(double lower, double upper) const
+{
+    std::vector<ModelNodeAddress> result;
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), lower, [](auto const& entry, double value) {
+        return entry.first < value;
+    });
+    for (; it != sorted_.end() && it->first <= upper; ++it)
+        result.push_back(it->second);
+
+    sortUnique(result);
+    return result;
+}
+
+std::optional<bool> ValueIndex::test(ModelNodeAddress root, Comparison op, ScalarValueType const& literal) const
+{
+    auto it = roots_.find(root.value_);
+    if (it == roots_.end())
+        return {};
+    auto const& info = it->second;
+
+    auto str = stringOf(literal);
+    auto kind = std::holds_alternative<int64_t>(literal) || std::holds_alternative<double>(literal) ? Number
+              : str                                     ? String
+              : std::holds_alternative<bool>(literal)   ? Bool
+                                                        : Other;
+    if (kind == Other || (kind == Bool && op != Comparison::Eq))
+        return {};
+
+    /* Comparing other kinds of values raises, except for nulls */
+    if (info.kinds_ & ~kind)
+        return {};
+    if (!info.kinds_)
+        return false;
+
+    auto contains = [&root](std::vector<ModelNodeAddress> const& roots) {
+        return std::binary_search(roots.begin(), roots.end(), root, lessAddress);
+    };
+    auto containsKey = [&contains](auto const& map, auto const& key) {
+        auto entry = map.find(key);
+        return entry != map.end() && contains(entry->second);
+    };
+
+    if (op == Comparison::Eq) {
+        if (auto i = std::get_if<int64_t>(&literal))
+            return containsKey(ints_, *i) || containsKey(floats_, floatKey(static_cast<double>(*i)));
+        if (auto d = std::get_if<double>(&literal)) {
+            if (std::isnan(*d))
+                return false;
+            if (containsKey(floats_, floatKey(*d)))
+                return true;
+            if (!info.hasInt_ || !std::isfinite(*d) || std::trunc(*d) != *d)
+                return false;
+            if (std::abs(*d) < MaxExactInt)
+                return containsKey(ints_, static_cast<int64_t>(*d));
+            return {};
+        }
+        if (str)
+            return containsKey(strings_, std::string(*str));
+        return contains(bools_[std::get<bool>(literal) ? 1 : 0]);
+    }
+
+    auto compare = [op](auto const& l, auto const& r) {
+        switch (op) {
+        case Comparison::Lt: return l < r;
+        case Comparison::LtEq: return l <= r;
+        case Comparison::Gt: return l > r;
+        case Comparison::GtEq: return l >= r;
+        default: return false;
+        }
+    };
+
+    /* Some value is smaller than the literal if the smallest one is, and vice versa */
+    auto smallest = op == Comparison::Lt || op == Comparison::LtEq;
+    if (str)
+        return info.hasString_ && compare(smallest ? info.minString_ : info.maxString_, *str);
+
+    return std::visit([&](auto const& lit) -> std::optional<bool> {
+        using T = std::decay_t<decltype(lit)>;
+        if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, double>) {
+            return (info.hasInt_ && compare(smallest ? info.minInt_ : info.maxInt_, lit)) ||
+                   (info.hasFloat_ && compare(smallest ? info.minFloat_ : info.maxFloat_, lit));
+        }
+        return {};
+    }, literal);
+}
+
+}
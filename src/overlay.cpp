@@ -3,6 +3,14 @@
 namespace simfil
 {
 
+Value* OverlayNodeStorage::find(StringId key)
+{
+    for (auto& [name, child] : overlayChildren_)
+        if (name == key)
+            return &child;
+    return nullptr;
+}
+
 void OverlayNodeStorage::resolve(ModelNode const& n, ResolveFn const& cb) const
 {
     cb(OverlayNode(n));
@@ -18,9 +26,47 @@ OverlayNode::OverlayNode(ModelNode const& n)
     : MandatoryDerivedModelNodeBase<OverlayNodeStorage>(n)
 {}
 
+OverlayNode::OverlayNode(OverlayNodeStorage& storage)
+    : MandatoryDerivedModelNodeBase<OverlayNodeStorage>(
+          ModelConstPtr(ModelConstPtr(), &storage),
+          {ModelPool::Objects, 0})
+{}
+
 auto OverlayNode::set(StringId const& key, Value const& child) -> void
 {
-    model().overlayChildren_.insert({key, child});
+    auto& children = model().overlayChildren_;
+    if (model().find(key))
+        return;
+
+    children.emplace_back(key, child);
+    if (shared())
+        children.back().second.own();
+}
+
+auto OverlayNode::reset(Value const& val) -> void
+{
+    model().value_ = val;
+    model().overlayChildren_.clear();
+}
+
+auto OverlayNode::escape(Value val) const -> Value
+{
+    if (shared() || !val.node || val.node->model_.get() != model_.get())
+        return val;
+    return Value::field(copy());
+}
+
+auto OverlayNode::copy() const -> model_ptr<OverlayNode>
+{
+    auto result = model_ptr<OverlayNode>::make(model().value_);
+    for (auto const& [key, child] : model().overlayChildren_)
+        result->set(key, child);
+    return result;
+}
+
+auto OverlayNode::shared() const -> bool
+{
+    return model_.use_count() != 0;
 }
 
 [[nodiscard]] ScalarValueType OverlayNode::value() const
@@ -35,11 +81,13 @@ auto OverlayNode::set(StringId const& key, Value const& child) -> void
 
 [[nodiscard]] ModelNode::Ptr OverlayNode::get(const StringId& key) const
 {
-    auto iter = model().overlayChildren_.find(key);
-    if (iter != model().overlayChildren_.end()) {
-        if (iter->second.node)
-            return iter->second.node;
-        return ValueNode(iter->second.getScalar());
+    if (auto child = model().find(key)) {
+        if (child->node)
+            return child->node;
+
+        /* Scalar fields share one model per thread, instead of allocating one per lookup */
+        thread_local const ModelConstPtr scalars = std::make_shared<Model>();
+        return ValueNode(child->getScalar(), scalars);
     }
     return model().value_.node->get(key);
 }
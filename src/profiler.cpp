@@ -0,0 +1,351 @@
+// Copyright (c) Navigation Data Standard e.V. - See "LICENSE" file.
+
+#include "simfil/profiler.h"
+#include "simfil/expression.h"
+#include "simfil/model/string-pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <unordered_map>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  define SIMFIL_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define SIMFIL_HAS_RDTSC 1
+#endif
+
+namespace simfil
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/* Cycle counter, or nanoseconds if the platform has none. */
+inline auto ticks() -> uint64_t
+{
+#if defined(SIMFIL_HAS_RDTSC)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+#endif
+}
+
+auto nanosSince(Clock::time_point start) -> double
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+/* Ticks per nanosecond, measured over a short busy wait. */
+auto calibrate() -> double
+{
+#if defined(SIMFIL_HAS_RDTSC)
+    const auto start = Clock::now();
+    const auto startTicks = ticks();
+    while (Clock::now() - start < std::chrono::milliseconds(1))
+        ;
+    return std::max(1e-3, static_cast<double>(ticks() - startTicks) / nanosSince(start));
+#else
+    return 1.0;
+#endif
+}
+
+auto jsonEscape(std::string_view str) -> std::string
+{
+    std::string r;
+    r.reserve(str.size() + 2);
+    r.push_back('"');
+    for (auto c : str) {
+        switch (c) {
+        case '"':  r += "\\\""; break;
+        case '\\': r += "\\\\"; break;
+        case '\n': r += "\\n"; break;
+        case '\r': r += "\\r"; break;
+        case '\t': r += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                r += buf;
+            } else {
+                r.push_back(c);
+            }
+        }
+    }
+    r.push_back('"');
+    return r;
+}
+
+/* Stack frames are separated by ';' in the folded format. */
+auto frameName(std::string text) -> std::string
+{
+    std::replace(text.begin(), text.end(), ';', ',');
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    return text;
+}
+
+}
+
+struct Profiler::Impl
+{
+    struct Counters
+    {
+        std::atomic<uint64_t> calls = 0;
+        std::atomic<uint64_t> results = 0;
+        std::atomic<uint64_t> nodeResults = 0;
+
+        /* Guarded by samplesMtx */
+        uint64_t selfTicks = 0;
+        uint64_t totalTicks = 0;
+    };
+
+    /* Expressions being evaluated by the calling thread. */
+    struct ThreadState
+    {
+        const Impl* owner = nullptr;
+        uint64_t lastSample = 0;
+        std::vector<const Expr*> stack;
+    };
+    static thread_local ThreadState thread;
+
+    const Environment& env;
+    const double ticksPerNs;
+    const uint64_t intervalTicks;
+
+    size_t startHits = 0;
+    size_t startMisses = 0;
+
+    mutable std::shared_mutex countersMtx;
+    std::unordered_map<const Expr*, Counters> counters;
+
+    mutable std::mutex samplesMtx;
+    std::map<std::vector<const Expr*>, uint64_t> stacks;
+
+    Impl(const Environment& env, uint64_t interval)
+        : env(env)
+        , ticksPerNs(calibrate())
+        , intervalTicks(static_cast<uint64_t>(static_cast<double>(interval) * ticksPerNs))
+    {
+        restart();
+    }
+
+    auto restart() -> void
+    {
+        startHits = env.stringPool->hits();
+        startMisses = env.stringPool->misses();
+    }
+
+    auto countersOf(const Expr& expr) -> Counters&
+    {
+        {
+            std::shared_lock lock(countersMtx);
+            if (auto iter = counters.find(&expr); iter != counters.end())
+                return iter->second;
+        }
+        std::unique_lock lock(countersMtx);
+        return counters[&expr];
+    }
+
+    /* Attribute the time since the last sample to the current stack. */
+    auto sample() -> void
+    {
+        const auto now = ticks();
+        if (thread.owner != this || thread.lastSample == 0) {
+            thread.owner = this;
+            thread.lastSample = now;
+            return;
+        }
+        if (now - thread.lastSample < intervalTicks || thread.stack.empty())
+            return;
+
+        const auto weight = now - thread.lastSample;
+        thread.lastSample = now;
+
+        std::unique_lock lock(samplesMtx);
+        stacks[thread.stack] += weight;
+
+        std::shared_lock countersLock(countersMtx);
+        const auto& stack = thread.stack;
+        for (auto iter = stack.begin(); iter != stack.end(); ++iter) {
+            /* Count recursive frames once */
+            if (std::find(stack.begin(), iter, *iter) != iter)
+                continue;
+            if (auto c = counters.find(*iter); c != counters.end())
+                c->second.totalTicks += weight;
+        }
+        if (auto c = counters.find(stack.back()); c != counters.end())
+            c->second.selfTicks += weight;
+    }
+
+    auto toNs(uint64_t t) const -> uint64_t
+    {
+        return static_cast<uint64_t>(static_cast<double>(t) / ticksPerNs);
+    }
+};
+
+thread_local Profiler::Impl::ThreadState Profiler::Impl::thread;
+
+Profiler::Profiler(const Environment& env, uint64_t interval)
+    : impl_(std::make_unique<Impl>(env, interval))
+{}
+
+Profiler::~Profiler() = default;
+
+auto Profiler::report() const -> Report
+{
+    Report r;
+    r.stringHits = impl_->env.stringPool->hits() - impl_->startHits;
+    r.stringMisses = impl_->env.stringPool->misses() - impl_->startMisses;
+
+    std::unique_lock samplesLock(impl_->samplesMtx);
+    std::shared_lock countersLock(impl_->countersMtx);
+
+    r.exprs.reserve(impl_->counters.size());
+    for (const auto& [expr, c] : impl_->counters) {
+        ExprStats stats;
+        stats.expr = expr;
+        stats.text = expr->toString();
+        stats.calls = c.calls.load(std::memory_order_relaxed);
+        stats.results = c.results.load(std::memory_order_relaxed);
+        stats.nodeResults = c.nodeResults.load(std::memory_order_relaxed);
+        stats.selfNs = impl_->toNs(c.selfTicks);
+        stats.totalNs = impl_->toNs(c.totalTicks);
+        r.exprs.push_back(std::move(stats));
+    }
+    std::sort(r.exprs.begin(), r.exprs.end(), [](const auto& l, const auto& r) {
+        return std::tie(l.totalNs, l.calls) > std::tie(r.totalNs, r.calls);
+    });
+
+    std::unordered_map<const Expr*, std::string> names;
+    for (const auto& stats : r.exprs)
+        names.emplace(stats.expr, frameName(stats.text));
+
+    r.stacks.reserve(impl_->stacks.size());
+    for (const auto& [stack, weight] : impl_->stacks) {
+        std::string folded;
+        for (auto expr : stack) {
+            if (!folded.empty())
+                folded.push_back(';');
+            folded += names[expr];
+        }
+        r.stacks.emplace_back(std::move(folded), impl_->toNs(weight));
+    }
+
+    return r;
+}
+
+auto Profiler::reset() -> void
+{
+    std::unique_lock samplesLock(impl_->samplesMtx);
+    std::unique_lock countersLock(impl_->countersMtx);
+    impl_->counters.clear();
+    impl_->stacks.clear();
+    impl_->restart();
+}
+
+auto Profiler::Report::toJson() const -> std::string
+{
+    std::string r = "{\"stringPool\":{\"hits\":" + std::to_string(stringHits) +
+                    ",\"misses\":" + std::to_string(stringMisses) + "},\"exprs\":[";
+    for (auto i = 0u; i < exprs.size(); ++i) {
+        const auto& e = exprs[i];
+        if (i > 0)
+            r.push_back(',');
+        r += "{\"expr\":" + jsonEscape(e.text) +
+             ",\"calls\":" + std::to_string(e.calls) +
+             ",\"results\":" + std::to_string(e.results) +
+             ",\"nodeResults\":" + std::to_string(e.nodeResults) +
+             ",\"selfNs\":" + std::to_string(e.selfNs) +
+             ",\"totalNs\":" + std::to_string(e.totalNs) + "}";
+    }
+    r += "],\"stacks\":[";
+    for (auto i = 0u; i < stacks.size(); ++i) {
+        if (i > 0)
+            r.push_back(',');
+        r += "{\"stack\":" + jsonEscape(stacks[i].first) +
+             ",\"ns\":" + std::to_string(stacks[i].second) + "}";
+    }
+    r += "]}";
+    return r;
+}
+
+auto Profiler::Report::toFolded() const -> std::string
+{
+    std::string r;
+    for (const auto& [stack, ns] : stacks)
+        r += stack + " " + std::to_string(ns) + "\n";
+    return r;
+}
+
+auto Profiler::Report::toString(size_t limit) const -> std::string
+{
+    char line[96];
+    std::snprintf(line, sizeof(line), "%12s %12s %12s %10s %10s  %s\n",
+                  "calls", "results", "node res", "self ms", "total ms", "expr");
+    std::string r = line;
+    for (auto i = 0u; i < exprs.size() && i < limit; ++i) {
+        const auto& e = exprs[i];
+        std::snprintf(line, sizeof(line), "%12llu %12llu %12llu %10.3f %10.3f  ",
+                      static_cast<unsigned long long>(e.calls),
+                      static_cast<unsigned long long>(e.results),
+                      static_cast<unsigned long long>(e.nodeResults),
+                      static_cast<double>(e.selfNs) / 1e6,
+                      static_cast<double>(e.totalNs) / 1e6);
+        r += line;
+        r += e.text.size() > 60 ? e.text.substr(0, 57) + "..." : e.text;
+        r.push_back('\n');
+    }
+    const auto lookups = stringHits + stringMisses;
+    if (lookups > 0) {
+        std::snprintf(line, sizeof(line), "string pool: %llu lookups, %.1f%% hits\n",
+                      static_cast<unsigned long long>(lookups),
+                      100.0 * static_cast<double>(stringHits) / static_cast<double>(lookups));
+        r += line;
+    }
+    return r;
+}
+
+auto Expr::profile(Context ctx, Value val, const ResultFn& res) const -> Result
+{
+    auto& impl = *ctx.env->profiler->impl_;
+    auto& counters = impl.countersOf(*this);
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+
+    auto& stack = Profiler::Impl::thread.stack;
+    stack.push_back(this);
+    impl.sample();
+
+    struct Pop
+    {
+        Profiler::Impl& impl;
+        std::vector<const Expr*>& stack;
+        ~Pop() {
+            impl.sample();
+            stack.pop_back();
+        }
+    } pop{impl, stack};
+
+    auto counted = LambdaResultFn([&](Context ctx, Value vv) {
+        counters.results.fetch_add(1, std::memory_order_relaxed);
+        if (vv.node)
+            counters.nodeResults.fetch_add(1, std::memory_order_relaxed);
+        return res(std::move(ctx), std::move(vv));
+    });
+
+    auto dbg = ctx.env->debug;
+    if (dbg) dbg->evalBegin(*this, ctx, val, counted);
+    auto r = ieval(std::move(ctx), std::move(val), counted);
+    if (dbg) dbg->evalEnd(*this);
+    return r;
+}
+
+}
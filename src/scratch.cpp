@@ -0,0 +1,53 @@
+#include "simfil/scratch.h"
+
+namespace simfil
+{
+
+Scratch::Scope::Scope()
+    : scratch_(Scratch::local())
+{
+    ++scratch_.depth_;
+}
+
+Scratch::Scope::~Scope()
+{
+    /* Keep the pool's blocks for the next evaluation, unless it grew too large */
+    if (--scratch_.depth_ == 0 && scratch_.upstream_.bytes_ > MaxRetained)
+        scratch_.pool_.release();
+}
+
+std::pmr::memory_resource* Scratch::Scope::resource() const
+{
+    return &scratch_.pool_;
+}
+
+Scratch& Scratch::local()
+{
+    thread_local Scratch scratch;
+    return scratch;
+}
+
+std::size_t Scratch::retained() const
+{
+    return upstream_.bytes_;
+}
+
+void* Scratch::Upstream::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    auto p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    bytes_ += bytes;
+    return p;
+}
+
+void Scratch::Upstream::do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    bytes_ -= bytes;
+}
+
+bool Scratch::Upstream::do_is_equal(std::pmr::memory_resource const& other) const noexcept
+{
+    return this == &other;
+}
+
+}
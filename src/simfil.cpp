@@ -9,21 +9,34 @@
 #include "simfil/environment.h"
 #include "simfil/model/model.h"
 #include "simfil/types.h"
+#include "simfil/scratch.h"
 #include "fmt/core.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <exception>
 #include <iterator>
+#include <limits>
+#include <map>
+#include <set>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <typeinfo>
+#include <optional>
+#include <span>
 #include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
 #include <cassert>
+#include <mutex>
+#include <thread>
 #include <vector>
-#include <deque>
 
 
 namespace simfil
@@ -138,6 +151,107 @@ struct CountedResultFn : ResultFn
     }
 };
 
+/**
+ * Explicit stacks for walking the descendants of a plain ModelPool node.
+ * A walk takes the next free stack of its thread and returns it when done,
+ * so nested walks (e.g. `**` inside a sub-expression of `**`) do not share
+ * a stack, and the stack memory is reused across evaluations.
+ */
+class WalkStack
+{
+public:
+    WalkStack()
+    {
+        auto& stacks = pool();
+        if (stacks.used == stacks.stacks.size())
+            stacks.stacks.emplace_back();
+        stack_ = &stacks.stacks[stacks.used++];
+        stack_->clear();
+    }
+
+    WalkStack(const WalkStack&) = delete;
+    WalkStack& operator=(const WalkStack&) = delete;
+
+    ~WalkStack()
+    {
+        --pool().used;
+    }
+
+    auto operator*() -> std::vector<ModelNodeAddress>&
+    {
+        return *stack_;
+    }
+
+private:
+    struct Pool
+    {
+        std::deque<std::vector<ModelNodeAddress>> stacks;
+        std::size_t used = 0;
+    };
+
+    static auto pool() -> Pool&
+    {
+        thread_local Pool stacks;
+        return stacks;
+    }
+
+    std::vector<ModelNodeAddress>* stack_;
+};
+
+/**
+ * Depth-first walk over `addr` and all its descendants, in the same
+ * pre-order as the recursive `ModelNode` traversal of `**`. Null nodes
+ * are skipped along with their children.
+ *
+ * Without a `name`, `fn` is called for every visited node. With a `name`,
+ * `fn` is called for the value of that field of every visited object
+ * instead (`**.name`), which is found while pushing the object's members.
+ */
+template <class Fn>
+static auto walkDescendants(const Context& ctx, const ModelPool& pool, ModelNodeAddress addr, Fn&& fn, StringId name = StringPool::Empty) -> Result
+{
+    WalkStack scoped;
+    auto& stack = *scoped;
+    stack.push_back(addr);
+
+    while (!stack.empty()) {
+        ctx.visit();
+        auto node = stack.back();
+        stack.pop_back();
+        if (pool.typeOf(node) == ValueType::Null)
+            continue;
+
+        if (!name && fn(node) == Result::Stop)
+            return Result::Stop;
+
+        /* Members are pushed in order and reversed, so the first one is visited next */
+        auto mark = stack.size();
+        if (name && node.column() == ModelPool::Objects) {
+            ModelNodeAddress match;
+            auto found = false;
+            pool.forEachField(node, [&](StringId field, ModelNodeAddress member) {
+                if (!found && field == name) {
+                    found = true;
+                    match = member;
+                }
+                stack.push_back(member);
+                return true;
+            });
+            if (match && fn(match) == Result::Stop)
+                return Result::Stop;
+        }
+        else {
+            pool.forEachMember(node, [&](ModelNodeAddress member) {
+                stack.push_back(member);
+                return true;
+            });
+        }
+        std::reverse(stack.begin() + mark, stack.end());
+    }
+
+    return Result::Continue;
+}
+
 class WildcardExpr : public Expr
 {
 public:
@@ -163,6 +277,7 @@ public:
 
             auto iterate(ModelNode const& val, int depth)
             {
+                ctx.visit();
                 if (val.type() == ValueType::Null)
                     return Result::Continue;
 
@@ -182,7 +297,14 @@ public:
             };
         };
 
-        auto r = Iterate{ctx, res}.iterate(*val.node, 0);
+        auto r = Result::Continue;
+        if (auto pool = ModelPool::native(*val.node)) {
+            r = walkDescendants(ctx, *pool, val.node->addr(), [&](ModelNodeAddress addr) {
+                return res(ctx, Value::field(*pool, *val.node, addr));
+            });
+        }
+        else
+            r = Iterate{ctx, res}.iterate(*val.node, 0);
         res.ensureCall();
         return r;
     }
@@ -212,11 +334,31 @@ public:
         if (ctx.phase == Context::Phase::Compilation)
             return res(ctx, Value::undef());
 
-        if (!val.node || !val.node->size())
+        if (!val.node)
             return res(ctx, Value::null());
 
         auto result = Result::Continue;
+        if (auto pool = ModelPool::native(*val.node)) {
+            auto size = pool->sizeOf(val.node->addr());
+            if (!size)
+                return res(ctx, Value::null());
+            ctx.visit(size);
+
+            pool->forEachMember(val.node->addr(), [&](ModelNodeAddress member) {
+                if (res(ctx, Value::field(*pool, *val.node, member)) == Result::Stop) {
+                    result = Result::Stop;
+                    return false;
+                }
+                return true;
+            });
+            return result;
+        }
+
+        if (!val.node->size())
+            return res(ctx, Value::null());
+
         val.node->iterate(ModelNode::IterLambda([&](auto&& subNode) {
+            ctx.visit();
             if (res(ctx, Value::field(std::move(subNode))) == Result::Stop) {
                 result = Result::Stop;
                 return false;
@@ -224,7 +366,7 @@ public:
             return true;
         }));
 
-        return Result::Continue;
+        return result;
     }
 
     auto toString() const -> std::string override
@@ -233,11 +375,61 @@ public:
     }
 };
 
+/**
+ * Field name symbol, resolved to a StringId when the expression is compiled.
+ *
+ * Names that are not in the string pool yet are looked up again only
+ * after the pool's generation changed. A resolved symbol never takes
+ * the string pool lock during evaluation.
+ */
+class FieldSymbol
+{
+public:
+    FieldSymbol(std::string_view name, const Environment* env)
+    {
+        if (env && name != "_") {
+            generation_ = env->stringPool->generation();
+            id_ = env->stringPool->get(name);
+        }
+    }
+
+    FieldSymbol(FieldSymbol&& other) noexcept
+        : id_(other.id_.load())
+        , generation_(other.generation_.load())
+    {}
+
+    auto id(const Context& ctx, std::string_view name) const -> StringId
+    {
+        if (auto id = id_.load(std::memory_order_acquire))
+            return id;
+
+        auto& strings = *ctx.env->stringPool;
+        auto generation = strings.generation();
+        /* Another thread may have resolved the name since id_ was loaded.
+         * Its id_ store happens before its generation_ store, so load id_
+         * again once the generation matches. */
+        if (generation == generation_.load(std::memory_order_acquire))
+            return id_.load(std::memory_order_acquire);
+
+        auto id = strings.get(name);
+        if (id)
+            id_.store(id, std::memory_order_release);
+        generation_.store(generation, std::memory_order_release);
+        return id;
+    }
+
+private:
+    mutable std::atomic<StringId> id_ = StringPool::Empty;
+    /* Pool generation of the last lookup; unresolved symbols start out stale */
+    mutable std::atomic<uint64_t> generation_ = std::numeric_limits<uint64_t>::max();
+};
+
 class FieldExpr : public Expr
 {
 public:
-    FieldExpr(std::string name)
+    FieldExpr(std::string name, const Environment* env = nullptr)
         : name_(std::move(name))
+        , symbol_(name_, env)
     {}
 
     auto type() const -> Type override
@@ -246,33 +438,41 @@ public:
     }
 
     auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        return res(ctx, lookup(ctx, std::move(val)));
+    }
+
+    /* Resolve this field on `val`. Shared with the bytecode backend. */
+    auto lookup(const Context& ctx, Value val) const -> Value
     {
         if (val.isa(ValueType::Undef))
-            return res(ctx, std::move(val));
+            return val;
 
         /* Special case: _ points to the current node */
         if (name_ == "_")
-            return res(ctx, val);
+            return val;
 
         if (!val.node)
-            return res(ctx, Value::null());
+            return Value::null();
 
-        if (!nameId_)
-            nameId_ = ctx.env->strings()->get(name_);
-
-        if (!nameId_)
+        auto nameId = symbol_.id(ctx, name_);
+        if (!nameId)
             /* If the field name is not in the string cache, then there
                is no field with that name. */
-            return res(ctx, Value::null());
+            return Value::null();
 
         /* Enter sub-node */
-        if (auto sub = val.node->get(nameId_)) {
-            return res(ctx, Value::field(*sub));
+        if (auto pool = ModelPool::native(*val.node)) {
+            if (auto sub = pool->fieldOf(val.node->addr(), nameId))
+                return Value::field(*pool, *val.node, sub);
+        }
+        else if (auto sub = val.node->get(nameId)) {
+            return Value::field(*sub);
         }
 
         if (ctx.phase == Context::Phase::Compilation)
-            return res(ctx, Value::undef());
-        return res(ctx, Value::null());
+            return Value::undef();
+        return Value::null();
     }
 
     auto toString() const -> std::string override
@@ -281,7 +481,231 @@ public:
     }
 
     std::string name_;
-    mutable StringId nameId_ = {};
+    FieldSymbol symbol_;
+};
+
+/**
+ * Fused chain of field names, equivalent to nested `PathExpr`s
+ * of `FieldExpr`s (`a.b.c`). Walks the nodes directly, without
+ * creating intermediate values or result callbacks.
+ */
+class FieldPathExpr : public Expr
+{
+public:
+    FieldPathExpr(std::vector<std::string> names, const Environment* env)
+        : names_(std::move(names))
+    {
+        assert(names_.size() > 1);
+        symbols_.reserve(names_.size());
+        for (const auto& name : names_)
+            symbols_.emplace_back(name, env);
+    }
+
+    auto type() const -> Type override
+    {
+        return Type::PATH;
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        return res(ctx, lookup(ctx, val));
+    }
+
+    /* Resolve the field chain on `val`. Shared with the bytecode backend. */
+    auto lookup(const Context& ctx, const Value& val) const -> Value
+    {
+        /* Same result as a PathExpr without any matching value */
+        auto none = [&]() {
+            if (ctx.phase == Context::Phase::Compilation)
+                return Value::undef();
+            return Value::null();
+        };
+
+        if (val.isa(ValueType::Undef) || !val.node)
+            return none();
+
+        if (auto pool = ModelPool::native(*val.node)) {
+            auto addr = val.node->addr();
+            for (auto i = 0u; i < names_.size(); ++i) {
+                auto nameId = symbols_[i].id(ctx, names_[i]);
+                if (!nameId)
+                    return none();
+
+                addr = pool->fieldOf(addr, nameId);
+                if (!addr)
+                    return none();
+            }
+            return Value::field(*pool, *val.node, addr);
+        }
+
+        auto node = val.node;
+        for (auto i = 0u; i < names_.size(); ++i) {
+            auto nameId = symbols_[i].id(ctx, names_[i]);
+            if (!nameId)
+                return none();
+
+            auto sub = node->get(nameId);
+            if (!sub)
+                return none();
+            node = std::move(sub);
+        }
+
+        return Value::field(node);
+    }
+
+    auto toString() const -> std::string override
+    {
+        auto s = names_[0];
+        for (auto i = 1u; i < names_.size(); ++i)
+            s = "(. "s + s + " "s + names_[i] + ")"s;
+        return s;
+    }
+
+    std::vector<std::string> names_;
+    std::vector<FieldSymbol> symbols_;
+};
+
+/**
+ * Fused `base.*.a.b`, equivalent to nested `PathExpr`s of an `AnyChildExpr`
+ * followed by `FieldExpr`s (base is optional). On plain ModelPool nodes,
+ * the children of each base value are gathered into a buffer, and every
+ * field is looked up for the whole batch at once, dropping the children
+ * which lack it. Results are handed out per batch, see forEachBatch().
+ */
+class ChildFieldsExpr : public Expr
+{
+public:
+    /* Number of children which are processed at once */
+    static constexpr std::size_t BatchSize = 256;
+
+    ChildFieldsExpr(ExprPtr base, std::vector<std::string> names, const Environment* env)
+        : base_(std::move(base))
+        , names_(std::move(names))
+    {
+        assert(!names_.empty());
+        symbols_.reserve(names_.size());
+        for (const auto& name : names_)
+            symbols_.emplace_back(name, env);
+    }
+
+    auto type() const -> Type override
+    {
+        return Type::PATH;
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& ores) const -> Result override
+    {
+        CountedResultFn<const ResultFn&> res(ores, ctx);
+        auto r = forEachBatch(ctx, std::move(val),
+            [&](const ModelPool& pool, const ModelNode& parent, std::span<const ModelNodeAddress> batch) {
+                for (auto addr : batch)
+                    if (res(ctx, Value::field(pool, parent, addr)) == Result::Stop)
+                        return Result::Stop;
+                return Result::Continue;
+            },
+            [&](Value v) {
+                return res(ctx, std::move(v));
+            });
+        res.ensureCall();
+        return r;
+    }
+
+    /**
+     * Evaluate the path, passing the results of plain ModelPool nodes to
+     * `batchFn(pool, parent, addresses)` and all other results to
+     * `valueFn(value)`, in order. Stops if either one returns Result::Stop.
+     * Yields nothing in the compilation phase.
+     */
+    template <class BatchFn, class ValueFn>
+    auto forEachBatch(Context ctx, Value val, BatchFn&& batchFn, ValueFn&& valueFn) const -> Result
+    {
+        auto children = [&](Context ctx, Value v) -> Result {
+            if (ctx.phase == Context::Phase::Compilation)
+                return Result::Continue;
+            if (v.isa(ValueType::Undef) || !v.node)
+                return Result::Continue;
+
+            if (auto pool = ModelPool::native(*v.node))
+                return nativeChildren(ctx, *pool, *v.node, batchFn);
+
+            auto result = Result::Continue;
+            v.node->iterate(ModelNode::IterLambda([&](auto&& child) {
+                ctx.visit();
+                auto node = ModelNode::Ptr(child);
+                for (auto i = 0u; i < names_.size() && node; ++i) {
+                    auto nameId = symbols_[i].id(ctx, names_[i]);
+                    node = nameId ? node->get(nameId) : ModelNode::Ptr{};
+                }
+                if (node && valueFn(Value::field(node)) == Result::Stop) {
+                    result = Result::Stop;
+                    return false;
+                }
+                return true;
+            }));
+            return result;
+        };
+
+        if (base_)
+            return base_->eval(ctx, std::move(val), LambdaResultFn(children));
+        return children(ctx, std::move(val));
+    }
+
+    auto toString() const -> std::string override
+    {
+        auto s = base_ ? "(. "s + base_->toString() + " *)"s : "*"s;
+        for (const auto& name : names_)
+            s = "(. "s + s + " "s + name + ")"s;
+        return s;
+    }
+
+    ExprPtr base_;
+    std::vector<std::string> names_;
+    std::vector<FieldSymbol> symbols_;
+
+private:
+    template <class BatchFn>
+    auto nativeChildren(const Context& ctx, const ModelPool& pool, const ModelNode& parent, BatchFn& batchFn) const -> Result
+    {
+        std::pmr::vector<StringId> nameIds(ctx.scratch);
+        nameIds.reserve(names_.size());
+        for (auto i = 0u; i < names_.size(); ++i) {
+            auto nameId = symbols_[i].id(ctx, names_[i]);
+            if (!nameId)
+                return Result::Continue;
+            nameIds.push_back(nameId);
+        }
+
+        auto size = pool.sizeOf(parent.addr());
+        ctx.visit(size);
+
+        std::pmr::vector<ModelNodeAddress> batch(ctx.scratch);
+        batch.reserve(std::min<std::size_t>(size, BatchSize));
+
+        /* Look up each field for the whole batch, keeping the children which have it */
+        auto flush = [&]() {
+            for (auto nameId : nameIds) {
+                auto kept = 0u;
+                for (auto addr : batch)
+                    if (auto field = pool.fieldOf(addr, nameId))
+                        batch[kept++] = field;
+                batch.resize(kept);
+            }
+            auto result = batch.empty() ? Result::Continue : batchFn(pool, parent, std::span<const ModelNodeAddress>(batch));
+            batch.clear();
+            return result;
+        };
+
+        auto result = Result::Continue;
+        pool.forEachMember(parent.addr(), [&](ModelNodeAddress child) {
+            batch.push_back(child);
+            if (batch.size() == BatchSize)
+                result = flush();
+            return result != Result::Stop;
+        });
+        if (result != Result::Stop)
+            result = flush();
+        return result;
+    }
 };
 
 class MultiConstExpr : public Expr
@@ -346,6 +770,11 @@ public:
         return res(ctx, value_);
     }
 
+    auto value() const -> const Value&
+    {
+        return value_;
+    }
+
     auto toString() const -> std::string override
     {
         if (value_.isa(ValueType::String))
@@ -479,13 +908,16 @@ public:
 
     auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
     {
-        if (!fn_)
-            fn_ = ctx.env->findFunction(name_);
-        if (!fn_)
+        auto fn = fn_.load(std::memory_order_relaxed);
+        if (!fn) {
+            fn = ctx.env->findFunction(name_);
+            fn_.store(fn, std::memory_order_relaxed);
+        }
+        if (!fn)
             raise<std::runtime_error>("Unknown function "s + name_);
 
         auto anyval = false;
-        auto result = fn_->eval(ctx, val, args_, LambdaResultFn([&res, &anyval](Context ctx, Value vv) {
+        auto result = fn->eval(ctx, val, args_, LambdaResultFn([&res, &anyval](Context ctx, Value vv) {
             anyval = true;
             return res(ctx, std::move(vv));
         }));
@@ -509,7 +941,7 @@ public:
 
     std::string name_;
     std::vector<ExprPtr> args_;
-    mutable const Function* fn_;
+    mutable std::atomic<const Function*> fn_;
 };
 
 class PathExpr : public Expr
@@ -538,6 +970,7 @@ public:
         auto res = CountedResultFn<const ResultFn&>(ores, ctx);
 
         auto r = left_->eval(ctx, val, LambdaResultFn([this, &res](Context ctx, Value v) {
+            ctx.visit();
             if (v.isa(ValueType::Undef))
                 return Result::Continue;
 
@@ -566,6 +999,57 @@ public:
     ExprPtr left_, right_;
 };
 
+/**
+ * Fused `**.name`, equivalent to `PathExpr(WildcardExpr, FieldExpr)`.
+ * On plain ModelPool nodes, the field names of every object are tested
+ * while walking the descendants, instead of looking up the field on each
+ * of them. Otherwise, the original path expression is evaluated.
+ */
+class WildcardFieldExpr : public Expr
+{
+public:
+    WildcardFieldExpr(ExprPtr path, std::string name, const Environment* env)
+        : path_(std::move(path))
+        , name_(std::move(name))
+        , symbol_(name_, env)
+    {}
+
+    auto type() const -> Type override
+    {
+        return Type::PATH;
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& ores) const -> Result override
+    {
+        /* Debug hooks expect the nodes of the original path */
+        if (ctx.phase == Context::Phase::Compilation || ctx.env->debug)
+            return path_->eval(ctx, std::move(val), ores);
+
+        auto pool = ModelPool::native(*val.node);
+        if (!pool)
+            return path_->eval(ctx, std::move(val), ores);
+
+        CountedResultFn<const ResultFn&> res(ores, ctx);
+        auto r = Result::Continue;
+        if (auto nameId = symbol_.id(ctx, name_)) {
+            r = walkDescendants(ctx, *pool, val.node->addr(), [&](ModelNodeAddress addr) {
+                return res(ctx, Value::field(*pool, *val.node, addr));
+            }, nameId);
+        }
+        res.ensureCall();
+        return r;
+    }
+
+    auto toString() const -> std::string override
+    {
+        return path_->toString();
+    }
+
+    ExprPtr path_;
+    std::string name_;
+    FieldSymbol symbol_;
+};
+
 /** Calls `unpack` onto values of type Object. Forwards the value(s) otherwise.
  *
  * 1... => 1
@@ -591,8 +1075,10 @@ public:
                 const auto& obj = v.as<ValueType::TransientObject>();
                 auto r = Result::Continue;
                 obj.meta->unpack(obj, [&](Value vv) {
+                    ctx.visit();
                     anyval = true;
-                    return res(ctx, std::move(vv)) == Result::Continue;
+                    r = res(ctx, std::move(vv));
+                    return r == Result::Continue;
                 });
 
                 if (r == Result::Stop)
@@ -649,6 +1135,35 @@ public:
     ExprPtr sub_;
 };
 
+template <class Operator>
+inline constexpr bool isComparison =
+    std::is_same_v<Operator, OperatorEq> || std::is_same_v<Operator, OperatorNeq> ||
+    std::is_same_v<Operator, OperatorLt> || std::is_same_v<Operator, OperatorLtEq> ||
+    std::is_same_v<Operator, OperatorGt> || std::is_same_v<Operator, OperatorGtEq>;
+
+/**
+ * Comparison of two numbers without the generic operator dispatch, which
+ * visits both values. Returns nullopt unless both values are ints or
+ * floats, so that all other operand types fall back to the dispatch.
+ */
+template <class Operator>
+static auto compareNumbers(const Value& l, const Value& r) -> std::optional<bool>
+{
+    if (l.isa(ValueType::Int)) {
+        if (r.isa(ValueType::Int))
+            return Operator()(l.as<ValueType::Int>(), r.as<ValueType::Int>());
+        if (r.isa(ValueType::Float))
+            return Operator()(l.as<ValueType::Int>(), r.as<ValueType::Float>());
+    }
+    else if (l.isa(ValueType::Float)) {
+        if (r.isa(ValueType::Int))
+            return Operator()(l.as<ValueType::Float>(), r.as<ValueType::Int>());
+        if (r.isa(ValueType::Float))
+            return Operator()(l.as<ValueType::Float>(), r.as<ValueType::Float>());
+    }
+    return std::nullopt;
+}
+
 /**
  * Generic binary operator expression.
  */
@@ -673,6 +1188,10 @@ public:
     {
         return left_->eval(ctx, val, LambdaResultFn([this, &res, &val](Context ctx, Value lv) {
             return right_->eval(ctx, val, LambdaResultFn([this, &res, &lv](Context ctx, Value rv) {
+                if constexpr (isComparison<Operator>) {
+                    if (auto result = compareNumbers<Operator>(lv, rv))
+                        return res(ctx, Value::make(*result));
+                }
                 return res(ctx, BinaryOperatorDispatcher<Operator>::dispatch(std::move(lv),
                                                                               std::move(rv)));
             }));
@@ -687,56 +1206,419 @@ public:
     ExprPtr left_, right_;
 };
 
-class UnaryWordOpExpr : public Expr
+/**
+ * Comparison of an expression against a string literal.
+ * String operands, like model strings which reference the
+ * pool's string data, are compared as string_views against the
+ * literal, without copying either one. All other operand types
+ * go through the generic operator dispatch.
+ */
+template <class Operator>
+class StringCompareExpr : public BinaryExpr<Operator>
 {
 public:
-    UnaryWordOpExpr(Token t, ExprPtr left)
-        : ident_(std::get<std::string>(t.value))
-        , left_(std::move(left))
+    using BinaryExpr<Operator>::left_;
+    using BinaryExpr<Operator>::right_;
+
+    StringCompareExpr(ExprPtr left, ExprPtr right, bool literalLeft)
+        : BinaryExpr<Operator>(std::move(left), std::move(right))
+        , literalLeft_(literalLeft)
+        , literal_(static_cast<const ConstExpr&>(literalLeft ? *left_ : *right_).value())
+        , string_(literal_.template as<ValueType::String>())
     {}
 
-    auto type() const -> Type override
-    {
-        return Type::VALUE;
-    }
-
     auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
     {
-        return left_->eval(ctx, val, LambdaResultFn([this, &res](Context ctx, Value val) {
-            if (val.isa(ValueType::Undef))
-                return res(ctx, std::move(val));
-
-            if (val.isa(ValueType::TransientObject)) {
-                const auto& obj = val.as<ValueType::TransientObject>();
-                return res(ctx, obj.meta->unaryOp(ident_, obj));
+        const auto& operand = literalLeft_ ? right_ : left_;
+        return operand->eval(ctx, val, LambdaResultFn([this, &res](Context ctx, Value vv) {
+            if (vv.isa(ValueType::String)) {
+                const auto str = view(vv);
+                return res(ctx, Value::make(literalLeft_ ? compare(string_, str) : compare(str, string_)));
             }
-
-            raise<std::runtime_error>(fmt::format("Invalid operator '{}' for value of type {}",
-                                                 ident_, valueType2String(val.type)));
+            return res(ctx, literalLeft_ ? BinaryOperatorDispatcher<Operator>::dispatch(literal_, vv)
+                                         : BinaryOperatorDispatcher<Operator>::dispatch(vv, literal_));
         }));
     }
 
-    auto toString() const -> std::string override
+private:
+    static auto view(const Value& v) -> std::string_view
     {
-        return "("s + ident_ + " "s + left_->toString() + ")"s;
+        if (auto sv = std::get_if<std::string_view>(&v.value))
+            return *sv;
+        if (auto str = std::get_if<std::string>(&v.value))
+            return *str;
+        return {};
     }
 
-    std::string ident_;
-    ExprPtr left_;
+    static auto compare(std::string_view l, std::string_view r) -> bool
+    {
+        if constexpr (std::is_same_v<Operator, OperatorEq>)
+            return l == r;
+        else if constexpr (std::is_same_v<Operator, OperatorNeq>)
+            return l != r;
+        else if constexpr (std::is_same_v<Operator, OperatorLt>)
+            return l < r;
+        else if constexpr (std::is_same_v<Operator, OperatorLtEq>)
+            return l <= r;
+        else if constexpr (std::is_same_v<Operator, OperatorGt>)
+            return l > r;
+        else
+            return l >= r;
+    }
+
+    const bool literalLeft_;
+    const Value literal_;
+    const std::string string_;
 };
 
-class BinaryWordOpExpr : public Expr
+/**
+ * Replace a comparison of an expression with a string
+ * literal by a StringCompareExpr.
+ */
+template <class Operator>
+static auto specializeStringCompare(ExprPtr expr) -> ExprPtr
+{
+    if (!expr || typeid(*expr) != typeid(BinaryExpr<Operator>))
+        return expr;
+
+    auto& binary = static_cast<BinaryExpr<Operator>&>(*expr);
+    auto isLiteral = [](const ExprPtr& e) {
+        auto c = dynamic_cast<const ConstExpr*>(e.get());
+        return c && c->value().isa(ValueType::String);
+    };
+
+    if (isLiteral(binary.right_) && !isLiteral(binary.left_))
+        return std::make_unique<StringCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), false);
+    if (isLiteral(binary.left_) && !isLiteral(binary.right_))
+        return std::make_unique<StringCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), true);
+    return expr;
+}
+
+/**
+ * Comparison of a ChildFieldsExpr against a number literal. Batches of
+ * ints or floats are read from their column at once and compared in a
+ * tight loop into a selection vector. Mixed batches and values of other
+ * models go through the generic operator dispatch, value by value.
+ */
+template <class Operator>
+class BatchCompareExpr : public BinaryExpr<Operator>
 {
 public:
-    BinaryWordOpExpr(Token t, ExprPtr left, ExprPtr right)
-        : ident_(std::get<std::string>(t.value))
-        , left_(std::move(left))
-        , right_(std::move(right))
+    using BinaryExpr<Operator>::left_;
+    using BinaryExpr<Operator>::right_;
+
+    BatchCompareExpr(ExprPtr left, ExprPtr right, bool literalLeft)
+        : BinaryExpr<Operator>(std::move(left), std::move(right))
+        , literalLeft_(literalLeft)
+        , literal_(static_cast<const ConstExpr&>(literalLeft ? *left_ : *right_).value())
     {}
 
-    auto type() const -> Type override
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
     {
-        return Type::VALUE;
+        if (ctx.phase == Context::Phase::Compilation)
+            return BinaryExpr<Operator>::ieval(ctx, std::move(val), res);
+
+        const auto& path = static_cast<const ChildFieldsExpr&>(literalLeft_ ? *right_ : *left_);
+        auto values = 0u;
+        auto r = path.forEachBatch(ctx, std::move(val),
+            [&](const ModelPool& pool, const ModelNode& parent, std::span<const ModelNodeAddress> batch) {
+                values += batch.size();
+                return compareBatch(ctx, pool, parent, batch, res);
+            },
+            [&](Value v) {
+                ++values;
+                return res(ctx, dispatch(v));
+            });
+
+        /* Like the path, which yields null if it has no values */
+        if (values == 0)
+            return res(ctx, dispatch(Value::null()));
+        return r;
+    }
+
+private:
+    auto dispatch(const Value& v) const -> Value
+    {
+        return literalLeft_ ? BinaryOperatorDispatcher<Operator>::dispatch(literal_, v)
+                            : BinaryOperatorDispatcher<Operator>::dispatch(v, literal_);
+    }
+
+    template <class T>
+    auto select(const T* values, std::size_t n, uint8_t* selected) const
+    {
+        auto compare = [&](auto literal) {
+            if (literalLeft_) {
+                for (auto i = 0u; i < n; ++i)
+                    selected[i] = Operator()(literal, values[i]);
+            }
+            else {
+                for (auto i = 0u; i < n; ++i)
+                    selected[i] = Operator()(values[i], literal);
+            }
+        };
+
+        if (literal_.isa(ValueType::Int))
+            compare(literal_.template as<ValueType::Int>());
+        else
+            compare(literal_.template as<ValueType::Float>());
+    }
+
+    auto compareBatch(Context ctx, const ModelPool& pool, const ModelNode& parent,
+                      std::span<const ModelNodeAddress> batch, const ResultFn& res) const -> Result
+    {
+        std::array<int64_t, ChildFieldsExpr::BatchSize> ints;
+        std::array<double, ChildFieldsExpr::BatchSize> floats;
+        std::array<uint8_t, ChildFieldsExpr::BatchSize> selected;
+
+        if (pool.intsOf(batch, ints.data()))
+            select(ints.data(), batch.size(), selected.data());
+        else if (pool.floatsOf(batch, floats.data()))
+            select(floats.data(), batch.size(), selected.data());
+        else {
+            for (auto addr : batch)
+                if (res(ctx, dispatch(Value::field(pool, parent, addr))) == Result::Stop)
+                    return Result::Stop;
+            return Result::Continue;
+        }
+
+        for (auto i = 0u; i < batch.size(); ++i)
+            if (res(ctx, Value::make(selected[i] != 0)) == Result::Stop)
+                return Result::Stop;
+        return Result::Continue;
+    }
+
+    const bool literalLeft_;
+    const Value literal_;
+};
+
+/**
+ * Replace a comparison of a ChildFieldsExpr with
+ * a number literal by a BatchCompareExpr.
+ */
+template <class Operator>
+static auto specializeBatchCompare(ExprPtr expr) -> ExprPtr
+{
+    if (!expr || typeid(*expr) != typeid(BinaryExpr<Operator>))
+        return expr;
+
+    auto& binary = static_cast<BinaryExpr<Operator>&>(*expr);
+    auto isLiteral = [](const ExprPtr& e) {
+        auto c = dynamic_cast<const ConstExpr*>(e.get());
+        return c && (c->value().isa(ValueType::Int) || c->value().isa(ValueType::Float));
+    };
+    auto isBatch = [](const ExprPtr& e) {
+        return dynamic_cast<const ChildFieldsExpr*>(e.get()) != nullptr;
+    };
+
+    if (isLiteral(binary.right_) && isBatch(binary.left_))
+        return std::make_unique<BatchCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), false);
+    if (isLiteral(binary.left_) && isBatch(binary.right_))
+        return std::make_unique<BatchCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), true);
+    return expr;
+}
+
+/**
+ * Comparison of count(...) against an int literal. Counting stops as
+ * soon as further positive results can not change the outcome, so that
+ * e.g. `count(x) > 0` evaluates `x` only up to its first positive result,
+ * like any(x).
+ */
+template <class Operator>
+class CountCompareExpr : public BinaryExpr<Operator>
+{
+public:
+    using BinaryExpr<Operator>::left_;
+    using BinaryExpr<Operator>::right_;
+
+    CountCompareExpr(ExprPtr left, ExprPtr right, bool literalLeft)
+        : BinaryExpr<Operator>(std::move(left), std::move(right))
+        , literalLeft_(literalLeft)
+        , literal_(static_cast<const ConstExpr&>(literalLeft ? *left_ : *right_).value())
+        , limit_(limit(literal_.template as<ValueType::Int>(), literalLeft))
+    {}
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        if (ctx.phase == Context::Phase::Compilation)
+            return BinaryExpr<Operator>::ieval(ctx, std::move(val), res);
+
+        const auto& call = static_cast<const CallExpression&>(literalLeft_ ? *right_ : *left_);
+        auto undef = false;
+        auto count = Value::make(CountFn::Fn.count(ctx, std::move(val), call.args_, limit_, undef));
+        return res(ctx, literalLeft_ ? BinaryOperatorDispatcher<Operator>::dispatch(literal_, count)
+                                     : BinaryOperatorDispatcher<Operator>::dispatch(count, literal_));
+    }
+
+private:
+    /* Smallest count from which on the result does not change anymore:
+     * `count >= n` and `count < n` are decided at n, all other
+     * comparisons at n + 1. */
+    static auto limit(int64_t n, bool literalLeft) -> int64_t
+    {
+        constexpr auto decidedAtN = std::is_same_v<Operator, OperatorGtEq> || std::is_same_v<Operator, OperatorLt>;
+        constexpr auto decidedAtNFlipped = std::is_same_v<Operator, OperatorLtEq> || std::is_same_v<Operator, OperatorGt>;
+        if (n < 0)
+            return 0;
+        if (literalLeft ? decidedAtNFlipped : decidedAtN)
+            return n;
+        return n == std::numeric_limits<int64_t>::max() ? n : n + 1;
+    }
+
+    const bool literalLeft_;
+    const Value literal_;
+    const int64_t limit_;
+};
+
+/**
+ * Replace a comparison of count(...) with an
+ * int literal by a CountCompareExpr.
+ */
+template <class Operator>
+static auto specializeCountCompare(Environment* env, ExprPtr expr) -> ExprPtr
+{
+    if (!expr || typeid(*expr) != typeid(BinaryExpr<Operator>))
+        return expr;
+
+    auto& binary = static_cast<BinaryExpr<Operator>&>(*expr);
+    auto isLiteral = [](const ExprPtr& e) {
+        auto c = dynamic_cast<const ConstExpr*>(e.get());
+        return c && c->value().isa(ValueType::Int);
+    };
+    auto isCount = [&](const ExprPtr& e) {
+        auto call = dynamic_cast<const CallExpression*>(e.get());
+        return call && !call->args_.empty() && env->findFunction(call->name_) == &CountFn::Fn;
+    };
+
+    if (isLiteral(binary.right_) && isCount(binary.left_))
+        return std::make_unique<CountCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), false);
+    if (isLiteral(binary.left_) && isCount(binary.right_))
+        return std::make_unique<CountCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), true);
+    return expr;
+}
+
+/**
+ * Comparison of an expression against a number literal. The literal is
+ * decoded once, and int or float operands are compared with it directly.
+ * All other operand types go through the generic operator dispatch.
+ */
+template <class Operator>
+class NumberCompareExpr : public BinaryExpr<Operator>
+{
+public:
+    using BinaryExpr<Operator>::left_;
+    using BinaryExpr<Operator>::right_;
+
+    NumberCompareExpr(ExprPtr left, ExprPtr right, bool literalLeft)
+        : BinaryExpr<Operator>(std::move(left), std::move(right))
+        , literalLeft_(literalLeft)
+        , literal_(static_cast<const ConstExpr&>(literalLeft ? *left_ : *right_).value())
+        , intLiteral_(literal_.isa(ValueType::Int))
+        , int_(intLiteral_ ? literal_.template as<ValueType::Int>() : 0)
+        , float_(intLiteral_ ? 0. : literal_.template as<ValueType::Float>())
+    {}
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        const auto& operand = literalLeft_ ? right_ : left_;
+        return operand->eval(ctx, val, LambdaResultFn([this, &res](Context ctx, Value vv) {
+            if (vv.isa(ValueType::Int))
+                return res(ctx, Value::make(compare(vv.template as<ValueType::Int>())));
+            if (vv.isa(ValueType::Float))
+                return res(ctx, Value::make(compare(vv.template as<ValueType::Float>())));
+            return res(ctx, literalLeft_ ? BinaryOperatorDispatcher<Operator>::dispatch(literal_, vv)
+                                         : BinaryOperatorDispatcher<Operator>::dispatch(vv, literal_));
+        }));
+    }
+
+private:
+    template <class T>
+    auto compare(T value) const -> bool
+    {
+        if (intLiteral_)
+            return literalLeft_ ? Operator()(int_, value) : Operator()(value, int_);
+        return literalLeft_ ? Operator()(float_, value) : Operator()(value, float_);
+    }
+
+    const bool literalLeft_;
+    const Value literal_;
+    const bool intLiteral_;
+    const int64_t int_;
+    const double float_;
+};
+
+/**
+ * Replace a comparison of an expression with a number
+ * literal by a NumberCompareExpr.
+ */
+template <class Operator>
+static auto specializeNumberCompare(ExprPtr expr) -> ExprPtr
+{
+    if (!expr || typeid(*expr) != typeid(BinaryExpr<Operator>))
+        return expr;
+
+    auto& binary = static_cast<BinaryExpr<Operator>&>(*expr);
+    auto isLiteral = [](const ExprPtr& e) {
+        auto c = dynamic_cast<const ConstExpr*>(e.get());
+        return c && (c->value().isa(ValueType::Int) || c->value().isa(ValueType::Float));
+    };
+
+    if (isLiteral(binary.right_) && !isLiteral(binary.left_))
+        return std::make_unique<NumberCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), false);
+    if (isLiteral(binary.left_) && !isLiteral(binary.right_))
+        return std::make_unique<NumberCompareExpr<Operator>>(std::move(binary.left_), std::move(binary.right_), true);
+    return expr;
+}
+
+class UnaryWordOpExpr : public Expr
+{
+public:
+    UnaryWordOpExpr(Token t, ExprPtr left)
+        : ident_(std::get<std::string>(t.value))
+        , left_(std::move(left))
+    {}
+
+    auto type() const -> Type override
+    {
+        return Type::VALUE;
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        return left_->eval(ctx, val, LambdaResultFn([this, &res](Context ctx, Value val) {
+            if (val.isa(ValueType::Undef))
+                return res(ctx, std::move(val));
+
+            if (val.isa(ValueType::TransientObject)) {
+                const auto& obj = val.as<ValueType::TransientObject>();
+                return res(ctx, obj.meta->unaryOp(ident_, obj));
+            }
+
+            raise<std::runtime_error>(fmt::format("Invalid operator '{}' for value of type {}",
+                                                 ident_, valueType2String(val.type)));
+        }));
+    }
+
+    auto toString() const -> std::string override
+    {
+        return "("s + ident_ + " "s + left_->toString() + ")"s;
+    }
+
+    std::string ident_;
+    ExprPtr left_;
+};
+
+class BinaryWordOpExpr : public Expr
+{
+public:
+    BinaryWordOpExpr(Token t, ExprPtr left, ExprPtr right)
+        : ident_(std::get<std::string>(t.value))
+        , left_(std::move(left))
+        , right_(std::move(right))
+    {}
+
+    auto type() const -> Type override
+    {
+        return Type::VALUE;
     }
 
     auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
@@ -903,114 +1785,461 @@ static auto simplifyOrForward(Environment* env, ExprPtr expr) -> ExprPtr
 }
 
 /**
- * Parser wrapper for parsing and & or operators.
- *
- * <expr> [and|or] <expr>
+ * Returns true if the function `name` reduces its argument to a single
+ * boolean (any/each), so wrapping its result in any(...) is redundant.
  */
-class AndOrParser : public InfixParselet
+static auto isBoolReduction(Environment* env, const std::string& name) -> bool
 {
-public:
-    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
-    {
-        auto right = p.parsePrecedence(precedence());
+    auto fn = env->findFunction(name);
+    return fn == &AnyFn::Fn || fn == &EachFn::Fn;
+}
 
-        if (t.type == Token::OP_AND)
-          return simplifyOrForward(p.env, std::make_unique<AndExpr>(std::move(left),
-                                                                    std::move(right)));
-        else if (t.type == Token::OP_OR)
-          return simplifyOrForward(p.env, std::make_unique<OrExpr>(std::move(left),
-                                                                   std::move(right)));
-        assert(0);
-        return nullptr;
-    }
+static auto isBoolReduction(Environment* env, const Expr& expr) -> bool
+{
+    auto call = dynamic_cast<const CallExpression*>(&expr);
+    return call && !call->args_.empty() && isBoolReduction(env, call->name_);
+}
 
-    int precedence() const override
-    {
-        return Precedence::LOGIC;
-    }
+/**
+ * Comparison of a path against a literal, which can be answered
+ * by a secondary index of the queried pool.
+ */
+struct IndexPredicate
+{
+    std::string path;
+    ValueIndex::Comparison op;
+    ScalarValueType literal;
 };
 
-class CastParser : public InfixParselet
+/**
+ * Get the normalized index path (see ValueIndex) of an expression
+ * which consists of field names and wildcards only.
+ */
+static auto indexPath(const Expr& e, std::string& path) -> bool
 {
-public:
-    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
-    {
-        auto type = p.consume();
-        if (type.type == Token::C_NULL)
-            return std::make_unique<ConstExpr>(Value::null());
-
-        if (type.type != Token::Type::WORD)
-            raise<std::runtime_error>("'as' expected typename got "s + type.toString());
+    auto append = [&path](std::string_view segment) {
+        if (!path.empty())
+            path.push_back('.');
+        path.append(segment);
+    };
 
-        auto name = std::get<std::string>(type.value);
-        return simplifyOrForward(p.env, [&]() -> ExprPtr {
-            if (name == strings::TypenameBool)
-                return std::make_unique<UnaryExpr<OperatorBool>>(std::move(left));
-            if (name == strings::TypenameInt)
-                return std::make_unique<UnaryExpr<OperatorAsInt>>(std::move(left));
-            if (name == strings::TypenameFloat)
-                return std::make_unique<UnaryExpr<OperatorAsFloat>>(std::move(left));
-            if (name == strings::TypenameString)
-                return std::make_unique<UnaryExpr<OperatorAsString>>(std::move(left));
+    if (auto field = dynamic_cast<const FieldExpr*>(&e)) {
+        if (field->name_ != "_")
+            append(field->name_);
+        return true;
+    }
+    if (auto fields = dynamic_cast<const FieldPathExpr*>(&e)) {
+        for (const auto& name : fields->names_)
+            append(name);
+        return true;
+    }
+    if (dynamic_cast<const AnyChildExpr*>(&e)) {
+        append("*");
+        return true;
+    }
+    if (dynamic_cast<const WildcardExpr*>(&e)) {
+        append("**");
+        return true;
+    }
+    if (auto sub = dynamic_cast<const PathExpr*>(&e))
+        return indexPath(*sub->left_, path) && indexPath(*sub->right_, path);
+    if (auto fused = dynamic_cast<const WildcardFieldExpr*>(&e))
+        return indexPath(*fused->path_, path);
+    if (auto children = dynamic_cast<const ChildFieldsExpr*>(&e)) {
+        if (children->base_ && !indexPath(*children->base_, path))
+            return false;
+        append("*");
+        for (const auto& name : children->names_)
+            append(name);
+        return true;
+    }
+    return false;
+}
 
-            raise<std::runtime_error>("Invalid type name for cast '"s + name + "'"s);
-        }());
+static auto indexLiteral(const Expr& e) -> std::optional<ScalarValueType>
+{
+    auto constant = dynamic_cast<const ConstExpr*>(&e);
+    if (!constant)
+        return {};
+
+    const auto& value = constant->value();
+    switch (value.type) {
+    case ValueType::Bool:   return ScalarValueType(std::in_place_type<bool>, value.as<ValueType::Bool>());
+    case ValueType::Int:    return ScalarValueType(std::in_place_type<int64_t>, value.as<ValueType::Int>());
+    case ValueType::Float:  return ScalarValueType(std::in_place_type<double>, value.as<ValueType::Float>());
+    case ValueType::String: return ScalarValueType(std::in_place_type<std::string>, value.as<ValueType::String>());
+    default:                return {};
     }
+}
 
-    int precedence() const override
-    {
-        return Precedence::CAST;
-    }
-};
+/**
+ * Match `<path> <Operator> <literal>`, or `<literal> <Operator> <path>`
+ * with the operands swapped.
+ */
+template <class Operator>
+static auto indexPredicate(const Expr& e, ValueIndex::Comparison op, ValueIndex::Comparison swapped) -> std::optional<IndexPredicate>
+{
+    auto binary = dynamic_cast<const BinaryExpr<Operator>*>(&e);
+    if (!binary)
+        return {};
+
+    IndexPredicate predicate;
+    if (auto literal = indexLiteral(*binary->right_)) {
+        predicate.op = op;
+        predicate.literal = std::move(*literal);
+        if (!indexPath(*binary->left_, predicate.path))
+            return {};
+    }
+    else if (auto swappedLiteral = indexLiteral(*binary->left_)) {
+        predicate.op = swapped;
+        predicate.literal = std::move(*swappedLiteral);
+        if (!indexPath(*binary->right_, predicate.path))
+            return {};
+    }
+
+    if (predicate.path.empty())
+        return {};
+    return predicate;
+}
 
 /**
- * Parser wrapper for parsing infix operators.
- *
- * <expr> OP <expr>
+ * Query planner hook: Match `any(<path> <op> <literal>)`, where the path
+ * consists of field names and wildcards, and <op> is a comparison.
  */
-template <class Operator,
-          int Precedence>
-class BinaryOpParser : public InfixParselet
+static auto indexPredicate(Environment& env, const Expr& expr) -> std::optional<IndexPredicate>
+{
+    auto call = dynamic_cast<const CallExpression*>(&expr);
+    if (!call || call->args_.size() != 1 || env.findFunction(call->name_) != &AnyFn::Fn)
+        return {};
+
+    using Comparison = ValueIndex::Comparison;
+    const auto& arg = *call->args_[0];
+    if (auto predicate = indexPredicate<OperatorEq>(arg, Comparison::Eq, Comparison::Eq))
+        return predicate;
+    if (auto predicate = indexPredicate<OperatorLt>(arg, Comparison::Lt, Comparison::Gt))
+        return predicate;
+    if (auto predicate = indexPredicate<OperatorLtEq>(arg, Comparison::LtEq, Comparison::GtEq))
+        return predicate;
+    if (auto predicate = indexPredicate<OperatorGt>(arg, Comparison::Gt, Comparison::Lt))
+        return predicate;
+    return indexPredicate<OperatorGtEq>(arg, Comparison::GtEq, Comparison::LtEq);
+}
+
+/**
+ * Looks up an IndexPredicate in the secondary index of the queried pool
+ * (see ModelPool::addIndex), if the pool has an index for the path and
+ * the current node is one of its roots. Evaluates the original
+ * expression otherwise.
+ */
+class IndexLookupExpr : public Expr
 {
 public:
-    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
+    IndexLookupExpr(ExprPtr expr, IndexPredicate predicate)
+        : expr_(std::move(expr))
+        , predicate_(std::move(predicate))
+    {}
+
+    auto type() const -> Type override
     {
-        auto right = p.parsePrecedence(precedence());
-        return simplifyOrForward(p.env, std::make_unique<BinaryExpr<Operator>>(std::move(left),
-                                                                                std::move(right)));
+        return expr_->type();
     }
 
-    int precedence() const override
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
     {
-        return Precedence;
+        if (ctx.phase == Context::Phase::Evaluation && !ctx.env->debug && val.node) {
+            if (auto pool = ModelPool::of(*val.node)) {
+                if (auto index = pool->index(predicate_.path)) {
+                    if (auto found = index->test(val.node->addr(), predicate_.op, predicate_.literal))
+                        return res(ctx, Value::make(*found));
+                }
+            }
+        }
+
+        return expr_->eval(ctx, std::move(val), res);
     }
-};
 
-/**
- * Parser for unary operators.
- *
- * ('-' | '~' | 'not') <expr>
- */
-template <class Operator>
-class UnaryOpParser : public PrefixParselet
-{
-    auto parse(Parser& p, Token t) const -> ExprPtr override
+    auto toString() const -> std::string override
     {
-        auto sub = p.parsePrecedence(Precedence::UNARY);
-        return simplifyOrForward(p.env, std::make_unique<UnaryExpr<Operator>>(std::move(sub)));
+        return expr_->toString();
     }
+
+    ExprPtr expr_;
+
+private:
+    IndexPredicate predicate_;
 };
 
 /**
- * Parse postfix unary operator.
+ * Field names which the values of an expression depend on: If one of
+ * the fields does not occur below the queried root, the expression yields
+ * only nulls without a node (nullFields), or no truthy value (falsyFields).
+ * Name sets are kept sorted.
  */
-template <class Operator>
-class UnaryPostOpParser : public InfixParselet
-{
-    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
-    {
-        return p.parseInfix(simplifyOrForward(p.env, std::make_unique<UnaryExpr<Operator>>(std::move(left))), 0);
-    }
+using FieldNames = std::vector<std::string>;
+
+static auto unite(FieldNames names, const FieldNames& other) -> FieldNames
+{
+    names.insert(names.end(), other.begin(), other.end());
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
+static auto intersect(const FieldNames& names, const FieldNames& other) -> FieldNames
+{
+    FieldNames result;
+    std::set_intersection(names.begin(), names.end(), other.begin(), other.end(), std::back_inserter(result));
+    return result;
+}
+
+static auto falsyFields(Environment& env, const Expr& e) -> FieldNames;
+
+static auto nullFields(Environment& env, const Expr& e) -> FieldNames
+{
+    if (auto field = dynamic_cast<const FieldExpr*>(&e)) {
+        if (field->name_ == "_")
+            return {};
+        return {field->name_};
+    }
+    if (auto fields = dynamic_cast<const FieldPathExpr*>(&e))
+        return unite({}, fields->names_);
+    if (auto path = dynamic_cast<const PathExpr*>(&e))
+        return unite(nullFields(env, *path->left_), nullFields(env, *path->right_));
+    if (auto fused = dynamic_cast<const WildcardFieldExpr*>(&e))
+        return nullFields(env, *fused->path_);
+    if (auto children = dynamic_cast<const ChildFieldsExpr*>(&e))
+        return unite(children->base_ ? nullFields(env, *children->base_) : FieldNames{}, children->names_);
+    if (auto sub = dynamic_cast<const SubExpr*>(&e))
+        return unite(nullFields(env, *sub->left_), falsyFields(env, *sub->sub_));
+    return {};
+}
+
+/* Comparisons of a null against a non-null literal are false */
+template <class Operator>
+static auto comparedFields(Environment& env, const Expr& e, FieldNames& names) -> bool
+{
+    auto binary = dynamic_cast<const BinaryExpr<Operator>*>(&e);
+    if (!binary)
+        return false;
+
+    if (indexLiteral(*binary->right_))
+        names = nullFields(env, *binary->left_);
+    else if (indexLiteral(*binary->left_))
+        names = nullFields(env, *binary->right_);
+    return true;
+}
+
+static auto falsyFields(Environment& env, const Expr& e) -> FieldNames
+{
+    if (auto path = dynamic_cast<const PathExpr*>(&e))
+        return unite(nullFields(env, *path->left_), falsyFields(env, *path->right_));
+    if (auto sub = dynamic_cast<const SubExpr*>(&e))
+        return unite(falsyFields(env, *sub->left_), falsyFields(env, *sub->sub_));
+    if (auto op = dynamic_cast<const AndExpr*>(&e))
+        return unite(falsyFields(env, *op->left_), falsyFields(env, *op->right_));
+    if (auto op = dynamic_cast<const OrExpr*>(&e))
+        return intersect(falsyFields(env, *op->left_), falsyFields(env, *op->right_));
+    if (auto call = dynamic_cast<const CallExpression*>(&e); call && call->args_.size() == 1) {
+        if (env.findFunction(call->name_) == &AnyFn::Fn)
+            return falsyFields(env, *call->args_[0]);
+        return {};
+    }
+
+    FieldNames names;
+    if (comparedFields<OperatorEq>(env, e, names) ||
+        comparedFields<OperatorLt>(env, e, names) ||
+        comparedFields<OperatorLtEq>(env, e, names) ||
+        comparedFields<OperatorGt>(env, e, names) ||
+        comparedFields<OperatorGtEq>(env, e, names))
+        return names;
+    return nullFields(env, e);
+}
+
+/**
+ * Query planner hook: Get the fields without which `any(...)` is false.
+ */
+static auto requiredFields(Environment& env, const Expr& expr) -> FieldNames
+{
+    auto call = dynamic_cast<const CallExpression*>(&expr);
+    if (!call || call->args_.size() != 1 || env.findFunction(call->name_) != &AnyFn::Fn)
+        return {};
+    return falsyFields(env, expr);
+}
+
+/**
+ * Returns false for roots whose field filter (see ModelPool::setFieldFilters)
+ * rules out one of the required fields. Evaluates the wrapped `any(...)`
+ * expression otherwise.
+ */
+class FieldFilterExpr : public Expr
+{
+public:
+    FieldFilterExpr(ExprPtr expr, FieldNames names, const Environment* env)
+        : expr_(std::move(expr))
+        , names_(std::move(names))
+    {
+        symbols_.reserve(names_.size());
+        for (const auto& name : names_)
+            symbols_.emplace_back(name, env);
+    }
+
+    auto type() const -> Type override
+    {
+        return expr_->type();
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        if (ctx.phase == Context::Phase::Evaluation && !ctx.env->debug && val.node) {
+            if (auto pool = ModelPool::native(*val.node)) {
+                for (auto i = 0u; i < names_.size(); ++i) {
+                    /* Names which are not in the string pool occur nowhere */
+                    auto id = symbols_[i].id(ctx, names_[i]);
+                    if (!id || !pool->mayContainField(val.node->addr(), id))
+                        return res(ctx, Value::f());
+                }
+            }
+        }
+
+        return expr_->eval(ctx, std::move(val), res);
+    }
+
+    auto toString() const -> std::string override
+    {
+        return expr_->toString();
+    }
+
+    ExprPtr expr_;
+
+private:
+    FieldNames names_;
+    std::vector<FieldSymbol> symbols_;
+};
+
+/**
+ * Parser wrapper for parsing and & or operators.
+ *
+ * <expr> [and|or] <expr>
+ */
+class AndOrParser : public InfixParselet
+{
+public:
+    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
+    {
+        auto right = p.parsePrecedence(precedence());
+
+        /* A constant left side decides at compile time, whether the right
+         * side is returned: `<true> and b` as well as `<false> or b` is b. */
+        if (auto constant = dynamic_cast<const ConstExpr*>(left.get())) {
+            auto truthy = UnaryOperatorDispatcher<OperatorBool>::dispatch(constant->value());
+            if (truthy.isa(ValueType::Bool) && truthy.as<ValueType::Bool>() == (t.type == Token::OP_AND))
+                return right;
+        }
+
+        if (t.type == Token::OP_AND)
+          return simplifyOrForward(p.env, std::make_unique<AndExpr>(std::move(left),
+                                                                    std::move(right)));
+        else if (t.type == Token::OP_OR)
+          return simplifyOrForward(p.env, std::make_unique<OrExpr>(std::move(left),
+                                                                   std::move(right)));
+        assert(0);
+        return nullptr;
+    }
+
+    int precedence() const override
+    {
+        return Precedence::LOGIC;
+    }
+};
+
+class CastParser : public InfixParselet
+{
+public:
+    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
+    {
+        auto type = p.consume();
+        if (type.type == Token::C_NULL)
+            return std::make_unique<ConstExpr>(Value::null());
+
+        if (type.type != Token::Type::WORD)
+            raise<std::runtime_error>("'as' expected typename got "s + type.toString());
+
+        auto name = std::get<std::string>(type.value);
+        return simplifyOrForward(p.env, [&]() -> ExprPtr {
+            if (name == strings::TypenameBool)
+                return std::make_unique<UnaryExpr<OperatorBool>>(std::move(left));
+            if (name == strings::TypenameInt)
+                return std::make_unique<UnaryExpr<OperatorAsInt>>(std::move(left));
+            if (name == strings::TypenameFloat)
+                return std::make_unique<UnaryExpr<OperatorAsFloat>>(std::move(left));
+            if (name == strings::TypenameString)
+                return std::make_unique<UnaryExpr<OperatorAsString>>(std::move(left));
+
+            raise<std::runtime_error>("Invalid type name for cast '"s + name + "'"s);
+        }());
+    }
+
+    int precedence() const override
+    {
+        return Precedence::CAST;
+    }
+};
+
+/**
+ * Parser wrapper for parsing infix operators.
+ *
+ * <expr> OP <expr>
+ */
+template <class Operator,
+          int Precedence>
+class BinaryOpParser : public InfixParselet
+{
+public:
+    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
+    {
+        auto right = p.parsePrecedence(precedence());
+        auto expr = simplifyOrForward(p.env, std::make_unique<BinaryExpr<Operator>>(std::move(left),
+                                                                                     std::move(right)));
+        if constexpr (isComparison<Operator>) {
+            expr = specializeStringCompare<Operator>(std::move(expr));
+            expr = specializeBatchCompare<Operator>(std::move(expr));
+            expr = specializeCountCompare<Operator>(p.env, std::move(expr));
+            return specializeNumberCompare<Operator>(std::move(expr));
+        }
+        return expr;
+    }
+
+    int precedence() const override
+    {
+        return Precedence;
+    }
+};
+
+/**
+ * Parser for unary operators.
+ *
+ * ('-' | '~' | 'not') <expr>
+ */
+template <class Operator>
+class UnaryOpParser : public PrefixParselet
+{
+    auto parse(Parser& p, Token t) const -> ExprPtr override
+    {
+        auto sub = p.parsePrecedence(Precedence::UNARY);
+        return simplifyOrForward(p.env, std::make_unique<UnaryExpr<Operator>>(std::move(sub)));
+    }
+};
+
+/**
+ * Parse postfix unary operator.
+ */
+template <class Operator>
+class UnaryPostOpParser : public InfixParselet
+{
+    auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
+    {
+        return p.parseInfix(simplifyOrForward(p.env, std::make_unique<UnaryExpr<Operator>>(std::move(left))), 0);
+    }
 
     auto precedence() const -> int override
     {
@@ -1219,11 +2448,16 @@ class WordParser : public PrefixParselet
             });
 
             auto arguments = p.parseList(Token::RPAREN);
+
+            /* any(any(...)) or any(each(...)) is the inner call */
+            if (arguments.size() == 1 && isBoolReduction(p.env, word) && isBoolReduction(p.env, *arguments[0]))
+                return std::move(arguments[0]);
+
             return simplifyOrForward(p.env, std::make_unique<CallExpression>(word, std::move(arguments)));
         }
 
         /* Single field name */
-        return std::make_unique<FieldExpr>(std::move(word));
+        return std::make_unique<FieldExpr>(std::move(word), p.env);
     }
 };
 
@@ -1237,6 +2471,44 @@ class PathParser : public InfixParselet
     auto parse(Parser& p, ExprPtr left, Token t) const -> ExprPtr override
     {
         auto right = p.parsePrecedence(precedence());
+
+        /* Fuse chains of plain field names into a single FieldPathExpr */
+        auto fieldName = [](const Expr& e) -> const std::string* {
+            if (auto field = dynamic_cast<const FieldExpr*>(&e); field && field->name_ != "_")
+                return &field->name_;
+            return nullptr;
+        };
+
+        if (auto rightName = fieldName(*right)) {
+            /* `**.name` tests the field names during the wildcard walk */
+            if (dynamic_cast<const WildcardExpr*>(left.get())) {
+                auto name = *rightName;
+                return std::make_unique<WildcardFieldExpr>(
+                    std::make_unique<PathExpr>(std::move(left), std::move(right)), std::move(name), p.env);
+            }
+
+            /* `base.*.name` looks up the field for batches of children */
+            if (auto leftChildren = dynamic_cast<ChildFieldsExpr*>(left.get())) {
+                leftChildren->names_.push_back(*rightName);
+                leftChildren->symbols_.emplace_back(*rightName, p.env);
+                return left;
+            }
+            if (dynamic_cast<const AnyChildExpr*>(left.get()))
+                return std::make_unique<ChildFieldsExpr>(nullptr, std::vector<std::string>{*rightName}, p.env);
+            if (auto leftPath = dynamic_cast<PathExpr*>(left.get());
+                leftPath && dynamic_cast<const AnyChildExpr*>(leftPath->right_.get()))
+                return std::make_unique<ChildFieldsExpr>(std::move(leftPath->left_), std::vector<std::string>{*rightName}, p.env);
+
+            if (auto leftName = fieldName(*left))
+                return std::make_unique<FieldPathExpr>(std::vector<std::string>{*leftName, *rightName}, p.env);
+
+            if (auto leftPath = dynamic_cast<const FieldPathExpr*>(left.get())) {
+                auto names = leftPath->names_;
+                names.push_back(*rightName);
+                return std::make_unique<FieldPathExpr>(std::move(names), p.env);
+            }
+        }
+
         return std::make_unique<PathExpr>(std::move(left), std::move(right));
     }
 
@@ -1246,79 +2518,940 @@ class PathParser : public InfixParselet
     }
 };
 
-auto compile(Environment& env, std::string_view sv, bool any) -> ExprPtr
+/**
+ * Bytecode backend
+ *
+ * The expression tree is lowered into a linear instruction list, which is
+ * executed by a small interpreter loop operating on an explicit value stack.
+ * Every lowered expression pushes exactly one value per result.
+ *
+ * Expressions yielding multiple values (wildcards, value lists and all
+ * expressions without a dedicated instruction) are generators: the rest
+ * of the current code range is executed once per produced value, with the
+ * value stack restored from a snapshot before each run. Scoped instructions
+ * (paths, any/each/count) run their body range with a local sink.
+ *
+ * The interpreter only runs in the evaluation phase without a debugger
+ * attached; otherwise the original tree is evaluated, so debug hooks see
+ * the same expressions as the tree interpreter.
+ */
+namespace bytecode
 {
-    Parser p(&env, sv);
 
-    /* Scalars */
-    p.prefixParsers[Token::C_TRUE]  = std::make_unique<ConstParser>(Value::t());
-    p.prefixParsers[Token::C_FALSE] = std::make_unique<ConstParser>(Value::f());
-    p.prefixParsers[Token::C_NULL]  = std::make_unique<ConstParser>(Value::null());
-    p.prefixParsers[Token::INT]     = std::make_unique<ScalarParser<int64_t>>();
-    p.prefixParsers[Token::FLOAT]   = std::make_unique<ScalarParser<double>>();
-    p.prefixParsers[Token::STRING]  = std::make_unique<ScalarParser<std::string>>();
-    p.prefixParsers[Token::REGEXP]  = std::make_unique<RegExpParser>();
+enum class Op : uint8_t
+{
+    Const,     /* Push constant `arg` */
+    Field,     /* Push field `arg` of the current value */
+    FieldPath, /* Push fused field path `arg` of the current value */
+    Unary,     /* Apply unary operator `arg` to the top value */
+    Binary,    /* Apply binary operator `arg` to the two top values */
+    And,       /* Keep top value and jump to `end` if it is falsy, else pop */
+    Or,        /* Keep top value and jump to `end` if it is truthy, else pop */
+    Path,      /* Path scope over [pc+1, end); null if the body yields nothing */
+    Enter,     /* Pop value and make it the current value for the rest of the range */
+    Any,       /* any(...) over [pc+1, end) */
+    Each,      /* each(...) over [pc+1, end) */
+    Count,     /* count(...) over [pc+1, end) */
+    Tree,      /* Generator: evaluate tree expression `arg` on the current value */
+};
 
-    /* Unary Operators */
-    p.prefixParsers[Token::OP_SUB]    = std::make_unique<UnaryOpParser<OperatorNegate>>();
-    p.prefixParsers[Token::OP_BITINV] = std::make_unique<UnaryOpParser<OperatorBitInv>>();
-    p.prefixParsers[Token::OP_NOT]    = std::make_unique<UnaryOpParser<OperatorNot>>();
-    p.prefixParsers[Token::OP_LEN]    = std::make_unique<UnaryOpParser<OperatorLen>>();
-    p.infixParsers[Token::OP_BOOL]    = std::make_unique<UnaryPostOpParser<OperatorBool>>();
-    p.prefixParsers[Token::OP_TYPEOF] = std::make_unique<UnaryOpParser<OperatorTypeof>>();
-    p.infixParsers[Token::OP_UNPACK]  = std::make_unique<UnpackOpParser>();
-    p.infixParsers[Token::WORD]       = std::make_unique<WordOpParser>();
+struct Instruction
+{
+    Op op;
+    uint32_t arg = 0;
+    uint32_t end = 0;
+};
 
-    /* Binary Operators */
-    p.infixParsers[Token::OP_ADD]   = std::make_unique<BinaryOpParser<OperatorAdd, Precedence::TERM>>();
-    p.infixParsers[Token::OP_SUB]   = std::make_unique<BinaryOpParser<OperatorSub, Precedence::TERM>>();
-    p.infixParsers[Token::OP_TIMES] = std::make_unique<BinaryOpParser<OperatorMul, Precedence::PRODUCT>>();
-    p.infixParsers[Token::OP_DIV]   = std::make_unique<BinaryOpParser<OperatorDiv, Precedence::PRODUCT>>();
-    p.infixParsers[Token::OP_MOD]   = std::make_unique<BinaryOpParser<OperatorMod, Precedence::PRODUCT>>();
+using UnaryFn = Value (*)(const Value&);
+using BinaryFn = Value (*)(const Value&, const Value&);
 
-    /* Bit Operators */
-    p.infixParsers[Token::OP_BITAND] = std::make_unique<BinaryOpParser<OperatorBitAnd, Precedence::BITWISE>>();
-    p.infixParsers[Token::OP_BITOR]  = std::make_unique<BinaryOpParser<OperatorBitOr, Precedence::BITWISE>>();
-    p.infixParsers[Token::OP_BITXOR] = std::make_unique<BinaryOpParser<OperatorBitXor, Precedence::BITWISE>>();
-    p.infixParsers[Token::OP_LSHIFT] = std::make_unique<BinaryOpParser<OperatorShl, Precedence::BITWISE>>();
-    p.infixParsers[Token::OP_RSHIFT] = std::make_unique<BinaryOpParser<OperatorShr, Precedence::BITWISE>>();
+template <class Operator>
+static auto unaryFn(const Value& v) -> Value
+{
+    return UnaryOperatorDispatcher<Operator>::dispatch(v);
+}
 
-    /* Comparison/Test */
-    p.infixParsers[Token::OP_EQ]     = std::make_unique<BinaryOpParser<OperatorEq,   Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_NOT_EQ] = std::make_unique<BinaryOpParser<OperatorNeq,  Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_LT]     = std::make_unique<BinaryOpParser<OperatorLt,   Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_LTEQ]   = std::make_unique<BinaryOpParser<OperatorLtEq, Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_GT]     = std::make_unique<BinaryOpParser<OperatorGt,   Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_GTEQ]   = std::make_unique<BinaryOpParser<OperatorGtEq, Precedence::EQUALITY>>();
-    p.infixParsers[Token::OP_AND]    = std::make_unique<AndOrParser>();
-    p.infixParsers[Token::OP_OR]     = std::make_unique<AndOrParser>();
+template <class Operator>
+static auto binaryFn(const Value& l, const Value& r) -> Value
+{
+    if constexpr (isComparison<Operator>) {
+        if (auto result = compareNumbers<Operator>(l, r))
+            return Value::make(*result);
+    }
+    return BinaryOperatorDispatcher<Operator>::dispatch(l, r);
+}
 
-    /* Cast */
-    p.infixParsers[Token::OP_CAST]   = std::make_unique<CastParser>();
+static auto truthy(const Value& v) -> bool
+{
+    if (v.isa(ValueType::Undef))
+        return false;
+    return UnaryOperatorDispatcher<OperatorBool>::dispatch(v).as<ValueType::Bool>();
+}
 
-    /* Subexpressions/Subscript */
-    p.prefixParsers[Token::LPAREN] = std::make_unique<ParenParser>();     /* (...) */
-    p.prefixParsers[Token::LBRACE] = std::make_unique<SubSelectParser>(); /* {...} */
-    p.infixParsers[Token::LBRACE] = std::make_unique<SubSelectParser>();
-    p.prefixParsers[Token::LBRACK] = std::make_unique<SubscriptParser>(); /* [...] */
-    p.infixParsers[Token::LBRACK] = std::make_unique<SubscriptParser>();
+struct Program
+{
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<const Expr*> exprs;
+    std::vector<UnaryFn> unary;
+    std::vector<BinaryFn> binary;
 
-    /* Ident/Function */
-    p.prefixParsers[Token::WORD] = std::make_unique<WordParser>();
-    p.prefixParsers[Token::SELF] = std::make_unique<WordParser>();
+    auto emit(Op op, uint32_t arg = 0) -> uint32_t
+    {
+        code.push_back({op, arg, 0});
+        return static_cast<uint32_t>(code.size() - 1);
+    }
 
-    /* Wildcards */
-    p.prefixParsers[Token::WILDCARD] = std::make_unique<WordParser>();
-    p.prefixParsers[Token::OP_TIMES] = std::make_unique<WordParser>();
+    auto close(uint32_t at)
+    {
+        code[at].end = static_cast<uint32_t>(code.size());
+    }
 
-    /* Paths */
-    p.infixParsers[Token::DOT]  = std::make_unique<PathParser>();
+    template <class Vec, class T>
+    static auto add(Vec& vec, T&& item) -> uint32_t
+    {
+        vec.push_back(std::forward<T>(item));
+        return static_cast<uint32_t>(vec.size() - 1);
+    }
+};
 
-    auto expr = [&](){
-        if (any) {
-            std::vector<ExprPtr> root;
-            root.emplace_back(p.parse());
-            return simplifyOrForward(p.env, std::make_unique<CallExpression>("any"s, std::move(root)));
+template <class... Operators>
+struct OperatorList {};
+
+using UnaryOperators = OperatorList<
+    OperatorNegate, OperatorBitInv, OperatorNot, OperatorLen, OperatorBool,
+    OperatorTypeof, OperatorAsInt, OperatorAsFloat, OperatorAsString>;
+
+using BinaryOperators = OperatorList<
+    OperatorAdd, OperatorSub, OperatorMul, OperatorDiv, OperatorMod,
+    OperatorBitAnd, OperatorBitOr, OperatorBitXor, OperatorShl, OperatorShr,
+    OperatorEq, OperatorNeq, OperatorLt, OperatorLtEq, OperatorGt, OperatorGtEq>;
+
+static auto lower(Environment& env, Program& p, const Expr& e) -> void;
+
+template <class... Operators>
+static auto lowerUnary(Environment& env, Program& p, const Expr& e, OperatorList<Operators...>) -> bool
+{
+    auto tryLower = [&]<class Operator>(Operator*) {
+        auto op = dynamic_cast<const UnaryExpr<Operator>*>(&e);
+        if (!op)
+            return false;
+        lower(env, p, *op->sub_);
+        p.emit(Op::Unary, Program::add(p.unary, &unaryFn<Operator>));
+        return true;
+    };
+    return (tryLower((Operators*)nullptr) || ...);
+}
+
+template <class... Operators>
+static auto lowerBinary(Environment& env, Program& p, const Expr& e, OperatorList<Operators...>) -> bool
+{
+    auto tryLower = [&]<class Operator>(Operator*) {
+        auto op = dynamic_cast<const BinaryExpr<Operator>*>(&e);
+        if (!op)
+            return false;
+        if constexpr (isComparison<Operator>) {
+            /* Batched and short-circuit comparisons stay with the tree interpreter */
+            if (dynamic_cast<const BatchCompareExpr<Operator>*>(op) ||
+                dynamic_cast<const CountCompareExpr<Operator>*>(op))
+                return false;
+        }
+        lower(env, p, *op->left_);
+        lower(env, p, *op->right_);
+        p.emit(Op::Binary, Program::add(p.binary, &binaryFn<Operator>));
+        return true;
+    };
+    return (tryLower((Operators*)nullptr) || ...);
+}
+
+static auto lower(Environment& env, Program& p, const Expr& e) -> void
+{
+    if (auto c = dynamic_cast<const ConstExpr*>(&e)) {
+        p.emit(Op::Const, Program::add(p.constants, c->value()));
+        return;
+    }
+
+    if (dynamic_cast<const FieldExpr*>(&e)) {
+        p.emit(Op::Field, Program::add(p.exprs, &e));
+        return;
+    }
+
+    if (dynamic_cast<const FieldPathExpr*>(&e)) {
+        p.emit(Op::FieldPath, Program::add(p.exprs, &e));
+        return;
+    }
+
+    if (auto path = dynamic_cast<const PathExpr*>(&e)) {
+        auto at = p.emit(Op::Path);
+        lower(env, p, *path->left_);
+        p.emit(Op::Enter);
+        lower(env, p, *path->right_);
+        p.close(at);
+        return;
+    }
+
+    if (auto op = dynamic_cast<const AndExpr*>(&e)) {
+        lower(env, p, *op->left_);
+        auto at = p.emit(Op::And);
+        lower(env, p, *op->right_);
+        p.close(at);
+        return;
+    }
+
+    if (auto op = dynamic_cast<const OrExpr*>(&e)) {
+        lower(env, p, *op->left_);
+        auto at = p.emit(Op::Or);
+        lower(env, p, *op->right_);
+        p.close(at);
+        return;
+    }
+
+    if (auto call = dynamic_cast<const CallExpression*>(&e); call && call->args_.size() == 1) {
+        auto fn = env.findFunction(call->name_);
+        auto reduction = fn == &AnyFn::Fn   ? std::optional<Op>(Op::Any)
+                       : fn == &EachFn::Fn  ? std::optional<Op>(Op::Each)
+                       : fn == &CountFn::Fn ? std::optional<Op>(Op::Count)
+                                            : std::nullopt;
+        if (reduction) {
+            auto at = p.emit(*reduction);
+            lower(env, p, *call->args_[0]);
+            p.close(at);
+            return;
+        }
+    }
+
+    if (lowerUnary(env, p, e, UnaryOperators{}) || lowerBinary(env, p, e, BinaryOperators{}))
+        return;
+
+    /* Everything else is evaluated by the tree interpreter */
+    p.emit(Op::Tree, Program::add(p.exprs, &e));
+}
+
+class Interpreter
+{
+public:
+    Interpreter(Context ctx, const Program& program)
+        : ctx_(std::move(ctx))
+        , program_(program)
+        , stack_(ctx_.scratch)
+    {}
+
+    /* Execute [pc, end) on the current value `cur` and pass
+     * the resulting top value(s) to `sink`. */
+    auto run(uint32_t pc, uint32_t end, const Value& cur, const ResultFn& sink) -> Result
+    {
+        const auto& code = program_.code;
+        while (pc < end) {
+            const auto& ins = code[pc];
+            switch (ins.op) {
+            case Op::Const:
+                stack_.push_back(program_.constants[ins.arg]);
+                ++pc;
+                break;
+
+            case Op::Field:
+                stack_.push_back(static_cast<const FieldExpr*>(program_.exprs[ins.arg])->lookup(ctx_, cur));
+                ++pc;
+                break;
+
+            case Op::FieldPath:
+                stack_.push_back(static_cast<const FieldPathExpr*>(program_.exprs[ins.arg])->lookup(ctx_, cur));
+                ++pc;
+                break;
+
+            case Op::Unary:
+                stack_.back() = program_.unary[ins.arg](stack_.back());
+                ++pc;
+                break;
+
+            case Op::Binary: {
+                auto rhs = pop();
+                stack_.back() = program_.binary[ins.arg](stack_.back(), rhs);
+                ++pc;
+                break;
+            }
+
+            case Op::And:
+            case Op::Or: {
+                /* Same rules as AndExpr/OrExpr */
+                const auto& lhs = stack_.back();
+                auto keep = lhs.isa(ValueType::Undef);
+                if (!keep) {
+                    auto v = UnaryOperatorDispatcher<OperatorBool>::dispatch(lhs);
+                    keep = v.isa(ValueType::Bool) && v.template as<ValueType::Bool>() == (ins.op == Op::Or);
+                }
+
+                if (keep) {
+                    pc = ins.end;
+                } else {
+                    stack_.pop_back();
+                    ++pc;
+                }
+                break;
+            }
+
+            case Op::Enter: {
+                auto v = pop();
+                if (v.isa(ValueType::Undef) || (v.isa(ValueType::Null) && !v.node))
+                    return Result::Continue;
+                return run(pc + 1, end, v, sink);
+            }
+
+            case Op::Path: {
+                /* The path is a complete expression, which leaves the values
+                 * below it alone, so only its height has to be restored */
+                const auto height = stack_.size();
+                auto calls = 0u;
+                auto r = run(pc + 1, ins.end, cur, LambdaResultFn([&](Context, Value v) {
+                    ctx_.visit();
+                    if (v.isa(ValueType::Undef) || (v.isa(ValueType::Null) && !v.node))
+                        return Result::Continue;
+                    ++calls;
+                    stack_.push_back(std::move(v));
+                    return run(ins.end, end, cur, sink);
+                }));
+
+                if (calls > 0 || r == Result::Stop)
+                    return r;
+
+                truncate(height);
+                stack_.push_back(Value::null());
+                pc = ins.end;
+                break;
+            }
+
+            case Op::Any:
+            case Op::Each:
+            case Op::Count: {
+                const auto height = stack_.size();
+                auto any = false;
+                auto each = true;
+                int64_t count = 0;
+                run(pc + 1, ins.end, cur, LambdaResultFn([&](Context, Value v) {
+                    ctx_.visit();
+                    auto t = truthy(v);
+                    any = any || t;
+                    each = each && t;
+                    count += t ? 1 : 0;
+                    if (ins.op == Op::Any)
+                        return any ? Result::Stop : Result::Continue;
+                    if (ins.op == Op::Each)
+                        return each ? Result::Continue : Result::Stop;
+                    return Result::Continue;
+                }));
+
+                truncate(height);
+                stack_.push_back(ins.op == Op::Any  ? Value::make(any)
+                               : ins.op == Op::Each ? Value::make(each)
+                                                    : Value::make(count));
+                pc = ins.end;
+                break;
+            }
+
+            case Op::Tree: {
+                /* Each value runs the rest of the program, which may consume
+                 * the operands below it, so they are restored per value */
+                const Stack saved(stack_, ctx_.scratch);
+                auto first = true;
+                return program_.exprs[ins.arg]->eval(ctx_, cur, LambdaResultFn([&, pc](Context, Value v) {
+                    if (!first)
+                        stack_ = saved;
+                    first = false;
+                    stack_.push_back(std::move(v));
+                    return run(pc + 1, end, cur, sink);
+                }));
+            }
+            }
+        }
+
+        return sink(ctx_, pop());
+    }
+
+private:
+    auto pop() -> Value
+    {
+        assert(!stack_.empty());
+        auto v = std::move(stack_.back());
+        stack_.pop_back();
+        return v;
+    }
+
+    /* Drop the values above `height` */
+    auto truncate(size_t height) -> void
+    {
+        stack_.erase(stack_.begin() + static_cast<std::ptrdiff_t>(height), stack_.end());
+    }
+
+    /* Snapshots of Tree ops live in scratch memory */
+    using Stack = std::pmr::vector<Value>;
+
+    Context ctx_;
+    const Program& program_;
+    Stack stack_;
+};
+
+/**
+ * Expression wrapper which executes the lowered program of `tree`.
+ */
+class ProgramExpr : public Expr
+{
+public:
+    ProgramExpr(Environment& env, ExprPtr tree)
+        : tree_(std::move(tree))
+    {
+        lower(env, program_, *tree_);
+    }
+
+    auto type() const -> Type override
+    {
+        return tree_->type();
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        if (ctx.env->debug || ctx.phase == Context::Phase::Compilation)
+            return tree_->eval(ctx, std::move(val), res);
+
+        Interpreter interpreter(ctx, program_);
+        return interpreter.run(0, static_cast<uint32_t>(program_.code.size()), val, res);
+    }
+
+    auto toString() const -> std::string override
+    {
+        return tree_->toString();
+    }
+
+    auto tree() const -> const Expr&
+    {
+        return *tree_;
+    }
+
+private:
+    ExprPtr tree_;
+    Program program_;
+};
+
+}
+
+/**
+ * Query packs: Per-root state of a QueryPack evaluation, which is shared
+ * by the expressions of the pack. It is only used while the expressions
+ * are evaluated on the root itself, so the state is bounded by the root.
+ */
+class PackCache
+{
+public:
+    PackCache(uint64_t pack, const ModelNode& root, size_t paths)
+        : pack_(pack)
+        , pool_(ModelPool::native(root))
+        , root_(root.addr())
+        , paths_(paths)
+        , previous_(active())
+    {
+        active() = this;
+    }
+
+    ~PackCache()
+    {
+        active() = previous_;
+    }
+
+    PackCache(const PackCache&) = delete;
+    PackCache& operator=(const PackCache&) = delete;
+
+    /* Cache of the pack evaluation on the calling thread,
+     * if `val` is its root, otherwise null. */
+    static auto of(uint64_t pack, const Context& ctx, const Value& val) -> PackCache*
+    {
+        auto cache = active();
+        if (!cache || cache->pack_ != pack || !cache->pool_ || !val.node)
+            return nullptr;
+        if (ctx.phase == Context::Phase::Compilation || ctx.env->debug)
+            return nullptr;
+        if (val.node->addr().value_ != cache->root_.value_ || ModelPool::native(*val.node) != cache->pool_)
+            return nullptr;
+        return cache;
+    }
+
+    auto pool() const -> const ModelPool&
+    {
+        return *pool_;
+    }
+
+    /* Recorded values of shared path `slot`, or null. */
+    auto path(size_t slot) -> std::optional<std::vector<Value>>&
+    {
+        return paths_[slot];
+    }
+
+    /* Fields collected by the shared `**` walk, or null. */
+    auto fields() -> std::optional<std::vector<std::vector<ModelNodeAddress>>>&
+    {
+        return fields_;
+    }
+
+private:
+    static auto active() -> PackCache*&
+    {
+        thread_local PackCache* cache = nullptr;
+        return cache;
+    }
+
+    uint64_t pack_;
+    const ModelPool* pool_;
+    ModelNodeAddress root_;
+    std::vector<std::optional<std::vector<Value>>> paths_;
+    std::optional<std::vector<std::vector<ModelNodeAddress>>> fields_;
+    PackCache* previous_;
+};
+
+/**
+ * Path with wildcards which occurs more than once in a pack. Its values
+ * on the root are recorded by the first use which takes all of them,
+ * and replayed afterwards.
+ */
+class SharedPathExpr : public Expr
+{
+public:
+    SharedPathExpr(uint64_t pack, size_t slot, ExprPtr path)
+        : pack_(pack)
+        , slot_(slot)
+        , path_(std::move(path))
+    {}
+
+    auto type() const -> Type override
+    {
+        return path_->type();
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& res) const -> Result override
+    {
+        auto cache = PackCache::of(pack_, ctx, val);
+        if (!cache)
+            return path_->eval(ctx, std::move(val), res);
+
+        auto& values = cache->path(slot_);
+        if (!values) {
+            /* Values are passed on while recording. If the caller stops
+             * early, the recording is incomplete and the next use records
+             * again, so a stopping rule does not walk the whole path. */
+            std::vector<Value> recorded;
+            auto stopped = false;
+            auto r = path_->eval(ctx, std::move(val), LambdaResultFn([&](Context ctx, Value vv) {
+                if (stopped)
+                    return Result::Stop;
+                recorded.push_back(vv);
+                stopped = res(ctx, std::move(vv)) == Result::Stop;
+                return stopped ? Result::Stop : Result::Continue;
+            }));
+            if (stopped)
+                return Result::Stop;
+            values = std::move(recorded);
+            return r;
+        }
+
+        for (const auto& v : *values) {
+            ctx.visit();
+            if (res(ctx, v) == Result::Stop)
+                return Result::Stop;
+        }
+        return Result::Continue;
+    }
+
+    auto toString() const -> std::string override
+    {
+        return path_->toString();
+    }
+
+    uint64_t pack_;
+    size_t slot_;
+    ExprPtr path_;
+};
+
+/**
+ * Walk like walkDescendants(), but collect the first field of every
+ * visited object for each of the sorted `names` at once.
+ */
+static auto collectFields(const Context& ctx, const ModelPool& pool, ModelNodeAddress addr,
+                          const std::vector<std::pair<StringId, size_t>>& names,
+                          std::vector<std::vector<ModelNodeAddress>>& fields) -> void
+{
+    WalkStack scoped;
+    auto& stack = *scoped;
+    stack.push_back(addr);
+
+    std::vector<size_t> matched;
+    while (!stack.empty()) {
+        ctx.visit();
+        auto node = stack.back();
+        stack.pop_back();
+        if (pool.typeOf(node) == ValueType::Null)
+            continue;
+
+        auto mark = stack.size();
+        if (node.column() == ModelPool::Objects) {
+            matched.clear();
+            pool.forEachField(node, [&](StringId field, ModelNodeAddress member) {
+                auto iter = std::lower_bound(names.begin(), names.end(), std::pair{field, size_t(0)});
+                for (; iter != names.end() && iter->first == field; ++iter) {
+                    if (std::find(matched.begin(), matched.end(), iter->second) != matched.end())
+                        continue;
+                    matched.push_back(iter->second);
+                    if (member)
+                        fields[iter->second].push_back(member);
+                }
+                stack.push_back(member);
+                return true;
+            });
+        }
+        else {
+            pool.forEachMember(node, [&](ModelNodeAddress member) {
+                stack.push_back(member);
+                return true;
+            });
+        }
+        std::reverse(stack.begin() + mark, stack.end());
+    }
+}
+
+/**
+ * `**.name` of a pack with more than one such lookup. On the root, the
+ * fields of all names are collected by one walk, see collectFields().
+ */
+class SharedFieldExpr : public Expr
+{
+public:
+    SharedFieldExpr(uint64_t pack, size_t index, std::shared_ptr<const std::vector<std::string>> names, ExprPtr expr)
+        : pack_(pack)
+        , index_(index)
+        , names_(std::move(names))
+        , expr_(std::move(expr))
+    {}
+
+    auto type() const -> Type override
+    {
+        return expr_->type();
+    }
+
+    auto ieval(Context ctx, Value val, const ResultFn& ores) const -> Result override
+    {
+        auto cache = PackCache::of(pack_, ctx, val);
+        if (!cache)
+            return expr_->eval(ctx, std::move(val), ores);
+
+        const auto& pool = cache->pool();
+        auto& fields = cache->fields();
+        if (!fields) {
+            /* Names which are not in the string pool occur nowhere */
+            std::vector<std::pair<StringId, size_t>> ids;
+            for (auto i = 0u; i < names_->size(); ++i)
+                if (auto id = ctx.env->strings()->get((*names_)[i]))
+                    ids.emplace_back(id, i);
+            std::sort(ids.begin(), ids.end());
+
+            fields.emplace(names_->size());
+            collectFields(ctx, pool, val.node->addr(), ids, *fields);
+        }
+
+        CountedResultFn<const ResultFn&> res(ores, ctx);
+        auto r = Result::Continue;
+        for (auto addr : (*fields)[index_]) {
+            if (res(ctx, Value::field(pool, *val.node, addr)) == Result::Stop) {
+                r = Result::Stop;
+                break;
+            }
+        }
+        res.ensureCall();
+        return r;
+    }
+
+    auto toString() const -> std::string override
+    {
+        return expr_->toString();
+    }
+
+    uint64_t pack_;
+    size_t index_;
+    std::shared_ptr<const std::vector<std::string>> names_;
+    ExprPtr expr_;
+};
+
+/* Pure path of field names and wildcards */
+static auto isPath(const Expr& e) -> bool
+{
+    if (dynamic_cast<const FieldExpr*>(&e) || dynamic_cast<const FieldPathExpr*>(&e) ||
+        dynamic_cast<const WildcardExpr*>(&e) || dynamic_cast<const AnyChildExpr*>(&e) ||
+        dynamic_cast<const WildcardFieldExpr*>(&e))
+        return true;
+    if (auto children = dynamic_cast<const ChildFieldsExpr*>(&e))
+        return !children->base_ || isPath(*children->base_);
+    if (auto path = dynamic_cast<const PathExpr*>(&e))
+        return isPath(*path->left_) && isPath(*path->right_);
+    return false;
+}
+
+/* Path whose evaluation visits more than a fixed number of nodes */
+static auto hasWildcard(const Expr& e) -> bool
+{
+    if (dynamic_cast<const WildcardExpr*>(&e) || dynamic_cast<const AnyChildExpr*>(&e) ||
+        dynamic_cast<const WildcardFieldExpr*>(&e) || dynamic_cast<const ChildFieldsExpr*>(&e))
+        return true;
+    if (auto path = dynamic_cast<const PathExpr*>(&e))
+        return hasWildcard(*path->left_) || hasWildcard(*path->right_);
+    return false;
+}
+
+template <template <class> class Node, class... Operators, class Fn>
+static auto forEachOperatorChild(Expr& e, bytecode::OperatorList<Operators...>, Fn&& fn) -> bool
+{
+    auto visit = [&]<class Operator>(Operator*) {
+        auto op = dynamic_cast<Node<Operator>*>(&e);
+        if (!op)
+            return false;
+        if constexpr (std::is_same_v<Node<Operator>, UnaryExpr<Operator>>) {
+            fn(op->sub_, true);
+        }
+        else {
+            /* Batched comparisons require their ChildFieldsExpr operand */
+            auto batched = false;
+            if constexpr (isComparison<Operator>)
+                batched = dynamic_cast<BatchCompareExpr<Operator>*>(op) != nullptr;
+            fn(op->left_, !batched);
+            fn(op->right_, !batched);
+        }
+        return true;
+    };
+    return (visit((Operators*)nullptr) || ...);
+}
+
+/**
+ * Calls `fn(child, wrap)` for the sub-expressions of `e`, which may be
+ * replaced if `wrap` is set. Unknown expressions are not visited.
+ */
+template <class Fn>
+static auto forEachChild(Expr& e, Fn&& fn) -> void
+{
+    if (auto call = dynamic_cast<CallExpression*>(&e)) {
+        for (auto& arg : call->args_)
+            fn(arg, true);
+    }
+    else if (auto path = dynamic_cast<PathExpr*>(&e)) {
+        fn(path->left_, true);
+        fn(path->right_, true);
+    }
+    else if (auto sub = dynamic_cast<SubExpr*>(&e)) {
+        fn(sub->left_, true);
+        fn(sub->sub_, true);
+    }
+    else if (auto subscript = dynamic_cast<SubscriptExpr*>(&e)) {
+        fn(subscript->left_, true);
+        fn(subscript->index_, true);
+    }
+    else if (auto unpack = dynamic_cast<UnpackExpr*>(&e)) {
+        fn(unpack->sub_, true);
+    }
+    else if (auto op = dynamic_cast<AndExpr*>(&e)) {
+        fn(op->left_, true);
+        fn(op->right_, true);
+    }
+    else if (auto op = dynamic_cast<OrExpr*>(&e)) {
+        fn(op->left_, true);
+        fn(op->right_, true);
+    }
+    else if (auto op = dynamic_cast<UnaryWordOpExpr*>(&e)) {
+        fn(op->left_, true);
+    }
+    else if (auto op = dynamic_cast<BinaryWordOpExpr*>(&e)) {
+        fn(op->left_, true);
+        fn(op->right_, true);
+    }
+    else if (auto lookup = dynamic_cast<IndexLookupExpr*>(&e)) {
+        fn(lookup->expr_, true);
+    }
+    else if (auto filter = dynamic_cast<FieldFilterExpr*>(&e)) {
+        fn(filter->expr_, true);
+    }
+    else if (!forEachOperatorChild<UnaryExpr>(e, bytecode::UnaryOperators{}, fn)) {
+        forEachOperatorChild<BinaryExpr>(e, bytecode::BinaryOperators{}, fn);
+    }
+}
+
+/**
+ * Rewrites the expressions of a pack: Counts the wildcard paths and
+ * `**.name` lookups of all expressions, then replaces the ones which
+ * occur more than once by their shared counterparts.
+ */
+class PackPlanner
+{
+public:
+    explicit PackPlanner(uint64_t pack)
+        : pack_(pack)
+    {}
+
+    auto count(Expr& e) -> void
+    {
+        if (auto fused = dynamic_cast<WildcardFieldExpr*>(&e)) {
+            ++lookups_;
+            if (std::find(names_.begin(), names_.end(), fused->name_) == names_.end())
+                names_.push_back(fused->name_);
+            return;
+        }
+        if (isPath(e)) {
+            countPrefixes(e);
+            return;
+        }
+        forEachChild(e, [this](ExprPtr& child, bool) { count(*child); });
+    }
+
+    auto rewrite(ExprPtr& e, bool wrap) -> void
+    {
+        if (auto fused = dynamic_cast<WildcardFieldExpr*>(e.get())) {
+            if (lookups_ > 1 && wrap) {
+                auto index = std::find(names_.begin(), names_.end(), fused->name_) - names_.begin();
+                e = std::make_unique<SharedFieldExpr>(pack_, index, sharedNames(), std::move(e));
+            }
+            return;
+        }
+
+        if (!isPath(*e)) {
+            forEachChild(*e, [this](ExprPtr& child, bool wrap) { rewrite(child, wrap); });
+            return;
+        }
+
+        /* Prefixes are shared on their own, e.g. `a.**` of `a.**.b` */
+        if (auto path = dynamic_cast<PathExpr*>(e.get())) {
+            rewrite(path->left_, true);
+            if (dynamic_cast<WildcardFieldExpr*>(path->right_.get()))
+                rewrite(path->right_, true);
+        }
+        else if (auto children = dynamic_cast<ChildFieldsExpr*>(e.get()); children && children->base_)
+            rewrite(children->base_, true);
+
+        if (!wrap || !hasWildcard(*e) || counts_[e->toString()] < 2)
+            return;
+        auto [slot, _] = slots_.try_emplace(e->toString(), slots_.size());
+        e = std::make_unique<SharedPathExpr>(pack_, slot->second, std::move(e));
+    }
+
+    auto paths() const -> size_t
+    {
+        return slots_.size();
+    }
+
+    auto fields() const -> std::vector<std::string>
+    {
+        return lookups_ > 1 ? names_ : std::vector<std::string>{};
+    }
+
+private:
+    auto countPrefixes(Expr& e) -> void
+    {
+        if (dynamic_cast<WildcardFieldExpr*>(&e)) {
+            count(e);
+            return;
+        }
+        if (hasWildcard(e))
+            ++counts_[e.toString()];
+        if (auto path = dynamic_cast<PathExpr*>(&e)) {
+            countPrefixes(*path->left_);
+            if (dynamic_cast<WildcardFieldExpr*>(path->right_.get()))
+                count(*path->right_);
+        }
+        else if (auto children = dynamic_cast<ChildFieldsExpr*>(&e); children && children->base_) {
+            countPrefixes(*children->base_);
+        }
+    }
+
+    auto sharedNames() -> std::shared_ptr<const std::vector<std::string>>
+    {
+        if (!shared_)
+            shared_ = std::make_shared<const std::vector<std::string>>(names_);
+        return shared_;
+    }
+
+    uint64_t pack_;
+    std::map<std::string, size_t> counts_;
+    std::map<std::string, size_t> slots_;
+    std::vector<std::string> names_;
+    size_t lookups_ = 0;
+    std::shared_ptr<const std::vector<std::string>> shared_;
+};
+
+auto compile(Environment& env, std::string_view sv, bool any, Backend backend) -> ExprPtr
+{
+    Parser p(&env, sv);
+
+    /* Scalars */
+    p.prefixParsers[Token::C_TRUE]  = std::make_unique<ConstParser>(Value::t());
+    p.prefixParsers[Token::C_FALSE] = std::make_unique<ConstParser>(Value::f());
+    p.prefixParsers[Token::C_NULL]  = std::make_unique<ConstParser>(Value::null());
+    p.prefixParsers[Token::INT]     = std::make_unique<ScalarParser<int64_t>>();
+    p.prefixParsers[Token::FLOAT]   = std::make_unique<ScalarParser<double>>();
+    p.prefixParsers[Token::STRING]  = std::make_unique<ScalarParser<std::string>>();
+    p.prefixParsers[Token::REGEXP]  = std::make_unique<RegExpParser>();
+
+    /* Unary Operators */
+    p.prefixParsers[Token::OP_SUB]    = std::make_unique<UnaryOpParser<OperatorNegate>>();
+    p.prefixParsers[Token::OP_BITINV] = std::make_unique<UnaryOpParser<OperatorBitInv>>();
+    p.prefixParsers[Token::OP_NOT]    = std::make_unique<UnaryOpParser<OperatorNot>>();
+    p.prefixParsers[Token::OP_LEN]    = std::make_unique<UnaryOpParser<OperatorLen>>();
+    p.infixParsers[Token::OP_BOOL]    = std::make_unique<UnaryPostOpParser<OperatorBool>>();
+    p.prefixParsers[Token::OP_TYPEOF] = std::make_unique<UnaryOpParser<OperatorTypeof>>();
+    p.infixParsers[Token::OP_UNPACK]  = std::make_unique<UnpackOpParser>();
+    p.infixParsers[Token::WORD]       = std::make_unique<WordOpParser>();
+
+    /* Binary Operators */
+    p.infixParsers[Token::OP_ADD]   = std::make_unique<BinaryOpParser<OperatorAdd, Precedence::TERM>>();
+    p.infixParsers[Token::OP_SUB]   = std::make_unique<BinaryOpParser<OperatorSub, Precedence::TERM>>();
+    p.infixParsers[Token::OP_TIMES] = std::make_unique<BinaryOpParser<OperatorMul, Precedence::PRODUCT>>();
+    p.infixParsers[Token::OP_DIV]   = std::make_unique<BinaryOpParser<OperatorDiv, Precedence::PRODUCT>>();
+    p.infixParsers[Token::OP_MOD]   = std::make_unique<BinaryOpParser<OperatorMod, Precedence::PRODUCT>>();
+
+    /* Bit Operators */
+    p.infixParsers[Token::OP_BITAND] = std::make_unique<BinaryOpParser<OperatorBitAnd, Precedence::BITWISE>>();
+    p.infixParsers[Token::OP_BITOR]  = std::make_unique<BinaryOpParser<OperatorBitOr, Precedence::BITWISE>>();
+    p.infixParsers[Token::OP_BITXOR] = std::make_unique<BinaryOpParser<OperatorBitXor, Precedence::BITWISE>>();
+    p.infixParsers[Token::OP_LSHIFT] = std::make_unique<BinaryOpParser<OperatorShl, Precedence::BITWISE>>();
+    p.infixParsers[Token::OP_RSHIFT] = std::make_unique<BinaryOpParser<OperatorShr, Precedence::BITWISE>>();
+
+    /* Comparison/Test */
+    p.infixParsers[Token::OP_EQ]     = std::make_unique<BinaryOpParser<OperatorEq,   Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_NOT_EQ] = std::make_unique<BinaryOpParser<OperatorNeq,  Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_LT]     = std::make_unique<BinaryOpParser<OperatorLt,   Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_LTEQ]   = std::make_unique<BinaryOpParser<OperatorLtEq, Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_GT]     = std::make_unique<BinaryOpParser<OperatorGt,   Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_GTEQ]   = std::make_unique<BinaryOpParser<OperatorGtEq, Precedence::EQUALITY>>();
+    p.infixParsers[Token::OP_AND]    = std::make_unique<AndOrParser>();
+    p.infixParsers[Token::OP_OR]     = std::make_unique<AndOrParser>();
+
+    /* Cast */
+    p.infixParsers[Token::OP_CAST]   = std::make_unique<CastParser>();
+
+    /* Subexpressions/Subscript */
+    p.prefixParsers[Token::LPAREN] = std::make_unique<ParenParser>();     /* (...) */
+    p.prefixParsers[Token::LBRACE] = std::make_unique<SubSelectParser>(); /* {...} */
+    p.infixParsers[Token::LBRACE] = std::make_unique<SubSelectParser>();
+    p.prefixParsers[Token::LBRACK] = std::make_unique<SubscriptParser>(); /* [...] */
+    p.infixParsers[Token::LBRACK] = std::make_unique<SubscriptParser>();
+
+    /* Ident/Function */
+    p.prefixParsers[Token::WORD] = std::make_unique<WordParser>();
+    p.prefixParsers[Token::SELF] = std::make_unique<WordParser>();
+
+    /* Wildcards */
+    p.prefixParsers[Token::WILDCARD] = std::make_unique<WordParser>();
+    p.prefixParsers[Token::OP_TIMES] = std::make_unique<WordParser>();
+
+    /* Paths */
+    p.infixParsers[Token::DOT]  = std::make_unique<PathParser>();
+
+    auto expr = [&](){
+        if (any) {
+            std::vector<ExprPtr> root;
+            root.emplace_back(p.parse());
+            if (isBoolReduction(p.env, *root[0]))
+                return std::move(root[0]);
+            return simplifyOrForward(p.env, std::make_unique<CallExpression>("any"s, std::move(root)));
         } else {
             return p.parse();
         }
@@ -1326,23 +3459,494 @@ auto compile(Environment& env, std::string_view sv, bool any) -> ExprPtr
 
     if (!p.match(Token::Type::NIL))
         raise<std::runtime_error>("Expected end-of-input; got "s + p.current().toString());
+
+    auto predicate = indexPredicate(env, *expr);
+    auto required = requiredFields(env, *expr);
+    if (backend == Backend::Bytecode)
+        expr = std::make_unique<bytecode::ProgramExpr>(env, std::move(expr));
+    if (predicate)
+        expr = std::make_unique<IndexLookupExpr>(std::move(expr), std::move(*predicate));
+    if (!required.empty())
+        expr = std::make_unique<FieldFilterExpr>(std::move(expr), std::move(required), &env);
+    return expr;
+}
+
+auto compileCached(Environment& env, std::string_view sv, bool any, Backend backend) -> std::shared_ptr<const Expr>
+{
+    if (!env.compileCache)
+        return compile(env, sv, any, backend);
+
+    /* Field name IDs are resolved against the environment's string pool
+     * and never change once resolved (pools only ever grow), so a cached
+     * expression stays valid as long as the pool is the same. */
+    const auto strings = env.stringPool;
+
+    std::string key;
+    key.reserve(sv.size() + 2);
+    key.push_back(any ? '1' : '0');
+    key.push_back(static_cast<char>('0' + static_cast<int>(backend)));
+    key.append(sv);
+
+    if (auto expr = env.compileCache->find(key, strings))
+        return expr;
+
+    std::shared_ptr<const Expr> expr = compile(env, sv, any, backend);
+    env.compileCache->insert(key, strings, expr);
     return expr;
 }
 
 auto eval(Environment& env, const Expr& ast, const ModelNode& node) -> std::vector<Value>
+{
+    std::vector<Value> res;
+    eval(env, ast, node, LambdaResultFn([&res](Context, Value vv) {
+        res.push_back(std::move(vv));
+        return Result::Continue;
+    }));
+
+    return res;
+}
+
+auto eval(Environment& env, const Expr& ast, const ModelNode& node, const ResultFn& res, const EvalOptions& options) -> size_t
 {
     if (!node.model_)
         raise<std::runtime_error>("ModelNode must have a model!");
 
+    if (options.limit == 0)
+        return 0;
+
+    Scratch::Scope scratch;
     Context ctx(&env);
+    ctx.scratch = scratch.resource();
+
+    std::optional<EvalBudget> budget;
+    if (env.limits.active()) {
+        budget.emplace(env.limits);
+        ctx.budget = &*budget;
+    }
+
+    auto skipped = size_t(0);
+    auto passed = size_t(0);
+    auto stopped = false;
+    /* The caller keeps the model alive for the whole evaluation, so
+     * intermediate nodes only borrow it. Results take ownership. */
+    ast.eval(ctx, Value::borrowed(node), LambdaResultFn([&](Context ctx, Value vv) {
+        /* Not all expressions stop iterating right away,
+         * so guard the user callback against further calls. */
+        if (stopped)
+            return Result::Stop;
 
-    std::vector<Value> res;
-    ast.eval(ctx, Value::field(node), LambdaResultFn([&res](Context ctx, Value vv) {
-        res.push_back(std::move(vv));
-        return Result::Continue;
+        if (skipped < options.offset) {
+            ++skipped;
+            return Result::Continue;
+        }
+
+        if (budget)
+            budget->result();
+        ++passed;
+        if (res(ctx, std::move(vv.own())) == Result::Stop || passed >= options.limit)
+            stopped = true;
+        return stopped ? Result::Stop : Result::Continue;
     }));
 
+    return passed;
+}
+
+auto evalCount(Environment& env, const Expr& ast, const ModelNode& node, const EvalOptions& options) -> size_t
+{
+    return eval(env, ast, node, LambdaResultFn([](Context, Value) {
+        return Result::Continue;
+    }), options);
+}
+
+/**
+ * Call `fn(i)` for every root index below `count`, on up to `threads`
+ * threads. If a call throws, the remaining roots are skipped and the
+ * first exception is rethrown on the calling thread.
+ */
+template <class Fn>
+static auto forEachRoot(size_t count, size_t threads, Fn&& fn) -> void
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(count, 1));
+
+    if (threads == 1) {
+        for (auto i = 0u; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    /* Workers claim small batches of roots from a shared cursor,
+     * so threads which finish early pick up the remaining work.
+     * Each root writes into its own result slot, which keeps the
+     * order stable without a merge step. */
+    const auto batch = std::clamp<size_t>(count / (threads * 16), 1, 64);
+    std::atomic_size_t next = 0;
+    std::atomic_bool failed = false;
+    std::exception_ptr error;
+    std::mutex errorMtx;
+
+    auto work = [&]() {
+        while (!failed.load(std::memory_order_relaxed)) {
+            const auto begin = next.fetch_add(batch, std::memory_order_relaxed);
+            if (begin >= count)
+                return;
+
+            const auto end = std::min(begin + batch, count);
+            for (auto i = begin; i < end; ++i) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> _(errorMtx);
+                    if (!error)
+                        error = std::current_exception();
+                    failed = true;
+                    return;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (auto i = 1u; i < threads; ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto& worker : workers)
+        worker.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+auto eval(Environment& env, const Expr& ast, const std::vector<ModelNode::Ptr>& roots, size_t threads) -> std::vector<std::vector<Value>>
+{
+    std::vector<std::vector<Value>> res(roots.size());
+
+    /* Debug callbacks are not required to be thread-safe. */
+    if (env.debug)
+        threads = 1;
+    forEachRoot(roots.size(), threads, [&](size_t i) {
+        res[i] = eval(env, ast, *roots[i]);
+    });
+    return res;
+}
+
+auto eval(Environment& env, const Expr& ast, const ModelPool& model, size_t threads) -> std::vector<std::vector<Value>>
+{
+    std::vector<ModelNode::Ptr> roots;
+    roots.reserve(model.numRoots());
+    for (auto i = 0u; i < model.numRoots(); ++i)
+        roots.emplace_back(model.root(i));
+
+    return eval(env, ast, roots, threads);
+}
+
+auto top(Environment& env, const Expr& ast, const Expr& key, const ModelPool& model, size_t k, size_t threads) -> std::vector<Value>
+{
+    TopK best(k);
+    std::mutex bestMtx;
+
+    if (env.debug)
+        threads = 1;
+    forEachRoot(model.numRoots(), threads, [&](size_t i) {
+        /* Results are ordered by root, then by their position in the root's results */
+        TopK local(k);
+        uint64_t n = static_cast<uint64_t>(i) << 32;
+        (void)eval(env, ast, *model.root(i), LambdaResultFn([&](Context ctx, Value vv) {
+            const auto order = n++;
+            (void)key.eval(ctx, vv, LambdaResultFn([&](Context, Value kv) {
+                local.push(std::move(kv), vv, order);
+                return Result::Stop;
+            }));
+            return Result::Continue;
+        }));
+
+        std::lock_guard<std::mutex> _(bestMtx);
+        best.merge(std::move(local));
+    });
+    return best.take();
+}
+
+QueryPack::QueryPack(std::vector<ExprPtr> exprs)
+    : exprs_(std::move(exprs))
+{
+    static std::atomic<uint64_t> nextId = 1;
+    id_ = nextId.fetch_add(1, std::memory_order_relaxed);
+
+    PackPlanner planner(id_);
+    for (auto& expr : exprs_)
+        planner.count(*expr);
+    for (auto& expr : exprs_)
+        planner.rewrite(expr, true);
+
+    paths_ = planner.paths();
+    fields_ = planner.fields();
+}
+
+QueryPack::~QueryPack() = default;
+QueryPack::QueryPack(QueryPack&&) noexcept = default;
+QueryPack& QueryPack::operator=(QueryPack&&) noexcept = default;
+
+auto QueryPack::size() const -> size_t
+{
+    return exprs_.size();
+}
+
+auto QueryPack::expr(size_t i) const -> const Expr&
+{
+    return *exprs_.at(i);
+}
+
+auto QueryPack::sharedPaths() const -> size_t
+{
+    return paths_;
+}
+
+auto QueryPack::sharedFields() const -> const std::vector<std::string>&
+{
+    return fields_;
+}
+
+auto eval(Environment& env, const QueryPack& pack, const ModelNode& node) -> std::vector<std::vector<Value>>
+{
+    PackCache cache(pack.id_, node, pack.paths_);
+
+    std::vector<std::vector<Value>> res;
+    res.reserve(pack.size());
+    for (const auto& expr : pack.exprs_)
+        res.push_back(eval(env, *expr, node));
     return res;
 }
 
+auto eval(Environment& env, const QueryPack& pack, const ModelPool& model, size_t threads) -> std::vector<std::vector<std::vector<Value>>>
+{
+    std::vector<std::vector<std::vector<Value>>> res(model.numRoots());
+
+    if (env.debug)
+        threads = 1;
+    forEachRoot(model.numRoots(), threads, [&](size_t i) {
+        res[i] = eval(env, pack, *model.root(i));
+    });
+    return res;
+}
+
+/**
+ * Collects the field names which `e` reads into `names`. Returns false
+ * if `e` may read any field, e.g. by wildcards, subscripts with computed
+ * keys or functions which are not built in.
+ */
+static auto readFields(const Expr& e, std::set<std::string>& names) -> bool
+{
+    if (auto field = dynamic_cast<const FieldExpr*>(&e)) {
+        if (field->name_ != "_")
+            names.insert(field->name_);
+        return true;
+    }
+    if (auto path = dynamic_cast<const FieldPathExpr*>(&e)) {
+        names.insert(path->names_.begin(), path->names_.end());
+        return true;
+    }
+    if (dynamic_cast<const ConstExpr*>(&e) || dynamic_cast<const MultiConstExpr*>(&e))
+        return true;
+    if (auto program = dynamic_cast<const bytecode::ProgramExpr*>(&e))
+        return readFields(program->tree(), names);
+    if (auto subscript = dynamic_cast<const SubscriptExpr*>(&e)) {
+        auto key = dynamic_cast<const ConstExpr*>(subscript->index_.get());
+        if (!key || !key->value().isa(ValueType::String))
+            return false;
+        names.insert(key->value().as<ValueType::String>());
+        return readFields(*subscript->left_, names);
+    }
+    if (auto call = dynamic_cast<const CallExpression*>(&e)) {
+        static const std::set<std::string, std::less<>> builtins = {
+            "any", "each", "all", "count", "range", "arr", "split", "select", "sum", "keys", "top"};
+        if (!builtins.contains(call->name_))
+            return false;
+    }
+
+    /* Wildcards and unknown expressions have no visited children */
+    auto children = 0u;
+    auto known = true;
+    forEachChild(const_cast<Expr&>(e), [&](ExprPtr& child, bool) {
+        ++children;
+        known = known && readFields(*child, names);
+    });
+    return known && children > 0;
+}
+
+struct IncrementalEval::Impl
+{
+    Environment& env;
+    const Expr& ast;
+    const ModelPool& model;
+
+    std::optional<std::vector<std::string>> fields;
+    std::vector<StringId> ids;
+
+    /* Pool state of the last update */
+    std::optional<ModelPool::Checkpoint> since;
+    std::vector<std::vector<Value>> results;
+    size_t evaluated = 0;
+
+    /* Objects and arrays which the expression can reach from a root,
+     * by address, with the indices of these roots. */
+    std::unordered_map<uint32_t, std::vector<uint32_t>> owners;
+
+    /* Roots which cannot be walked, evaluated by every update */
+    std::vector<uint32_t> opaque;
+
+    Impl(Environment& env, const Expr& ast, const ModelPool& model)
+        : env(env)
+        , ast(ast)
+        , model(model)
+    {
+        std::set<std::string> names;
+        if (readFields(ast, names))
+            fields.emplace(names.begin(), names.end());
+    }
+
+    auto reachable(StringId name) const -> bool
+    {
+        return !fields || std::find(ids.begin(), ids.end(), name) != ids.end();
+    }
+
+    /* Record the objects and arrays reachable from root `i`. */
+    auto walk(uint32_t i) -> void
+    {
+        auto root = model.root(i);
+        if (ModelPool::native(*root) != &model) {
+            opaque.push_back(i);
+            return;
+        }
+
+        std::vector<ModelNodeAddress> stack{root->addr()};
+        std::unordered_set<uint32_t> visited;
+        while (!stack.empty()) {
+            auto addr = stack.back();
+            stack.pop_back();
+
+            const auto column = addr.column();
+            if (column != ModelPool::Objects && column != ModelPool::Arrays)
+                continue;
+            if (!visited.insert(addr.value_).second)
+                continue;
+
+            auto& roots = owners[addr.value_];
+            if (std::find(roots.begin(), roots.end(), i) == roots.end())
+                roots.push_back(i);
+
+            if (column == ModelPool::Objects) {
+                model.forEachField(addr, [&](StringId name, ModelNodeAddress member) {
+                    if (reachable(name))
+                        stack.push_back(member);
+                    return true;
+                });
+            }
+            else {
+                model.forEachMember(addr, [&](ModelNodeAddress member) {
+                    stack.push_back(member);
+                    return true;
+                });
+            }
+        }
+    }
+
+    /* Mark the owners of the containers which grew since the last update. */
+    auto markGrown(uint8_t column, const std::vector<uint32_t>& before,
+                   const std::vector<uint32_t>& after, std::vector<bool>& affected) const -> void
+    {
+        for (auto a = 0u; a < before.size(); ++a) {
+            if (after[a] == before[a])
+                continue;
+            if (auto iter = owners.find(ModelNodeAddress(column, a).value_); iter != owners.end())
+                for (auto i : iter->second)
+                    affected[i] = true;
+        }
+    }
+
+    auto update(size_t threads) -> void
+    {
+        auto now = model.checkpoint();
+
+        auto shrunk = [&](const std::vector<uint32_t>& before, const std::vector<uint32_t>& after) {
+            if (after.size() < before.size())
+                return true;
+            for (auto a = 0u; a < before.size(); ++a)
+                if (after[a] < before[a])
+                    return true;
+            return false;
+        };
+        if (since && (now.roots_ < since->roots_ ||
+                      shrunk(since->objectSizes_, now.objectSizes_) ||
+                      shrunk(since->arraySizes_, now.arraySizes_)))
+            raise<std::runtime_error>("IncrementalEval: The model pool was cleared.");
+
+        std::vector<bool> affected(now.roots_, !since);
+        if (since) {
+            for (auto i = since->roots_; i < now.roots_; ++i)
+                affected[i] = true;
+            for (auto i : opaque)
+                affected[i] = true;
+            markGrown(ModelPool::Objects, since->objectSizes_, now.objectSizes_, affected);
+            markGrown(ModelPool::Arrays, since->arraySizes_, now.arraySizes_, affected);
+        }
+
+        /* Field names may have been added to the string pool */
+        if (fields) {
+            const auto strings = model.strings();
+            ids.clear();
+            for (const auto& name : *fields)
+                if (auto id = strings->get(name))
+                    ids.push_back(id);
+        }
+
+        std::vector<uint32_t> roots;
+        opaque.clear();
+        for (auto i = 0u; i < now.roots_; ++i) {
+            if (!affected[i])
+                continue;
+            roots.push_back(i);
+            walk(i);
+        }
+
+        results.resize(now.roots_);
+        if (env.debug)
+            threads = 1;
+        forEachRoot(roots.size(), threads, [&](size_t i) {
+            results[roots[i]] = simfil::eval(env, ast, *model.root(roots[i]));
+        });
+
+        evaluated = roots.size();
+        since = std::move(now);
+    }
+};
+
+IncrementalEval::IncrementalEval(Environment& env, const Expr& ast, const ModelPool& model)
+    : impl_(std::make_unique<Impl>(env, ast, model))
+{}
+
+IncrementalEval::~IncrementalEval() = default;
+
+auto IncrementalEval::update(size_t threads) -> const std::vector<std::vector<Value>>&
+{
+    impl_->update(threads);
+    return impl_->results;
+}
+
+auto IncrementalEval::results() const -> const std::vector<std::vector<Value>>&
+{
+    return impl_->results;
+}
+
+auto IncrementalEval::evaluated() const -> size_t
+{
+    return impl_->evaluated;
+}
+
+auto IncrementalEval::fields() const -> const std::optional<std::vector<std::string>>&
+{
+    return impl_->fields;
+}
+
 }
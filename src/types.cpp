@@ -4,6 +4,11 @@
 #include "simfil/operator.h"
 #include "fmt/core.h"
 
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 namespace simfil
 {
 
@@ -90,6 +95,92 @@ auto IRangeType::unpack(const IRange& self, std::function<bool(Value)> res) cons
     } while (i != end);
 }
 
+Regex::Regex(std::string_view pattern)
+{
+    static constexpr std::string_view metaChars = "^$\\.*+?()[]{}|";
+    static constexpr std::string_view any = ".*";
+    auto isLiteral = [](std::string_view str) {
+        return str.find_first_of(metaChars) == std::string_view::npos;
+    };
+
+    auto inner = pattern;
+    auto anyPrefix = inner.starts_with(any);
+    if (anyPrefix)
+        inner.remove_prefix(any.size());
+    auto anySuffix = inner.size() >= any.size() && inner.ends_with(any);
+    if (anySuffix)
+        inner.remove_suffix(any.size());
+
+    if (isLiteral(inner)) {
+        literal_ = inner;
+        kind_ = anyPrefix ? (anySuffix ? Kind::Contains : Kind::Suffix)
+                          : (anySuffix ? Kind::Prefix : Kind::Literal);
+    }
+    else
+        re_ = std::regex(std::string(pattern));
+}
+
+auto Regex::cached(std::string_view pattern) -> std::shared_ptr<const Regex>
+{
+    static constexpr size_t Capacity = 256;
+    static std::mutex mutex;
+    static std::list<std::string> order;  // Least recently used first.
+    static std::unordered_map<std::string_view, std::pair<std::shared_ptr<const Regex>, std::list<std::string>::iterator>> entries;
+
+    {
+        std::lock_guard lock(mutex);
+        if (auto it = entries.find(pattern); it != entries.end()) {
+            order.splice(order.end(), order, it->second.second);
+            return it->second.first;
+        }
+    }
+
+    /* Compile without holding the lock, std::regex may throw. */
+    auto regex = std::make_shared<const Regex>(pattern);
+
+    std::lock_guard lock(mutex);
+    if (auto it = entries.find(pattern); it != entries.end())
+        return it->second.first;
+    if (entries.size() >= Capacity) {
+        entries.erase(order.front());
+        order.pop_front();
+    }
+    auto pos = order.emplace(order.end(), pattern);
+    entries.emplace(*pos, std::make_pair(regex, pos));
+    return regex;
+}
+
+auto Regex::match(std::string_view str) const -> bool
+{
+    /* In ECMAScript, `.` matches any character except line terminators. */
+    auto anyChars = [](std::string_view s) {
+        return s.find_first_of("\n\r") == std::string_view::npos;
+    };
+
+    switch (kind_) {
+    case Kind::Literal:
+        return str == literal_;
+    case Kind::Prefix:
+        return str.starts_with(literal_) && anyChars(str.substr(literal_.size()));
+    case Kind::Suffix:
+        return str.ends_with(literal_) && anyChars(str.substr(0, str.size() - literal_.size()));
+    case Kind::Contains: {
+        /* Some occurrence must cover all line terminators. */
+        auto first = str.find_first_of("\n\r");
+        if (first == std::string_view::npos)
+            return str.find(literal_) != std::string_view::npos;
+        auto last = str.find_last_of("\n\r");
+        for (auto pos = str.find(literal_); pos != std::string_view::npos && pos <= first; pos = str.find(literal_, pos + 1))
+            if (pos + literal_.size() > last)
+                return true;
+        return false;
+    }
+    case Kind::Regex:
+        break;
+    }
+    return std::regex_match(str.begin(), str.end(), re_);
+}
+
 ReType ReType::Type;
 ReType::ReType()
     : TypedMetaType("re")
@@ -100,7 +191,7 @@ auto ReType::make(std::string_view expr) -> Value
     auto obj = TransientObject(&ReType::Type);
     auto re = get(obj);
     re->str = expr;
-    re->re = std::regex(std::string(expr));
+    re->re = Regex::cached(expr);
 
     return Value(ValueType::TransientObject, std::move(obj));
 }
@@ -133,10 +224,10 @@ auto ReType::binaryOp(std::string_view op, const Value& l, const Re& r) const ->
         const auto& str = l.as<ValueType::String>();
 
         if (op == OperatorEq::name())
-            return std::regex_match(str, r.re) ? Value::make(str) : Value::f();
+            return r.re->match(str) ? Value::make(str) : Value::f();
 
         if (op == OperatorNeq::name())
-            return std::regex_match(str, r.re) ? Value::f() : Value::make(str);
+            return r.re->match(str) ? Value::f() : Value::make(str);
     }
 
     raise<InvalidOperandsError>(op);
@@ -1,5 +1,39 @@
 #include "simfil/value.h"
+#include "simfil/model/model.h"
+#include "simfil/overlay.h"
 
 namespace simfil
 {
+
+auto Value::field(const ModelPool& pool, const ModelNode& parent, ModelNodeAddress address) -> Value
+{
+    return {pool.typeOf(address), pool.valueOf(address), ModelNode::Ptr::make(parent.model_, address)};
+}
+
+auto Value::typeOf(const ModelNode& node) -> ValueType
+{
+    if (node.model_) {
+        if (auto type = node.model_->columnType(node.addr_.column()); type != ValueType::Undef)
+            return type;
+    }
+    return node.type();
+}
+
+auto Value::own() -> Value&
+{
+    if (node) {
+        auto& model = node->model_;
+        if (model && model.use_count() == 0) {
+            /* Reusable overlay storage has no owner, see OverlayNodeStorage() */
+            if (auto owner = model->weak_from_this().lock())
+                model = std::move(owner);
+            else if (dynamic_cast<const OverlayNodeStorage*>(model.get()))
+                *this = Value::field(OverlayNode(*node).copy());
+            else
+                model = model->shared_from_this();
+        }
+    }
+    return *this;
+}
+
 }
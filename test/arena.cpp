@@ -1,5 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
 #include <thread>
+#include <atomic>
 #include <bitsery/bitsery.h>
 #include <bitsery/adapter/buffer.h>
 #include <bitsery/traits/vector.h>
@@ -87,6 +88,59 @@ TEST_CASE("ArrayArena clear and shrink_to_fit", "[ArrayArena]") {
     }
 }
 
+TEST_CASE("ArrayArena compact", "[ArrayArena]") {
+    ArrayArena<int> arena;
+    ArrayIndex array1 = arena.new_array(1);
+    ArrayIndex array2 = arena.new_array(0);
+    ArrayIndex array3 = arena.new_array(8);
+
+    // Interleave growth, so both arrays are spread across several chunks.
+    for (int i = 0; i < 100; ++i) {
+        arena.push_back(array1, i);
+        if (i % 3 == 0)
+            arena.push_back(array3, -i);
+    }
+
+    arena.compact();
+    REQUIRE(arena.is_read_only());
+    REQUIRE(arena.size() == 3);
+    REQUIRE(arena.size(array1) == 100);
+    REQUIRE(arena.size(array2) == 0);
+    REQUIRE(arena.size(array3) == 34);
+
+    for (int i = 0; i < 100; ++i)
+        REQUIRE(arena.at(array1, i) == i);
+    REQUIRE_THROWS_AS(arena.at(array1, 100), std::out_of_range);
+
+    int expected = 0;
+    arena.iterate(array3, [&](int value) { REQUIRE(value == -expected); expected += 3; });
+    REQUIRE(expected == 102);
+
+    REQUIRE_THROWS(arena.push_back(array1, 100));
+    REQUIRE_THROWS(arena.new_array(1));
+
+    arena.clear();
+    REQUIRE(!arena.is_read_only());
+    REQUIRE_NOTHROW(arena.new_array(1));
+}
+
+TEST_CASE("ArrayArena bulk arrays", "[ArrayArena]") {
+    ArrayArena<int> arena;
+    arena.reserve(2, 100);
+
+    ArrayIndex array1 = arena.new_array(100, [](int& element, size_t i) { element = static_cast<int>(i) * 2; });
+    ArrayIndex array2 = arena.new_array(0, [](int&, size_t) { FAIL(); });
+    REQUIRE(arena.size(array1) == 100);
+    REQUIRE(arena.size(array2) == 0);
+    for (int i = 0; i < 100; ++i)
+        REQUIRE(arena.at(array1, i) == i * 2);
+
+    // Appending to a bulk array continues in a new chunk.
+    arena.push_back(array1, -1);
+    REQUIRE(arena.size(array1) == 101);
+    REQUIRE(arena.at(array1, 100) == -1);
+}
+
 TEST_CASE("ArrayArena multiple arrays", "[ArrayArena]") {
     ArrayArena<int> arena;
     std::vector<std::vector<int>> expected = {
@@ -211,6 +265,92 @@ TEST_CASE("ArrayArena Concurrency", "[ArrayArena]") {
         }
     }
 }
+
+TEST_CASE("ArrayArena Concurrent Readers", "[ArrayArena]") {
+    ArrayArena<int> arena;
+    const size_t num_writers = 8;
+    const size_t num_iterations = 20000;
+
+    std::vector<ArrayIndex> arrays;
+    for (size_t i = 0; i < num_writers; ++i)
+        arrays.push_back(arena.new_array(1));
+
+    // Readers scan arrays which are being appended to by other threads.
+    // Every element which is visible must already hold its final value.
+    std::atomic_bool done{false};
+    std::atomic_size_t mismatches{0};
+    auto reader = [&]() {
+        while (!done) {
+            for (auto array : arrays) {
+                auto size = arena.size(array);
+                for (size_t i = 0; i < size; ++i)
+                    if (arena.at(array, i) != static_cast<int>(i))
+                        ++mismatches;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i)
+        threads.emplace_back(reader);
+
+    std::vector<std::thread> writers;
+    for (auto array : arrays)
+        writers.emplace_back([&, array]() {
+            for (size_t i = 0; i < num_iterations; ++i)
+                arena.push_back(array, static_cast<int>(i));
+        });
+
+    for (auto& writer : writers)
+        writer.join();
+    done = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(mismatches == 0);
+    for (auto array : arrays)
+        REQUIRE(arena.size(array) == num_iterations);
+}
+
+TEST_CASE("ArrayArena Concurrent Bulk Arrays", "[ArrayArena]") {
+    ArrayArena<int> arena;
+    const size_t num_writers = 4;
+    const size_t num_arrays = 2000;
+
+    // Readers scan all arrays, including heads which are just being created.
+    std::atomic_bool done{false};
+    std::atomic_size_t mismatches{0};
+    auto reader = [&]() {
+        while (!done) {
+            for (ArrayIndex a = 0; a < static_cast<ArrayIndex>(arena.size()); ++a) {
+                auto size = arena.size(a);
+                for (size_t i = 0; i < size; ++i)
+                    if (arena.at(a, i) != static_cast<int>(i))
+                        ++mismatches;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 2; ++i)
+        threads.emplace_back(reader);
+
+    std::vector<std::thread> writers;
+    for (size_t w = 0; w < num_writers; ++w)
+        writers.emplace_back([&]() {
+            for (size_t n = 0; n < num_arrays; ++n)
+                arena.new_array(n % 16, [](int& element, size_t i) { element = static_cast<int>(i); });
+        });
+
+    for (auto& writer : writers)
+        writer.join();
+    done = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(mismatches == 0);
+    REQUIRE(arena.size() == num_writers * num_arrays);
+}
 #endif
 
 TEST_CASE("ArrayArena serialization and deserialization") {
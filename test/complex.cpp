@@ -1,11 +1,16 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
 #include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
 
 #include "simfil/model/model.h"
 #include "simfil/model/string-pool.h"
 #include "simfil/simfil.h"
+#include "simfil/async.h"
 #include "simfil/model/json.h"
+#include "simfil/types.h"
 
 using namespace simfil;
 
@@ -90,6 +95,22 @@ TEST_CASE("Regular Expression", "[complex.regexp]") {
     REQUIRE_RESULT("'abc' = re'a.c'", "abc");
     REQUIRE_RESULT("re'a.x' != 'abc'", "abc");
     REQUIRE_RESULT("'abc' != re'a.x'", "abc");
+    REQUIRE_RESULT("re'Main.*' = 'Main Street'", "Main Street");
+    REQUIRE_RESULT("re'.*Street' = 'Main Street'", "Main Street");
+    REQUIRE_RESULT("re'.*in St.*' = 'Main Street'", "Main Street");
+    REQUIRE_RESULT("re('Main.*') = 'Main Street'", "Main Street");
+
+    /* Literal fast paths must agree with std::regex */
+    const std::vector<std::string> patterns = {"abc", "abc.*", ".*abc", ".*abc.*", ".*", "", "a.c", ".*b.*c"};
+    const std::vector<std::string> strings = {"abc", "xabc", "abcx", "xabcx", "ab", "", "a\nabc", "abc\nx", "x\nabc\nx", "\nabc"};
+    for (auto const& pattern : patterns) {
+        auto regex = Regex::cached(pattern);
+        REQUIRE(regex == Regex::cached(pattern));
+        for (auto const& str : strings) {
+            INFO(pattern << " / " << str);
+            REQUIRE(regex->match(str) == std::regex_match(str, std::regex(pattern)));
+        }
+    }
 }
 
 TEST_CASE("Runtime Error", "[complex.runtime-error]") {
@@ -169,3 +190,1215 @@ TEST_CASE("Serialization", "[complex.serialization]") {
             REQUIRE(model->strings()->resolve(sId) == recoveredFields->resolve(StringId(sId)));
     }
 }
+
+TEST_CASE("Compacted Model", "[complex.compact]") {
+    auto model = json::parse(invoice);
+    auto json = model->toJson();
+
+    model->compact();
+    REQUIRE(model->isReadOnly());
+    REQUIRE(model->toJson() == json);
+    REQUIRE_THROWS(model->newObject());
+    REQUIRE_THROWS(model->resolveObject(model->root(0))->addField("x", "y"));
+
+    /* Compacted pools serialize like any other */
+    std::stringstream stream;
+    model->write(stream);
+    auto recovered = std::make_shared<ModelPool>(model->strings());
+    recovered->read(stream);
+    REQUIRE(recovered->toJson() == json);
+}
+
+TEST_CASE("Compressed Serialization", "[complex.compressed-serialization]") {
+    auto model = json::parse(invoice);
+    for (auto i = 0; i < 500; ++i) {
+        auto point = model->newObject(3);
+        point->addField("id", (int64_t)1000000000 + i);
+        point->addField("x", 11.5 + i * 1e-5);
+        point->addField("y", 48.25);
+        model->addRoot(point);
+    }
+    auto json = model->toJson();
+
+    std::stringstream raw, compressed;
+    model->write(raw);
+    model->writeCompressed(compressed);
+    REQUIRE(compressed.str().size() < raw.str().size());
+
+    auto recovered = std::make_shared<ModelPool>(model->strings());
+    recovered->readCompressed(compressed);
+    REQUIRE(recovered->toJson() == json);
+    REQUIRE_NOTHROW(recovered->validate());
+
+    SECTION("Corrupt data is rejected") {
+        auto bytes = compressed.str();
+        std::stringstream badMagic("X" + bytes.substr(1));
+        REQUIRE_THROWS(recovered->readCompressed(badMagic));
+
+        std::stringstream truncated(bytes.substr(0, bytes.size() / 2));
+        REQUIRE_THROWS(recovered->readCompressed(truncated));
+
+        /* Magic, version and StringId size take 10 bytes, then the payload size follows */
+        auto header = bytes.substr(0, 10);
+        auto sizeBytes = 0u;
+        while (static_cast<uint8_t>(bytes[10 + sizeBytes]) & 0x80)
+            ++sizeBytes;
+        auto payload = bytes.substr(10 + sizeBytes + 1);
+
+        /* A huge payload size is not allocated up front */
+        std::stringstream huge(header + "\xff\xff\xff\xff\xff\xff\xff\xff\x7f" + payload);
+        REQUIRE_THROWS_WITH(recovered->readCompressed(huge), "Compressed ModelPool: Unexpected end of data.");
+
+        /* A payload which ends within the columns leaves the pool as it was */
+        auto half = payload.substr(0, payload.size() / 2);
+        std::string size;
+        for (auto n = half.size(); ; n >>= 7) {
+            size.push_back(static_cast<char>(n >= 0x80 ? (n & 0x7f) | 0x80 : n));
+            if (n < 0x80)
+                break;
+        }
+        std::stringstream partial(header + size + half);
+        REQUIRE_THROWS(recovered->readCompressed(partial));
+        REQUIRE(recovered->toJson() == json);
+    }
+}
+
+TEST_CASE("Chunked Serialization", "[complex.chunked-serialization]") {
+    auto model = json::parse(invoice);
+    for (auto i = 0; i < 500; ++i) {
+        auto point = model->newObject(3);
+        point->addField("id", (int64_t)1000000000 + i);
+        point->addField("x", 11.5 + i * 1e-5);
+        point->addField("name", "p" + std::to_string(i));
+        model->addRoot(point);
+    }
+    auto json = model->toJson();
+
+    std::stringstream chunked;
+    model->writeChunked(chunked, 4);
+
+    auto recovered = std::make_shared<ModelPool>(model->strings());
+    recovered->readChunked(chunked, 4);
+    REQUIRE(recovered->toJson() == json);
+    REQUIRE_NOTHROW(recovered->validate());
+
+    SECTION("Corrupt data is rejected") {
+        auto bytes = chunked.str();
+        std::stringstream badMagic("X" + bytes.substr(1));
+        REQUIRE_THROWS(recovered->readChunked(badMagic));
+
+        std::stringstream truncated(bytes.substr(0, bytes.size() / 2));
+        REQUIRE_THROWS(recovered->readChunked(truncated));
+
+        bytes[bytes.size() - 3] ^= 0x40;
+        std::stringstream flipped(bytes);
+        REQUIRE_THROWS(recovered->readChunked(flipped));
+
+        /* Failed reads leave the pool as it was */
+        REQUIRE(recovered->toJson() == json);
+    }
+
+    SECTION("Duplicate columns are rejected") {
+        /* Header of two empty blocks of the roots column */
+        std::string header = "SIMFILCK";
+        header += {'\x01', static_cast<char>(sizeof(StringId)), '\x02', 0, 0, 0, 0, 0, 0};
+        std::stringstream duplicate(header);
+        REQUIRE_THROWS_WITH(recovered->readChunked(duplicate), "Chunked ModelPool: Duplicate column 0.");
+        REQUIRE(recovered->toJson() == json);
+    }
+
+    SECTION("Huge block sizes are not allocated up front") {
+        /* Header of one roots block which claims about 2^63 bytes */
+        std::string header = "SIMFILCK";
+        header += {'\x01', static_cast<char>(sizeof(StringId)), '\x01', 0};
+        header += "\xff\xff\xff\xff\xff\xff\xff\xff\x7f";
+        header += {0, 'a', 'b', 'c'};
+        std::stringstream huge(header);
+        REQUIRE_THROWS_WITH(recovered->readChunked(huge), "Chunked ModelPool: Unexpected end of data.");
+        REQUIRE(recovered->toJson() == json);
+    }
+}
+
+TEST_CASE("Delta Serialization", "[complex.delta-serialization]") {
+    auto producer = json::parse(invoice);
+    auto consumer = std::make_shared<ModelPool>(producer->strings());
+    {
+        std::stringstream stream;
+        producer->write(stream);
+        consumer->read(stream);
+    }
+
+    auto since = producer->checkpoint();
+    auto root = producer->resolveObject(producer->root(0));
+    root->addField("appended", (int64_t)7);
+    auto items = producer->newArray(2);
+    items->append(1.5).append(std::string_view("item"));
+    auto feature = producer->newObject(2);
+    feature->addField("items", items);
+    feature->addField("id", (int64_t)-42);
+    producer->addRoot(feature);
+
+    std::stringstream delta;
+    producer->writeDelta(delta, since);
+    std::stringstream full;
+    producer->writeCompressed(full);
+    REQUIRE(delta.str().size() < full.str().size() / 4);
+
+    auto deltaBytes = delta.str();
+    consumer->readDelta(delta);
+    REQUIRE(consumer->toJson() == producer->toJson());
+    REQUIRE_NOTHROW(consumer->validate());
+
+    /* Members added to arrays of the checkpoint */
+    since = producer->checkpoint();
+    items->append((int64_t)3);
+    std::stringstream second;
+    producer->writeDelta(second, since);
+    consumer->readDelta(second);
+    REQUIRE(consumer->toJson() == producer->toJson());
+
+    /* A delta only applies to a pool in the state of its checkpoint */
+    std::stringstream again(deltaBytes);
+    REQUIRE_THROWS(consumer->readDelta(again));
+
+    /* A truncated delta leaves the pool as it was, including grown arrays */
+    since = producer->checkpoint();
+    items->append((int64_t)4);
+    producer->addRoot(producer->newObject(0));
+    std::stringstream third;
+    producer->writeDelta(third, since);
+    auto bytes = third.str();
+    size_t pos = 10, payloadSize = 0; /* After the magic, version and StringId size */
+    for (auto shift = 0;; shift += 7) {
+        payloadSize |= size_t(bytes[pos] & 0x7f) << shift;
+        if (!(bytes[pos++] & 0x80))
+            break;
+    }
+    auto truncated = bytes.substr(0, 10);
+    for (auto n = payloadSize - 1; ; n >>= 7) {
+        truncated.push_back(static_cast<char>((n & 0x7f) | (n > 0x7f ? 0x80 : 0)));
+        if (n <= 0x7f)
+            break;
+    }
+    truncated += bytes.substr(pos, payloadSize - 1);
+    auto before = consumer->toJson();
+    std::stringstream partial(truncated);
+    REQUIRE_THROWS(consumer->readDelta(partial));
+    REQUIRE(consumer->toJson() == before);
+    REQUIRE_NOTHROW(consumer->validate());
+}
+
+TEST_CASE("String Deduplication", "[complex.string-dedup]") {
+    auto build = [](bool dedup) {
+        auto model = std::make_shared<ModelPool>();
+        model->setStringDeduplication(dedup);
+        for (auto i = 0; i < 100; ++i) {
+            auto root = model->newObject(2);
+            root->addField("class", i % 3 ? "street" : "highway");
+            root->addField("name", "road" + std::to_string(i));
+            model->addRoot(root);
+        }
+        return model;
+    };
+
+    auto plain = build(false);
+    auto dedup = build(true);
+    REQUIRE(dedup->stringDeduplication());
+    REQUIRE(dedup->toJson() == plain->toJson());
+
+    /* Repeated values are the same node */
+    auto a = dedup->resolveObject(dedup->root(1))->get("class");
+    auto b = dedup->resolveObject(dedup->root(2))->get("class");
+    REQUIRE(a->addr() == b->addr());
+    REQUIRE(dedup->newValue("highway")->addr() == dedup->resolveObject(dedup->root(0))->get("class")->addr());
+
+    std::stringstream plainStream, dedupStream;
+    plain->write(plainStream);
+    dedup->write(dedupStream);
+    REQUIRE(dedupStream.str().size() < plainStream.str().size());
+
+    /* The index is rebuilt after reading */
+    auto recovered = std::make_shared<ModelPool>(dedup->strings());
+    recovered->setStringDeduplication(true);
+    recovered->read(dedupStream);
+    REQUIRE(recovered->toJson() == plain->toJson());
+    REQUIRE(recovered->newValue("street")->addr() == recovered->resolveObject(recovered->root(1))->get("class")->addr());
+
+    /* Existing strings are indexed when enabling deduplication */
+    plain->setStringDeduplication(true);
+    REQUIRE(plain->newValue("road7")->addr() == plain->resolveObject(plain->root(7))->get("name")->addr());
+}
+
+TEST_CASE("Mapped Serialization", "[complex.mapped-serialization]") {
+    auto model = json::parse(invoice);
+
+    std::stringstream stream;
+    model->writeMapped(stream);
+    auto bytes = stream.str();
+    auto buffer = std::make_shared<std::vector<std::byte>>(bytes.size());
+    std::memcpy(buffer->data(), bytes.data(), bytes.size());
+
+    auto mapped = std::make_shared<ModelPool>(model->strings());
+    mapped->readMapped(buffer, *buffer);
+
+    SECTION("Mapped pool equals the original")
+    {
+        REQUIRE(mapped->isMapped());
+        REQUIRE(mapped->numRoots() == model->numRoots());
+        REQUIRE(mapped->toJson() == model->toJson());
+        REQUIRE_NOTHROW(mapped->validate());
+
+        Environment env(mapped->strings());
+        auto ast = compile(env, "sum(**.(price * quantity))", false);
+        REQUIRE(eval(env, *ast, *mapped->root(0))[0].toString() == "336.360000");
+    }
+
+    SECTION("Mapped pool is read-only")
+    {
+        REQUIRE_THROWS(mapped->newObject());
+        REQUIRE_THROWS(mapped->newValue(int64_t(1) << 40));
+        REQUIRE_THROWS(mapped->addRoot(mapped->root(0)));
+        REQUIRE_THROWS(mapped->resolveObject(mapped->root(0))->addField("x", "y"));
+
+        mapped->clear();
+        REQUIRE(!mapped->isMapped());
+        REQUIRE_NOTHROW(mapped->newObject());
+    }
+
+    SECTION("Mapped pool can be written again")
+    {
+        std::stringstream again;
+        mapped->writeMapped(again);
+        REQUIRE(again.str() == bytes);
+    }
+
+    SECTION("Memory-mapped file")
+    {
+        auto path = (std::filesystem::temp_directory_path() / "simfil-mapped-test.bin").string();
+        {
+            std::ofstream file(path, std::ios::binary);
+            model->writeMapped(file);
+        }
+
+        auto fromFile = std::make_shared<ModelPool>(model->strings());
+        fromFile->readMapped(path);
+        REQUIRE(fromFile->toJson() == model->toJson());
+        fromFile.reset();
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Bad buffers are rejected")
+    {
+        auto corrupt = std::make_shared<std::vector<std::byte>>(*buffer);
+        (*corrupt)[0] = std::byte{'X'};
+        REQUIRE_THROWS(mapped->readMapped(corrupt, *corrupt));
+
+        auto truncated = std::span<const std::byte>(*buffer).first(buffer->size() / 2);
+        REQUIRE_THROWS(mapped->readMapped(buffer, truncated));
+    }
+
+    SECTION("Bad chunk tables are rejected")
+    {
+        /* The header holds magic, version and flags (16 bytes), then an
+         * (offset, size) pair per section. Object heads are section 5,
+         * a chunk is (offset, capacity, size, next, last). */
+        uint64_t heads = 0;
+        std::memcpy(&heads, buffer->data() + 16 + 5 * 16, sizeof(heads));
+        auto patched = [&](size_t field, uint32_t value) {
+            auto corrupt = std::make_shared<std::vector<std::byte>>(*buffer);
+            std::memcpy(corrupt->data() + heads + field * sizeof(uint32_t), &value, sizeof(value));
+            return corrupt;
+        };
+
+        auto offset = patched(0, 0xfffffff0u);
+        REQUIRE_THROWS_WITH(mapped->readMapped(offset, *offset), "Mapped ModelPool: Bad chunk bounds.");
+        auto next = patched(3, 12345u);
+        REQUIRE_THROWS_WITH(mapped->readMapped(next, *next), "Mapped ModelPool: Bad chunk link.");
+    }
+}
+
+TEST_CASE("JSON Object Keys", "[complex.json-keys]") {
+    /* Fields are sorted by key, and a repeated key keeps its last value */
+    auto model = json::parse(R"({"b": 1, "a": {"y": 2, "x": 3, "y": 4}, "c": 5, "a2": 6})");
+    auto root = model->resolveObject(model->root(0));
+    REQUIRE(root->size() == 4);
+    std::vector<std::string_view> keys;
+    for (auto i = 0; i < root->size(); ++i)
+        keys.push_back(*model->strings()->resolve(root->keyAt(i)));
+    REQUIRE(keys == std::vector<std::string_view>{"a", "a2", "b", "c"});
+
+    auto nested = model->resolveObject(root->get("a"));
+    REQUIRE(nested->size() == 2);
+    REQUIRE(Value(nested->get("y")->value()).as<ValueType::Int>() == 4);
+
+    Environment env(model->strings());
+    REQUIRE(eval(env, *compile(env, "keys(_)", false), *model->root(0)).size() == 4);
+    REQUIRE(eval(env, *compile(env, "a.*", false), *model->root(0))[1].toString() == "4");
+}
+
+TEST_CASE("Parse JSON Roots", "[complex.json-roots]") {
+    std::vector<std::string> documents = {
+        R"({"id": 1, "tags": ["a", "b"], "nested": {"x": [1, [2, 3]], "y": {}}})",
+        R"({"id": 2, "text": "brackets ] } [ { and , \" inside"})",
+        R"([1, 2.5, true, "x"])",
+        R"(42)",
+    };
+    for (auto i = 0; i < 200; ++i)
+        documents.push_back(R"({"id": )" + std::to_string(i + 10) + R"(, "value": [)" + std::to_string(i) + "]}");
+
+    // Expected model, built from one document at a time.
+    auto expected = std::make_shared<ModelPool>();
+    for (auto const& document : documents)
+        json::parse(document, expected);
+
+    auto check = [&](ModelPoolPtr const& model) {
+        REQUIRE(model->numRoots() == expected->numRoots());
+        for (auto i = 0u; i < model->numRoots(); ++i)
+            REQUIRE(model->root(i)->toJson() == expected->root(i)->toJson());
+    };
+
+    SECTION("Lines") {
+        std::string input;
+        for (auto const& document : documents)
+            input += document + "\r\n\n";
+        std::istringstream stream(input);
+
+        auto model = std::make_shared<ModelPool>();
+        REQUIRE(json::parseRoots(stream, model, json::RootLayout::Lines, 4) == documents.size());
+        check(model);
+    }
+
+    SECTION("Array") {
+        std::string input = " [\n";
+        for (auto i = 0u; i < documents.size(); ++i)
+            input += (i ? ",\n" : "") + documents[i];
+        input += "\n] ";
+        std::istringstream stream(input);
+
+        auto model = std::make_shared<ModelPool>();
+        REQUIRE(json::parseRoots(stream, model, json::RootLayout::Array, 3) == documents.size());
+        check(model);
+
+        Environment env(model->strings());
+        auto ast = compile(env, "count(**.value)", false);
+        REQUIRE(eval(env, *ast, *model->root(10))[0].toString() == "1");
+    }
+
+    SECTION("Errors") {
+        auto model = std::make_shared<ModelPool>();
+        std::istringstream invalid("{\"a\": 1}\n{\"b\":}\n");
+        REQUIRE_THROWS(json::parseRoots(invalid, model, json::RootLayout::Lines, 2));
+
+        std::istringstream unterminated("[1, 2");
+        REQUIRE_THROWS(json::parseRoots(unterminated, model, json::RootLayout::Array, 2));
+
+        std::istringstream missing("[1,, 2]");
+        REQUIRE_THROWS(json::parseRoots(missing, model, json::RootLayout::Array, 2));
+    }
+}
+
+TEST_CASE("Parallel Evaluation", "[complex.parallel]") {
+    auto model = std::make_shared<ModelPool>();
+    for (auto i = 0; i < 1000; ++i) {
+        auto root = model->newObject(2);
+        root->addField("id", (int64_t)i);
+        root->addField("tag", i % 2 ? "odd" : "even");
+        model->addRoot(root);
+    }
+
+    Environment env(model->strings());
+
+    SECTION("Results are ordered by root") {
+        auto ast = compile(env, "tag == 'even' and id", false);
+        auto res = eval(env, *ast, *model, 4);
+
+        REQUIRE(res.size() == model->numRoots());
+        for (auto i = 0u; i < res.size(); ++i) {
+            auto single = eval(env, *ast, *model->root(i));
+            REQUIRE(res[i].size() == single.size());
+            REQUIRE(res[i][0].toString() == single[0].toString());
+        }
+    }
+
+    SECTION("Traces are collected from all threads") {
+        auto ast = compile(env, "trace(id)", false);
+        (void)eval(env, *ast, *model, 4);
+        REQUIRE(env.traces["id"].calls == model->numRoots());
+    }
+
+    SECTION("Errors are rethrown") {
+        auto ast = compile(env, "1 / (id - 500)", false);
+        REQUIRE_THROWS(eval(env, *ast, *model, 4));
+    }
+}
+
+TEST_CASE("Bytecode Backend", "[complex.bytecode]") {
+    auto model = json::parse(invoice);
+    Environment env(model->strings());
+
+    auto run = [&](std::string_view query, bool any, Backend backend) {
+        auto ast = compile(env, query, any, backend);
+        std::string vals;
+        for (const auto& vv : eval(env, *ast, *model->root(0))) {
+            if (!vals.empty())
+                vals.push_back('|');
+            vals += vv.toString();
+        }
+        return vals;
+    };
+
+    const std::vector<std::string_view> queries = {
+        "account.name",
+        "account.order.*.id",
+        "account.order.*.product.*.(price * quantity)",
+        "sum(account.order.*.product.*.(price * quantity))",
+        "**.(price * quantity)",
+        "**.price > 30",
+        "account.order.*.product.*.name == 'Thing'",
+        "count(account.order.*.product.*.quantity > 1)",
+        "any(**.name == 'Thing') and not each(**.quantity == 1)",
+        "each(account.order.*.product.*.price > 20)",
+        "nonexisting or account.name",
+        "account.name and nonexisting",
+        "(account.order.*.product.*.quantity as string) + 'x'",
+        "account.{name}",
+        "account.order[0].product[1].name",
+        "account.nonexisting.name",
+        "#account.order",
+        "typeof account.order.*.product.*.price",
+        "-account.order.*.product.*.quantity",
+        "~(account.order.*.product.*.quantity)",
+        "account.order.*.product.*.price <= 34.45",
+        "re'.*Thing' = **.name",
+        "1 + 2 * account.order.*.product.*.quantity",
+        "account.order.*.product.*.quantity * count(**.price > 30) + account.order.*.id",
+        "1 + (account.nonexisting.* + 2)",
+    };
+
+    for (auto query : queries) {
+        INFO("Query: " << query);
+        REQUIRE(run(query, false, Backend::Bytecode) == run(query, false, Backend::Tree));
+        REQUIRE(run(query, true, Backend::Bytecode) == run(query, true, Backend::Tree));
+    }
+
+    SECTION("Runtime errors are raised") {
+        REQUIRE_THROWS(run("1 / (nonexisting as int)", false, Backend::Bytecode));
+    }
+
+    SECTION("Debug hooks see the expression tree") {
+        auto ast = compile(env, "account.order.*.id", false, Backend::Bytecode);
+        REQUIRE(ast->toString() == compile(env, "account.order.*.id", false)->toString());
+    }
+}
+
+TEST_CASE("Compile Cache", "[complex.compile-cache]") {
+    auto model = json::parse(invoice);
+    Environment env(model->strings());
+    auto& cache = *env.compileCache;
+
+    SECTION("Hits return the same expression") {
+        auto a = compileCached(env, "account.name", false);
+        auto b = compileCached(env, "account.name", false);
+        auto c = compileCached(env, "account.name", true);
+        REQUIRE(a == b);
+        REQUIRE(a != c);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(eval(env, *b, *model->root(0))[0].toString() == "Demo");
+    }
+
+    SECTION("Least recently used entries are evicted") {
+        cache.setCapacity(2);
+        auto a = compileCached(env, "1", false);
+        (void)compileCached(env, "2", false);
+        (void)compileCached(env, "1", false);
+        (void)compileCached(env, "3", false);
+        REQUIRE(cache.size() == 2);
+        REQUIRE(compileCached(env, "1", false) == a);
+        REQUIRE(cache.hits() == 2);
+        (void)compileCached(env, "2", false);
+        REQUIRE(cache.misses() == 4);
+    }
+
+    SECTION("Entries of another string pool are not reused") {
+        auto a = compileCached(env, "account.name", false);
+        env.stringPool = std::make_shared<StringPool>();
+        auto b = compileCached(env, "account.name", false);
+        REQUIRE(a != b);
+        REQUIRE(cache.size() == 1);
+    }
+
+    SECTION("Entries of a freed string pool are not reused at the same address") {
+        alignas(StringPool) static unsigned char storage[sizeof(StringPool)];
+        auto inPlace = []() {
+            return std::shared_ptr<StringPool>(new (storage) StringPool(), [](StringPool* pool) { pool->~StringPool(); });
+        };
+
+        env.stringPool = inPlace();
+        auto a = compileCached(env, "account.name", false);
+        env.stringPool.reset();
+        env.stringPool = inPlace();
+        auto b = compileCached(env, "account.name", false);
+        REQUIRE(a != b);
+        REQUIRE(cache.hits() == 0);
+        env.stringPool = model->strings();
+    }
+
+    SECTION("Compile errors are not cached") {
+        REQUIRE_THROWS(compileCached(env, "1 +", false));
+        REQUIRE(cache.size() == 0);
+    }
+}
+
+TEST_CASE("Value Index", "[complex.value-index]") {
+    auto documents = {
+        R"({"features": [{"id": 1, "speed": 50}, {"id": 2, "speed": 80.5}]})",
+        R"({"features": [{"id": 3, "speed": "fast"}, {"id": 2.0}], "name": "b"})",
+        R"({"features": []})",
+    };
+
+    auto indexed = std::make_shared<ModelPool>();
+    auto plain = std::make_shared<ModelPool>();
+    for (auto document : documents) {
+        json::parse(document, indexed);
+        json::parse(document, plain);
+    }
+
+    indexed->addIndex("features.*.id");
+    indexed->addIndex(" features . * . speed ");
+    indexed->addIndex("**.id");
+    REQUIRE(!indexed->index("features.*.id"));
+    indexed->compact();
+
+    SECTION("Lookups") {
+        auto index = indexed->index("features.*.id");
+        REQUIRE(index);
+        REQUIRE(index->equal(int64_t(2)).size() == 2);
+        REQUIRE(index->equal(3.).size() == 1);
+        REQUIRE(index->equal(int64_t(4)).empty());
+        REQUIRE(index->range(2., 3.).size() == 2);
+        REQUIRE(index->range(0., 1.).size() == 1);
+
+        using Comparison = ValueIndex::Comparison;
+        auto speed = indexed->index("features.*.speed");
+        REQUIRE(speed);
+        REQUIRE(speed->test(indexed->root(0)->addr(), Comparison::Gt, int64_t(80)) == true);
+        REQUIRE(speed->test(indexed->root(0)->addr(), Comparison::Lt, 50.) == false);
+        REQUIRE(speed->test(indexed->root(2)->addr(), Comparison::Eq, int64_t(50)) == false);
+        /* Comparing strings to numbers raises, which the index leaves to the query */
+        REQUIRE(!speed->test(indexed->root(1)->addr(), Comparison::Gt, int64_t(80)));
+    }
+
+    SECTION("Queries return the same results as without index") {
+        auto run = [](ModelPoolPtr const& model, std::string_view query, size_t root, Backend backend) {
+            Environment env(model->strings());
+            try {
+                return eval(env, *compile(env, query, true, backend), *model->root(root))[0].toString();
+            } catch (const std::exception&) {
+                return std::string("error");
+            }
+        };
+
+        auto queries = {
+            "features.*.id == 2",
+            "2 == features.*.id",
+            "features.*.id == 2.5",
+            "features.*.id < 2",
+            "3 <= features.*.id",
+            "features.*.id > 2",
+            "features.*.speed > 80",
+            "features.*.speed == 'fast'",
+            "**.id == 3",
+            "any(**.id >= 3)",
+        };
+
+        for (auto query : queries) {
+            for (auto root = 0u; root < indexed->numRoots(); ++root) {
+                INFO("Query: " << query << ", root " << root);
+                REQUIRE(run(indexed, query, root, Backend::Tree) == run(plain, query, root, Backend::Tree));
+                REQUIRE(run(indexed, query, root, Backend::Bytecode) == run(plain, query, root, Backend::Tree));
+            }
+        }
+    }
+
+    SECTION("Indexes are rebuilt after clear()") {
+        indexed->clear();
+        REQUIRE(!indexed->index("features.*.id"));
+        json::parse(documents.begin()[0], indexed);
+        indexed->compact();
+        REQUIRE(indexed->index("features.*.id")->equal(int64_t(1)).size() == 1);
+    }
+
+    REQUIRE_THROWS(indexed->addIndex("features..id"));
+}
+
+TEST_CASE("Field Filters", "[complex.field-filters]") {
+    auto documents = {
+        R"({"a": {"b": 1}})",
+        R"({"a": {"tollInfo": 5}, "c": [{"b": 2}]})",
+    };
+
+    auto filtered = std::make_shared<ModelPool>();
+    auto plain = std::make_shared<ModelPool>();
+    for (auto document : documents) {
+        json::parse(document, filtered);
+        json::parse(document, plain);
+    }
+
+    filtered->setFieldFilters(true);
+    filtered->compact();
+
+    auto id = [&](std::string_view name) { return filtered->strings()->get(name); };
+    REQUIRE(filtered->mayContainField(filtered->root(0)->addr(), id("a")));
+    REQUIRE(filtered->mayContainField(filtered->root(0)->addr(), id("b")));
+    REQUIRE(!filtered->mayContainField(filtered->root(0)->addr(), id("tollInfo")));
+    REQUIRE(filtered->mayContainField(filtered->root(1)->addr(), id("tollInfo")));
+    REQUIRE(filtered->mayContainField(filtered->root(1)->addr(), id("b")));
+
+    auto run = [](ModelPoolPtr const& model, std::string_view query, size_t root) {
+        Environment env(model->strings());
+        return eval(env, *compile(env, query), *model->root(root))[0].toString();
+    };
+
+    auto queries = {
+        "**.tollInfo",
+        "**.tollInfo == 5",
+        "a.tollInfo > 1 and a.b",
+        "a.tollInfo or a.b",
+        "**.{tollInfo}",
+        "not **.tollInfo",
+        "**.tollInfo == null",
+        "**.unknown",
+    };
+
+    for (auto query : queries) {
+        for (auto root = 0u; root < filtered->numRoots(); ++root) {
+            INFO("Query: " << query << ", root " << root);
+            REQUIRE(run(filtered, query, root) == run(plain, query, root));
+        }
+    }
+
+    filtered->setFieldFilters(false);
+    REQUIRE(filtered->mayContainField(filtered->root(0)->addr(), id("tollInfo")));
+}
+
+TEST_CASE("Wildcard Walk", "[complex.wildcard-walk]") {
+    /* `**._.name` is not fused and looks up the field on every node */
+    auto queries = {
+        std::pair{"**.id", "**._.id"},
+        std::pair{"**.quantity", "**._.quantity"},
+        std::pair{"**.id == 'abc'", "**._.id == 'abc'"},
+        std::pair{"count(**.product)", "count(**._.product)"},
+        std::pair{"**.{**.price > 100}", "**.{**._.price > 100}"},
+        std::pair{"**.unknown", "**._.unknown"},
+        std::pair{"any(**.price > 100)", "any(**._.price > 100)"},
+    };
+
+    for (auto [fused, plain] : queries) {
+        INFO("Query: " << fused);
+        REQUIRE(joined_result(fused) == joined_result(plain));
+    }
+
+    REQUIRE_RESULT("**.id", "order1|abc|xyz|order12|abc|xyz");
+
+    SECTION("Deep nesting does not recurse") {
+        auto model = std::make_shared<ModelPool>();
+        auto leaf = model->newObject();
+        leaf->addField("id", (int64_t)42);
+        auto node = model->newArray();
+        node->append(leaf);
+        for (auto i = 0; i < 100000; ++i) {
+            auto parent = model->newArray();
+            parent->append(node);
+            node = parent;
+        }
+        model->addRoot(node);
+
+        Environment env(model->strings());
+        REQUIRE(eval(env, *compile(env, "count(**)", false), *model->root(0))[0].toString() == "100003");
+        REQUIRE(eval(env, *compile(env, "**.id", false), *model->root(0))[0].toString() == "42");
+    }
+}
+
+TEST_CASE("Batch Evaluation", "[complex.batch]") {
+    /* More features than fit into one batch; the last ones have float and string speeds */
+    std::string doc = R"({"features": [)";
+    for (auto i = 0; i < 1000; ++i) {
+        if (i > 0)
+            doc += ",";
+        if (i % 7 == 0)
+            doc += R"({"id": )" + std::to_string(i) + "}";
+        else if (i >= 900)
+            doc += R"({"attributes": {"speed": )" + std::to_string(i) + ".5}}";
+        else
+            doc += R"({"attributes": {"speed": )" + std::to_string(i % 130) + "}}";
+    }
+    doc += R"(], "numbers": [{"a": 1}, {"a": 2.5}, {"a": null}], "mixed": [{"a": 1}, {"a": "x"}], "empty": []})";
+    auto model = json::parse(doc);
+
+    auto run = [&](std::string_view query, bool any) {
+        Environment env(model->strings());
+        std::string vals;
+        for (const auto& vv : eval(env, *compile(env, query, any), *model->root(0))) {
+            if (!vals.empty())
+                vals.push_back('|');
+            vals += vv.toString();
+        }
+        return vals;
+    };
+
+    /* `*._.name` is not batched */
+    auto queries = {
+        std::pair{"features.*.attributes.speed", "features.*._.attributes.speed"},
+        std::pair{"features.*.attributes.speed > 120", "features.*._.attributes.speed > 120"},
+        std::pair{"count(features.*.attributes.speed >= 950)", "count(features.*._.attributes.speed >= 950)"},
+        std::pair{"100 == features.*.attributes.speed", "100 == features.*._.attributes.speed"},
+        std::pair{"features.*.id != 14", "features.*._.id != 14"},
+        std::pair{"numbers.*.a == 1", "numbers.*._.a == 1"},
+        std::pair{"numbers.*.a < 2", "numbers.*._.a < 2"},
+        std::pair{"empty.*.a == 1", "empty.*._.a == 1"},
+        std::pair{"features.*.unknown < 1", "features.*._.unknown < 1"},
+        std::pair{"*.*.attributes.speed < 3", "*.*._.attributes.speed < 3"},
+    };
+
+    for (auto [batched, plain] : queries) {
+        INFO("Query: " << batched);
+        REQUIRE(run(batched, false) == run(plain, false));
+        REQUIRE(run(batched, true) == run(plain, true));
+    }
+
+    REQUIRE(run("count(features.*.attributes.speed)", false) == "857");
+    REQUIRE(run("empty.*.a == 1", false) == "false");
+    REQUIRE(run("numbers.*.a < 2", false) == "true|false");
+    REQUIRE_THROWS(run("mixed.*.a < 2", false));
+
+    Environment env(model->strings());
+    REQUIRE(compile(env, "features.*.attributes.speed > 1", false)->toString() == "(> (. (. (. features *) attributes) speed) 1)");
+}
+
+TEST_CASE("Short-Circuit Aggregates", "[complex.short-circuit]") {
+    /* `count(...) + 0` is not short-circuited */
+    auto queries = {
+        std::pair{"count(**.price > 100) > 0", "count(**.price > 100) + 0 > 0"},
+        std::pair{"count(**.price > 100) == 0", "count(**.price > 100) + 0 == 0"},
+        std::pair{"count(**.price > 10) >= 2", "count(**.price > 10) + 0 >= 2"},
+        std::pair{"count(**.price > 10) < 4", "count(**.price > 10) + 0 < 4"},
+        std::pair{"count(**.price > 10) <= 4", "count(**.price > 10) + 0 <= 4"},
+        std::pair{"count(**.price > 10) != 4", "count(**.price > 10) + 0 != 4"},
+        std::pair{"3 < count(**.price)", "3 < count(**.price) + 0"},
+        std::pair{"4 <= count(**.price)", "4 <= count(**.price) + 0"},
+        std::pair{"count(**.price) > -1", "count(**.price) + 0 > -1"},
+        std::pair{"count(**.unknown) == 0", "count(**.unknown) + 0 == 0"},
+        std::pair{"count(account.order.*.id, **.price > 100) > 2", "count(account.order.*.id, **.price > 100) + 0 > 2"},
+    };
+
+    for (auto [shortCircuit, plain] : queries) {
+        INFO("Query: " << shortCircuit);
+        REQUIRE(joined_result(shortCircuit) == joined_result(plain));
+    }
+
+    REQUIRE_RESULT("count(**.price > 100) > 0", "true");
+    REQUIRE_RESULT("count(range(1, 1000000000)...) > 3", "true");
+    REQUIRE_RESULT("any(range(1, 1000000000)... > 3)", "true");
+
+    SECTION("Evaluation stops at the first positive result") {
+        auto model = json::parse(invoice);
+        Environment env(model->strings());
+        auto evaluations = 0;
+        Debug debug;
+        debug.evalBegin = [&](const Expr&, Context&, Value&, const ResultFn&) { ++evaluations; };
+        debug.evalEnd = [](const Expr&) {};
+
+        auto countEvaluations = [&](std::string_view query) {
+            auto ast = compile(env, query, false);
+            evaluations = 0;
+            env.debug = &debug;
+            auto res = eval(env, *ast, *model->root(0));
+            env.debug = nullptr;
+            REQUIRE(res.size() == 1);
+            REQUIRE(res[0].toString() == "true");
+            return evaluations;
+        };
+
+        REQUIRE(countEvaluations("count(**.price > 10) > 0") < countEvaluations("count(**.price > 10) + 0 > 0"));
+    }
+}
+
+TEST_CASE("Query Pack", "[complex.query-pack]") {
+    auto model = json::parse(invoice);
+    json::parse(R"({"account": {"name": "Other", "order": [{"id": "order3", "product": [{"name": "Thing", "id": "abc", "price": 1.5}]}]}})", model);
+
+    auto queries = {
+        "**.price > 100",
+        "**.id",
+        "count(**.quantity)",
+        "**.NAME",
+        "sum(**.price)",
+        "**.unknown",
+        "account.order.*.product.*.price",
+        "account.order.*.product.*.quantity",
+        "count(account.**)",
+        "account.**.id",
+        "**.{**.id == 'abc'}.name",
+        "**.product.*.id",
+    };
+
+    for (auto any : {false, true}) {
+        Environment env(model->strings());
+        std::vector<ExprPtr> exprs;
+        for (auto query : queries)
+            exprs.push_back(compile(env, query, any));
+        QueryPack pack(std::move(exprs));
+
+        REQUIRE(pack.size() == queries.size());
+        REQUIRE(pack.sharedFields() == std::vector<std::string>{"price", "id", "quantity", "NAME", "unknown", "product"});
+        REQUIRE(pack.sharedPaths() == 2); /* account.order.*.product, account.** */
+
+        auto results = eval(env, pack, *model, 2);
+        REQUIRE(results.size() == 2);
+        for (auto root = 0u; root < model->numRoots(); ++root) {
+            auto i = 0u;
+            for (auto query : queries) {
+                INFO("Query: " << query << ", root " << root);
+                REQUIRE(pack.expr(i).toString() == compile(env, query, any)->toString());
+
+                auto expected = eval(env, *compile(env, query, any), *model->root(root));
+                REQUIRE(results[root][i].size() == expected.size());
+                for (auto j = 0u; j < expected.size(); ++j)
+                    REQUIRE(results[root][i][j].toString() == expected[j].toString());
+                ++i;
+            }
+        }
+    }
+}
+
+TEST_CASE("Query Pack Early Stop", "[complex.query-pack]") {
+    std::string numbers;
+    for (auto i = 0; i < 3000; ++i)
+        numbers += (i ? ", " : "") + std::to_string(i);
+    auto model = std::make_shared<ModelPool>();
+    json::parse("{\"numbers\": [" + numbers + "]}", model);
+
+    Environment env(model->strings());
+    std::vector<ExprPtr> exprs;
+    exprs.push_back(compile(env, "any(numbers.** == 1)", false));
+    exprs.push_back(compile(env, "any(numbers.** == 2)", false));
+    QueryPack pack(std::move(exprs));
+    REQUIRE(pack.sharedPaths() == 1);
+
+    /* Rules which stop at their first match do not walk the whole path */
+    env.limits.maxNodes = 100;
+    auto results = eval(env, pack, *model->root(0));
+    REQUIRE(results[0][0].as<ValueType::Bool>());
+    REQUIRE(results[1][0].as<ValueType::Bool>());
+
+    /* An incomplete recording is not replayed */
+    exprs.clear();
+    exprs.push_back(compile(env, "any(numbers.** == 1)", false));
+    exprs.push_back(compile(env, "count(numbers.**)", false));
+    exprs.push_back(compile(env, "count(numbers.**)", false));
+    QueryPack counting(std::move(exprs));
+    env.limits.maxNodes = 0;
+    results = eval(env, counting, *model->root(0));
+    REQUIRE(results[0][0].as<ValueType::Bool>());
+    REQUIRE(results[1][0].as<ValueType::Int>() == 3001);
+    REQUIRE(results[2][0].as<ValueType::Int>() == 3001);
+}
+
+TEST_CASE("Incremental Evaluation", "[complex.incremental]") {
+    auto model = std::make_shared<ModelPool>();
+    std::vector<model_ptr<Object>> props, extras;
+    std::vector<model_ptr<Array>> lists;
+
+    auto addRoot = [&](int64_t i) {
+        auto root = model->newObject(4);
+        props.push_back(model->newObject(2));
+        if (i != 7)
+            props.back()->addField("speed", i);
+        extras.push_back(model->newObject(2));
+        extras.back()->addField("note", "n" + std::to_string(i));
+        lists.push_back(model->newArray(2));
+        lists.back()->append(i);
+        root->addField("id", i);
+        root->addField("props", props.back());
+        root->addField("extra", extras.back());
+        root->addField("list", lists.back());
+        model->addRoot(root);
+    };
+    for (auto i = 0; i < 100; ++i)
+        addRoot(i);
+
+    Environment env(model->strings());
+    auto byName = compile(env, "props.speed > 50", false);
+    auto wildcard = compile(env, "count(list.*)", false);
+
+    IncrementalEval named(env, *byName, *model);
+    IncrementalEval any(env, *wildcard, *model);
+    REQUIRE(named.fields() == std::vector<std::string>{"props", "speed"});
+    REQUIRE(!any.fields());
+
+    auto check = [&](IncrementalEval& incremental, const Expr& ast, size_t evaluated) {
+        const auto& results = incremental.update(2);
+        REQUIRE(incremental.evaluated() == evaluated);
+        REQUIRE(results.size() == model->numRoots());
+        for (auto i = 0u; i < model->numRoots(); ++i) {
+            INFO("Root " << i << ": " << ast.toString());
+            auto expected = eval(env, ast, *model->root(i));
+            REQUIRE(results[i].size() == expected.size());
+            for (auto j = 0u; j < expected.size(); ++j)
+                REQUIRE(results[i][j].toString() == expected[j].toString());
+        }
+    };
+
+    check(named, *byName, 100);
+    check(any, *wildcard, 100);
+
+    /* Nothing changed */
+    check(named, *byName, 0);
+
+    /* Fields of objects which the expression cannot reach */
+    extras[3]->addField("speed", (int64_t)99);
+    check(named, *byName, 0);
+
+    /* Fields of reachable objects */
+    props[7]->addField("speed", (int64_t)80);
+    props[8]->addField("lanes", (int64_t)2);
+    check(named, *byName, 2);
+    REQUIRE(named.results()[7][0].toString() == "true");
+
+    /* New roots */
+    addRoot(100);
+    check(named, *byName, 1);
+
+    /* Arrays are reachable by wildcards */
+    lists[9]->append((int64_t)1);
+    check(named, *byName, 0);
+    check(any, *wildcard, 2);  /* Root 9 and the new root */
+    REQUIRE(any.results()[9][0].toString() == "2");
+}
+
+namespace
+{
+
+/* Pool which counts the prefetched nodes, like a lazily-loaded model would */
+struct PrefetchingPool : public ModelPool
+{
+    mutable std::atomic<size_t> prefetches = 0;
+    mutable std::atomic<size_t> prefetched = 0;
+
+    void prefetch(std::span<const ModelNode::Ptr> nodes) const override {
+        ++prefetches;
+        prefetched += nodes.size();
+    }
+};
+
+}
+
+TEST_CASE("Async Evaluation", "[complex.async]") {
+    auto model = std::make_shared<PrefetchingPool>();
+    for (auto i = 0; i < 200; ++i) {
+        auto root = model->newObject(1);
+        root->addField("id", (int64_t)i);
+        model->addRoot(root);
+    }
+
+    Environment env(model->strings());
+    auto ast = compile(env, "100 / (id - 5)", false);
+
+    std::vector<std::future<std::vector<Value>>> futures;
+    {
+        AsyncEvaluator evaluator(env, 2, 16);
+        for (auto i = 0u; i < model->numRoots(); ++i)
+            futures.push_back(evaluator.submit(*ast, model->root(i)));
+        evaluator.wait();
+        REQUIRE(model->prefetched == model->numRoots());
+        REQUIRE(model->prefetches >= model->numRoots() / 16);
+    }
+
+    for (auto i = 0u; i < futures.size(); ++i) {
+        INFO("Root " << i);
+        if (i == 5) {
+            REQUIRE_THROWS(futures[i].get());
+            continue;
+        }
+        auto res = futures[i].get();
+        REQUIRE(res.size() == 1);
+        REQUIRE(res[0].toString() == eval(env, *ast, *model->root(i))[0].toString());
+    }
+}
+
+TEST_CASE("Model Builder", "[complex.builder]") {
+    auto model = std::make_shared<ModelPool>();
+    ModelBuilder builder(*model);
+    builder.reserve({.roots_ = 100, .objects_ = 200, .fields_ = 500, .arrays_ = 100, .elements_ = 300,
+                     .ints_ = 100, .strings_ = 100, .stringBytes_ = 1000});
+
+    const auto id = builder.name("id");
+    const auto name = builder.name("name");
+    const auto point = builder.name("point");
+    const auto tags = builder.name("tags");
+    for (auto i = 0; i < 100; ++i) {
+        std::array<ModelNodeAddress, 3> elements{builder.value((int64_t)i), builder.value(true), builder.null()};
+        std::array<ModelBuilder::Field, 2> coords{{
+            {builder.name("x"), builder.value(i * 0.5)},
+            {builder.name("y"), builder.value((int64_t)-i)}}};
+        std::array<ModelBuilder::Field, 4> fields{{
+            {id, builder.value((int64_t)i * 100000)},
+            {name, builder.value("road" + std::to_string(i))},
+            {point, builder.object(coords)},
+            {tags, builder.array(elements)}}};
+        builder.addRoot(builder.object(fields));
+    }
+    model->validate();
+
+    REQUIRE(model->numRoots() == 100);
+    auto json = model->toJson();
+    REQUIRE(json[7] == nlohmann::json::parse(R"({"id": 700000, "name": "road7", "point": {"x": 3.5, "y": -7}, "tags": [7, true, null]})"));
+
+    Environment env(model->strings());
+    auto ast = compile(env, "point.y < -97", false);
+    auto res = eval(env, *ast, *model);
+    REQUIRE(res[98][0].toString() == "true");
+    REQUIRE(res[97][0].toString() == "false");
+
+    /* Nodes can be extended via handles */
+    model->resolveObject(builder.node(model->root(0)->addr()))->addField("extra", (int64_t)1);
+    REQUIRE(model->toJson()[0]["extra"] == 1);
+}
+
+TEST_CASE("Merge Pools", "[complex.merge]") {
+    auto makeTile = [](int tile) {
+        auto pool = std::make_shared<ModelPool>();
+        json::parse(R"({"tile": )" + std::to_string(tile) + R"(, "name": "a)" + std::to_string(tile) + R"(", "big": 9999999999, "f": 1.5, "tags": [1, "x"]})", pool);
+        auto root = pool->newObject();
+        root->addField(std::string("only") + std::to_string(tile), (int64_t)tile);
+        pool->addRoot(root);
+        return pool;
+    };
+
+    auto a = makeTile(1);
+    auto b = makeTile(2);
+    REQUIRE(a->strings() != b->strings());
+
+    const auto first = a->merge(*b);
+    REQUIRE(first == 2);
+    REQUIRE(a->numRoots() == 4);
+    REQUIRE_NOTHROW(a->validate());
+
+    auto expected = a->toJson();
+    REQUIRE(expected[2] == b->toJson()[0]);
+    REQUIRE(expected[3] == nlohmann::json::parse(R"({"only2": 2})"));
+    REQUIRE(expected[0] == makeTile(1)->toJson()[0]);
+
+    Environment env(a->strings());
+    auto ast = compile(env, "tile == 2 and tags.* == 'x'", false);
+    auto res = eval(env, *ast, *a);
+    REQUIRE(res[0][0].toString() == "false");
+    REQUIRE(res[2][0].toString() == "true");
+
+    /* Pools which share their strings are merged without translation */
+    auto c = std::make_shared<ModelPool>(a->strings());
+    c->merge(*a);
+    REQUIRE(c->toJson() == a->toJson());
+
+    REQUIRE_THROWS(a->merge(*a));
+}
+
+TEST_CASE("Top Results", "[complex.top]") {
+    auto model = std::make_shared<ModelPool>();
+    for (auto i = 0; i < 100; ++i)
+        json::parse("{\"id\": " + std::to_string(i) + ", \"length\": " + std::to_string((i * 37) % 100) +
+                    ", \"lanes\": [" + std::to_string(i % 7) + ", " + std::to_string(i % 5) + "]}", model);
+
+    Environment env(model->strings());
+    auto roots = compile(env, "_", false);
+    auto length = compile(env, "length", false);
+    auto best = top(env, *roots, *length, *model, 3, 4);
+    REQUIRE(best.size() == 3);
+    REQUIRE(best[0].node->get(model->strings()->get("length"))->value() == ScalarValueType((int64_t)99));
+    REQUIRE(best[1].node->get(model->strings()->get("length"))->value() == ScalarValueType((int64_t)98));
+    REQUIRE(best[2].node->get(model->strings()->get("length"))->value() == ScalarValueType((int64_t)97));
+
+    /* Equal keys rank by root, then by result */
+    auto lanes = compile(env, "lanes.*", false);
+    auto self = compile(env, "_", false);
+    auto most = top(env, *lanes, *self, *model, 4);
+    REQUIRE(most.size() == 4);
+    for (auto& lane : most)
+        REQUIRE(lane.as<ValueType::Int>() == 6);
+
+    REQUIRE(top(env, *roots, *length, *model, 0).empty());
+    REQUIRE(top(env, *roots, *length, *model, 1000).size() == 100);
+}
+
+TEST_CASE("Evaluation Limits", "[complex.limits]") {
+    std::string numbers;
+    for (auto i = 0; i < 3000; ++i)
+        numbers += (i ? ", " : "") + std::to_string(i);
+    auto model = std::make_shared<ModelPool>();
+    json::parse("{\"numbers\": [" + numbers + "]}", model);
+
+    Environment env(model->strings());
+    auto all = compile(env, "**", false);
+    auto children = compile(env, "numbers.*", false);
+    auto total = compile(env, "sum(numbers.*)", false);
+    REQUIRE(eval(env, *all, *model->root(0)).size() == 3002);
+
+    SECTION("Nodes") {
+        env.limits.maxNodes = 1000;
+        REQUIRE_THROWS_AS(eval(env, *all, *model->root(0)), EvalLimitError);
+        REQUIRE_THROWS_AS(eval(env, *total, *model->root(0)), EvalLimitError);
+        try {
+            eval(env, *children, *model->root(0));
+            FAIL("expected EvalLimitError");
+        } catch (const EvalLimitError& e) {
+            REQUIRE(e.reason == EvalLimitError::Nodes);
+        }
+
+        env.limits.maxNodes = 10000;
+        REQUIRE(eval(env, *all, *model->root(0)).size() == 3002);
+    }
+
+    SECTION("Bytecode and packs") {
+        auto bytecode = compile(env, "count(numbers.* > 10)", false, Backend::Bytecode);
+        std::vector<ExprPtr> exprs;
+        exprs.push_back(compile(env, "count(numbers.*)", false));
+        exprs.push_back(compile(env, "sum(numbers.*)", false));
+        QueryPack pack(std::move(exprs));
+        REQUIRE(pack.sharedPaths() == 1);
+
+        env.limits.maxNodes = 1000;
+        REQUIRE_THROWS_AS(eval(env, *bytecode, *model->root(0)), EvalLimitError);
+        REQUIRE_THROWS_AS(eval(env, pack, *model->root(0)), EvalLimitError);
+
+        env.limits.maxNodes = 0;
+        env.limits.cancel = std::make_shared<CancellationToken>();
+        env.limits.cancel->cancel();
+        REQUIRE_THROWS_AS(eval(env, *bytecode, *model->root(0)), EvalLimitError);
+
+        env.limits.cancel->reset();
+        REQUIRE(eval(env, *bytecode, *model->root(0))[0].as<ValueType::Int>() == 2989);
+        REQUIRE(eval(env, pack, *model->root(0))[1][0].as<ValueType::Int>() == 4498500);
+    }
+
+    SECTION("Results") {
+        env.limits.maxResults = 10;
+        REQUIRE_THROWS_AS(eval(env, *children, *model->root(0)), EvalLimitError);
+        REQUIRE(eval(env, *total, *model->root(0)).size() == 1);
+
+        /* Results beyond the limit of the options are not counted */
+        REQUIRE(evalCount(env, *children, *model->root(0), {.limit = 10}) == 10);
+    }
+
+    SECTION("Cancellation") {
+        env.limits.cancel = std::make_shared<CancellationToken>();
+        REQUIRE(eval(env, *all, *model->root(0)).size() == 3002);
+
+        env.limits.cancel->cancel();
+        REQUIRE_THROWS_AS(eval(env, *children, *model->root(0)), EvalLimitError);
+        REQUIRE_THROWS_AS(eval(env, *children, *model, 2), EvalLimitError);
+
+        env.limits.cancel->reset();
+        REQUIRE(eval(env, *children, *model->root(0)).size() == 3000);
+    }
+}
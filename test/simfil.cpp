@@ -1,8 +1,17 @@
 #include "simfil/simfil.h"
 #include "simfil/exception-handler.h"
 #include "simfil/model/json.h"
+#include "simfil/model/simd.h"
+#include "simfil/scratch.h"
+#if defined(SIMFIL_PROFILER)
+#include "simfil/profiler.h"
+#endif
 
 #include <catch2/catch_test_macros.hpp>
+#include <fmt/format.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
 
 using namespace simfil;
 
@@ -146,6 +155,15 @@ TEST_CASE("OperatorAndOr", "[ast.operator-and-or]") {
     REQUIRE_AST("1 and null", "null");
     REQUIRE_AST("1 and 2",    "2");
     REQUIRE_AST("a and b",    "(and a b)");
+
+    /* Constant left side */
+    REQUIRE_AST("true and a",  "a");
+    REQUIRE_AST("1 and a.b",   "(. a b)");
+    REQUIRE_AST("false and a", "false");
+    REQUIRE_AST("false or a",  "a");
+    REQUIRE_AST("null or a",   "a");
+    REQUIRE_AST("true or a",   "true");
+    REQUIRE_AST("a and true",  "(and a true)"); /* Not foldable */
 }
 
 TEST_CASE("ModeSetter", "[ast.mode-setter]") {
@@ -155,6 +173,16 @@ TEST_CASE("ModeSetter", "[ast.mode-setter]") {
     REQUIRE_AST("each(a.b)",   "(each (. a b))");
     REQUIRE_AST("count(true)", "1");
     REQUIRE_AST("count(a.b)",  "(count (. a b))");
+
+    /* Redundant nesting */
+    REQUIRE_AST("any(any(a.b))",  "(any (. a b))");
+    REQUIRE_AST("any(each(a.b))", "(each (. a b))");
+    REQUIRE_AST("each(any(a.b))", "(any (. a b))");
+    REQUIRE_AST("any(count(a))",  "(any (count a))");
+
+    Environment env(Environment::WithNewStringCache);
+    REQUIRE(compile(env, "each(a.b)", true)->toString() == "(each (. a b))");
+    REQUIRE(compile(env, "a.b", true)->toString() == "(any (. a b))");
 }
 
 TEST_CASE("UtilityFns", "[ast.functions]") {
@@ -272,6 +300,46 @@ TEST_CASE("Array Access", "[yaml.array-access]") {
     REQUIRE_RESULT("c.* != 'a'",             "false|true|true");
 }
 
+TEST_CASE("String Literal Comparison", "[yaml.string-compare]") {
+    REQUIRE_RESULT("sub.a == 'sub a'", "true");
+    REQUIRE_RESULT("'sub a' == sub.a", "true");
+    REQUIRE_RESULT("sub.a != 'sub a'", "false");
+    REQUIRE_RESULT("c.* < 'b'",  "true|false|false");
+    REQUIRE_RESULT("c.* <= 'b'", "true|true|false");
+    REQUIRE_RESULT("c.* > 'b'",  "false|false|true");
+    REQUIRE_RESULT("'b' >= c.*", "true|true|false");
+    REQUIRE_RESULT("count(c.*.{_ == 'b'})", "1");
+
+    /* Other operand types use the generic dispatch */
+    REQUIRE_THROWS(joined_result("a == 'a'"));
+    REQUIRE_RESULT("nonexisting == 'a'", "false");
+    REQUIRE_RESULT("sub.a + 'x' == 'sub ax'", "true");
+    REQUIRE_THROWS(joined_result("a < 'a'"));
+
+    REQUIRE_AST("a == 'x'", "(== a \"x\")");
+}
+
+TEST_CASE("Number Literal Comparison", "[yaml.number-compare]") {
+    REQUIRE_RESULT("a == 1", "true");
+    REQUIRE_RESULT("1 < b", "true");
+    REQUIRE_RESULT("b >= 2.5", "false");
+    REQUIRE_RESULT("1.5 > a", "true");
+    REQUIRE_RESULT("a != 1.0", "false");
+    REQUIRE_RESULT("arr(a, b, 1.5) <= 1.5", "true|false|true");
+
+    /* Compared values which are both numbers skip the generic dispatch */
+    REQUIRE_RESULT("a < b", "true");
+    REQUIRE_RESULT("a + 0.5 == b - 0.5", "true");
+
+    /* Other operand types use the generic dispatch */
+    REQUIRE_RESULT("nonexisting == 1", "false");
+    REQUIRE_RESULT("nonexisting < b", "false");
+    REQUIRE_THROWS(joined_result("sub.a < 1"));
+    REQUIRE_THROWS(joined_result("sub.a < a"));
+
+    REQUIRE_AST("a < 1", "(< a 1)");
+}
+
 TEST_CASE("Single Values", "[yaml.single-values]") {
 
     auto json = R"({"a":1,"b":2,"c":["a","b","c"],"d":[0,1,2],"geoLineString":{"geometry":{"coordinates":[[1,2],[3,4]],"type":"LineString"}},"geoPoint":{"geometry":{"coordinates":[1,2],"type":"Point"}},"geoPolygon":{"geometry":{"coordinates":[[[1,2],[3,4],[5,6]]],"type":"Polygon"}},"sub":{"a":"sub a","b":"sub b","sub":{"a":"sub sub a","b":"sub sub b"}}})";
@@ -287,6 +355,15 @@ TEST_CASE("Single Values", "[yaml.single-values]") {
     REQUIRE_RESULT("sub.a", "sub a");
     REQUIRE_RESULT("sub.sub", sub_sub_json);
     REQUIRE_RESULT("sub.sub.a", "sub sub a");
+
+    /* Fused field paths */
+    REQUIRE_RESULT("sub.sub.c", "null");
+    REQUIRE_RESULT("sub.x.a", "null");
+    REQUIRE_RESULT("a.b", "null");
+    REQUIRE_RESULT("geoPoint.geometry.type", "Point");
+    REQUIRE_RESULT("geoPoint.geometry.coordinates.*", "1|2");
+    REQUIRE_RESULT("sub.sub._.a", "sub sub a");
+    REQUIRE_RESULT("nonexisting.a.b", "null");
 }
 
 TEST_CASE("Model Functions", "[yaml.mode-functions]") {
@@ -320,6 +397,25 @@ TEST_CASE("Model Functions", "[yaml.mode-functions]") {
         REQUIRE_RESULT("sum(range(1, 10)..., $sum + $val)", "55");
         REQUIRE_RESULT("sum(range(1, 10)..., $sum + $val, 10)", "65");
         REQUIRE_RESULT("sum(range(1, 10)..., $sum * $val, 1)", "3628800");
+        REQUIRE_RESULT("sum(range(1, 3)..., $sum + $idx * $val)", "8");
+        REQUIRE_RESULT("sum(range(1, 3)..., $idx)", "2");
+        /* The overlay outlives the reused storage */
+        REQUIRE_RESULT("sum(sub, _).a", "sub a");
+        /* Owning the overlay inside the loop copies it */
+        REQUIRE_RESULT("sum(sub, trace(_)).a", "sub a");
+        REQUIRE_RESULT("sum(sub, top(_, 1, $val.a)).a", "sub a");
+        REQUIRE_RESULT("sum(sub, sum(_, _)).a", "sub a");
+    }
+    SECTION("Test top(... )") {
+        REQUIRE_RESULT("top(range(1, 10)..., 3)", "10|9|8");
+        REQUIRE_RESULT("top(arr(2, 7, 1.5, 7.5), 2)", "7.5|7");
+        REQUIRE_RESULT("top(c.*, 2)", "c|b");
+        REQUIRE_RESULT("top(d.*, 2, 0 - _)", "0|1");
+        /* Values with keys which are not numbers or strings are ignored */
+        REQUIRE_RESULT("top(arr(null, 1, true), 5)", "1");
+        /* Equal keys keep their order */
+        REQUIRE_RESULT("top(arr(1, 2, 3), 2, 0)", "1|2");
+        REQUIRE_THROWS(joined_result("top(arr(1, 'a'), 2)"));
     }
     SECTION("Count non-false values generated by arr(...)") {
         REQUIRE_RESULT("count(arr(null, null))", "0");
@@ -359,6 +455,72 @@ TEST_CASE("Value Expansion", "[yaml.value-expansion]") {
     }
 }
 
+TEST_CASE("Streaming Evaluation", "[yaml.streaming]") {
+    auto model = simfil::json::parse(doc);
+    Environment env(model->strings());
+    auto ast = compile(env, "c.*", false);
+
+    auto collect = [&](const EvalOptions& options) {
+        std::string vals;
+        auto n = eval(env, *ast, *model->root(0), LambdaResultFn([&](Context, Value vv) {
+            if (!vals.empty())
+                vals.push_back('|');
+            vals += vv.toString();
+            return Result::Continue;
+        }), options);
+        REQUIRE(n == std::count(vals.begin(), vals.end(), '|') + (vals.empty() ? 0 : 1));
+        return vals;
+    };
+
+    SECTION("Offset and limit") {
+        REQUIRE(collect({}) == "a|b|c");
+        REQUIRE(collect({.offset = 1}) == "b|c");
+        REQUIRE(collect({.limit = 2}) == "a|b");
+        REQUIRE(collect({.offset = 1, .limit = 1}) == "b");
+        REQUIRE(collect({.offset = 5}) == "");
+        REQUIRE(collect({.limit = 0}) == "");
+    }
+
+    SECTION("Stop from callback") {
+        auto calls = 0;
+        eval(env, *ast, *model->root(0), LambdaResultFn([&](Context, Value) {
+            ++calls;
+            return Result::Stop;
+        }));
+        REQUIRE(calls == 1);
+    }
+
+    SECTION("Count only") {
+        REQUIRE(evalCount(env, *ast, *model->root(0)) == 3);
+        REQUIRE(evalCount(env, *compile(env, "**", false), *model->root(0), {.limit = 4}) == 4);
+    }
+}
+
+TEST_CASE("Result Model Ownership", "[yaml.model-ownership]") {
+    SECTION("Borrowed values do not own their model") {
+        auto model = simfil::json::parse(doc);
+        auto value = Value::borrowed(*model->root(0));
+        REQUIRE(model.use_count() == 1);
+        REQUIRE(value.node->size() > 0);
+        value.own();
+        REQUIRE(model.use_count() == 2);
+    }
+
+    SECTION("Results keep their model alive") {
+        std::vector<Value> result;
+        {
+            auto model = simfil::json::parse(doc);
+            Environment env(model->strings());
+            result = eval(env, *compile(env, "sub.sub", false), *model->root(0));
+            auto strings = eval(env, *compile(env, "sub.a", false), *model->root(0));
+            result.insert(result.end(), strings.begin(), strings.end());
+        }
+        REQUIRE(result.size() == 2);
+        REQUIRE(result[0].node->size() == 2);
+        REQUIRE(result[1].toString() == "sub a");
+    }
+}
+
 TEST_CASE("Model Pool Validation", "[model.validation]") {
     auto pool = std::make_shared<ModelPool>();
 
@@ -465,6 +627,273 @@ TEST_CASE("Object/Array Extend", "[model.extend]") {
     }
 }
 
+TEST_CASE("Object Field Index", "[model.field-index]")
+{
+    auto pool = std::make_shared<ModelPool>();
+    auto obj = pool->newObject();
+    for (auto i = 0; i < 64; ++i)
+        obj->addField(fmt::format("field{}", 63 - i), (int64_t)i);
+    obj->addField("field7", "duplicate");
+
+    auto requireFields = [&](model_ptr<Object> const& o) {
+        for (auto i = 0; i < 64; ++i) {
+            auto id = pool->strings()->get(fmt::format("field{}", 63 - i));
+            REQUIRE(Value(o->get(id)->value()).as<ValueType::Int>() == i);
+        }
+        REQUIRE(!o->get(pool->strings()->emplace("missing")));
+    };
+
+    requireFields(obj);
+    pool->buildFieldIndex();
+    requireFields(obj);
+
+    REQUIRE(obj->keyAt(0) == pool->strings()->get("field63"));
+    REQUIRE(obj->keyAt(64) == pool->strings()->get("field7"));
+    REQUIRE(Value(obj->at(64)->value()).toString() == "duplicate");
+    auto numKeys = 0;
+    for (auto&& key : obj->fieldNames())
+        numKeys += key ? 1 : 0;
+    REQUIRE(numKeys == 65);
+
+    SECTION("Narrow indexed objects are scanned, wide ones searched") {
+        auto narrow = pool->newObject();
+        for (auto i = 0; i < 20; ++i)
+            narrow->addField(fmt::format("field{}", 19 - i), (int64_t)i);
+        narrow->addField("field3", "duplicate");
+        pool->buildFieldIndex();
+
+        REQUIRE(Value(narrow->get(pool->strings()->get("field3"))->value()).as<ValueType::Int>() == 16);
+        REQUIRE(Value(obj->get(pool->strings()->get("field7"))->value()).as<ValueType::Int>() == 56);
+        REQUIRE(!narrow->get(pool->strings()->get("field63")));
+
+        auto addr = pool->fieldOf(obj->addr(), pool->strings()->get("field0"));
+        REQUIRE(addr.value_ == obj->get(pool->strings()->get("field0"))->addr().value_);
+        REQUIRE(!pool->fieldOf(obj->addr(), pool->strings()->get("missing")));
+    }
+
+    SECTION("Objects extended after indexing fall back to scanning") {
+        obj->addField("late", (int64_t)-1);
+        requireFields(obj);
+        REQUIRE(Value(obj->get("late")->value()).as<ValueType::Int>() == -1);
+    }
+
+    SECTION("Index is rebuilt after deserialization") {
+        pool->addRoot(obj);
+        std::stringstream stream;
+        pool->write(stream);
+
+        auto recovered = std::make_shared<ModelPool>(pool->strings());
+        recovered->read(stream);
+        requireFields(recovered->resolveObject(recovered->root(0)));
+    }
+}
+
+TEST_CASE("Native Node Access", "[model.native]")
+{
+    auto pool = std::make_shared<ModelPool>();
+    auto obj = pool->newObject();
+    auto arr = pool->newArray();
+    arr->append(true).append((int16_t)-3).append((int64_t)1 << 40).append(1.5).append("str");
+    obj->addField("arr", arr);
+    obj->addField("small", (uint16_t)7);
+    pool->addRoot(obj);
+
+    auto root = pool->root(0);
+    REQUIRE(ModelPool::native(*root) == pool.get());
+    REQUIRE(pool->sizeOf(root->addr()) == 2);
+    REQUIRE(pool->typeOf(root->addr()) == ValueType::Object);
+    REQUIRE(!pool->fieldOf(root->addr(), pool->strings()->emplace("missing")));
+
+    auto arrAddr = pool->fieldOf(root->addr(), pool->strings()->get("arr"));
+    REQUIRE(arrAddr.value_ == arr->addr().value_);
+    REQUIRE(pool->sizeOf(arrAddr) == 5);
+
+    /* Same types and values as the resolved nodes */
+    auto i = 0;
+    REQUIRE(pool->forEachMember(arrAddr, [&](ModelNodeAddress member) {
+        auto node = arr->at(i++);
+        REQUIRE(member.value_ == node->addr().value_);
+        REQUIRE(pool->typeOf(member) == node->type());
+        REQUIRE(pool->valueOf(member) == node->value());
+        return true;
+    }));
+    REQUIRE(i == 5);
+    REQUIRE(!pool->forEachMember(arrAddr, [](auto&&) { return false; }));
+
+    /* Derived pools may override resolve() */
+    struct DerivedPool : public ModelPool {};
+    auto derived = std::make_shared<DerivedPool>();
+    derived->addRoot(derived->newObject());
+    REQUIRE(ModelPool::native(*derived->root(0)) == nullptr);
+}
+
+TEST_CASE("Column Types", "[model.column-types]")
+{
+    struct CountingPool : public ModelPool
+    {
+        mutable int resolved = 0;
+
+        CountingPool() { setColumnType(FirstCustomColumnId, ValueType::Object); }
+
+        void resolve(ModelNode const& n, ResolveFn const& cb) const override
+        {
+            ++resolved;
+            if (n.addr().column() >= FirstCustomColumnId)
+                return;
+            ModelPool::resolve(n, cb);
+        }
+    };
+
+    constexpr uint8_t custom = ModelPool::FirstCustomColumnId;
+    constexpr uint8_t unregistered = ModelPool::FirstCustomColumnId + 1;
+
+    auto pool = std::make_shared<CountingPool>();
+    REQUIRE(pool->columnType(ModelPool::Objects) == ValueType::Object);
+    REQUIRE(pool->columnType(ModelPool::Int64) == ValueType::Int);
+    REQUIRE(pool->columnType(ModelPool::Scalar) == ValueType::Undef);
+    REQUIRE(Model().columnType(ModelPool::Objects) == ValueType::Undef);
+
+    auto obj = pool->newObject();
+    obj->addField("name", "value");
+    auto name = obj->get(pool->strings()->get("name"));
+
+    /* Containers are classified without resolving them, scalars resolve their value */
+    pool->resolved = 0;
+    REQUIRE(Value::field(ModelNode::Ptr(obj)).type == ValueType::Object);
+    REQUIRE(pool->resolved == 0);
+    auto field = Value::field(name);
+    REQUIRE(field.type == ValueType::String);
+    REQUIRE(field.toString() == "value");
+    REQUIRE(pool->resolved == 1);
+
+    auto customNode = ModelNode::Ptr::make(pool, ModelNodeAddress{custom, 0});
+    REQUIRE(Value::field(customNode).type == ValueType::Object);
+    REQUIRE(pool->resolved == 1);
+
+    /* Unregistered columns are resolved */
+    auto unregisteredNode = ModelNode::Ptr::make(pool, ModelNodeAddress{unregistered, 0});
+    REQUIRE(Value::field(unregisteredNode).type == ValueType::Null);
+    REQUIRE(pool->resolved > 1);
+}
+
+TEST_CASE("StringId Scan", "[model.simd]")
+{
+    INFO("Kernel: " << simd::findStringIdKernel());
+
+    std::vector<StringId> ids;
+    for (auto n = 0; n < 70; ++n) {
+        for (auto i = 0; i < n; ++i)
+            REQUIRE(simd::findStringId(ids, ids[i]) == i);
+        REQUIRE(simd::findStringId(ids, 0xffff) == n);
+        ids.push_back(static_cast<StringId>(1000 + n));
+    }
+
+    std::vector<StringId> dups = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 9};
+    REQUIRE(simd::findStringId(dups, 9) == 8);
+
+    /* Lanes which only differ in their most significant byte */
+    constexpr auto msb = static_cast<StringId>(StringPool::MaxId & ~(StringPool::MaxId >> 8));
+    std::vector<StringId> upper(40, StringPool::MaxId);
+    upper.back() = StringPool::MaxId ^ msb;
+    REQUIRE(simd::findStringId(upper, upper.back()) == 39);
+}
+
+TEST_CASE("Concurrent String Pool Access", "[model.string-pool]")
+{
+    StringPool strings;
+    constexpr auto numThreads = 8;
+    constexpr auto numStrings = 2000;
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<StringId>> ids(numThreads);
+    std::vector<std::vector<StringId>> lookups(numThreads);
+    for (auto t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (auto i = 0; i < numStrings; ++i) {
+                ids[t].push_back(strings.emplace(fmt::format("key{}", i)));
+                lookups[t].push_back(strings.get(fmt::format("KEY{}", i)));
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    /* Lookups are case-insensitive */
+    for (auto t = 0; t < numThreads; ++t)
+        REQUIRE(lookups[t] == ids[t]);
+
+    REQUIRE(strings.size() == numStrings + StringPool::NextStaticId);
+    for (auto t = 1; t < numThreads; ++t)
+        REQUIRE(ids[t] == ids[0]);
+    for (auto i = 0; i < numStrings; ++i)
+        REQUIRE(strings.resolve(ids[0][i]) == fmt::format("key{}", i));
+    REQUIRE(strings.misses() == numStrings);
+
+    StringPool copy(strings);
+    REQUIRE(copy == strings);
+    REQUIRE(copy.resolve(ids[0][42]) == "key42");
+    REQUIRE(!copy.resolve(strings.highest() + 1));
+}
+
+TEST_CASE("String Pool Case Folding", "[model.string-pool]")
+{
+    StringPool strings;
+
+    /* Strings of every length around the eight byte words which are folded at once */
+    std::vector<StringId> ids;
+    for (auto n = 1; n < 20; ++n)
+        ids.push_back(strings.emplace(std::string(n, 'x') + "Key"));
+    for (auto n = 1; n < 20; ++n) {
+        REQUIRE(strings.get(std::string(n, 'X') + "kEY") == ids[n - 1]);
+        REQUIRE(strings.get(std::string(n, 'x') + "Ke") == StringPool::Empty);
+    }
+
+    /* Only ASCII letters are folded */
+    auto at = strings.emplace("@[`{");
+    REQUIRE(strings.get("`{@[") == StringPool::Empty);
+    REQUIRE(strings.get("@[`{") == at);
+    auto umlaut = strings.emplace("Stra\xc3\x9f\xc3\xa9");
+    REQUIRE(strings.get("STRA\xc3\x9f\xc3\xa9") == umlaut);
+    REQUIRE(strings.get("Stra\xc3\x9f\xc3\x89") == StringPool::Empty);
+
+    /* Strings larger than a storage block */
+    std::string large(100000, 'a');
+    auto largeId = strings.emplace(large);
+    REQUIRE(strings.resolve(largeId) == large);
+    REQUIRE(strings.resolve(ids[0]) == "xKey");
+    REQUIRE(strings.bytes() > large.size());
+}
+
+TEST_CASE("Key Cache", "[model.key-cache]")
+{
+    auto pool = std::make_shared<ModelPool>();
+    KeyCache keys(pool->strings());
+
+    auto name = keys.emplace("name");
+    REQUIRE(name == pool->strings()->get("name"));
+    REQUIRE(keys.emplace("name") == name);
+    REQUIRE(keys.emplace("NAME") == name);
+    REQUIRE(keys.size() == 2);
+
+    /* Repeated keys do not reach the pool */
+    auto hits = pool->strings()->hits();
+    for (auto i = 0; i < 100; ++i)
+        (void)keys.emplace("name");
+    REQUIRE(pool->strings()->hits() == hits);
+
+    auto obj = pool->newObject();
+    obj->addField(name, "Demo");
+    obj->addField(keys.emplace("count"), (int64_t)3);
+    obj->addBool(keys.emplace("valid"), true);
+    obj->addField(keys.emplace("child"), pool->newArray(0));
+    pool->addRoot(obj);
+
+    REQUIRE_NOTHROW(pool->validate());
+    REQUIRE(obj->get("name")->value() == ScalarValueType(std::string_view("Demo")));
+    REQUIRE(obj->get("count")->value() == ScalarValueType((int64_t)3));
+    REQUIRE(obj->size() == 4);
+}
+
 TEST_CASE("Switch Model String Pool", "[model.setStrings]")
 {
     auto pool = std::make_shared<ModelPool>();
@@ -484,6 +913,143 @@ TEST_CASE("Switch Model String Pool", "[model.setStrings]")
     REQUIRE(oldFieldDict->size() != newFieldDict->size());
 }
 
+TEST_CASE("Late Field Name Resolution", "[model.field-symbols]")
+{
+    auto pool = std::make_shared<ModelPool>();
+    Environment env(pool->strings());
+
+    /* Field names are not known to the pool at compile time */
+    auto field = compile(env, "late", false);
+    auto path = compile(env, "late.inner", false);
+
+    auto root = pool->newObject();
+    pool->addRoot(root);
+    REQUIRE(eval(env, *field, *pool->root(0))[0].toString() == "null");
+
+    auto generation = pool->strings()->generation();
+    auto inner = pool->newObject();
+    inner->addField("inner", (int64_t)42);
+    root->addField("late", inner);
+    REQUIRE(pool->strings()->generation() > generation);
+
+    REQUIRE(eval(env, *field, *pool->root(0))[0].isa(ValueType::Object));
+    REQUIRE(eval(env, *path, *pool->root(0))[0].toString() == "42");
+
+    /* Known strings do not change the generation */
+    generation = pool->strings()->generation();
+    pool->strings()->emplace("late");
+    REQUIRE(pool->strings()->generation() == generation);
+}
+
+TEST_CASE("Late Field Name Resolution Threaded", "[model.field-symbols]")
+{
+    auto pool = std::make_shared<ModelPool>();
+    Environment env(pool->strings());
+
+    std::vector<ExprPtr> exprs;
+    for (auto i = 0; i < 200; ++i)
+        exprs.push_back(compile(env, "late", false));
+
+    auto root = pool->newObject();
+    root->addField("late", (int64_t)42);
+    pool->addRoot(root);
+
+    /* All threads resolve the late name of the same expressions at once */
+    std::atomic<int> misses = 0;
+    std::vector<std::thread> threads;
+    for (auto t = 0; t < 4; ++t)
+        threads.emplace_back([&]() {
+            for (const auto& expr : exprs)
+                if (eval(env, *expr, *pool->root(0))[0].toString() != "42")
+                    ++misses;
+        });
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(misses == 0);
+}
+
+TEST_CASE("Scratch Memory", "[eval.scratch]")
+{
+    auto& scratch = Scratch::local();
+    {
+        Scratch::Scope outer;
+        std::pmr::vector<int64_t> values(outer.resource());
+        values.resize(1000);
+        REQUIRE(scratch.retained() >= 1000 * sizeof(int64_t));
+
+        Scratch::Scope inner;
+        REQUIRE(inner.resource() == outer.resource());
+    }
+
+    /* Blocks are kept for the next evaluation of the thread */
+    REQUIRE(scratch.retained() > 0);
+
+    Scratch* other = nullptr;
+    std::thread([&]() { other = &Scratch::local(); }).join();
+    REQUIRE(other != &scratch);
+
+    /* Evaluations use the pool of their thread */
+    auto model = std::make_shared<ModelPool>();
+    Environment env(model->strings());
+    model->addRoot(model->newObject());
+    std::pmr::memory_resource* used = nullptr;
+    eval(env, *compile(env, "true", false), *model->root(0), LambdaResultFn([&](Context ctx, Value) {
+        used = ctx.scratch;
+        return Result::Continue;
+    }));
+    REQUIRE(used == Scratch::Scope().resource());
+
+    /* Parts of model strings are copies, as results may outlive the model */
+    auto object = model->newObject();
+    object->addField("path", "a.b.c");
+    model->addRoot(object);
+    auto parts = eval(env, *compile(env, "split(path, '.')", false), *model->root(1));
+    model.reset();
+    REQUIRE(parts.size() == 3);
+    REQUIRE(parts[1].stringViewValue() == nullptr);
+    REQUIRE(parts[1].as<ValueType::String>() == "b");
+}
+
+#if defined(SIMFIL_PROFILER)
+TEST_CASE("Profiler", "[eval.profiler]")
+{
+    auto model = std::make_shared<ModelPool>();
+    auto sub = model->newObject();
+    sub->addField("b", "x");
+    auto root = model->newObject();
+    root->addField("a", sub);
+    model->addRoot(root);
+
+    Environment env(model->strings());
+    auto expr = compile(env, "a.b", false);
+
+    Profiler profiler(env);
+    env.profiler = &profiler;
+    for (auto i = 0; i < 3; ++i)
+        eval(env, *expr, *model->root(0), LambdaResultFn([](Context, Value) {
+            return Result::Continue;
+        }));
+    env.profiler = nullptr;
+
+    auto report = profiler.report();
+    REQUIRE(report.exprs.size() == 3);
+    auto find = [&](std::string_view text) {
+        auto iter = std::find_if(report.exprs.begin(), report.exprs.end(), [&](auto&& e) { return e.text == text; });
+        REQUIRE(iter != report.exprs.end());
+        return *iter;
+    };
+    REQUIRE(find("(. a b)").calls == 3);
+    REQUIRE(find("(. a b)").results == 3);
+    REQUIRE(find("a").calls == 3);
+    REQUIRE(find("a").nodeResults == 3);
+    REQUIRE(find("b").calls == 3);
+    REQUIRE(report.toJson().find("{\"expr\":\"a\",\"calls\":3,\"results\":3,\"nodeResults\":3,") != std::string::npos);
+
+    profiler.reset();
+    REQUIRE(profiler.report().exprs.empty());
+}
+#endif
+
 TEST_CASE("Exception Handler", "[exception]")
 {
     bool handlerCalled = false;